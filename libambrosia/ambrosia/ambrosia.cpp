@@ -362,17 +362,18 @@ namespace AMBROSIA {
                     atomCount++;
                     getSelection(ALL).add(atom);
                 }
-                else if (node->type() == Utopia::Node::getNode("chain"))
-                {
-    //                      qDebug() << "FOUND ATOM";
-                    Utopia::Node * chain = node;
-                    Renderable * chain_renderable = chainRenderableManager->create(chain);
-                    chain_renderable->setDisplay(false);
-                    getSelection(CHAINS).add(chain);
-                }
             }
         }
 
+        // Build chains
+        Utopia::HasType isChain(Utopia::Node::getNode("chain"));
+        foreach (Utopia::Node * chain, Utopia::select(minions, &isChain))
+        {
+            Renderable * chain_renderable = chainRenderableManager->create(chain);
+            chain_renderable->setDisplay(false);
+            getSelection(CHAINS).add(chain);
+        }
+
 /*        Utopia::Node::descendant_iterator node_iter = complex->descendantsBegin();
           Utopia::Node::descendant_iterator node_end = complex->descendantsEnd();
           for (; node_iter != node_end; ++node_iter) {
@@ -38,6 +38,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
 #include <math.h>
 #include <ctype.h>
 #ifdef WIN32
@@ -66,6 +67,8 @@ extern bool unicodeTypeAlphaNum(Unicode c);
 
 #include <vector>
 #include <algorithm>
+#include <map>
+#include <string>
 
 using namespace std;
 using namespace Spine;
@@ -215,6 +218,7 @@ public:
 
 CrackleTextFontInfo::CrackleTextFontInfo(GfxState *state) {
     gfxFont = state->getFont();
+    pdfFont = gfxFont ? new Crackle::PDFFont(gfxFont) : (Crackle::PDFFont *)NULL;
 #if TEXTOUT_WORD_LIST
     fontName = (gfxFont && gfxFont->getName()) ? gfxFont->getName()->copy()
         : (GString *)NULL;
@@ -222,7 +226,20 @@ CrackleTextFontInfo::CrackleTextFontInfo(GfxState *state) {
 #endif
 }
 
+CrackleTextFontInfo::CrackleTextFontInfo(GString *fontNameA, int flagsA,
+                                         Crackle::PDFFont *pdfFontA) {
+    gfxFont = NULL;
+    pdfFont = pdfFontA;
+#if TEXTOUT_WORD_LIST
+    fontName = fontNameA;
+    flags = flagsA;
+#else
+    delete fontNameA;
+#endif
+}
+
 CrackleTextFontInfo::~CrackleTextFontInfo() {
+    delete pdfFont;
 #if TEXTOUT_WORD_LIST
     if (fontName) {
         delete fontName;
@@ -356,6 +373,27 @@ CrackleTextWord::CrackleTextWord(GfxState *state, int rotA, double x0, double y0
     link = NULL;
 }
 
+CrackleTextWord::CrackleTextWord(int rotA, CrackleTextFontInfo *fontA,
+                                 double fontSizeA) {
+    rot = rotA;
+    font = fontA;
+    fontSize = fontSizeA;
+    xMin = yMin = 0;
+    xMax = yMax = 0;
+    base = 0;
+    text = NULL;
+    edge = NULL;
+    charPos = NULL;
+    len = size = 0;
+    spaceAfter = false;
+    next = NULL;
+#if TEXTOUT_WORD_LIST
+    colorR = colorG = colorB = 0;
+#endif
+    underlined = false;
+    link = NULL;
+}
+
 CrackleTextWord::~CrackleTextWord() {
     gfree(text);
     gfree(edge);
@@ -1905,6 +1943,7 @@ CrackleTextPage::CrackleTextPage(bool rawOrderA) {
     int rot;
 
     rawOrder = rawOrderA;
+    imageCount = -1;
     curWord = NULL;
     charPos = 0;
     curFont = NULL;
@@ -2055,7 +2094,7 @@ void CrackleTextPage::updateFont(GfxState *state) {
             // Store new font info for crackle use here since
             // embedded pdf documents will be partially freed
             // by the end of the page
-            Crackle::PDFFont font(state->getFont());
+            Crackle::PDFFont font(*curFont->getPDFFont());
             string nm=font.name();
             if(!nm.empty()) {
                 _font_collection.insert(std::make_pair(nm, font));
@@ -4353,6 +4392,529 @@ CrackleTextWordList *CrackleTextPage::makeWordList(bool physLayout) {
 }
 #endif
 
+//------------------------------------------------------------------------
+// CrackleTextLayoutWriter / CrackleTextLayoutReader
+//------------------------------------------------------------------------
+
+// Serialised pages are only ever read back on the machine that wrote
+// them, so values are stored in native byte order and layout.
+static const char layoutMagic[4] = { 'C', 'R', 'K', 'L' };
+
+// Bump this whenever the serialised form changes.
+static const int layoutVersion = 2;
+
+class CrackleTextLayoutWriter {
+public:
+
+    CrackleTextLayoutWriter(std::string &bufferA): buffer(bufferA) {}
+
+    template< class T > void put(T value)
+        { buffer.append((const char *)&value, sizeof(T)); }
+    template< class T > void putArray(const T *values, int n)
+        { if (n > 0) { buffer.append((const char *)values, n * sizeof(T)); } }
+    void putBool(bool value) { put<unsigned char>(value ? 1 : 0); }
+    void putString(const std::string &str);
+    void putGString(GString *str);
+
+private:
+
+    std::string &buffer;
+};
+
+void CrackleTextLayoutWriter::putString(const std::string &str) {
+    put<int>((int)str.size());
+    buffer.append(str);
+}
+
+void CrackleTextLayoutWriter::putGString(GString *str) {
+    int i;
+
+    if (!str) {
+        put<int>(-1);
+        return;
+    }
+    put<int>(str->getLength());
+    for (i = 0; i < str->getLength(); ++i) {
+        buffer += (char)str->getChar(i);
+    }
+}
+
+class CrackleTextLayoutReader {
+public:
+
+    CrackleTextLayoutReader(const char *dataA, size_t lengthA)
+        : data(dataA), end(dataA + lengthA), ok(true) {}
+
+    template< class T > bool get(T *value)
+        { return getInto(value, 1); }
+    template< class T > bool getInto(T *values, int n);
+    // Returns a gmalloc'd array of <n> values, or NULL if <n> is zero
+    // or the data is exhausted.
+    template< class T > T *getArray(int n);
+    bool getBool(bool *value);
+    bool getCount(int *n);
+    bool getString(std::string *str);
+    // Returns NULL both for a serialised NULL and on failure.
+    GString *getGString();
+
+    void fail() { ok = false; }
+    bool isOk() { return ok; }
+    bool atEnd() { return data == end; }
+
+private:
+
+    bool check(int n, size_t sizeA);
+
+    const char *data;
+    const char *end;
+    bool ok;
+};
+
+bool CrackleTextLayoutReader::check(int n, size_t sizeA) {
+    if (!ok || n < 0 || (size_t)n > (size_t)(end - data) / sizeA) {
+        ok = false;
+    }
+    return ok;
+}
+
+template< class T > bool CrackleTextLayoutReader::getInto(T *values, int n) {
+    if (!check(n, sizeof(T))) {
+        return false;
+    }
+    if (n > 0) {
+        memcpy(values, data, n * sizeof(T));
+        data += n * sizeof(T);
+    }
+    return true;
+}
+
+template< class T > T *CrackleTextLayoutReader::getArray(int n) {
+    T *values;
+
+    if (!check(n, sizeof(T)) || n == 0) {
+        return NULL;
+    }
+    values = (T *)gmallocn(n, sizeof(T));
+    getInto(values, n);
+    return values;
+}
+
+bool CrackleTextLayoutReader::getBool(bool *value) {
+    unsigned char c;
+
+    if (!get(&c)) {
+        return false;
+    }
+    *value = (c != 0);
+    return true;
+}
+
+bool CrackleTextLayoutReader::getCount(int *n) {
+    if (get(n) && *n < 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+bool CrackleTextLayoutReader::getString(std::string *str) {
+    int n;
+
+    if (!getCount(&n) || !check(n, 1)) {
+        return false;
+    }
+    str->assign(data, n);
+    data += n;
+    return true;
+}
+
+GString *CrackleTextLayoutReader::getGString() {
+    GString *str;
+    int n;
+
+    if (!get(&n) || n < 0 || !check(n, 1)) {
+        return NULL;
+    }
+    str = new GString(data, n);
+    data += n;
+    return str;
+}
+
+//------------------------------------------------------------------------
+// CrackleTextPage serialisation
+//------------------------------------------------------------------------
+
+void CrackleTextPage::writeFont(CrackleTextLayoutWriter *out,
+                                const Crackle::PDFFont &font) {
+    Crackle::PDFFont::FontSizes::const_iterator size;
+
+    out->putString(font._name);
+    out->putString(font._tag);
+    out->putBool(font._isFixedWidth);
+    out->putBool(font._isSerif);
+    out->putBool(font._isSymbolic);
+    out->putBool(font._isItalic);
+    out->putBool(font._isBold);
+    out->put<int>((int)font._sizes.size());
+    for (size = font._sizes.begin(); size != font._sizes.end(); ++size) {
+        out->put<double>(size->first);
+        out->put<int>(size->second);
+    }
+}
+
+bool CrackleTextPage::readFont(CrackleTextLayoutReader *in,
+                               Crackle::PDFFont *font) {
+    double fontSize;
+    int nSizes, count, i;
+
+    in->getString(&font->_name);
+    in->getString(&font->_tag);
+    in->getBool(&font->_isFixedWidth);
+    in->getBool(&font->_isSerif);
+    in->getBool(&font->_isSymbolic);
+    in->getBool(&font->_isItalic);
+    in->getBool(&font->_isBold);
+    if (in->getCount(&nSizes)) {
+        for (i = 0; i < nSizes && in->get(&fontSize) && in->get(&count); ++i) {
+            font->_sizes[fontSize] = count;
+        }
+    }
+    return in->isOk();
+}
+
+void CrackleTextPage::serialize(std::string &buffer) {
+    CrackleTextLayoutWriter out(buffer);
+    std::map<CrackleTextFontInfo *, int> fontIdx;
+    std::map<CrackleTextBlock *, int> blockIdx;
+    Crackle::PDFFontCollection::const_iterator entry;
+    CrackleTextFontInfo *fontInfo;
+    CrackleTextFlow *flow;
+    CrackleTextBlock *blk;
+    CrackleTextLine *line;
+    CrackleTextWord *word;
+    std::map<CrackleTextFontInfo *, int>::iterator fi;
+    std::map<CrackleTextBlock *, int>::iterator bi;
+    int n, i;
+
+    out.putArray(layoutMagic, 4);
+    out.put<int>(layoutVersion);
+    out.put<double>(pageWidth);
+    out.put<double>(pageHeight);
+    out.put<int>(primaryRot);
+    out.putBool(primaryLR);
+    out.put<int>(imageCount);
+
+    // fonts
+    out.put<int>(fonts->getLength());
+    for (i = 0; i < fonts->getLength(); ++i) {
+        fontInfo = (CrackleTextFontInfo *)fonts->get(i);
+        fontIdx[fontInfo] = i;
+#if TEXTOUT_WORD_LIST
+        out.putGString(fontInfo->fontName);
+        out.put<int>(fontInfo->flags);
+#else
+        out.putGString(NULL);
+        out.put<int>(0);
+#endif
+        out.putBool(fontInfo->pdfFont != NULL);
+        if (fontInfo->pdfFont) {
+            writeFont(&out, *fontInfo->pdfFont);
+        }
+    }
+    out.put<int>((int)_font_collection.size());
+    for (entry = _font_collection.begin(); entry != _font_collection.end(); ++entry) {
+        out.putString(entry->first);
+        writeFont(&out, entry->second);
+    }
+
+    // flows, in reading order
+    for (n = 0, flow = flows; flow; flow = flow->next) {
+        ++n;
+    }
+    out.put<int>(n);
+    n = 0;
+    for (flow = flows; flow; flow = flow->next) {
+        out.put<double>(flow->xMin);
+        out.put<double>(flow->xMax);
+        out.put<double>(flow->yMin);
+        out.put<double>(flow->yMax);
+        out.put<double>(flow->priMin);
+        out.put<double>(flow->priMax);
+        for (i = 0, blk = flow->blocks; blk; blk = blk->next) {
+            ++i;
+        }
+        out.put<int>(i);
+        for (blk = flow->blocks; blk; blk = blk->next) {
+            blockIdx[blk] = n++;
+            out.put<int>(blk->rot);
+            out.put<double>(blk->xMin);
+            out.put<double>(blk->xMax);
+            out.put<double>(blk->yMin);
+            out.put<double>(blk->yMax);
+            out.put<double>(blk->priMin);
+            out.put<double>(blk->priMax);
+            out.put<int>(blk->nLines);
+            out.put<int>(blk->charCount);
+            out.put<int>(blk->col);
+            out.put<int>(blk->nColumns);
+            for (i = 0, line = blk->lines; line; line = line->next) {
+                ++i;
+            }
+            out.put<int>(i);
+            for (line = blk->lines; line; line = line->next) {
+                out.put<int>(line->rot);
+                out.put<double>(line->base);
+                out.put<double>(line->xMin);
+                out.put<double>(line->xMax);
+                out.put<double>(line->yMin);
+                out.put<double>(line->yMax);
+                out.put<int>(line->len);
+                out.putArray(line->text, line->len);
+                out.putBool(line->edge != NULL);
+                if (line->edge) {
+                    out.putArray(line->edge, line->len + 1);
+                }
+                out.putBool(line->col != NULL);
+                if (line->col) {
+                    out.putArray(line->col, line->len + 1);
+                }
+                out.put<int>(line->convertedLen);
+                out.putBool(line->hyphenated);
+                for (i = 0, word = line->words; word; word = word->next) {
+                    ++i;
+                }
+                out.put<int>(i);
+                for (word = line->words; word; word = word->next) {
+                    fi = fontIdx.find(word->font);
+                    out.put<int>(word->rot);
+                    out.put<int>(fi == fontIdx.end() ? -1 : fi->second);
+                    out.put<double>(word->fontSize);
+                    out.put<double>(word->base);
+                    out.put<double>(word->xMin);
+                    out.put<double>(word->xMax);
+                    out.put<double>(word->yMin);
+                    out.put<double>(word->yMax);
+                    out.put<int>(word->len);
+                    out.putArray(word->text, word->len);
+                    out.putArray(word->edge, word->len + 1);
+                    out.putArray(word->charPos, word->len + 1);
+                    out.putBool(word->spaceAfter);
+#if TEXTOUT_WORD_LIST
+                    out.put<double>(word->colorR);
+                    out.put<double>(word->colorG);
+                    out.put<double>(word->colorB);
+#else
+                    out.put<double>(0);
+                    out.put<double>(0);
+                    out.put<double>(0);
+#endif
+                    out.putBool(word->underlined);
+                }
+            }
+        }
+    }
+
+    // the same blocks, in yx order
+    out.put<int>(nBlocks);
+    for (i = 0; i < nBlocks; ++i) {
+        bi = blockIdx.find(blocks[i]);
+        out.put<int>(bi == blockIdx.end() ? -1 : bi->second);
+    }
+}
+
+CrackleTextPage *CrackleTextPage::deserialize(const char *data, size_t length) {
+    CrackleTextLayoutReader in(data, length);
+    CrackleTextPage *page;
+    std::vector<CrackleTextFontInfo *> fontList;
+    std::vector<CrackleTextBlock *> blockList;
+    CrackleTextFontInfo *fontInfo;
+    Crackle::PDFFont *pdfFont;
+    CrackleTextFlow *flow, *lastFlow;
+    CrackleTextBlock *blk;
+    CrackleTextLine *line;
+    CrackleTextWord *word;
+    GString *fontName;
+    std::string key;
+    char magic[4];
+    double flowBox[6], fontSize, base;
+    bool hasFont, hasArray;
+    int version, nFonts, nFlows, nBlks, nLines, nWords, flags;
+    int rot, fontIdx, blockIdx;
+    int i, j, k, l;
+
+    if (!in.getInto(magic, 4) || memcmp(magic, layoutMagic, 4) != 0 ||
+        !in.get(&version) || version != layoutVersion) {
+        return NULL;
+    }
+
+    page = new CrackleTextPage(false);
+    in.get(&page->pageWidth);
+    in.get(&page->pageHeight);
+    in.get(&page->primaryRot);
+    in.getBool(&page->primaryLR);
+    in.get(&page->imageCount);
+
+    // fonts
+    in.getCount(&nFonts);
+    for (i = 0; in.isOk() && i < nFonts; ++i) {
+        fontName = in.getGString();
+        in.get(&flags);
+        pdfFont = NULL;
+        if (in.getBool(&hasFont) && hasFont) {
+            pdfFont = new Crackle::PDFFont();
+            readFont(&in, pdfFont);
+        }
+        fontInfo = new CrackleTextFontInfo(fontName, flags, pdfFont);
+#if POPPLER_CHECK_VERSION(0, 70, 0)
+        page->fonts->push_back(fontInfo);
+#else
+        page->fonts->append(fontInfo);
+#endif
+        fontList.push_back(fontInfo);
+    }
+    in.getCount(&nFonts);
+    for (i = 0; in.isOk() && i < nFonts; ++i) {
+        Crackle::PDFFont font;
+        if (in.getString(&key) && readFont(&in, &font)) {
+            page->_font_collection.insert(std::make_pair(key, font));
+        }
+    }
+
+    // flows
+    lastFlow = NULL;
+    in.getCount(&nFlows);
+    for (i = 0; in.isOk() && i < nFlows; ++i) {
+        in.getInto(flowBox, 6);
+        if (!in.getCount(&nBlks) || nBlks == 0) {
+            in.fail();
+            break;
+        }
+        flow = NULL;
+        for (j = 0; in.isOk() && j < nBlks; ++j) {
+            if (!in.get(&rot)) {
+                break;
+            }
+            blk = new CrackleTextBlock(page, rot);
+            blockList.push_back(blk);
+            if (flow) {
+                flow->lastBlk->next = blk;
+                flow->lastBlk = blk;
+            } else {
+                flow = new CrackleTextFlow(page, blk);
+                if (lastFlow) {
+                    lastFlow->next = flow;
+                } else {
+                    page->flows = flow;
+                }
+                lastFlow = flow;
+            }
+            in.get(&blk->xMin);
+            in.get(&blk->xMax);
+            in.get(&blk->yMin);
+            in.get(&blk->yMax);
+            in.get(&blk->priMin);
+            in.get(&blk->priMax);
+            in.get(&blk->nLines);
+            in.get(&blk->charCount);
+            in.get(&blk->col);
+            in.get(&blk->nColumns);
+
+            in.getCount(&nLines);
+            for (k = 0; in.isOk() && k < nLines; ++k) {
+                if (!in.get(&rot) || !in.get(&base)) {
+                    break;
+                }
+                line = new CrackleTextLine(blk, rot, base);
+                if (blk->curLine) {
+                    blk->curLine->next = line;
+                } else {
+                    blk->lines = line;
+                }
+                blk->curLine = line;
+                in.get(&line->xMin);
+                in.get(&line->xMax);
+                in.get(&line->yMin);
+                in.get(&line->yMax);
+                in.getCount(&line->len);
+                line->text = in.getArray<Unicode>(line->len);
+                if (in.getBool(&hasArray) && hasArray) {
+                    line->edge = in.getArray<double>(line->len + 1);
+                }
+                if (in.getBool(&hasArray) && hasArray) {
+                    line->col = in.getArray<int>(line->len + 1);
+                }
+                in.get(&line->convertedLen);
+                in.getBool(&line->hyphenated);
+
+                in.getCount(&nWords);
+                for (l = 0; in.isOk() && l < nWords; ++l) {
+                    if (!in.get(&rot) || !in.get(&fontIdx) || !in.get(&fontSize)) {
+                        break;
+                    }
+                    if (fontIdx < -1 || fontIdx >= (int)fontList.size()) {
+                        in.fail();
+                        break;
+                    }
+                    word = new CrackleTextWord(rot, fontIdx < 0 ? NULL : fontList[fontIdx],
+                                               fontSize);
+                    if (line->lastWord) {
+                        line->lastWord->next = word;
+                    } else {
+                        line->words = word;
+                    }
+                    line->lastWord = word;
+                    in.get(&word->base);
+                    in.get(&word->xMin);
+                    in.get(&word->xMax);
+                    in.get(&word->yMin);
+                    in.get(&word->yMax);
+                    in.getCount(&word->len);
+                    word->size = word->len;
+                    word->text = in.getArray<Unicode>(word->len);
+                    word->edge = in.getArray<double>(word->len + 1);
+                    word->charPos = in.getArray<int>(word->len + 1);
+                    in.getBool(&word->spaceAfter);
+#if TEXTOUT_WORD_LIST
+                    in.get(&word->colorR);
+                    in.get(&word->colorG);
+                    in.get(&word->colorB);
+#else
+                    in.getInto(flowBox, 3);
+#endif
+                    in.getBool(&word->underlined);
+                }
+            }
+        }
+        if (flow) {
+            flow->xMin = flowBox[0];
+            flow->xMax = flowBox[1];
+            flow->yMin = flowBox[2];
+            flow->yMax = flowBox[3];
+            flow->priMin = flowBox[4];
+            flow->priMax = flowBox[5];
+        }
+    }
+
+    // blocks in yx order
+    if (in.getCount(&page->nBlocks)) {
+        page->blocks = (CrackleTextBlock **)gmallocn(page->nBlocks, sizeof(CrackleTextBlock *));
+        for (i = 0; i < page->nBlocks; ++i) {
+            page->blocks[i] = NULL;
+            if (in.get(&blockIdx) && blockIdx >= 0 && blockIdx < (int)blockList.size()) {
+                page->blocks[i] = blockList[blockIdx];
+            } else {
+                in.fail();
+                break;
+            }
+        }
+    }
+
+    if (!in.isOk() || !in.atEnd()) {
+        delete page;
+        return NULL;
+    }
+    return page;
+}
+
 //------------------------------------------------------------------------
 // CrackleTextOutputDev
 //------------------------------------------------------------------------
@@ -4363,7 +4925,8 @@ static void outputToFile(void *stream, const char *text, int len) {
 
 CrackleTextOutputDev::CrackleTextOutputDev(char *fileName, bool physLayoutA,
                                            double fixedPitchA, bool rawOrderA, bool append)
-    : _images(boost::shared_ptr<ImageCollection> (new ImageCollection))
+    : _images(boost::shared_ptr<ImageCollection> (new ImageCollection)),
+      _extractImages(true), _extractText(true), _xref(0)
 {
     text = NULL;
     physLayout = physLayoutA;
@@ -4399,7 +4962,8 @@ CrackleTextOutputDev::CrackleTextOutputDev(char *fileName, bool physLayoutA,
 
 CrackleTextOutputDev::CrackleTextOutputDev(TextOutputFunc func, void *stream,
                                            bool physLayoutA, double fixedPitchA, bool rawOrderA)
-    : _images(boost::shared_ptr<ImageCollection> (new ImageCollection))
+    : _images(boost::shared_ptr<ImageCollection> (new ImageCollection)),
+      _extractImages(true), _extractText(true), _xref(0)
 {
     outputFunc = func;
     outputStream = stream;
@@ -4431,6 +4995,9 @@ void CrackleTextOutputDev::startPage(int pageNum, GfxState *state) {
 
 void CrackleTextOutputDev::endPage() {
     text->endPage();
+    if (!_extractText) {
+        return;
+    }
     text->coalesce(physLayout, fixedPitch, doHTML);
     if (outputStream) {
         text->dump(outputStream, outputFunc, physLayout);
@@ -4438,11 +5005,15 @@ void CrackleTextOutputDev::endPage() {
 }
 
 void CrackleTextOutputDev::restoreState(GfxState *state) {
-    text->updateFont(state);
+    if (_extractText) {
+        text->updateFont(state);
+    }
 }
 
 void CrackleTextOutputDev::updateFont(GfxState *state) {
-    text->updateFont(state);
+    if (_extractText) {
+        text->updateFont(state);
+    }
 }
 
 void CrackleTextOutputDev::beginString(GfxState *state, GString *s) {
@@ -4451,19 +5022,145 @@ void CrackleTextOutputDev::beginString(GfxState *state, GString *s) {
 void CrackleTextOutputDev::endString(GfxState *state) {
 }
 
+namespace {
+
+    boost::shared_ptr<char> newImageBuffer(size_t size_)
+    {
+        return boost::shared_ptr<char>(new char[size_], boost::checked_array_deleter<char>());
+    }
+
+    // copy a 1 bit per pixel stream
+    boost::shared_ptr<char> readBitmap(Stream *str, int width, int height, size_t & size)
+    {
+        str->reset();
+
+        size = height * ((width + 7) / 8);
+        boost::shared_ptr<char> data(newImageBuffer(size));
+        for (size_t i = 0; i < size; ++i) {
+            data.get()[i]=str->getChar();
+        }
+
+        str->close();
+        return data;
+    }
+
+    // copy the raw (undecoded) data of a DCT stream
+    boost::shared_ptr<char> readJPEG(Stream *str, size_t & size)
+    {
+        int c;
+        vector<char> buffer;
+
+#ifdef UTOPIA_SPINE_BACKEND_POPPLER
+        str = str->getNextStream();
+#else
+        str = ((DCTStream *)str)->getRawStream();
+#endif
+        str->reset();
+
+        while ( (c= str->getChar()) != EOF ) {
+            buffer.push_back(static_cast<char>(c));
+        }
+        str->close();
+
+        size=buffer.size();
+        boost::shared_ptr<char> data(newImageBuffer(size));
+        copy(buffer.begin(), buffer.end(), data.get());
+        return data;
+    }
+
+    // decode a stream of samples to packed RGB
+    boost::shared_ptr<char> readRGB(Stream *str, int width, int height,
+                                    GfxImageColorMap *colorMap, size_t & size)
+    {
+        size=(height * width * 3);
+        boost::shared_ptr<char> data(newImageBuffer(size));
+        char *p_data(data.get());
+
+        // initialize stream
+        ImageStream *imgStr = new ImageStream(str, width, colorMap->getNumPixelComps(),
+                                              colorMap->getBits());
+        imgStr->reset();
+
+        GfxRGB rgb;
+        size_t i(0);
+
+        // for each line...
+        for (size_t y = 0; y < static_cast<size_t>(height); ++y) {
+
+            // write the line
+            unsigned char *p = imgStr->getLine();
+            for (size_t x = 0; x < static_cast<size_t>(width); ++x) {
+                colorMap->getRGB(p, &rgb);
+                p_data[i++]=colToByte(rgb.r);
+                p_data[i++]=colToByte(rgb.g);
+                p_data[i++]=colToByte(rgb.b);
+                p += colorMap->getNumPixelComps();
+            }
+        }
+
+        delete imgStr;
+        return data;
+    }
+
+    // Decodes an image XObject when its data is first asked for. The
+    // stream is fetched afresh from the xref while the page is being
+    // interpreted, and from then on only reads the document's (immutable)
+    // buffer, so it may be decoded later on any thread.
+    class DeferredImageSource : public Spine::Image::Source
+    {
+    public:
+        DeferredImageSource(Image::ImageType type_, Object & obj_,
+                            int width_, int height_, GfxImageColorMap *colorMap_,
+                            boost::shared_array<char> buffer_)
+            : _type(type_), _obj(std::move(obj_)), _width(width_), _height(height_),
+              _colorMap(colorMap_ ? colorMap_->copy() : 0), _buffer(buffer_)
+        {}
+
+        ~DeferredImageSource()
+        {
+            delete _colorMap;
+        }
+
+        boost::shared_ptr<char> load(size_t & size_)
+        {
+            Stream *str(_obj.getStream());
+            switch (_type) {
+            case Image::Bitmap:
+                return readBitmap(str, _width, _height, size_);
+            case Image::JPEG:
+                return readJPEG(str, size_);
+            default:
+                return readRGB(str, _width, _height, _colorMap, size_);
+            }
+        }
+
+    private:
+        Image::ImageType _type;
+        Object _obj;
+        int _width;
+        int _height;
+        GfxImageColorMap *_colorMap;
+        boost::shared_array<char> _buffer;
+    };
+
+}
+
 void CrackleTextOutputDev::drawImage(GfxState *state, Object *ref, Stream *str,
                                      int width, int height, GfxImageColorMap *colorMap,
                                      int *maskColors, bool inlineImg, bool interpolate)
 {
-    int c;
     size_t size;
     Image::ImageType type;
-    char * data;
+    boost::shared_ptr<char> data;
     const double *ctm;
     double mat[6];
     bool rot;
     double xScale, yScale;
 
+    if (!_extractImages) {
+        return;
+    }
+
     ctm=state->getCTM();
     mat[0] = ctm[0];
     mat[1] = ctm[1];
@@ -4493,97 +5190,66 @@ void CrackleTextOutputDev::drawImage(GfxState *state, Object *ref, Stream *str,
 
 
     if (colorMap->getNumPixelComps() == 1 && colorMap->getBits() == 1) {
-
         type=Image::Bitmap;
-
-        str->reset();
-
-        // copy the stream
-        size = height * ((width + 7) / 8);
-        data=new char[size];
-        for (size_t i = 0; i < size; ++i) {
-            data[i]=str->getChar();
-        }
-
-        str->close();
-
     } else if (str->getKind() == strDCT && colorMap->getNumPixelComps() == 3
 	       && !inlineImg) {
-
         type=Image::JPEG;
-
-        vector<char> buffer;
-
-#ifdef UTOPIA_SPINE_BACKEND_POPPLER
-	str = str->getNextStream();
-#else
-        str = ((DCTStream *)str)->getRawStream();
-#endif
-        str->reset();
-
-        while ( (c= str->getChar()) != EOF ) {
-            buffer.push_back(static_cast<char>(c));
-        }
-        str->close();
-
-        size=buffer.size();
-        data=new char[size];
-        copy(buffer.begin(), buffer.end(), data);
-        buffer.clear();
-
     } else {
-
         type=Image::RGB;
+    }
 
-        size=(height * width * 3);
-        data=new char[size];
-
-        // initialize stream
-        ImageStream *imgStr = new ImageStream(str, width, colorMap->getNumPixelComps(),
-                                              colorMap->getBits());
-        imgStr->reset();
-
-        GfxRGB rgb;
-        size_t i(0);
-
-        // for each line...
-        for (size_t y = 0; y < static_cast<size_t>(height); ++y) {
-
-            // write the line
-            unsigned char *p = imgStr->getLine();
-            for (size_t x = 0; x < static_cast<size_t>(width); ++x) {
-                colorMap->getRGB(p, &rgb);
-                data[i++]=colToByte(rgb.r);
-                data[i++]=colToByte(rgb.g);
-                data[i++]=colToByte(rgb.b);
-                p += colorMap->getNumPixelComps();
-            }
+    // Image XObjects can be decoded later if needed; inline images are
+    // part of the content stream and so must be read now
+    if (!inlineImg && ref && ref->isRef() && _xref) {
+        Object obj(ref->fetch(_xref));
+        if (obj.isStream()) {
+            boost::shared_ptr<Spine::Image::Source> source(
+                new DeferredImageSource(type, obj, width, height, colorMap, _buffer));
+            this->_images->push_back( Image(type, width, height, bbox, source) );
+            return;
         }
+    }
 
-        delete imgStr;
+    switch (type) {
+    case Image::Bitmap:
+        data=readBitmap(str, width, height, size);
+        break;
+    case Image::JPEG:
+        data=readJPEG(str, size);
+        break;
+    default:
+        data=readRGB(str, width, height, colorMap, size);
+        break;
     }
 
     this->_images->push_back( Image(type, width, height, bbox, data, size) );
-    delete [] data;
 }
 
 void CrackleTextOutputDev::drawChar(GfxState *state, double x, double y,
                                     double dx, double dy,
                                     double originX, double originY,
                                     CharCode c, int nBytes, Unicode *u, int uLen) {
-    text->addChar(state, x, y, dx, dy, c, nBytes, u, uLen);
+    if (_extractText) {
+        text->addChar(state, x, y, dx, dy, c, nBytes, u, uLen);
+    }
 }
 
 void CrackleTextOutputDev::incCharCount(int nChars) {
-    text->incCharCount(nChars);
+    if (_extractText) {
+        text->incCharCount(nChars);
+    }
 }
 
 void CrackleTextOutputDev::beginActualText(GfxState *state, Unicode *u, int uLen) {
-    text->beginActualText(state, u, uLen);
+    if (_extractText) {
+        text->beginActualText(state, u, uLen);
+    }
 }
 
 void CrackleTextOutputDev::endActualText(GfxState *state) {
-    text->endActualText(state);
+    if (_extractText) {
+        text->endActualText(state);
+    }
 }
 
 
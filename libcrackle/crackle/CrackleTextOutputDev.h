@@ -61,14 +61,17 @@
 #include <spine/BoundingBox.h>
 #include <spine/Image.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/shared_array.hpp>
 #include <stdio.h>
 
 #include <map>
+#include <string>
 #include <vector>
 #include <crackle/PDFFont.h>
 #include <crackle/PDFFontCollection.h>
 
 class Stream;
+class XRef;
 class GString;
 class GList;
 class GfxFont;
@@ -84,6 +87,8 @@ class CrackleTextBlock;
 class CrackleTextFlow;
 class CrackleTextWordList;
 class CrackleTextPage;
+class CrackleTextLayoutWriter;
+class CrackleTextLayoutReader;
 
 namespace Crackle
 {
@@ -119,9 +124,19 @@ public:
 #endif
 
     GfxFont *getFont() { return gfxFont; }
+
+    // Get the crackle description of the font, taken when the font was
+    // first seen (NULL if the text was drawn without a current font).
+    const Crackle::PDFFont *getPDFFont() { return pdfFont; }
 private:
 
+    // Restore font information from a serialised page, in which case
+    // there is no GfxFont.
+    CrackleTextFontInfo(GString *fontNameA, int flagsA,
+                        Crackle::PDFFont *pdfFontA);
+
     GfxFont *gfxFont;
+    Crackle::PDFFont *pdfFont;
 #if TEXTOUT_WORD_LIST
     GString *fontName;
     int flags;
@@ -210,6 +225,9 @@ public:
     CrackleTextWord* nextWord () { return next; };
 private:
 
+    // Restore an empty word from a serialised page.
+    CrackleTextWord(int rotA, CrackleTextFontInfo *fontA, double fontSizeA);
+
     int rot;                      // rotation, multiple of 90 degrees
     //   (0, 1, 2, or 3)
     double xMin, xMax;            // bounding box x coordinates
@@ -584,12 +602,28 @@ public:
     CrackleTextWordList *makeWordList(bool physLayout);
 #endif
 
+    // The number of images found on the page, or -1 if they weren't
+    // collected. Carried through serialisation so that a page restored
+    // from it knows whether there are any images to extract.
+    int getImageCount() { return imageCount; }
+    void setImageCount(int imageCountA) { imageCount = imageCountA; }
+
     GList * getFontList() { return this->fonts; };
     const Crackle::PDFFontCollection &getFontCollection() { return this->_font_collection; }
 
+    // Append a compact binary form of the coalesced page (flows, blocks,
+    // lines, words and fonts) to <buffer>.
+    void serialize(std::string &buffer);
+
+    // Rebuild a page from the output of serialize(), returning NULL if
+    // <data> is not a valid serialisation.
+    static CrackleTextPage *deserialize(const char *data, size_t length);
+
 private:
 
     void clear();
+    static void writeFont(CrackleTextLayoutWriter *out, const Crackle::PDFFont &font);
+    static bool readFont(CrackleTextLayoutReader *in, Crackle::PDFFont *font);
     void assignColumns(CrackleTextLineFrag *frags, int nFrags, bool rot);
     int dumpFragment(Unicode *text, int len, UnicodeMap *uMap, GString *s);
 
@@ -622,6 +656,7 @@ private:
     int primaryRot;               // primary rotation
     bool primaryLR;              // primary direction (true means L-to-R,
     //   false means R-to-L)
+    int imageCount;               // number of images, or -1 if unknown
     CrackleTextWord *rawWords;            // list of words, in raw order (only if
     //   rawOrder is set)
     CrackleTextWord *rawLastWord; // last word on rawWords list
@@ -780,6 +815,21 @@ public:
         return _images;
     }
 
+    // Turn image collection on or off (for text only extraction).
+    void setExtractImages(bool extractImages_) { _extractImages = extractImages_; }
+
+    // Turn text collection on or off (for image only extraction, when
+    // the page's text is known already).
+    void setExtractText(bool extractText_) { _extractText = extractText_; }
+
+    // Allow the decoding of image XObjects to be deferred until their
+    // data is asked for. <buffer_> is the document's data, kept alive
+    // for as long as any deferred image needs it.
+    void setDocument(XRef *xref_, boost::shared_array<char> buffer_) {
+        _xref = xref_;
+        _buffer = buffer_;
+    }
+
 
     virtual void drawImage(GfxState *state, Object *ref, Stream *str,
                            int width, int height, GfxImageColorMap *colorMap,
@@ -811,6 +861,10 @@ private:
 
     // store extracted images
     boost::shared_ptr<Crackle::ImageCollection> _images;
+    bool _extractImages;
+    bool _extractText;
+    XRef *_xref;
+    boost::shared_array<char> _buffer;
 
 };
 
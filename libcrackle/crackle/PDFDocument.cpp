@@ -29,6 +29,7 @@
 
 #include <crackle/PDFDocument.h>
 #include <crackle/PDFPage.h>
+#include <crackle/PDFRenderContext.h>
 #include <crackle/PDFTextRegionCollection.h>
 #include <crackle/PDFTextBlockCollection.h>
 #include <crackle/PDFTextLineCollection.h>
@@ -56,6 +57,7 @@
 #include "glib/poppler-features.h"
 
 #include <cwctype>
+#include <deque>
 #include <algorithm>
 #include <locale>
 #include <cstdlib>
@@ -66,6 +68,10 @@
 #include <sstream>
 
 #include <string>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <utf8/unicode.h>
 #include <pcrecpp.h>
 
@@ -135,15 +141,264 @@ namespace {
         return res;
     }
 
+    PDFDocument::Concurrency getConcurrencyFromEnvironment()
+    {
+        PDFDocument::Concurrency concurrency(PDFDocument::GlobalConcurrency);
+        const char *env=getenv("CRACKLE_CONCURRENCY");
+        if (env) {
+            if (strcmp(env, "document")==0) {
+                concurrency=PDFDocument::DocumentConcurrency;
+            } else if (strcmp(env, "page")==0) {
+                concurrency=PDFDocument::PageConcurrency;
+            }
+        }
+        return concurrency;
+    }
+
+    // Keeps a file mapping alive for as long as any buffer refers to it
+    class MappedRegionDeleter
+    {
+    public:
+        MappedRegionDeleter(boost::shared_ptr<boost::interprocess::mapped_region> region_)
+            : _region(region_)
+        {}
+
+        void operator () (char *)
+        {
+            _region.reset();
+        }
+
+    private:
+        boost::shared_ptr<boost::interprocess::mapped_region> _region;
+    };
+
+    struct PrefetchQueue
+    {
+        boost::mutex mutex;
+        size_t next;
+        size_t last;
+        size_t done;
+        size_t total;
+        PDFDocument::PrefetchProgress progress;
+        void * userdef;
+
+        // helpers yet to finish with the queue
+        size_t helpers;
+        boost::condition_variable finished;
+    };
+
+    // Long-lived threads shared by every document's page prefetches, so
+    // that a prefetch doesn't pay for starting and joining threads
+    class PrefetchPool
+    {
+    public:
+        static PrefetchPool & instance()
+        {
+            static boost::once_flag once=BOOST_ONCE_INIT;
+            boost::call_once(&PrefetchPool::create, once);
+            return *_instance;
+        }
+
+        size_t size() const
+        {
+            return _size;
+        }
+
+        void post(const boost::function< void () > & task_)
+        {
+            {
+                boost::lock_guard<boost::mutex> g(_mutex);
+                _tasks.push_back(task_);
+            }
+            _available.notify_one();
+        }
+
+        ~PrefetchPool()
+        {
+            {
+                boost::lock_guard<boost::mutex> g(_mutex);
+                _stopping=true;
+            }
+            _available.notify_all();
+            _threads.join_all();
+        }
+
+    private:
+        PrefetchPool()
+            : _size(std::max(boost::thread::hardware_concurrency(), 1u)), _stopping(false)
+        {
+            for (size_t i=0; i<_size; ++i) {
+                _threads.create_thread(boost::bind(&PrefetchPool::run, this));
+            }
+        }
+
+        static void create()
+        {
+            static PrefetchPool pool;
+            _instance=&pool;
+        }
+
+        void run()
+        {
+            for (;;) {
+                boost::function< void () > task;
+                {
+                    boost::unique_lock<boost::mutex> g(_mutex);
+                    while (_tasks.empty() && !_stopping) {
+                        _available.wait(g);
+                    }
+                    if (_tasks.empty()) {
+                        return;
+                    }
+                    task=_tasks.front();
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+        static PrefetchPool * _instance;
+
+        size_t _size;
+        bool _stopping;
+        std::deque< boost::function< void () > > _tasks;
+        boost::mutex _mutex;
+        boost::condition_variable _available;
+        boost::thread_group _threads;
+    };
+
+    PrefetchPool * PrefetchPool::_instance=0;
+
+    void prefetchWorker(PDFDocument * doc_, PrefetchQueue * queue_)
+    {
+        for (;;) {
+            size_t page;
+            {
+                boost::lock_guard<boost::mutex> g(queue_->mutex);
+                if (queue_->next >= queue_->last) {
+                    break;
+                }
+                page=queue_->next++;
+            }
+
+            // pages that have already been extracted return immediately
+            (*doc_)[page].regions();
+
+            boost::lock_guard<boost::mutex> g(queue_->mutex);
+            ++queue_->done;
+            if (queue_->progress) {
+                queue_->progress(queue_->userdef, queue_->done, queue_->total);
+            }
+        }
+    }
+
+    void prefetchHelper(PDFDocument * doc_, PrefetchQueue * queue_)
+    {
+        prefetchWorker(doc_, queue_);
+
+        boost::lock_guard<boost::mutex> g(queue_->mutex);
+        if (--queue_->helpers == 0) {
+            queue_->finished.notify_all();
+        }
+    }
+
 }
 
 /****************************************************************************/
 
 boost::mutex Crackle::PDFDocument::_globalMutexDocument;
+boost::mutex Crackle::PDFDocument::_globalMutexConcurrency;
+Crackle::PDFDocument::Concurrency Crackle::PDFDocument::_defaultConcurrency(getConcurrencyFromEnvironment());
+size_t Crackle::PDFDocument::_defaultMaxContexts(0);
+
+/****************************************************************************/
+
+void Crackle::PDFDocument::setConcurrency(Concurrency concurrency_, size_t maxContexts_)
+{
+    boost::lock_guard<boost::mutex> g(_globalMutexConcurrency);
+    _defaultConcurrency=concurrency_;
+    _defaultMaxContexts=maxContexts_;
+}
+
+/****************************************************************************/
+
+Crackle::PDFDocument::Concurrency Crackle::PDFDocument::concurrency()
+{
+    boost::lock_guard<boost::mutex> g(_globalMutexConcurrency);
+    return _defaultConcurrency;
+}
+
+/****************************************************************************/
+
+Crackle::PDFDocument::RenderLock::RenderLock(PDFDocument * doc_)
+    : _doc(doc_), _context(doc_->_acquireContext())
+{}
+
+/****************************************************************************/
+
+Crackle::PDFDocument::RenderLock::~RenderLock()
+{
+    _doc->_releaseContext(_context);
+}
+
+/****************************************************************************/
+
+boost::shared_ptr<PDFRenderContext> Crackle::PDFDocument::_acquireContext()
+{
+    switch (_concurrency) {
+    case GlobalConcurrency:
+        _globalMutexDocument.lock();
+        return _context;
+    case DocumentConcurrency:
+        _mutexDocument.lock();
+        return _context;
+    default:
+        break;
+    }
+
+    boost::unique_lock<boost::mutex> g(_mutexContexts);
+    while (_idleContexts.empty() && _contextCount >= _maxContexts) {
+        _contextAvailable.wait(g);
+    }
+
+    boost::shared_ptr<PDFRenderContext> context;
+    if (!_idleContexts.empty()) {
+        context=_idleContexts.back();
+        _idleContexts.pop_back();
+    } else {
+        // opening a context parses the xref, so do it outside the lock
+        ++_contextCount;
+        g.unlock();
+        context=boost::shared_ptr<PDFRenderContext>(new PDFRenderContext(_data, _datalen));
+    }
+    return context;
+}
+
+/****************************************************************************/
+
+void Crackle::PDFDocument::_releaseContext(boost::shared_ptr<PDFRenderContext> context_)
+{
+    switch (_concurrency) {
+    case GlobalConcurrency:
+        _globalMutexDocument.unlock();
+        return;
+    case DocumentConcurrency:
+        _mutexDocument.unlock();
+        return;
+    default:
+        break;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> g(_mutexContexts);
+        _idleContexts.push_back(context_);
+    }
+    _contextAvailable.notify_one();
+}
 
 
 Crackle::PDFDocument::PDFDocument()
-    : Spine::Document(), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0)
+    : Spine::Document(), _concurrency(GlobalConcurrency), _maxContexts(1), _contextCount(0), _prefetched(false), _extractImages(true), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0)
 
 {
     //std::cerr << "+++ DOC " << this << std::endl;
@@ -153,7 +408,7 @@ Crackle::PDFDocument::PDFDocument()
 /****************************************************************************/
 
 Crackle::PDFDocument::PDFDocument(const char *filename_)
-    : Spine::Document(), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0)
+    : Spine::Document(), _concurrency(GlobalConcurrency), _maxContexts(1), _contextCount(0), _prefetched(false), _extractImages(true), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0)
 {
     //std::cerr << "+++ DOC " << this << std::endl;
     _initialise();
@@ -163,7 +418,7 @@ Crackle::PDFDocument::PDFDocument(const char *filename_)
 /****************************************************************************/
 
 Crackle::PDFDocument::PDFDocument(boost::shared_array<char> buffer_, std::size_t length_)
-    : Spine::Document(), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0)
+    : Spine::Document(), _concurrency(GlobalConcurrency), _maxContexts(1), _contextCount(0), _prefetched(false), _extractImages(true), _crackle_errorcode(errNone), _fonts_counted(false), _datalen(0), _generated_anchors(0)
 {
     //std::cerr << "+++ DOC " << this << std::endl;
     _initialise();
@@ -174,7 +429,7 @@ Crackle::PDFDocument::PDFDocument(boost::shared_array<char> buffer_, std::size_t
 
 Crackle::PDFDocument::~PDFDocument()
 {
-    //std::cerr << "--- DOC " << this << " " << _textDevice.use_count() << std::endl;
+    //std::cerr << "--- DOC " << this << std::endl;
     this->close();
 }
 
@@ -190,14 +445,25 @@ void Crackle::PDFDocument::close() {
         delete i->second;
     }
 
-    _textDevice.reset();
-    _renderDevice.reset();
-    _printDevice.reset();
+    {
+        boost::lock_guard<boost::mutex> g(_mutexContexts);
+        _idleContexts.clear();
+        _contextCount=0;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> g(_mutexPrefetch);
+        _prefetched=false;
+    }
 
     _doc.reset();
     _dict.reset();
+    _context.reset();
     _data.reset();
     _datalen=0;
+
+    boost::lock_guard<boost::mutex> h(_mutexFilehash);
+    _filehash.clear();
 }
 
 /****************************************************************************/
@@ -272,6 +538,21 @@ Crackle::PDFDocument::errorString()
 
 void Crackle::PDFDocument::readFile(const char * filename_) // MUST be utf-8
 {
+    // Map the file rather than reading it, so that its pages are only
+    // brought into memory as xpdf asks for them
+    try {
+        using namespace boost::interprocess;
+
+        file_mapping file(filename_, read_only);
+        boost::shared_ptr<mapped_region> region(new mapped_region(file, read_only));
+        shared_array<char> data(static_cast<char *>(region->get_address()),
+                                MappedRegionDeleter(region));
+        this->readBuffer(data, region->get_size());
+        return;
+    } catch (boost::interprocess::interprocess_exception &) {
+        // fall back to reading the file into memory
+    }
+
     FILE *file=fopen(filename_, "rb");
     if(file) {
         fseek(file, 0, SEEK_END);
@@ -297,19 +578,25 @@ void Crackle::PDFDocument::readBuffer(shared_array<char> data_, size_t length_)
 {
     this->close();
 
-    // stream and file ownership is passed to PDFDoc
-    _dict=boost::shared_ptr<Object>(new Object);
-    _dict->setToNull();
-
     _data=data_;
     _datalen=length_;
 
-    MemStream *stream=new MemStream(_data.get(), 0, _datalen, std::move(*_dict.get()));
-    _open(stream);
+    {
+        boost::lock_guard<boost::mutex> g(_globalMutexConcurrency);
+        _concurrency=_defaultConcurrency;
+        _maxContexts=_defaultMaxContexts;
+    }
+    if (_maxContexts==0) {
+        _maxContexts=std::max(1u, boost::thread::hardware_concurrency());
+    }
+
+    _context=boost::shared_ptr<PDFRenderContext>(new PDFRenderContext(_data, _datalen));
+    _doc=_context->doc;
+    _dict=_context->dict;
+    if (!_context->isOK()) {
+        _crackle_errorcode=errOpenFile;
+    }
 
-    Spine::Sha256 hash;
-    hash.update(reinterpret_cast< unsigned char * > (data_.get()), length_);
-    _filehash=Spine::Fingerprint::binaryFingerprintIri(hash.calculateHash());
     if(this->isOK()) {
         _updateAnnotations();
     }
@@ -774,6 +1061,21 @@ time_t Crackle::PDFDocument::modificationDate()
 // generate SHA-256 hash of file
 string Crackle::PDFDocument::filehash()
 {
+    boost::lock_guard<boost::mutex> g(_mutexFilehash);
+
+    if (_filehash.empty() && _data) {
+        // Hashed on first use, a chunk at a time, so that opening a
+        // mapped file doesn't require reading all of it
+        static const long chunk=1024*1024;
+
+        Spine::Sha256 hash;
+        unsigned char *data(reinterpret_cast< unsigned char * > (_data.get()));
+        for (long offset=0; offset<_datalen; offset+=chunk) {
+            hash.update(data+offset, std::min(chunk, _datalen-offset));
+        }
+        _filehash=Spine::Fingerprint::binaryFingerprintIri(hash.calculateHash());
+    }
+
     return _filehash;
 }
 
@@ -800,55 +1102,6 @@ void Crackle::PDFDocument::_initialise()
 
 /****************************************************************************/
 
-void Crackle::PDFDocument::_open(BaseStream *stream_)
-{
-    _doc      = boost::shared_ptr<PDFDoc>(new PDFDoc(stream_));
-
-    if (_doc->isOk()) {
-        _textDevice=boost::shared_ptr<CrackleTextOutputDev>(new CrackleTextOutputDev ((char *)0, false, 0.0, false, false));
-
-        SplashColor paperColour;
-        paperColour[0] = 255;
-        paperColour[1] = 255;
-        paperColour[2] = 255;
-
-#ifdef UTOPIA_SPINE_BACKEND_POPPLER
-        // defaults setup anti aliasing for screen
-        _renderDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true));
-
-  #ifdef HAVE_POPPLER_SPLASH_SET_FONT_ANTIALIAS
-        // newer versions of poppler no longer sets font anti-aliasing in constructor
-        _printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true));
-        _printDevice->setFontAntialias(false);
-  #else
-        _printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true, false));
-        // original
-  #endif
-
-  #ifdef HAVE_POPPLER_SPLASH_SET_VECTOR_ANTIALIAS
-        _printDevice->setVectorAntialias(false);
-  #endif
-
-#else // XPDF
-        _renderDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true, true));
-        _printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true, false));
-#endif
-
-#ifdef UTOPIA_SPINE_BACKEND_POPPLER
-        _renderDevice->startDoc(_doc.get());
-        _printDevice->startDoc(_doc.get());
-#else // XPDF
-        _renderDevice->startDoc(_doc->getXRef());
-        _printDevice->startDoc(_doc->getXRef());
-#endif
-
-    } else {
-        _crackle_errorcode=errOpenFile;
-    }
-}
-
-/****************************************************************************/
-
 Crackle::PDFDocument::ViewMode Crackle::PDFDocument::viewMode()
 {
     ViewMode res=ViewNone;
@@ -949,6 +1202,87 @@ size_t Crackle::PDFDocument::numberOfPages()
 
 /****************************************************************************/
 
+void Crackle::PDFDocument::prefetchPages(size_t first_, size_t last_,
+                                         PrefetchProgress progress_, void * userdef_)
+{
+    last_=std::min(last_, this->size());
+    if (first_ >= last_) {
+        return;
+    }
+
+    PrefetchQueue queue;
+    queue.next=first_;
+    queue.last=last_;
+    queue.done=0;
+    queue.total=last_-first_;
+    queue.progress=progress_;
+    queue.userdef=userdef_;
+
+    // the calling thread takes a share of the work too
+    size_t helpers(0);
+    if (_concurrency==PageConcurrency) {
+        PrefetchPool & pool(PrefetchPool::instance());
+        helpers=std::min(std::min(_maxContexts, pool.size()+1), last_-first_) - 1;
+        queue.helpers=helpers;
+        for (size_t i=0; i<helpers; ++i) {
+            pool.post(boost::bind(prefetchHelper, this, &queue));
+        }
+    } else {
+        queue.helpers=0;
+    }
+
+    prefetchWorker(this, &queue);
+
+    // the queue lives on this stack, so wait for every helper to let go
+    boost::unique_lock<boost::mutex> g(queue.mutex);
+    while (queue.helpers > 0) {
+        queue.finished.wait(g);
+    }
+}
+
+/****************************************************************************/
+
+void Crackle::PDFDocument::prefetch()
+{
+    // Callers arriving during the prefetch wait for it, as they would
+    // otherwise extract the same pages themselves
+    boost::lock_guard<boost::mutex> g(_mutexPrefetch);
+    if (!_prefetched) {
+        this->prefetchPages();
+        _prefetched=true;
+    }
+}
+
+/****************************************************************************/
+
+void Crackle::PDFDocument::prefetchFrom(int pageNumber_)
+{
+    if (pageNumber_ <= 1) {
+        this->prefetch();
+    } else {
+        boost::lock_guard<boost::mutex> g(_mutexPrefetch);
+        if (!_prefetched) {
+            this->prefetchPages(pageNumber_-1);
+        }
+    }
+}
+
+/****************************************************************************/
+
+void Crackle::PDFDocument::setExtractImages(bool extractImages_)
+{
+    _extractImages=extractImages_;
+}
+
+/****************************************************************************/
+
+bool Crackle::PDFDocument::extractImages() const
+{
+    return _extractImages;
+}
+
+/****************************************************************************/
+
 Crackle::PDFDocument::const_iterator
 Crackle::PDFDocument::begin()
 {
@@ -971,8 +1305,7 @@ Crackle::PDFDocument::operator[](int idx_)
     boost::lock_guard<boost::mutex> g(_mutexPageMap);
     std::map<int,PDFPage *>::const_iterator i=_pageMap.find(idx_);
     if(i==_pageMap.end()) {
-      _pageMap[idx_]= new PDFPage(this, idx_+1, _textDevice,
-                                  _renderDevice, _printDevice);
+      _pageMap[idx_]= new PDFPage(this, idx_+1);
     }
 
     return(*(_pageMap[idx_]));
@@ -42,6 +42,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/shared_array.hpp>
 #include <boost/thread.hpp>
+#include <vector>
 
 #ifdef UTOPIA_SPINE_BACKEND_POPPLER
 #ifndef GList
@@ -49,7 +50,6 @@
 #endif
 #endif
 
-class BaseStream;
 class Object;
 class PDFDoc;
 class CrackleTextOutputDev;
@@ -63,6 +63,7 @@ namespace Crackle
 
     class PDFPageSequence;
     class PDFCursor;
+    class PDFRenderContext;
 
     /***************************************************************************
      *
@@ -74,6 +75,23 @@ namespace Crackle
      * Represents a collection of pages from a PDF.
      * PDFPage instances are created lazily.
      *
+     * Page rendering and text extraction is guarded according to the
+     * concurrency mode in force when the document was read:
+     *
+     *   GlobalConcurrency    - one lock shared by every document in the
+     *                          process (the historical behaviour)
+     *   DocumentConcurrency  - one lock per document, so that distinct
+     *                          documents are processed in parallel
+     *   PageConcurrency      - each document keeps a pool of independent
+     *                          render contexts, so that distinct pages of
+     *                          the same document are also processed in
+     *                          parallel (at the cost of one xref per
+     *                          context)
+     *
+     * The default may be set with setConcurrency() or with the
+     * CRACKLE_CONCURRENCY environment variable ("global", "document" or
+     * "page").
+     *
      **************************************************************************/
 
     class PDFDocument : public Spine::Document
@@ -216,6 +234,19 @@ namespace Crackle
         typedef std::ptrdiff_t difference_type;
         typedef std::size_t size_type;
 
+        enum Concurrency {
+            GlobalConcurrency,
+            DocumentConcurrency,
+            PageConcurrency
+        };
+
+        // Affects documents subsequently read. A maxContexts_ of zero
+        // means one render context per hardware thread.
+        static void setConcurrency(Concurrency concurrency_, size_t maxContexts_=0);
+        static Concurrency concurrency();
+
+        typedef void (*PrefetchProgress)(void * userdef_, size_t done_, size_t total_);
+
         PDFDocument();
         virtual ~PDFDocument();
         PDFDocument(const char * filename_);
@@ -238,6 +269,24 @@ namespace Crackle
         virtual Spine::Document::FingerprintSet fingerprints();
         size_type size();
         size_t numberOfPages();
+
+        // Extract the text and images of pages [first_, last_) ahead of
+        // use. Under PageConcurrency the pages are shared out between the
+        // calling thread and a process-wide pool of prefetch threads, up to
+        // one per render context; otherwise they are extracted on the
+        // calling thread. Blocks until done.
+        void prefetchPages(size_t first_=0, size_t last_=(size_t) -1,
+                           PrefetchProgress progress_=0, void * userdef_=0);
+        // Prefetches the whole document, once
+        virtual void prefetch();
+        // Prefetches from the given (1-based) page to the end
+        virtual void prefetchFrom(int pageNumber_);
+
+        // When false, pages are extracted for their text only and have no
+        // images (which also affects image fingerprints). Must be set
+        // before the pages concerned are first used.
+        void setExtractImages(bool extractImages_);
+        bool extractImages() const;
         const_iterator begin();
         const_iterator end();
 
@@ -264,7 +313,6 @@ namespace Crackle
 
         void _initialise();
         void _updateAnnotations();
-        void _open(BaseStream *stream_);
 
         std::string _addAnchor(Object *obj, std::string name="");
         std::string _addAnchor(const LinkDest *dest1, std::string name="");
@@ -283,13 +331,51 @@ namespace Crackle
         mutable boost::mutex _mutexDocument;
         static boost::mutex _globalMutexDocument;
 
+        static boost::mutex _globalMutexConcurrency;
+        static Concurrency _defaultConcurrency;
+        static size_t _defaultMaxContexts;
+
         boost::shared_ptr<PDFDoc> xpdfDoc() { return _doc; }
 
         friend class PDFPage;
 
-        boost::shared_ptr<CrackleTextOutputDev>  _textDevice;
-        boost::shared_ptr<SplashOutputDev> _renderDevice;
-        boost::shared_ptr<SplashOutputDev> _printDevice;
+        // Grants exclusive use of a render context for the lifetime of
+        // the lock, according to the document's concurrency mode.
+        class RenderLock
+        {
+        public:
+            RenderLock(PDFDocument * doc_);
+            ~RenderLock();
+
+            PDFRenderContext * operator -> () const { return _context.get(); }
+            PDFRenderContext * get() const { return _context.get(); }
+
+        private:
+            RenderLock(const RenderLock& rhs_);
+            const RenderLock& operator=(const RenderLock& rhs_);
+
+            PDFDocument * _doc;
+            boost::shared_ptr<PDFRenderContext> _context;
+        };
+
+        boost::shared_ptr<PDFRenderContext> _acquireContext();
+        void _releaseContext(boost::shared_ptr<PDFRenderContext> context_);
+
+        // the context the document was opened with
+        boost::shared_ptr<PDFRenderContext> _context;
+
+        // additional contexts for page level concurrency
+        Concurrency _concurrency;
+        size_t _maxContexts;
+        size_t _contextCount;
+        std::vector< boost::shared_ptr<PDFRenderContext> > _idleContexts;
+        boost::mutex _mutexContexts;
+        boost::condition_variable _contextAvailable;
+
+        bool _prefetched;
+        boost::mutex _mutexPrefetch;
+
+        bool _extractImages;
 
         int _crackle_errorcode;
         mutable bool _fonts_counted;
@@ -297,6 +383,7 @@ namespace Crackle
         mutable std::string _uuid;
         mutable std::string _docid;
         mutable std::string _filehash;
+        boost::mutex _mutexFilehash;
 
         boost::shared_array<char> _data;
         long _datalen;
@@ -89,6 +89,11 @@ PDFFont::PDFFont (GfxFont *gfxfont_, const FontSizes &sizes_)
 
 }
 
+PDFFont::PDFFont ()
+    : _isFixedWidth(false), _isSerif(false), _isSymbolic(false),
+      _isItalic(false), _isBold(false), _count(0)
+{}
+
 std::string PDFFont::name() const
 {
     return _name;
@@ -34,6 +34,7 @@
 
 class GfxFont;
 class CrackleTextPage;
+class CrackleTextFontInfo;
 
 namespace Crackle
 {
@@ -73,6 +74,7 @@ namespace Crackle
     private:
 
         PDFFont (GfxFont *gfxfont_, const FontSizes &sizes_=FontSizes());
+        PDFFont ();
         void updateSizes(float size_, int increase_=1);
         void updateSizes(const FontSizes &sizes_);
 
@@ -82,6 +84,7 @@ namespace Crackle
         friend class Crackle::PDFTextCharacter;
         friend class Crackle::PDFFontCollection;
         friend class ::CrackleTextPage;
+        friend class ::CrackleTextFontInfo;
 
         bool _isFixedWidth;
         bool _isSerif;
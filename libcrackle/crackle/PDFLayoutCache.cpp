@@ -0,0 +1,391 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libcrackle library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libcrackle library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libcrackle library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libcrackle library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * PDFLayoutCache.cpp
+ *
+ ****************************************************************************/
+
+#include <crackle/PDFLayoutCache.h>
+#include <crackle/CrackleTextOutputDev.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <process.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+using namespace std;
+using namespace Crackle;
+
+namespace {
+
+#ifdef _WIN32
+    const char separator='\\';
+#else
+    const char separator='/';
+#endif
+
+    string getDirectoryFromEnvironment()
+    {
+        const char *env=getenv("CRACKLE_LAYOUT_CACHE");
+        if (env) {
+            return env;
+        }
+
+#ifdef _WIN32
+        const char *base=getenv("LOCALAPPDATA");
+        if (base && *base) {
+            return string(base) + "\\crackle\\layout";
+        }
+#else
+        const char *base=getenv("XDG_CACHE_HOME");
+        if (base && *base) {
+            return string(base) + "/crackle/layout";
+        }
+        base=getenv("HOME");
+        if (base && *base) {
+            return string(base) + "/.cache/crackle/layout";
+        }
+#endif
+
+        return string();
+    }
+
+    void makeDirectory(const string &path_)
+    {
+#ifdef _WIN32
+        _mkdir(path_.c_str());
+#else
+        mkdir(path_.c_str(), 0755);
+#endif
+    }
+
+    // Creates path_ and any missing parents; failures show up when the
+    // file is written
+    void makeDirectories(const string &path_)
+    {
+        for (size_t i=path_.find_first_of("/\\", 1); i!=string::npos; i=path_.find_first_of("/\\", i+1)) {
+            makeDirectory(path_.substr(0, i));
+        }
+        makeDirectory(path_);
+    }
+
+    int processId()
+    {
+#ifdef _WIN32
+        return _getpid();
+#else
+        return getpid();
+#endif
+    }
+
+    unsigned long long getMaxSizeFromEnvironment()
+    {
+        const char *env=getenv("CRACKLE_LAYOUT_CACHE_SIZE");
+        if (env && *env) {
+            return strtoull(env, 0, 10) * 1024 * 1024;
+        }
+        return 256ull * 1024 * 1024;
+    }
+
+    bool statPath(const string &path_, time_t &modified_, unsigned long long &size_, bool &isDirectory_)
+    {
+#ifdef _WIN32
+        struct _stat64 info;
+        if (_stat64(path_.c_str(), &info)!=0) {
+            return false;
+        }
+        isDirectory_=(info.st_mode & _S_IFDIR)!=0;
+#else
+        struct stat info;
+        if (stat(path_.c_str(), &info)!=0) {
+            return false;
+        }
+        isDirectory_=S_ISDIR(info.st_mode);
+#endif
+        modified_=info.st_mtime;
+        size_=info.st_size;
+        return true;
+    }
+
+    bool exists(const string &path_)
+    {
+        time_t modified;
+        unsigned long long size;
+        bool isDirectory;
+        return statPath(path_, modified, size, isDirectory);
+    }
+
+    // Marks a file as just used
+    void touch(const string &path_)
+    {
+#ifdef _WIN32
+        _utime(path_.c_str(), 0);
+#else
+        utime(path_.c_str(), 0);
+#endif
+    }
+
+    // The names of the entries in path_, other than . and ..
+    vector< string > listDirectory(const string &path_)
+    {
+        vector< string > names;
+#ifdef _WIN32
+        struct _finddata_t entry;
+        intptr_t handle(_findfirst((path_ + "\\*").c_str(), &entry));
+        if (handle!=-1) {
+            do {
+                names.push_back(entry.name);
+            } while (_findnext(handle, &entry)==0);
+            _findclose(handle);
+        }
+#else
+        if (DIR *dir=opendir(path_.c_str())) {
+            while (struct dirent *entry=readdir(dir)) {
+                names.push_back(entry->d_name);
+            }
+            closedir(dir);
+        }
+#endif
+        names.erase(remove(names.begin(), names.end(), string(".")), names.end());
+        names.erase(remove(names.begin(), names.end(), string("..")), names.end());
+        return names;
+    }
+
+    // The cached pages of one document
+    struct CachedDocument
+    {
+        string path;
+        time_t used;
+        unsigned long long size;
+
+        bool operator < (const CachedDocument &rhs_) const
+        {
+            return used < rhs_.used;
+        }
+    };
+
+}
+
+/****************************************************************************/
+
+boost::mutex Crackle::PDFLayoutCache::_mutexDirectory;
+std::string Crackle::PDFLayoutCache::_directory(getDirectoryFromEnvironment());
+unsigned long long Crackle::PDFLayoutCache::_maxSize(getMaxSizeFromEnvironment());
+boost::mutex Crackle::PDFLayoutCache::_mutexPrune;
+
+/****************************************************************************/
+
+void Crackle::PDFLayoutCache::setDirectory(const std::string &path_)
+{
+    boost::lock_guard<boost::mutex> g(_mutexDirectory);
+    _directory=path_;
+}
+
+/****************************************************************************/
+
+std::string Crackle::PDFLayoutCache::directory()
+{
+    boost::lock_guard<boost::mutex> g(_mutexDirectory);
+    return _directory;
+}
+
+/****************************************************************************/
+
+void Crackle::PDFLayoutCache::setMaxSize(unsigned long long bytes_)
+{
+    boost::lock_guard<boost::mutex> g(_mutexDirectory);
+    _maxSize=bytes_;
+}
+
+/****************************************************************************/
+
+unsigned long long Crackle::PDFLayoutCache::maxSize()
+{
+    boost::lock_guard<boost::mutex> g(_mutexDirectory);
+    return _maxSize;
+}
+
+/****************************************************************************/
+
+std::string Crackle::PDFLayoutCache::_filename(const std::string &filehash_, unsigned int page_)
+{
+    string dir(directory());
+
+    // the hash is a fingerprint IRI, of which only the digest is wanted
+    string digest(filehash_.substr(filehash_.rfind('/')+1));
+
+    if (dir.empty() || digest.empty()) {
+        return string();
+    }
+
+    ostringstream filename;
+    filename << dir << separator << digest << separator << page_ << ".layout";
+    return filename.str();
+}
+
+/****************************************************************************/
+
+CrackleTextPage *Crackle::PDFLayoutCache::load(const std::string &filehash_, unsigned int page_)
+{
+    string filename(_filename(filehash_, page_));
+
+    if (filename.empty()) {
+        return 0;
+    }
+
+    // the page is rebuilt straight out of the mapping, which can be
+    // dropped as soon as that is done
+    try {
+        boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+
+        CrackleTextPage *textpage(CrackleTextPage::deserialize(static_cast< const char * >(region.get_address()),
+                                                               region.get_size()));
+        if (textpage) {
+            // a file's age is how recently it was used when pruning
+            touch(filename);
+        }
+        return textpage;
+    } catch (boost::interprocess::interprocess_exception &) {
+        // not cached (or unreadable)
+        return 0;
+    }
+}
+
+/****************************************************************************/
+
+void Crackle::PDFLayoutCache::save(const std::string &filehash_, unsigned int page_, CrackleTextPage *textpage_)
+{
+    string filename(_filename(filehash_, page_));
+
+    if (filename.empty() || !textpage_) {
+        return;
+    }
+
+    string buffer;
+    textpage_->serialize(buffer);
+
+    string documentDirectory(filename.substr(0, filename.rfind(separator)));
+    bool newDocument(!exists(documentDirectory));
+    makeDirectories(documentDirectory);
+
+    // written aside and renamed into place so that readers, in this or
+    // another process, never see a partial file
+    ostringstream temporary;
+    temporary << filename << '.' << processId() << '.' << boost::this_thread::get_id() << ".tmp";
+
+    bool written;
+    {
+        ofstream out(temporary.str().c_str(), ios::out | ios::binary | ios::trunc);
+        out.write(buffer.data(), buffer.size());
+        out.close();
+        written=!out.fail();
+    }
+
+    if (!written || rename(temporary.str().c_str(), filename.c_str())!=0) {
+        remove(temporary.str().c_str());
+    }
+
+    // the cache only grows by a document at a time, so that is when it
+    // is brought back within budget
+    if (newDocument) {
+        _prune(documentDirectory.substr(0, documentDirectory.rfind(separator)), documentDirectory);
+    }
+}
+
+/****************************************************************************/
+
+void Crackle::PDFLayoutCache::_prune(const std::string &directory_, const std::string &keep_)
+{
+    unsigned long long budget(maxSize());
+    if (budget==0) {
+        return;
+    }
+
+    boost::lock_guard<boost::mutex> g(_mutexPrune);
+
+    vector< CachedDocument > documents;
+    unsigned long long total(0);
+    vector< string > digests(listDirectory(directory_));
+    for (vector< string >::const_iterator digest(digests.begin()); digest!=digests.end(); ++digest) {
+        CachedDocument document;
+        document.path=directory_ + separator + *digest;
+        document.used=0;
+        document.size=0;
+
+        vector< string > pages(listDirectory(document.path));
+        for (vector< string >::const_iterator page(pages.begin()); page!=pages.end(); ++page) {
+            time_t modified;
+            unsigned long long size;
+            bool isDirectory;
+            if (statPath(document.path + separator + *page, modified, size, isDirectory) && !isDirectory) {
+                document.used=std::max(document.used, modified);
+                document.size+=size;
+            }
+        }
+
+        total+=document.size;
+        if (document.path!=keep_) {
+            documents.push_back(document);
+        }
+    }
+
+    // least recently used first
+    std::sort(documents.begin(), documents.end());
+    for (vector< CachedDocument >::const_iterator document(documents.begin());
+         total>budget && document!=documents.end(); ++document) {
+        vector< string > pages(listDirectory(document->path));
+        for (vector< string >::const_iterator page(pages.begin()); page!=pages.end(); ++page) {
+            remove((document->path + separator + *page).c_str());
+        }
+#ifdef _WIN32
+        _rmdir(document->path.c_str());
+#else
+        rmdir(document->path.c_str());
+#endif
+        total-=document->size;
+    }
+}
+
+/****************************************************************************/
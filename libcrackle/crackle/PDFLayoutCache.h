@@ -0,0 +1,86 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libcrackle library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libcrackle library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libcrackle library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libcrackle library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef PDFLAYOUTCACHE_INCL_
+#define PDFLAYOUTCACHE_INCL_
+
+/*****************************************************************************
+ *
+ * PDFLayoutCache.h
+ *
+ ****************************************************************************/
+
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+
+class CrackleTextPage;
+
+namespace Crackle
+{
+
+    /***************************************************************************
+     *
+     * PDFLayoutCache
+     *
+     * A local, persistent store of extracted page layouts keyed by the
+     * SHA-256 hash of the document's file. Reopening a document whose pages
+     * have been seen before maps each page's layout back in rather than
+     * reinterpreting its content stream and coalescing its text again.
+     *
+     * The cache lives in $CRACKLE_LAYOUT_CACHE if that is set (an empty
+     * value disables it), otherwise under the user's cache directory.
+     *
+     * It is kept within a size budget (256MB by default, or
+     * $CRACKLE_LAYOUT_CACHE_SIZE megabytes) by discarding the layouts of
+     * the least recently used documents whenever a new document is added.
+     *
+     **************************************************************************/
+
+    class PDFLayoutCache
+    {
+    public:
+
+        static void setDirectory(const std::string &path_);
+        static std::string directory();
+
+        // A budget of zero leaves the cache unbounded
+        static void setMaxSize(unsigned long long bytes_);
+        static unsigned long long maxSize();
+
+        // Returns a newly allocated page, or NULL if the page isn't cached
+        static CrackleTextPage *load(const std::string &filehash_, unsigned int page_);
+        static void save(const std::string &filehash_, unsigned int page_, CrackleTextPage *textpage_);
+
+    private:
+
+        static std::string _filename(const std::string &filehash_, unsigned int page_);
+        static void _prune(const std::string &directory_, const std::string &keep_);
+
+        static boost::mutex _mutexDirectory;
+        static std::string _directory;
+        static unsigned long long _maxSize;
+        static boost::mutex _mutexPrune;
+    };
+
+}
+
+#endif /* PDFLAYOUTCACHE_INCL_ */
@@ -28,11 +28,13 @@
  ****************************************************************************/
 #include <crackle/PDFPage.h>
 #include <crackle/PDFDocument.h>
+#include <crackle/PDFRenderContext.h>
 #include <spine/Image.h>
 #include <crackle/ImageCollection.h>
 #include <crackle/CrackleTextOutputDev.h>
 #include <crackle/PDFTextRegionCollection.h>
 #include <crackle/PDFFontCollection.h>
+#include <crackle/PDFLayoutCache.h>
 #include <crackle/xpdfapi.h>
 
 #include "aconf.h"
@@ -54,22 +56,15 @@ using namespace boost;
 using namespace Spine;
 using namespace Crackle;
 
-Crackle::PDFPage::PDFPage (PDFDocument * doc_, unsigned int page_,
-                           boost::shared_ptr<CrackleTextOutputDev> textDevice_,
-                           boost::shared_ptr<SplashOutputDev> renderDevice_,
-                           boost::shared_ptr<SplashOutputDev> printDevice_)
-  : _doc(doc_), _page(page_), _textDevice(textDevice_),
-    _renderDevice(renderDevice_),
-    _printDevice(printDevice_),
+Crackle::PDFPage::PDFPage (PDFDocument * doc_, unsigned int page_)
+  : _doc(doc_), _page(page_),
     _sharedData(boost::shared_ptr<SharedData>(new SharedData))
 {
     //std::cerr << "+++ PAG " << this << std::endl;
 }
 
 Crackle::PDFPage::PDFPage (const PDFPage &rhs_)
-    : _doc(rhs_._doc), _page(rhs_._page), _textDevice(rhs_._textDevice),
-      _renderDevice(rhs_._renderDevice),
-      _printDevice(rhs_._printDevice),
+    : _doc(rhs_._doc), _page(rhs_._page),
       _sharedData(rhs_._sharedData)
 {
     //std::cerr << "+++ PAG " << this << std::endl;
@@ -77,7 +72,7 @@ Crackle::PDFPage::PDFPage (const PDFPage &rhs_)
 
 Crackle::PDFPage::~PDFPage ()
 {
-    //std::cerr << "--- PAG " << this << " " << _textDevice.use_count() << std::endl;
+    //std::cerr << "--- PAG " << this << std::endl;
 }
 
 PDFPage &Crackle::PDFPage::operator= (const PDFPage &rhs_)
@@ -87,9 +82,6 @@ PDFPage &Crackle::PDFPage::operator= (const PDFPage &rhs_)
         _sharedData=rhs_._sharedData;
         _doc=rhs_._doc;
         _page=rhs_._page;
-        _textDevice=rhs_._textDevice;
-        _renderDevice=rhs_._renderDevice;
-        _printDevice=rhs_._printDevice;
     }
 
     return *this;
@@ -156,7 +148,19 @@ const Crackle::ImageCollection &Crackle::PDFPage::images() const
     _mutexSharedData.unlock();
 
     if (!alreadyExtracted) {
-        _extractTextAndImages();
+        if (!_doc->extractImages()) {
+            _setImages(boost::shared_ptr<ImageCollection>(new ImageCollection));
+        } else if (_loadCachedText()) {
+            // the text is known, so only the images need finding, and
+            // only then if the page had any when its layout was cached
+            if (_cachedImageCount() == 0) {
+                _setImages(boost::shared_ptr<ImageCollection>(new ImageCollection));
+            } else {
+                _extractImages();
+            }
+        } else {
+            _extractTextAndImages();
+        }
     }
 
     boost::lock_guard<boost::mutex> g(_mutexSharedData);
@@ -167,19 +171,21 @@ Spine::Image Crackle::PDFPage::render(size_t width_,
                                       size_t height_,
                                       bool antialias_) const
 {
-    Crackle::PDFDocument::_globalMutexDocument.lock();
-
-    double w(_doc->xpdfDoc()->getPageCropWidth(_page));
-    double h(_doc->xpdfDoc()->getPageCropHeight(_page));
-    /*
-      double w(_doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->x2 - _doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->x1);
-      double h(_doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->y2 - _doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->y1);
-    */
-    if (_doc->xpdfDoc()->getPageRotate(_page) % 180) // Swap if rotated by 90 / 270 degrees
+    double w, h;
     {
-        double tmp(w); w=h; h=tmp;
+        PDFDocument::RenderLock context(_doc);
+
+        w=context->doc->getPageCropWidth(_page);
+        h=context->doc->getPageCropHeight(_page);
+        /*
+          double w(_doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->x2 - _doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->x1);
+          double h(_doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->y2 - _doc->xpdfDoc()->getCatalog()->getPage(_page)->getTrimBox()->y1);
+        */
+        if (context->doc->getPageRotate(_page) % 180) // Swap if rotated by 90 / 270 degrees
+        {
+            double tmp(w); w=h; h=tmp;
+        }
     }
-    Crackle::PDFDocument::_globalMutexDocument.unlock();
 
 
     double fit_resolution_w = (72.0 * width_) / w;
@@ -191,11 +197,11 @@ Spine::Image Crackle::PDFPage::render(size_t width_,
 
 Spine::Image Crackle::PDFPage::render(double resolution_, bool antialias_) const
 {
-    boost::lock_guard<boost::mutex> g(Crackle::PDFDocument::_globalMutexDocument);
-    _doc->xpdfDoc()->displayPage(_renderDevice.get(), _page, resolution_,
-                                 resolution_, 0, false, false, false);
+    PDFDocument::RenderLock context(_doc);
+    context->doc->displayPage(context->renderDevice.get(), _page, resolution_,
+                              resolution_, 0, false, false, false);
 
-    SplashBitmap *bitmap(_renderDevice->getBitmap());
+    SplashBitmap *bitmap(context->renderDevice->getBitmap());
 
     size_t length= bitmap->getWidth() * 3 * bitmap->getHeight();
     char *data=reinterpret_cast<char *>(bitmap->getDataPtr());
@@ -233,7 +239,7 @@ Spine::Image Crackle::PDFPage::renderArea(const Spine::BoundingBox & slice,
                                           double resolutionY_,
                                           bool antialias_) const
 {
-    boost::lock_guard<boost::mutex> g(Crackle::PDFDocument::_globalMutexDocument);
+    PDFDocument::RenderLock context(_doc);
     double resolutionScaleX(72.0 / resolutionX_);
     double resolutionScaleY(72.0 / resolutionY_);
     Spine::BoundingBox scaledSlice(slice.x1 / resolutionScaleX, slice.y1 / resolutionScaleX,
@@ -241,16 +247,16 @@ Spine::Image Crackle::PDFPage::renderArea(const Spine::BoundingBox & slice,
 
     boost::shared_ptr<SplashOutputDev> dev;
     if(antialias_) {
-      dev = _renderDevice;
+      dev = context->renderDevice;
     } else {
-      dev = _printDevice;
+      dev = context->printDevice;
     }
 
-    _doc->xpdfDoc()->displayPageSlice(dev.get(), _page, resolutionX_,
-                                      resolutionY_, 0, false, false, false,
-                                      (int) scaledSlice.x1, (int) scaledSlice.y1,
-                                      (int) (scaledSlice.x2-scaledSlice.x1),
-                                      (int) (scaledSlice.y2-scaledSlice.y1));
+    context->doc->displayPageSlice(dev.get(), _page, resolutionX_,
+                                   resolutionY_, 0, false, false, false,
+                                   (int) scaledSlice.x1, (int) scaledSlice.y1,
+                                   (int) (scaledSlice.x2-scaledSlice.x1),
+                                   (int) (scaledSlice.y2-scaledSlice.y1));
 
     SplashBitmap *bitmap(dev->getBitmap());
 
@@ -266,27 +272,173 @@ Spine::Image Crackle::PDFPage::renderArea(const Spine::BoundingBox & slice,
                  slice, data, length);
 }
 
+bool Crackle::PDFPage::renderInto(unsigned char *buffer_, int width_, int height_,
+                                  size_t stride_, Spine::Image::PixelFormat format_,
+                                  bool antialias_) const
+{
+    PDFDocument::RenderLock context(_doc);
+
+    double w(context->doc->getPageCropWidth(_page));
+    double h(context->doc->getPageCropHeight(_page));
+    if (context->doc->getPageRotate(_page) % 180) // Swap if rotated by 90 / 270 degrees
+    {
+        double tmp(w); w=h; h=tmp;
+    }
+
+    boost::shared_ptr<SplashOutputDev> dev(antialias_ ? context->renderDevice : context->printDevice);
+    context->doc->displayPage(dev.get(), _page, (72.0 * width_) / w,
+                              (72.0 * height_) / h, 0, false, false, false);
+
+    // the device's bitmap is reused, so it is copied out (once, straight
+    // into the caller's buffer) before the context is given up
+    return _copyBitmap(dev->getBitmap(), buffer_, width_, height_, stride_, format_);
+}
+
+bool Crackle::PDFPage::renderAreaInto(const Spine::BoundingBox & slice,
+                                      double resolution_,
+                                      unsigned char *buffer_, int width_, int height_,
+                                      size_t stride_, Spine::Image::PixelFormat format_,
+                                      bool antialias_) const
+{
+    PDFDocument::RenderLock context(_doc);
+    double resolutionScale(72.0 / resolution_);
+    Spine::BoundingBox scaledSlice(slice.x1 / resolutionScale, slice.y1 / resolutionScale,
+                                   slice.x2 / resolutionScale, slice.y2 / resolutionScale);
+
+    boost::shared_ptr<SplashOutputDev> dev(antialias_ ? context->renderDevice : context->printDevice);
+    context->doc->displayPageSlice(dev.get(), _page, resolution_,
+                                   resolution_, 0, false, false, false,
+                                   (int) scaledSlice.x1, (int) scaledSlice.y1,
+                                   (int) (scaledSlice.x2-scaledSlice.x1),
+                                   (int) (scaledSlice.y2-scaledSlice.y1));
+
+    return _copyBitmap(dev->getBitmap(), buffer_, width_, height_, stride_, format_);
+}
+
+bool Crackle::PDFPage::_copyBitmap(SplashBitmap *bitmap_,
+                                   unsigned char *buffer_, int width_, int height_,
+                                   size_t stride_, Spine::Image::PixelFormat format_)
+{
+    if (!bitmap_ || !bitmap_->getDataPtr()) {
+        return false;
+    }
+
+    // rows may run bottom to top, in which case the data pointer is to
+    // the last of them and the row size is negative
+    Spine::Image::copyPixels(reinterpret_cast<const unsigned char *>(bitmap_->getDataPtr()),
+                             bitmap_->getWidth(), bitmap_->getHeight(), bitmap_->getRowSize(),
+                             buffer_, width_, height_, stride_, format_);
+    return true;
+}
+
+void Crackle::PDFPage::_displayPage(PDFRenderContext * context_) const
+{
+    double w(context_->doc->getPageMediaWidth(_page));
+    double h(context_->doc->getPageMediaHeight(_page));
+
+    const PDFRectangle *rect=context_->doc->getCatalog()->getPage(_page)->getMediaBox();
+
+    double resolution_w = (72.0 * (rect->x2-rect->x1)) / w;
+    double resolution_h = (72.0 * (rect->y2-rect->y1)) / h;
+
+    context_->doc->displayPage(context_->textDevice.get(), _page, resolution_w, resolution_h,
+                               0, false, false, false);
+}
+
 void Crackle::PDFPage::_extractTextAndImages() const
 {
+    boost::shared_ptr<CrackleTextPage> textpage;
+    boost::shared_ptr<ImageCollection> images;
     {
-        boost::lock_guard<boost::mutex> g(Crackle::PDFDocument::_globalMutexDocument);
+        PDFDocument::RenderLock context(_doc);
 
-        double w(_doc->xpdfDoc()->getPageMediaWidth(_page));
-        double h(_doc->xpdfDoc()->getPageMediaHeight(_page));
+        context->textDevice->setExtractImages(_doc->extractImages());
+        _displayPage(context.get());
 
-        const PDFRectangle *rect=_doc->xpdfDoc()->getCatalog()->getPage(_page)->getMediaBox();
+        // the device is reused for the next page, so take its results
+        // before giving the context up
+        textpage=boost::shared_ptr<CrackleTextPage> (context->textDevice->takeText());
+        images=context->textDevice->pageImages();
+    }
 
-        double resolution_w = (72.0 * (rect->x2-rect->x1)) / w;
-        double resolution_h = (72.0 * (rect->y2-rect->y1)) / h;
+    textpage->setImageCount(_doc->extractImages() ? (int) images->size() : -1);
 
-        _doc->xpdfDoc()->displayPage(_textDevice.get(), _page, resolution_w, resolution_h,
-                                     0, false, false, false);
+    // another thread may have extracted this page in the meantime, or
+    // its text may have come from the layout cache, in which case those
+    // results may already have been handed out
+    bool extractedText=false;
+    {
+        boost::lock_guard<boost::mutex> g(_mutexSharedData);
+        if (!_sharedData->_text) {
+            _sharedData->_textpage=textpage;
+            _sharedData->_text= boost::shared_ptr<PDFTextRegionCollection> (new PDFTextRegionCollection(_sharedData->_textpage->getFlows()));
+            extractedText=true;
+        }
+        if (!_sharedData->_images) {
+            _sharedData->_images=images;
+        }
+    }
+
+    if (extractedText) {
+        PDFLayoutCache::save(_doc->filehash(), _page, textpage.get());
+    }
+}
+
+void Crackle::PDFPage::_extractImages() const
+{
+    boost::shared_ptr<ImageCollection> images;
+    {
+        PDFDocument::RenderLock context(_doc);
+
+        // the content stream is still interpreted, but no text is
+        // collected or laid out
+        context->textDevice->setExtractImages(true);
+        context->textDevice->setExtractText(false);
+        _displayPage(context.get());
+        context->textDevice->setExtractText(true);
+
+        images=context->textDevice->pageImages();
+    }
+
+    _setImages(images);
+}
+
+void Crackle::PDFPage::_setImages(boost::shared_ptr<ImageCollection> images_) const
+{
+    boost::lock_guard<boost::mutex> g(_mutexSharedData);
+    if (!_sharedData->_images) {
+        _sharedData->_images=images_;
+    }
+}
+
+int Crackle::PDFPage::_cachedImageCount() const
+{
+    boost::lock_guard<boost::mutex> g(_mutexSharedData);
+    return _sharedData->_textpage ? _sharedData->_textpage->getImageCount() : -1;
+}
+
+bool Crackle::PDFPage::_loadCachedText() const
+{
+    {
+        // already restored (or extracted)
+        boost::lock_guard<boost::mutex> g(_mutexSharedData);
+        if (_sharedData->_text) {
+            return true;
+        }
+    }
+
+    boost::shared_ptr<CrackleTextPage> textpage(PDFLayoutCache::load(_doc->filehash(), _page));
+
+    if (!textpage) {
+        return false;
     }
 
     boost::lock_guard<boost::mutex> g(_mutexSharedData);
-    _sharedData->_textpage=boost::shared_ptr<CrackleTextPage> (_textDevice->takeText());
-    _sharedData->_text= boost::shared_ptr<PDFTextRegionCollection> (new PDFTextRegionCollection(_sharedData->_textpage->getFlows()));
-    _sharedData->_images=boost::shared_ptr<ImageCollection>(_textDevice->pageImages());
+    if (!_sharedData->_text) {
+        _sharedData->_textpage=textpage;
+        _sharedData->_text= boost::shared_ptr<PDFTextRegionCollection> (new PDFTextRegionCollection(_sharedData->_textpage->getFlows()));
+    }
+    return true;
 }
 
 const Crackle::PDFTextRegionCollection &Crackle::PDFPage::regions() const
@@ -295,7 +447,7 @@ const Crackle::PDFTextRegionCollection &Crackle::PDFPage::regions() const
     bool alreadyExtracted = (bool) _sharedData->_text;
     _mutexSharedData.unlock();
 
-    if (!alreadyExtracted) {
+    if (!alreadyExtracted && !_loadCachedText()) {
         _extractTextAndImages();
     }
 
@@ -43,15 +43,13 @@
 
 class PDFDoc;
 class CrackleTextPage;
-
-class CrackleTextOutputDev;
-class SplashOutputDev;
 class SplashBitmap;
 
 namespace Crackle
 {
 
     class ImageCollection;
+    class PDFRenderContext;
 
     class PDFPage : public Spine::Page
     {
@@ -95,6 +93,14 @@ namespace Crackle
         Spine::Image renderArea(const Spine::BoundingBox & slice,
                                 double resolution_,
                                 bool antialias_=true) const;
+        bool renderInto(unsigned char *buffer_, int width_, int height_,
+                        size_t stride_, Spine::Image::PixelFormat format_,
+                        bool antialias_=true) const;
+        bool renderAreaInto(const Spine::BoundingBox & slice,
+                            double resolution_,
+                            unsigned char *buffer_, int width_, int height_,
+                            size_t stride_, Spine::Image::PixelFormat format_,
+                            bool antialias_=true) const;
 
         const PDFTextRegionCollection &regions() const;
         const PDFFontCollection &fonts() const;
@@ -104,10 +110,7 @@ namespace Crackle
 
         friend class PDFDocument;
 
-        PDFPage (PDFDocument * doc_, unsigned int page_,
-                 boost::shared_ptr<CrackleTextOutputDev> textDevice_,
-                 boost::shared_ptr<SplashOutputDev> renderDevice_,
-                 boost::shared_ptr<SplashOutputDev> printDevice_);
+        PDFPage (PDFDocument * doc_, unsigned int page_);
 
         PDFPage &operator=(const PDFPage& rhs_);
 
@@ -116,15 +119,19 @@ namespace Crackle
                                        double resolutionY_,
                                        bool antialias_=true) const;
 
+        static bool _copyBitmap(SplashBitmap *bitmap_,
+                                unsigned char *buffer_, int width_, int height_,
+                                size_t stride_, Spine::Image::PixelFormat format_);
+        void _displayPage(PDFRenderContext * context_) const;
         void _extractTextAndImages() const;
+        void _extractImages() const;
+        void _setImages(boost::shared_ptr<ImageCollection> images_) const;
+        int _cachedImageCount() const;
+        bool _loadCachedText() const;
 
         mutable PDFDocument * _doc;
         unsigned int _page;
 
-        mutable boost::shared_ptr<CrackleTextOutputDev> _textDevice;
-        mutable boost::shared_ptr<SplashOutputDev> _renderDevice;
-        mutable boost::shared_ptr<SplashOutputDev> _printDevice;
-
         // This struct is reference counted and shared between all copies
         // of this page. The data contained within is generated lazilly.
         // Creating this struct therefore allows copies to be made before
@@ -0,0 +1,110 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libcrackle library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libcrackle library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libcrackle library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libcrackle library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * PDFRenderContext.cpp
+ *
+ ****************************************************************************/
+
+#include <crackle/PDFRenderContext.h>
+#include <crackle/CrackleTextOutputDev.h>
+
+#include "aconf.h"
+#include "Object.h"
+#include "Stream.h"
+#include "PDFDoc.h"
+#include "SplashOutputDev.h"
+
+using namespace Crackle;
+
+/****************************************************************************/
+
+Crackle::PDFRenderContext::PDFRenderContext(boost::shared_array<char> data_, std::size_t length_)
+    : _data(data_)
+{
+    // stream and file ownership is passed to PDFDoc
+    dict=boost::shared_ptr<Object>(new Object);
+    dict->setToNull();
+
+    MemStream *stream=new MemStream(_data.get(), 0, length_, std::move(*dict.get()));
+    doc=boost::shared_ptr<PDFDoc>(new PDFDoc(stream));
+
+    if (doc->isOk()) {
+        textDevice=boost::shared_ptr<CrackleTextOutputDev>(new CrackleTextOutputDev ((char *)0, false, 0.0, false, false));
+        textDevice->setDocument(doc->getXRef(), _data);
+
+        SplashColor paperColour;
+        paperColour[0] = 255;
+        paperColour[1] = 255;
+        paperColour[2] = 255;
+
+#ifdef UTOPIA_SPINE_BACKEND_POPPLER
+        // defaults setup anti aliasing for screen
+        renderDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true));
+
+  #ifdef HAVE_POPPLER_SPLASH_SET_FONT_ANTIALIAS
+        // newer versions of poppler no longer sets font anti-aliasing in constructor
+        printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true));
+        printDevice->setFontAntialias(false);
+  #else
+        printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true, false));
+        // original
+  #endif
+
+  #ifdef HAVE_POPPLER_SPLASH_SET_VECTOR_ANTIALIAS
+        printDevice->setVectorAntialias(false);
+  #endif
+
+#else // XPDF
+        renderDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true, true));
+        printDevice=boost::shared_ptr<SplashOutputDev>(new SplashOutputDev(splashModeRGB8, 3, false, paperColour, true, false));
+#endif
+
+#ifdef UTOPIA_SPINE_BACKEND_POPPLER
+        renderDevice->startDoc(doc.get());
+        printDevice->startDoc(doc.get());
+#else // XPDF
+        renderDevice->startDoc(doc->getXRef());
+        printDevice->startDoc(doc->getXRef());
+#endif
+    }
+}
+
+/****************************************************************************/
+
+Crackle::PDFRenderContext::~PDFRenderContext()
+{
+    // devices refer to the document, so must go first
+    textDevice.reset();
+    renderDevice.reset();
+    printDevice.reset();
+
+    doc.reset();
+    dict.reset();
+}
+
+/****************************************************************************/
+
+bool Crackle::PDFRenderContext::isOK() const
+{
+    return doc && doc->isOk();
+}
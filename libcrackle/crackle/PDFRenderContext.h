@@ -0,0 +1,85 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libcrackle library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libcrackle library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libcrackle library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libcrackle library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef PDFRENDERCONTEXT_INCL_
+#define PDFRENDERCONTEXT_INCL_
+
+/*****************************************************************************
+ *
+ * PDFRenderContext.h
+ *
+ ****************************************************************************/
+
+#include <boost/shared_ptr.hpp>
+#include <boost/shared_array.hpp>
+
+#include <cstddef>
+
+class Object;
+class PDFDoc;
+class CrackleTextOutputDev;
+class SplashOutputDev;
+
+namespace Crackle
+{
+
+    /***************************************************************************
+     *
+     * PDFRenderContext
+     *
+     * Everything xpdf needs to interpret a page: a PDFDoc with its own XRef
+     * and stream position, plus the text and raster output devices that
+     * draw into it. None of these are reentrant, so a context must only be
+     * used by one thread at a time. Several contexts may be opened over
+     * the same (shared, immutable) buffer, which is what allows distinct
+     * pages and documents to be processed in parallel.
+     *
+     **************************************************************************/
+
+    class PDFRenderContext
+    {
+    public:
+
+        PDFRenderContext(boost::shared_array<char> data_, std::size_t length_);
+        ~PDFRenderContext();
+
+        bool isOK() const;
+
+        boost::shared_ptr<Object> dict;
+        boost::shared_ptr<PDFDoc> doc;
+
+        boost::shared_ptr<CrackleTextOutputDev> textDevice;
+        boost::shared_ptr<SplashOutputDev> renderDevice;
+        boost::shared_ptr<SplashOutputDev> printDevice;
+
+    private:
+
+        // Do not copy or assign
+        PDFRenderContext(const PDFRenderContext& rhs_);
+        const PDFRenderContext& operator=(const PDFRenderContext& rhs_);
+
+        // keeps the buffer alive for as long as the stream refers to it
+        boost::shared_array<char> _data;
+    };
+
+}
+
+#endif /* PDFRENDERCONTEXT_INCL_ */
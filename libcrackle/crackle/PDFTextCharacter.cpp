@@ -77,7 +77,13 @@ void Crackle::PDFTextCharacter::advance()
 
 PDFFont Crackle::PDFTextCharacter::font() const
 {
-    return PDFFont(_word->getFontInfo()->getFont());
+    // fonts are described when first seen, as the GfxFont may since
+    // have been freed (or, for a cached page, never have existed)
+    CrackleTextFontInfo *info(_word->getFontInfo());
+    if (info->getPDFFont()) {
+        return *info->getPDFFont();
+    }
+    return PDFFont(info->getFont());
 }
 
 double Crackle::PDFTextCharacter::fontSize() const
@@ -0,0 +1,140 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libcrackle library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libcrackle library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libcrackle library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libcrackle library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * renderbench.cpp
+ *
+ * Measures page rendering throughput under each of crackle's concurrency
+ * modes, by rendering every page of a document from a number of threads.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ *
+ * renderbench.cpp
+ *
+ * Measures multi-document rendering throughput under each of crackle's
+ * concurrency modes. For each thread count from one up to the number of
+ * cores, as many documents are opened as there are threads (cycling through
+ * the files given), and each thread renders every page of its own document.
+ *
+ ****************************************************************************/
+
+#include <crackle/PDFDocument.h>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace Crackle;
+
+namespace
+{
+
+    void renderDocument(PDFDocument * doc_, double resolution_)
+    {
+        for (size_t page=0; page<doc_->numberOfPages(); ++page) {
+            (*doc_)[page].render(resolution_);
+        }
+    }
+
+    double run(const std::vector< const char * > & filenames_, PDFDocument::Concurrency concurrency_,
+               size_t threads_, double resolution_, size_t & pages_)
+    {
+        // the mode is fixed when a document is read, and documents are
+        // opened before the clock starts
+        PDFDocument::setConcurrency(concurrency_);
+        boost::ptr_vector< PDFDocument > docs;
+        pages_=0;
+        for (size_t i=0; i<threads_; ++i) {
+            const char * filename(filenames_[i % filenames_.size()]);
+            docs.push_back(new PDFDocument(filename));
+            if (!docs.back().isOK()) {
+                fprintf(stderr, "cannot open %s: %s\n", filename, docs.back().errorString());
+                exit(1);
+            }
+            pages_+=docs.back().numberOfPages();
+        }
+
+        boost::posix_time::ptime start(boost::posix_time::microsec_clock::universal_time());
+        boost::thread_group threads;
+        for (size_t i=0; i<threads_; ++i) {
+            threads.create_thread(boost::bind(renderDocument, &docs[i], resolution_));
+        }
+        threads.join_all();
+        boost::posix_time::time_duration elapsed(boost::posix_time::microsec_clock::universal_time()-start);
+
+        return elapsed.total_microseconds()/1000000.0;
+    }
+
+}
+
+int main(int argc, char ** argv)
+{
+    double resolution(150.0);
+    std::vector< const char * > filenames;
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-dpi") == 0 && i+1 < argc) {
+            resolution=atof(argv[++i]);
+        } else {
+            filenames.push_back(argv[i]);
+        }
+    }
+    if (filenames.empty()) {
+        fprintf(stderr, "usage: %s [-dpi N] <file.pdf> [more.pdf ...]\n", argv[0]);
+        return 1;
+    }
+
+    size_t cores(boost::thread::hardware_concurrency());
+    if (cores == 0) {
+        cores=1;
+    }
+
+    static const struct {
+        PDFDocument::Concurrency concurrency;
+        const char * name;
+    } modes[] = {
+        { PDFDocument::GlobalConcurrency, "global" },
+        { PDFDocument::DocumentConcurrency, "document" },
+        { PDFDocument::PageConcurrency, "page" }
+    };
+
+    printf("%-10s %8s %8s %10s %10s\n", "mode", "threads", "pages", "seconds", "pages/s");
+    for (size_t i=0; i<sizeof(modes)/sizeof(modes[0]); ++i) {
+        for (size_t threads=1; threads<=cores; ++threads) {
+            size_t pages(0);
+            double seconds(run(filenames, modes[i].concurrency, threads, resolution, pages));
+            printf("%-10s %8lu %8lu %10.3f %10.2f\n", modes[i].name,
+                   (unsigned long) threads, (unsigned long) pages, seconds,
+                   seconds > 0 ? pages/seconds : 0.0);
+        }
+    }
+
+    return 0;
+}
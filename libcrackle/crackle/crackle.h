@@ -27,6 +27,7 @@
 #include <crackle/PDFDocument.h>
 #include <crackle/PDFFontCollection.h>
 #include <crackle/PDFFont.h>
+#include <crackle/PDFLayoutCache.h>
 #include <crackle/ImageCollection.h>
 #include <crackle/PDFPage.h>
 #include <crackle/PDFTextBlockCollection.h>
@@ -52,9 +52,29 @@
 
 #include <QtCore/qmath.h>
 
+#include <algorithm>
+
 #include <QDebug>
 
 
+namespace
+{
+
+    // Orders word indices by the vertical centre of their words
+    struct WordCenterLessThan
+    {
+        WordCenterLessThan(const QVector< QRectF > & rects) : rects(rects) {}
+
+        bool operator () (int lhs, int rhs) const { return rects.at(lhs).center().y() < rects.at(rhs).center().y(); }
+        bool operator () (int lhs, double rhs) const { return rects.at(lhs).center().y() < rhs; }
+        bool operator () (double lhs, int rhs) const { return lhs < rects.at(rhs).center().y(); }
+
+        const QVector< QRectF > & rects;
+    };
+
+}
+
+
 TablificationDialog::TablificationDialog(Spine::DocumentHandle document, Spine::AnnotationHandle annotation)
     : QWidget(0), hasChanged(false)
 {
@@ -98,24 +118,19 @@ void TablificationDialog::initialise()
     scrolled = false;
     zoom = 1.0;
 
+    source.renderedResolution = 0.0;
+    source.renderedRotation = -1;
+
+    snapshotWords();
+
     // Work out whether we should default to another rotation
     {
         QMap< int, int > rotations;
 
-        // Get text from document
-        Spine::CursorHandle cursor(source.document->newCursor(source.area.page));
-        while (/* const Spine::Line * line = */ cursor->line()) {
-            while (const Spine::Word * word = cursor->word()) {
-                Spine::BoundingBox bb(word->boundingBox());
-                double x, y;
-                bb.getCenter(&x, &y);
-                if (source.area.boundingBox.contains(x, y)) {
-                    int rotation = word->rotation();
-                    rotations.insert(rotation, rotations.value(rotation, 0) + 1);
-                }
-                cursor->nextWord(Spine::WithinLine);
+        foreach (const SourceWord & word, words) {
+            if (QRectF(0, 0, 1, 1).contains(word.rect.center())) {
+                rotations.insert(word.rotation, rotations.value(word.rotation, 0) + 1);
             }
-            cursor->nextLine(Spine::WithinPage);
         }
 
         QMap< int, int > frequencies;
@@ -367,36 +382,105 @@ void TablificationDialog::onRotateRightPressed()
 
 void TablificationDialog::calculateObstacles()
 {
-    // Get text from document
     obstacles.clear();
-    Spine::CursorHandle cursor(source.document->newCursor(source.area.page));
-    while (const Spine::Word * word = cursor->word()) {
-        Spine::BoundingBox bb(word->boundingBox());
-        QRectF rect(logicalRectForBoundingBox(bb));
-        if (rect.intersects(QRectF(0, 0, 1, 1))) {
-            rect = source.logicalTransform.mapRect(rect);
-            if (source.rotation == 1 || source.rotation == 2) {
-                rect.moveLeft(1-rect.right());
-            }
-            if (source.rotation == 2 || source.rotation == 3) {
-                rect.moveTop(1-rect.bottom());
-            }
-            obstacles.append(rect);
+    foreach (const SourceWord & word, words) {
+        QRectF rect(source.logicalTransform.mapRect(word.rect));
+        if (source.rotation == 1 || source.rotation == 2) {
+            rect.moveLeft(1-rect.right());
+        }
+        if (source.rotation == 2 || source.rotation == 3) {
+            rect.moveTop(1-rect.bottom());
         }
-        cursor->nextWord(Spine::WithinPage);
+        obstacles.append(rect);
     }
     gridView->setObstacles(obstacles);
 }
 
 void TablificationDialog::renderImage()
 {
-    Spine::Image sImage = source.document->renderArea(source.area, effectiveResolution());
-    QImage image(Papyro::qImageFromSpineImage(&sImage));
-    image = image.transformed(QTransform().rotate(source.rotation * 90));
-    source.image = QPixmap::fromImage(image);
+    // Only go back to the document when the resolution changes
+    double renderResolution = effectiveResolution();
+    if (source.rendered.isNull() || source.renderedResolution != renderResolution) {
+        Spine::Image sImage = source.document->renderArea(source.area, renderResolution);
+        source.rendered = Papyro::qImageFromSpineImage(&sImage);
+        source.renderedResolution = renderResolution;
+        source.renderedRotation = -1;
+    }
+    if (source.renderedRotation != source.rotation) {
+        source.image = QPixmap::fromImage(source.rendered.transformed(QTransform().rotate(source.rotation * 90)));
+        source.renderedRotation = source.rotation;
+    }
     repositionImage();
 }
 
+void TablificationDialog::snapshotWords()
+{
+    // Get text from document
+    words.clear();
+    int line = 0;
+    Spine::CursorHandle cursor(source.document->newCursor(source.area.page));
+    while (/* const Spine::Line * line = */ cursor->line()) {
+        while (const Spine::Word * word = cursor->word()) {
+            QRectF rect(logicalRectForBoundingBox(word->boundingBox()));
+            if (rect.intersects(QRectF(0, 0, 1, 1))) {
+                SourceWord sourceWord;
+                sourceWord.rect = rect;
+                sourceWord.text = Papyro::qStringFromUnicode(word->text());
+                sourceWord.spaceAfter = word->spaceAfter();
+                sourceWord.rotation = word->rotation();
+                sourceWord.line = line;
+                words.append(sourceWord);
+            }
+            cursor->nextWord(Spine::WithinLine);
+        }
+        cursor->nextLine(Spine::WithinPage);
+        ++line;
+    }
+
+    // Index the words by their vertical centres
+    rects.clear();
+    wordsByCenter.clear();
+    foreach (const SourceWord & word, words) {
+        wordsByCenter.append(rects.size());
+        rects.append(word.rect);
+    }
+    std::stable_sort(wordsByCenter.begin(), wordsByCenter.end(), WordCenterLessThan(rects));
+}
+
+QString TablificationDialog::textInCell(const QRectF & cellRect) const
+{
+    // Only words whose centres are within the cell's vertical extent are candidates
+    WordCenterLessThan lessThan(rects);
+    QVector< int >::const_iterator first = std::lower_bound(wordsByCenter.begin(), wordsByCenter.end(), cellRect.top(), lessThan);
+    QVector< int >::const_iterator last = std::upper_bound(first, wordsByCenter.end(), cellRect.bottom(), lessThan);
+    QVector< int > matches;
+    for (; first != last; ++first) {
+        if (cellRect.contains(words.at(*first).rect.center())) {
+            matches.append(*first);
+        }
+    }
+    std::sort(matches.begin(), matches.end());
+
+    // Reassemble in reading order, one line of text per line of the page
+    QString content;
+    int line = -1;
+    foreach (int index, matches) {
+        const SourceWord & word(words.at(index));
+        if (line >= 0 && word.line != line) {
+            if (content.endsWith(" ")) {
+                content.chop(1);
+            }
+            content += QString(word.line - line, QChar('\n'));
+        }
+        line = word.line;
+        content += word.text;
+        if (word.spaceAfter) {
+            content += " ";
+        }
+    }
+    return content.trimmed();
+}
+
 TablificationDialog::~TablificationDialog()
 {}
 
@@ -755,42 +839,14 @@ void TablificationDialog::onNextPressed()
                 QRectF cellRect(hSec.offset, vSec.offset, hSec.size, vSec.size);
                 cellRect = source.logicalTransform.inverted().mapRect(cellRect);
 
-                // Translate cell to page coords
-                Spine::Area area(source.area.page,
-                                 0,
-                                 Spine::BoundingBox(source.area.boundingBox.x1 + cellRect.left() * source.area.boundingBox.width(),
-                                                    source.area.boundingBox.y1 + cellRect.top() * source.area.boundingBox.height(),
-                                                    source.area.boundingBox.x1 + cellRect.right() * source.area.boundingBox.width(),
-                                                    source.area.boundingBox.y1 + cellRect.bottom() * source.area.boundingBox.height()));
-
-                // Get text from document
-                Spine::CursorHandle cursor(source.document->newCursor(source.area.page));
-                QString content;
-                while (/* const Spine::Line * line = */ cursor->line()) {
-                    while (const Spine::Word * word = cursor->word()) {
-                        Spine::BoundingBox bb(word->boundingBox());
-                        QRectF rect(logicalRectForBoundingBox(bb));
-                        if (cellRect.contains(rect.center())) {
-                            content += Papyro::qStringFromUnicode(word->text());
-                            if (word->spaceAfter()) {
-                                content += " ";
-                            }
-                        }
-                        cursor->nextWord(Spine::WithinLine);
-                    }
-                    if (content.endsWith(" ")) {
-                        content.chop(1);
-                    }
-                    content += "\n";
-                    cursor->nextLine(Spine::WithinPage);
-                }
+                QString content(textInCell(cellRect));
 
                 QTableWidgetItem * item = table->item(r, c);
                 if (item == 0) {
                     item = new QTableWidgetItem;
                     table->setItem(r, c, item);
                 }
-                item->setText(content.trimmed());
+                item->setText(content);
             }
         }
 
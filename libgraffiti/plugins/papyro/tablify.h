@@ -38,6 +38,7 @@
 #include <graffiti/grid.h>
 
 #include <QGridLayout>
+#include <QImage>
 #include <QLabel>
 #include <QPushButton>
 #include <QScrollBar>
@@ -45,6 +46,7 @@
 #include <QStackedLayout>
 #include <QTableWidget>
 #include <QTransform>
+#include <QVector>
 
 
 class TablificationDialog : public QWidget
@@ -100,7 +102,26 @@ protected:
         } transformed;
 
         QPixmap image;
+
+        // Unrotated rendering of the area, and the resolution it was made at
+        QImage rendered;
+        double renderedResolution;
+        int renderedRotation;
     } source;
+
+    // The words of the source area, taken once from the document
+    struct SourceWord {
+        QRectF rect; // Logical (unrotated) coordinates
+        QString text;
+        bool spaceAfter;
+        int rotation;
+        int line;
+    };
+    QVector< SourceWord > words; // In reading order
+    QVector< QRectF > rects; // Logical rectangles of words, by index
+    QVector< int > wordsByCenter; // Indices into words, by vertical centre
+    void snapshotWords();
+    QString textInCell(const QRectF & cellRect) const;
     double defaultResolution;
     double minimumResolution;
     double resolution;
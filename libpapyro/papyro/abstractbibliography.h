@@ -42,6 +42,7 @@ namespace Athenaeum
 {
 
     class PersistenceModel;
+    class SearchIndex;
 
     /////////////////////////////////////////////////////////////////////////////////////
     // AbstractBibliography provides the main API for interacting with a
@@ -104,6 +105,10 @@ namespace Athenaeum
         virtual bool removeItem(CitationHandle item) { return false; }
         virtual CitationHandle takeItemAt(int idx) = 0;
 
+        /////////////////////////////////////////////////////////////////////////////////
+        // Bibliographies may keep a full text index of their items
+        virtual const SearchIndex * searchIndex() const { return 0; }
+
     protected:
         virtual void progressChanged(qreal progress) = 0;
         virtual void stateChanged(Athenaeum::AbstractBibliography::State state) = 0;
@@ -64,6 +64,12 @@ namespace Papyro
         virtual QStringList handleableEvents() { return QStringList(); }
         virtual bool handleEvent(const QString & event, Spine::DocumentHandle document, const QVariantMap & kwargs = QVariantMap()) { return false; }
 
+        // What the handler of an event consumes and produces: event names, or the
+        // names of annotation lists. Handlers declaring what they consume are run
+        // as soon as it is ready, rather than after everything queued before them
+        virtual QStringList consumes(const QString & event) { return QStringList(); }
+        virtual QStringList produces(const QString & event) { return QStringList(); }
+
         /** Lookup framework **/
 
         virtual std::set< Spine::AnnotationHandle > lookup(Spine::DocumentHandle document, const std::string & phrase, const QVariantMap & kwargs = QVariantMap())
@@ -86,6 +86,11 @@ namespace Papyro
         d->annotator->cancel();
     }
 
+    QStringList AnnotatorRunnable::consumes() const
+    {
+        return d->annotator->consumes(d->eventName);
+    }
+
     const QString & AnnotatorRunnable::eventName() const
     {
         return d->eventName;
@@ -97,6 +102,11 @@ namespace Papyro
         return d->runnable;
     }
 
+    QStringList AnnotatorRunnable::produces() const
+    {
+        return d->annotator->produces(d->eventName);
+    }
+
     void AnnotatorRunnable::run()
     {
         if (isRunnable())
@@ -40,6 +40,7 @@
 #include <QObject>
 #include <QRunnable>
 #include <QString>
+#include <QStringList>
 
 class QVariant;
 
@@ -55,8 +56,10 @@ namespace Papyro
         AnnotatorRunnable(boost::shared_ptr< Annotator > annotator, const QString & eventName, Spine::DocumentHandle document, const QVariantMap & kwargs = QVariantMap());
         ~AnnotatorRunnable();
 
+        QStringList consumes() const;
         bool isRunnable() const;
         const QString & eventName() const;
+        QStringList produces() const;
         void run();
         void setProgress(qreal progress);
         void skip();
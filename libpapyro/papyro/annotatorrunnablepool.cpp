@@ -52,16 +52,41 @@ namespace Papyro
 
 
 
+    /// AnnotatorRunnablePoolPrivate ////////////////////////////////////////////////////
+
+    AnnotatorRunnablePoolPrivate::AnnotatorRunnablePoolPrivate()
+        : running(0), firstUnfinished(0), barrier(0)
+    {
+        clock.start();
+    }
+
+    void AnnotatorRunnablePoolPrivate::reset()
+    {
+        // Every task has finished, but a runnable may still be returning from run(),
+        // and others may yet have its queued signals to deliver
+        threadPool.waitForDone();
+        foreach (const AnnotatorTask & task, tasks)
+        {
+            if (task.runnable)
+            {
+                task.runnable->deleteLater();
+            }
+        }
+        tasks.clear();
+        taskIndex.clear();
+        firstUnfinished = 0;
+        barrier = 0;
+        clock.restart();
+    }
+
+
+
+
     /// AnnotatorRunnablePool ///////////////////////////////////////////////////////////
 
     AnnotatorRunnablePool::AnnotatorRunnablePool(QObject * parent)
         : QObject(parent), d(new AnnotatorRunnablePoolPrivate)
-    {
-        d->queued = 0;
-        d->running = 0;
-        d->finished = 0;
-        d->futureQueued = 0;
-    }
+    {}
 
     AnnotatorRunnablePool::~AnnotatorRunnablePool()
     {
@@ -70,63 +95,103 @@ namespace Papyro
         delete d;
     }
 
+    QList< AnnotatorTiming > AnnotatorRunnablePool::criticalPath() const
+    {
+        // Start from whichever task finished last...
+        int task = -1;
+        for (int i = 0; i < d->tasks.size(); ++i)
+        {
+            const AnnotatorTiming & timing(d->tasks.at(i).timing);
+            if (timing.finished >= 0 && (task < 0 || timing.finished > d->tasks.at(task).timing.finished))
+            {
+                task = i;
+            }
+        }
+
+        // ...and work back through whatever it was waiting on
+        QList< AnnotatorTiming > path;
+        while (task >= 0)
+        {
+            path.prepend(d->tasks.at(task).timing);
+            task = d->tasks.at(task).readiedBy;
+        }
+        return path;
+    }
+
     bool AnnotatorRunnablePool::isActive()
     {
-        return d->running + d->queued > 0;
+        return d->firstUnfinished < d->tasks.size();
     }
 
     void AnnotatorRunnablePool::onStarted()
     {
+        QHash< AnnotatorRunnable *, int >::const_iterator found(d->taskIndex.constFind(qobject_cast< AnnotatorRunnable * >(sender())));
+        if (found == d->taskIndex.constEnd())
+        {
+            return;
+        }
+
         if (d->running == 0)
         {
             Q_EMIT started();
         }
-
-        --d->queued;
         ++d->running;
+
+        AnnotatorTask & task(d->tasks[found.value()]);
+        task.state = AnnotatorTask::Running;
+        task.timing.started = d->clock.elapsed();
     }
 
-    void AnnotatorRunnablePool::onFinished()
+    void AnnotatorRunnablePool::onFinished(bool skipped)
     {
-        --d->running;
-        ++d->finished;
+        QHash< AnnotatorRunnable *, int >::const_iterator found(d->taskIndex.constFind(qobject_cast< AnnotatorRunnable * >(sender())));
+        if (found == d->taskIndex.constEnd())
+        {
+            return;
+        }
 
-        if (d->running + d->queued == 0)
+        int index = found.value();
+        AnnotatorTask & task(d->tasks[index]);
+        if (task.state == AnnotatorTask::Running)
         {
-            // FIXME only Q_EMIT this when not future queues exist?
-            Q_EMIT finished();
+            --d->running;
+        }
+        task.state = AnnotatorTask::Finished;
+        task.timing.finished = d->clock.elapsed();
+        task.timing.skipped = skipped;
 
-            // Dequeue futures until something is queued, or nothing left
-            bool stop = false;
-            int size = d->futureQueues.size();
-            while (--size >= 0 && !d->futureQueues.isEmpty() && !stop)
+        // Start whatever was waiting only on this
+        foreach (int dependent, task.dependents)
+        {
+            AnnotatorTask & waiting(d->tasks[dependent]);
+            waiting.waitingOn.remove(index);
+            if (waiting.waitingOn.isEmpty() && waiting.state == AnnotatorTask::Waiting)
             {
-                // Let people know this pool just synced
-                Q_EMIT synced();
-
-                QList< QPair< AnnotatorRunnable *, int > > futureQueue(d->futureQueues.takeFirst());
-                SyncPointEmitter * emitter = d->futureEmitters.takeFirst();
-
-                // Queue next set of runnables
-                if (!futureQueue.isEmpty())
-                {
-                    QListIterator< QPair< AnnotatorRunnable *, int > > f_iter(futureQueue);
-                    while (f_iter.hasNext())
-                    {
-                        QPair< AnnotatorRunnable *, int > info(f_iter.next());
-                        _start(info.first, info.second);
-                        --d->futureQueued;
-                    }
-                    stop = true;
-                }
+                waiting.readiedBy = index;
+                _start(dependent);
+            }
+        }
 
-                if (emitter)
-                {
-                    emitter->emitSyncPoint();
-                    delete emitter;
-                }
+        // Emit any sync points now reached
+        while (d->firstUnfinished < d->tasks.size() && d->tasks.at(d->firstUnfinished).state == AnnotatorTask::Finished)
+        {
+            ++d->firstUnfinished;
+        }
+        while (!d->emitters.isEmpty() && d->emitters.first().first <= d->firstUnfinished)
+        {
+            SyncPointEmitter * emitter = d->emitters.takeFirst().second;
+            Q_EMIT synced();
+            if (emitter)
+            {
+                emitter->emitSyncPoint();
+                delete emitter;
             }
         }
+
+        if (!isActive())
+        {
+            Q_EMIT finished();
+        }
     }
 
     void AnnotatorRunnablePool::skip()
@@ -139,31 +204,43 @@ namespace Papyro
             runnable.next()->skip();
         }
 
-        // Remove future queues
-        QListIterator< QList< QPair< AnnotatorRunnable *, int > > > futureQueues(d->futureQueues);
-        while (futureQueues.hasNext())
+        // Remove runnables still waiting to be started
+        for (int i = d->firstUnfinished; i < d->tasks.size(); ++i)
         {
-            QListIterator< QPair< AnnotatorRunnable *, int > > futureQueue(futureQueues.next());
-            while (futureQueue.hasNext())
+            AnnotatorTask & task(d->tasks[i]);
+            if (task.state == AnnotatorTask::Waiting)
             {
-                delete futureQueue.next().first;
-                --d->futureQueued;
+                d->taskIndex.remove(task.runnable);
+                delete task.runnable;
+                task.runnable = 0;
+                task.waitingOn.clear();
+                task.state = AnnotatorTask::Finished;
+                task.timing.skipped = true;
             }
         }
-        d->futureQueues.clear();
+        while (d->firstUnfinished < d->tasks.size() && d->tasks.at(d->firstUnfinished).state == AnnotatorTask::Finished)
+        {
+            ++d->firstUnfinished;
+        }
 
         // Emit all pending sync points
-        QListIterator< SyncPointEmitter * > emitters(d->futureEmitters);
+        QListIterator< QPair< int, SyncPointEmitter * > > emitters(d->emitters);
         while (emitters.hasNext())
         {
-            SyncPointEmitter * emitter = emitters.next();
+            SyncPointEmitter * emitter = emitters.next().second;
             if (emitter)
             {
                 emitter->emitSyncPoint();
                 delete emitter;
             }
         }
-        d->futureEmitters.clear();
+        d->emitters.clear();
+
+        // Nothing was running, so there is nothing left to wait for
+        if (!isActive())
+        {
+            d->reset();
+        }
 
         // Sync for further runnables
         sync();
@@ -178,26 +255,82 @@ namespace Papyro
         }
     }
 
-    void AnnotatorRunnablePool::_start(AnnotatorRunnable * runnable, int priority)
+    void AnnotatorRunnablePool::_start(int index)
     {
-        connect(runnable, SIGNAL(started()), this, SLOT(onStarted()));
-        connect(runnable, SIGNAL(finished()), this, SLOT(onFinished()));
-        d->threadPool.start(runnable, priority);
-        ++d->queued;
+        AnnotatorTask & task(d->tasks[index]);
+        task.state = AnnotatorTask::Queued;
+        task.timing.ready = d->clock.elapsed();
+        d->threadPool.start(task.runnable, task.priority);
     }
 
     void AnnotatorRunnablePool::start(AnnotatorRunnable * runnable, int priority)
     {
-        runnable->setParent(this);
+        // Once the pool has gone idle, a new graph is begun; until then the last one
+        // is kept for its timings
+        if (!isActive())
+        {
+            d->reset();
+        }
 
-        if (d->futureQueues.isEmpty())
+        // The pool keeps its runnables until it next goes idle
+        runnable->setAutoDelete(false);
+        runnable->setParent(this);
+        connect(runnable, SIGNAL(started()), this, SLOT(onStarted()));
+        connect(runnable, SIGNAL(finished(bool)), this, SLOT(onFinished(bool)));
+
+        int index = d->tasks.size();
+        AnnotatorTask task;
+        task.runnable = runnable;
+        task.priority = priority;
+        task.state = AnnotatorTask::Waiting;
+        task.consumes = runnable->consumes();
+        task.produces = runnable->produces();
+        task.produces << runnable->eventName();
+        task.readiedBy = -1;
+        task.timing.title = runnable->title();
+        task.timing.eventName = runnable->eventName();
+        task.timing.submitted = d->clock.elapsed();
+        task.timing.ready = -1;
+        task.timing.started = -1;
+        task.timing.finished = -1;
+        task.timing.skipped = false;
+
+        // Runnables that declare what they consume wait only on the unfinished
+        // runnables that produce it; any others wait on everything before the
+        // last sync point
+        for (int i = d->firstUnfinished; i < index; ++i)
         {
-            _start(runnable, priority);
+            AnnotatorTask & earlier(d->tasks[i]);
+            if (earlier.state != AnnotatorTask::Finished)
+            {
+                bool dependsOn = false;
+                if (task.consumes.isEmpty())
+                {
+                    dependsOn = (i < d->barrier);
+                }
+                else
+                {
+                    foreach (const QString & consumed, task.consumes)
+                    {
+                        if ((dependsOn = earlier.produces.contains(consumed)))
+                        {
+                            break;
+                        }
+                    }
+                }
+                if (dependsOn)
+                {
+                    task.waitingOn.insert(i);
+                    earlier.dependents.append(index);
+                }
+            }
         }
-        else
+
+        d->tasks.append(task);
+        d->taskIndex[runnable] = index;
+        if (task.waitingOn.isEmpty())
         {
-            d->futureQueues.back().append(qMakePair(runnable, priority));
-            ++d->futureQueued;
+            _start(index);
         }
     }
 
@@ -209,29 +342,36 @@ namespace Papyro
 
     void AnnotatorRunnablePool::sync(const QObject * receiver, const char * method, Qt::ConnectionType type)
     {
+        // Runnables given from now on (that don't say otherwise) wait for those given
+        // before now
+        d->barrier = d->tasks.size();
+
         // If reciever/method pair is specified, then sync (or Q_EMIT synced() immediately if queue is empty)
         if (receiver && method)
         {
             SyncPointEmitter * emitter = new SyncPointEmitter(this);
             connect(emitter, SIGNAL(synced()), receiver, method, type);
 
-            if (d->running + d->queued == 0)
+            if (!isActive())
             {
                 emitter->emitSyncPoint();
                 delete emitter;
             }
             else
             {
-                d->futureQueues.append(QList< QPair< AnnotatorRunnable *, int > >());
-                d->futureEmitters.append(emitter);
+                d->emitters.append(qMakePair(d->tasks.size(), emitter));
             }
         }
-        // Add a new sync point if required
-        else if (d->running + d->queued > 0 && (d->futureQueues.isEmpty() || !d->futureQueues.back().isEmpty()))
+    }
+
+    QList< AnnotatorTiming > AnnotatorRunnablePool::timings() const
+    {
+        QList< AnnotatorTiming > timings;
+        foreach (const AnnotatorTask & task, d->tasks)
         {
-            d->futureQueues.append(QList< QPair< AnnotatorRunnable *, int > >());
-            d->futureEmitters.append(0);
+            timings << task.timing;
         }
+        return timings;
     }
 
     void AnnotatorRunnablePool::waitForDone()
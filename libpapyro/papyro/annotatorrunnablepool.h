@@ -34,6 +34,7 @@
 
 #include <QList>
 #include <QObject>
+#include <QString>
 #include <QThreadPool>
 
 namespace Papyro
@@ -44,6 +45,25 @@ namespace Papyro
 
 
 
+    /// AnnotatorTiming /////////////////////////////////////////////////////////////////
+
+    // When a runnable was handed to the pool, became ready, started and finished,
+    // in milliseconds since the pool last started from idle (-1 if it never got
+    // that far)
+    struct AnnotatorTiming
+    {
+        QString title;
+        QString eventName;
+        qint64 submitted;
+        qint64 ready;
+        qint64 started;
+        qint64 finished;
+        bool skipped;
+    };
+
+
+
+
     /// AnnotatorRunnablePool ///////////////////////////////////////////////////////////
 
     class AnnotatorRunnablePoolPrivate;
@@ -63,6 +83,12 @@ namespace Papyro
         void sync(const QObject * receiver, const char * method, Qt::ConnectionType type = Qt::AutoConnection);
         void waitForDone();
 
+        // Timings of every runnable started by this pool since it was last idle, in
+        // the order given, and the chain of runnables that held up the one to
+        // finish last
+        QList< AnnotatorTiming > criticalPath() const;
+        QList< AnnotatorTiming > timings() const;
+
     Q_SIGNALS:
         void started();
         void synced();
@@ -70,10 +96,10 @@ namespace Papyro
 
     protected Q_SLOTS:
         void onStarted();
-        void onFinished();
+        void onFinished(bool skipped);
 
     protected:
-        void _start(AnnotatorRunnable * runnable, int priority);
+        void _start(int task);
 
     private:
         AnnotatorRunnablePoolPrivate * d;
@@ -32,9 +32,15 @@
 #ifndef PAPYRO_ANNOTATORRUNNABLEPOOL_P_H
 #define PAPYRO_ANNOTATORRUNNABLEPOOL_P_H
 
+#include <papyro/annotatorrunnablepool.h>
+
+#include <QElapsedTimer>
+#include <QHash>
 #include <QList>
 #include <QObject>
 #include <QPair>
+#include <QSet>
+#include <QStringList>
 #include <QThreadPool>
 
 namespace Papyro
@@ -63,18 +69,64 @@ namespace Papyro
 
 
 
+    /// AnnotatorTask ///////////////////////////////////////////////////////////////////
+
+    // A runnable's place in the pool's dependency graph
+    struct AnnotatorTask
+    {
+        enum State {
+            Waiting,
+            Queued,
+            Running,
+            Finished
+        };
+
+        AnnotatorRunnable * runnable;
+        int priority;
+        State state;
+
+        // What this runnable needs before it can start, and what it provides to
+        // those that come after it (which includes the event it handles)
+        QStringList consumes;
+        QStringList produces;
+
+        // Unfinished tasks this one waits on, and those waiting on it
+        QSet< int > waitingOn;
+        QList< int > dependents;
+        // The last of the tasks this one waited on (-1 if none)
+        int readiedBy;
+
+        AnnotatorTiming timing;
+    }; // struct AnnotatorTask
+
+
+
+
     /// AnnotatorRunnablePoolPrivate ////////////////////////////////////////////////////
 
     class AnnotatorRunnablePoolPrivate
     {
     public:
-        int queued;
+        AnnotatorRunnablePoolPrivate();
+
+        // Forget the tasks of an idle pool, so the graph covers only what the
+        // pool is given from now on
+        void reset();
+
         int running;
-        int finished;
-        int futureQueued;
 
-        QList< QList< QPair< AnnotatorRunnable *, int > > > futureQueues;
-        QList< SyncPointEmitter * > futureEmitters;
+        // Every task given to the pool, in order, and which task each runnable is
+        QList< AnnotatorTask > tasks;
+        QHash< AnnotatorRunnable *, int > taskIndex;
+        // Tasks before this one have all finished
+        int firstUnfinished;
+        // Tasks that declare nothing they consume must wait on all before this one
+        int barrier;
+
+        // Sync points waiting on all tasks before the given index
+        QList< QPair< int, SyncPointEmitter * > > emitters;
+
+        QElapsedTimer clock;
         QThreadPool threadPool;
 
     }; // class AnnotatorRunnablePoolPrivate;
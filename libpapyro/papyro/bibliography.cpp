@@ -80,6 +80,7 @@ namespace Athenaeum
         }
         connect(item.get(), SIGNAL(changed(int, QVariant)),
                 this, SLOT(onCitationChanged(int, QVariant)));
+        searchIndex.addItem(item);
     }
 
     void BibliographyPrivate::onCitationChanged(int role, QVariant oldValue)
@@ -93,6 +94,10 @@ namespace Athenaeum
                 ++row;
             }
             if (row < items.count()) {
+                // Reindex before anyone filtering on the change hears of it
+                if (SearchIndex::isIndexed(role)) {
+                    searchIndex.updateItem(items.at(row));
+                }
                 QModelIndex index(bibliography->index(row, 0));
                 QVector< int > roles; roles << Qt::DisplayRole << role;
                 emit dataChanged(index, index, roles);
@@ -112,6 +117,7 @@ namespace Athenaeum
         }
         disconnect(item.get(), SIGNAL(changed(int, QVariant)),
                    this, SLOT(onCitationChanged(int, QVariant)));
+        searchIndex.removeItem(item);
     }
 
 
@@ -159,6 +165,7 @@ namespace Athenaeum
         d->items.clear();
         d->itemsByKey.clear();
         d->itemsById.clear();
+        d->searchIndex.clear();
         endRemoveRows();
     }
 
@@ -535,6 +542,11 @@ namespace Athenaeum
         return false;
     }
 
+    const SearchIndex * Bibliography::searchIndex() const
+    {
+        return &d->searchIndex;
+    }
+
     void Bibliography::setPersistenceModel(PersistenceModel * persistenceModel)
     {
         if (d->persistenceModel) {
@@ -585,6 +597,7 @@ namespace Athenaeum
             taken = d->items.at(idx);
             d->items.remove(idx);
             d->itemsByKey.remove(taken->field(Citation::KeyRole).toString());
+            d->searchIndex.removeItem(taken);
             endRemoveRows();
         }
 
@@ -34,6 +34,7 @@
 
 #include <papyro/bibliography.h>
 #include <papyro/citation.h>
+#include <papyro/searchindex.h>
 
 #include <QMap>
 #include <QMutex>
@@ -65,6 +66,7 @@ namespace Athenaeum
         bool readOnly;
         QString title;
         PersistenceModel * persistenceModel;
+        SearchIndex searchIndex;
 
         void addItemIds(const CitationHandle & item);
         void removeItemIds(const CitationHandle & item);
@@ -105,6 +105,21 @@ namespace Athenaeum
         return (idx >= 0 && idx < d->fields.size()) ? d->fields.at(idx) : null;
     }
 
+    // Built once (and thread-safely), as citations may be parsed in parallel
+    static QMap< QString, Citation::Flag > makeFlagsByName()
+    {
+        QMap< QString, Citation::Flag > mapping;
+        mapping["unread"] = Citation::UnreadFlag;
+        mapping["starred"] = Citation::StarredFlag;
+        return mapping;
+    }
+
+    static const QMap< QString, Citation::Flag > & flagsByName()
+    {
+        static const QMap< QString, Citation::Flag > mapping(makeFlagsByName());
+        return mapping;
+    }
+
     static QVariant jsonToQVariant(cJSON * obj)
     {
         if (obj) {
@@ -204,11 +219,7 @@ namespace Athenaeum
 
                     //// Flags
                     case FlagsRole: {
-                        static QMap< QString, Flag > mapping;
-                        if (mapping.isEmpty()) {
-                            mapping["unread"] = UnreadFlag;
-                            mapping["starred"] = StarredFlag;
-                        }
+                        const QMap< QString, Flag > & mapping(flagsByName());
                         Citation::Flags flags(NoFlags);
                         int count = cJSON_GetArraySize(field);
                         for (int i = 0; i < count; ++i) {
@@ -265,11 +276,7 @@ namespace Athenaeum
                 if (field.isValid()) {
                     switch (role) {
                     case FlagsRole: {
-                        static QMap< QString, Flag > mapping;
-                        if (mapping.isEmpty()) {
-                            mapping["unread"] = UnreadFlag;
-                            mapping["starred"] = StarredFlag;
-                        }
+                        const QMap< QString, Flag > & mapping(flagsByName());
                         Citation::Flags flags(NoFlags);
                         foreach (const QString & flagName, field.toStringList()) {
                             flags |= mapping.value(flagName, NoFlags);
@@ -478,6 +478,12 @@ namespace Athenaeum
         return false;
     }
 
+    const SearchIndex * Collection::searchIndex() const
+    {
+        // Collections share the index of the bibliography they draw from
+        return d->sourceBibliography ? d->sourceBibliography->searchIndex() : 0;
+    }
+
     void Collection::setPersistenceModel(PersistenceModel * persistenceModel)
     {
         if (d->persistenceModel) {
@@ -108,6 +108,10 @@ namespace Athenaeum
         virtual bool removeItem(CitationHandle item);
         virtual CitationHandle takeItemAt(int idx);
 
+        /////////////////////////////////////////////////////////////////////////////////
+        // Full text index of this bibliography's items
+        virtual const SearchIndex * searchIndex() const;
+
         /////////////////////////////////////////////////////////////////////////////////
         // AbstractItemModel methods
 
@@ -34,18 +34,29 @@
 
 #include <boost/weak_ptr.hpp>
 
+#include <QCache>
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDir>
 #include <QDomDocument>
 #include <QFile>
 #include <QJsonDocument>
+#include <QJsonObject>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QResource>
+#include <QSaveFile>
 #include <QScriptEngine>
 #include <QSettings>
+#include <QSet>
 #include <QString>
 #include <QStringList>
+#include <QThread>
 #include <QVariantMap>
+#include <QWaitCondition>
+#include <QXmlStreamReader>
+
+#include <vector>
 
 #include <QDebug>
 
@@ -90,7 +101,7 @@ namespace Papyro
             QDomElement elem = doc.documentElement();
             QVariant converted = elementToVariant(elem);
 
-            return QString::fromUtf8(QJsonDocument::fromVariant(converted).toJson());
+            return QString::fromUtf8(QJsonDocument::fromVariant(converted).toJson(QJsonDocument::Compact));
         }
 
         QScriptValue retrieveLocale(QScriptContext * context, QScriptEngine * engine)
@@ -106,6 +117,8 @@ namespace Papyro
             if (citeproc.open(QIODevice::ReadOnly)) {
                 QByteArray raw(citeproc.readAll());
                 xml = QString::fromUtf8(raw.constData(), raw.size());
+            } else {
+                return engine->undefinedValue();
             }
 
             return engine->evaluate("(" + xml + ")", Utopia::resource_path() + "/citeproc/locales/" + lang + ".json");
@@ -148,23 +161,65 @@ namespace Papyro
             return ret;
         }
 
+        // Find a style's title without compiling it
+        QString styleTitle(const QFileInfo & styleFileInfo)
+        {
+            QFile file(styleFileInfo.filePath());
+            if (file.open(QIODevice::ReadOnly)) {
+                if (styleFileInfo.suffix() == "csl") {
+                    // Stream only as far as style/info/title
+                    QXmlStreamReader xml(&file);
+                    QStringList path;
+                    while (!xml.atEnd()) {
+                        xml.readNext();
+                        if (xml.isStartElement()) {
+                            path << xml.name().toString();
+                            if (path.size() == 3 && path.at(1) == "info" && path.at(2) == "title") {
+                                return xml.readElementText().trimmed();
+                            }
+                        } else if (xml.isEndElement()) {
+                            path.removeLast();
+                            if (path.size() == 1 && xml.name() == "info") {
+                                break;
+                            }
+                        }
+                    }
+                } else {
+                    QVariantMap style(QJsonDocument::fromJson(file.readAll()).toVariant().toMap());
+                    foreach (const QVariant & info, style.value("children").toList()) {
+                        if (info.toMap().value("name") == "info") {
+                            foreach (const QVariant & title, info.toMap().value("children").toList()) {
+                                if (title.toMap().value("name") == "title") {
+                                    return title.toMap().value("children").toStringList().join(" ");
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            return QString();
+        }
+
+        // Where the JSON form of a CSL (XML) style file is kept
+        QString compiledStylePath(const QFileInfo & styleFileInfo)
+        {
+            QByteArray hash(QCryptographicHash::hash(styleFileInfo.absoluteFilePath().toUtf8(), QCryptographicHash::Md5).toHex());
+            return Utopia::profile_path() + "/cslcache/" + QString::fromUtf8(hash) + ".json";
+        }
+
+        // Used when no other locale has been configured
+        const QString fallbackLocale("en-GB");
+
     }
 
 
 
 
-    class CSLEnginePrivate
+    class CSLScriptEngine
     {
     public:
-        CSLEnginePrivate()
-            : mutex(QMutex::Recursive)
+        CSLScriptEngine()
         {
-            // Populate from settings
-            QSettings conf;
-            conf.sync();
-            conf.beginGroup("CSLEngine");
-            defaultStyle = conf.value("Default Style", "apa").toString();
-
             // Provide the environment with helper methods
             QScriptValue globalObject = engine.globalObject();
             globalObject.setProperty(QString("retrieveLocale"), engine.newFunction(retrieveLocale));
@@ -178,32 +233,85 @@ namespace Papyro
             foreach (const QString & source, sources) {
                 evaluate(&engine, resource(source), source);
             }
+        }
+
+        QScriptEngine engine;
+        QSet< QString > installedStyles;
+
+    }; // class CSLScriptEngine
+
+
+
+
+    // A citation to be formatted
+    struct CSLFormatJob
+    {
+        CSLFormatJob()
+            : done(false)
+        {}
+
+        QVariantMap metadata;
+        QString code;
+        QString locale;
+        QString key;
+        QString formatted;
+        bool done;
+    }; // struct CSLFormatJob
+
+
+
+
+    class CSLEnginePrivate;
+
+    // Script engines belong to the thread that created them, so each is
+    // created by a thread of its own, which then formats (with that engine
+    // alone) whichever queued citations it is handed
+    class CSLEngineThread : public QThread
+    {
+    public:
+        CSLEngineThread(CSLEnginePrivate * d)
+            : d(d)
+        {}
+
+    protected:
+        void run();
+
+    private:
+        CSLEnginePrivate * d;
+    }; // class CSLEngineThread
+
+
 
-            // Grab handle for admin functions
-            QScriptValue installLocaleFn = globalObject.property("installLocale");
-            QScriptValue installStyleFn = globalObject.property("installStyle");
 
-            // Install locales
-            QVariantMap localeMap(evaluate(&engine, "(" + resource(Utopia::resource_path() + "/citeproc/locales.json") + ")", Utopia::resource_path() + "/citeproc/locales.json").toVariant().toMap());
+    class CSLEnginePrivate
+    {
+    public:
+        CSLEnginePrivate()
+            : mutex(QMutex::Recursive),
+              maximumEngines(qBound(1, QThread::idealThreadCount(), 4)),
+              idleEngines(0),
+              stopping(false),
+              memo(2000)
+        {
+            // Populate from settings
+            QSettings conf;
+            conf.sync();
+            conf.beginGroup("CSLEngine");
+            defaultStyle = conf.value("Default Style", "apa").toString();
+            defaultLocale = conf.value("Default Locale", fallbackLocale).toString();
+
+            // Register locales; these are only loaded when a style asks for them
+            QVariantMap localeMap(QJsonDocument::fromJson(resource(Utopia::resource_path() + "/citeproc/locales.json").toUtf8()).toVariant().toMap());
             QMapIterator< QString, QVariant > localeMapIter(localeMap);
             while (localeMapIter.hasNext()) {
                 localeMapIter.next();
                 QString code = localeMapIter.key();
-                QString description = localeMapIter.value().toString();
-                if (code != "description") {
-                    QString locale = resource(Utopia::resource_path() + "/citeproc/locales/" + code + ".json", false);
-                    if (!locale.isEmpty()) {
-                        QScriptValueList args;
-                        args << engine.toScriptValue(code);
-                        args << engine.toScriptValue(description);
-                        args << engine.evaluate("(" + locale + ")");
-                        installLocaleFn.call(globalObject, args);
-                        qDebug() << "CSLEngine: Loaded locale" << code;
-                    }
+                if (code != "description" && QFile::exists(Utopia::resource_path() + "/citeproc/locales/" + code + ".json")) {
+                    locales[code] = localeMapIter.value().toString();
                 }
             }
 
-            // Install styles
+            // Register styles; these are only compiled when first used
             QDir stylesDir(Utopia::resource_path() + "/citeproc/styles");
             QDir userStylesDir(Utopia::profile_path() + "/csl");
             QStringList filters;
@@ -212,35 +320,244 @@ namespace Papyro
             userStylesDir.setNameFilters(filters);
             QFileInfoList styleFiles = stylesDir.entryInfoList() + userStylesDir.entryInfoList();
             foreach (const QFileInfo & styleFileInfo, styleFiles) {
-                QString styleFile = styleFileInfo.fileName();
-                QString code = styleFile.section(".", 0, 0);
-                QString description(code);
-                description = description.replace(QRegExp("[^a-zA-Z0-9]+"), " ").trimmed();
-                QString style = resource(styleFileInfo.filePath());
+                QString code = styleFileInfo.fileName().section(".", 0, 0);
+                QString title = styleTitle(styleFileInfo);
+                if (title.isEmpty()) {
+                    title = code;
+                    title = title.replace(QRegExp("[^a-zA-Z0-9]+"), " ").trimmed();
+                }
+                styles[code] = qMakePair(styleFileInfo, title);
+            }
+        }
+
+        ~CSLEnginePrivate()
+        {
+            // Each thread finishes what is queued, then stops
+            {
+                QMutexLocker guard(&poolMutex);
+                stopping = true;
+                poolCondition.wakeAll();
+            }
+            foreach (CSLEngineThread * engine, engines) {
+                engine->wait();
+            }
+            qDeleteAll(engines);
+        }
+
+        // Guards the defaults, and the registered and compiled styles
+        QString defaultStyle;
+        QString defaultLocale;
+        QMutex mutex;
+
+        // Style code -> (file, title), and locale code -> description
+        QMap< QString, QPair< QFileInfo, QString > > styles;
+        QMap< QString, QString > locales;
+        // Style code -> JSON form of the style
+        QMap< QString, QString > compiledStyles;
+
+        // Threads with a script engine each, formatting queued citations one
+        // at a time; they are started as they are needed
+        QMutex poolMutex;
+        QWaitCondition poolCondition;
+        QWaitCondition jobsDone;
+        QList< CSLEngineThread * > engines;
+        QList< CSLFormatJob * > jobs;
+        int maximumEngines;
+        int idleEngines;
+        bool stopping;
+
+        // (style, locale, item hash) -> formatted citation
+        QMutex memoMutex;
+        QCache< QString, QString > memo;
+
+        QString resolveStyle(const QString & style)
+        {
+            QMutexLocker guard(&mutex);
+            QStringList candidates;
+            candidates << style << defaultStyle << "apa";
+            foreach (const QString & candidate, candidates) {
+                QMapIterator< QString, QPair< QFileInfo, QString > > iter(styles);
+                while (!candidate.isEmpty() && iter.hasNext()) {
+                    iter.next();
+                    if (iter.key().compare(candidate, Qt::CaseInsensitive) == 0) {
+                        return iter.key();
+                    }
+                }
+            }
+            return style;
+        }
+
+        QString compileStyle(const QString & code)
+        {
+            QMutexLocker guard(&mutex);
+            if (!compiledStyles.contains(code) && styles.contains(code)) {
+                const QFileInfo & styleFileInfo(styles[code].first);
+                QString style;
                 if (styleFileInfo.suffix() == "csl") {
-                    style = xmlToJson(style);
+                    // Converted styles are kept on disk until the style changes
+                    QFileInfo compiledFileInfo(compiledStylePath(styleFileInfo));
+                    if (compiledFileInfo.exists() && compiledFileInfo.lastModified() >= styleFileInfo.lastModified()) {
+                        style = resource(compiledFileInfo.filePath(), false);
+                    }
+                    if (style.isEmpty()) {
+                        style = xmlToJson(resource(styleFileInfo.filePath()));
+                        QDir().mkpath(compiledFileInfo.absolutePath());
+                        QSaveFile compiledFile(compiledFileInfo.filePath());
+                        if (!style.isEmpty() && compiledFile.open(QIODevice::WriteOnly)) {
+                            compiledFile.write(style.toUtf8());
+                            compiledFile.commit();
+                        }
+                    }
+                } else {
+                    style = resource(styleFileInfo.filePath());
                 }
-                if (!style.isEmpty()) {
+                if (style.isEmpty()) {
+                    qDebug() << "CSLEngine: Could not load style" << styleFileInfo.fileName();
+                } else {
+                    qDebug() << "CSLEngine: Loaded style" << styleFileInfo.fileName();
+                }
+                compiledStyles[code] = style;
+            }
+            return compiledStyles.value(code);
+        }
+
+        QString resolveLocale(const QString & locale)
+        {
+            QMutexLocker guard(&mutex);
+            return locale.isEmpty() ? defaultLocale : locale;
+        }
+
+        QString titleOf(const QString & code)
+        {
+            QMutexLocker guard(&mutex);
+            return styles.value(code).second;
+        }
+
+        // A job for the given citation, unless it has already been formatted
+        bool prepare(CSLFormatJob * job, const QVariantMap & metadata, const QString & style, const QString & locale)
+        {
+            job->metadata = metadata;
+            job->code = resolveStyle(style);
+            job->locale = resolveLocale(locale);
+            QByteArray itemHash(QCryptographicHash::hash(QJsonDocument(QJsonObject::fromVariantMap(metadata)).toJson(QJsonDocument::Compact), QCryptographicHash::Sha1));
+            job->key = job->code + "\n" + job->locale + "\n" + QString::fromLatin1(itemHash.toHex());
+
+            QMutexLocker guard(&memoMutex);
+            if (QString * formatted = memo.object(job->key)) {
+                job->formatted = *formatted;
+                job->done = true;
+            }
+            return !job->done;
+        }
+
+        // Queue the given jobs, and wait for them to be done
+        void run(const QList< CSLFormatJob * > & toRun)
+        {
+            if (toRun.isEmpty()) {
+                return;
+            }
+
+            {
+                QMutexLocker guard(&poolMutex);
+                jobs << toRun;
+                int wanted = qMin(jobs.size() - idleEngines, maximumEngines - engines.size());
+                for (int i = 0; i < wanted; ++i) {
+                    CSLEngineThread * engine = new CSLEngineThread(this);
+                    engines << engine;
+                    engine->start();
+                }
+                poolCondition.wakeAll();
+                foreach (CSLFormatJob * job, toRun) {
+                    while (!job->done) {
+                        jobsDone.wait(&poolMutex);
+                    }
+                }
+            }
+
+            QMutexLocker guard(&memoMutex);
+            foreach (CSLFormatJob * job, toRun) {
+                if (!job->formatted.isEmpty()) {
+                    memo.insert(job->key, new QString(job->formatted));
+                }
+            }
+        }
+
+        // Called by each engine's thread, to format queued citations until stopped
+        void serve(CSLScriptEngine * cslScriptEngine)
+        {
+            QMutexLocker guard(&poolMutex);
+            while (true) {
+                ++idleEngines;
+                while (jobs.isEmpty() && !stopping) {
+                    poolCondition.wait(&poolMutex);
+                }
+                --idleEngines;
+                if (jobs.isEmpty()) {
+                    break;
+                }
+                CSLFormatJob * job = jobs.takeFirst();
+                guard.unlock();
+                QString formatted(format(cslScriptEngine, job->metadata, job->code, job->locale));
+                guard.relock();
+                job->formatted = formatted;
+                job->done = true;
+                jobsDone.wakeAll();
+            }
+        }
+
+        QString format(CSLScriptEngine * cslScriptEngine, const QVariantMap & metadata, const QString & code, const QString & locale)
+        {
+            QString formatted;
+            QScriptEngine & engine(cslScriptEngine->engine);
+            QScriptValue globalObject = engine.globalObject();
+
+            // Install the style into this engine on first use
+            if (!cslScriptEngine->installedStyles.contains(code)) {
+                QString json(compileStyle(code));
+                if (!json.isEmpty()) {
                     QScriptValueList args;
                     args << engine.toScriptValue(code);
-                    args << engine.toScriptValue(description);
-                    args << engine.evaluate("(" + style + ")");
-                    installStyleFn.call(globalObject, args);
-                    qDebug() << "CSLEngine: Loaded style" << styleFile;
+                    args << engine.toScriptValue(titleOf(code));
+                    args << evaluate(&engine, "(" + json + ")");
+                    globalObject.property("installStyle").call(globalObject, args);
+                }
+                cslScriptEngine->installedStyles.insert(code);
+            }
+
+            QScriptValue formatFn = globalObject.property("format");
+            if (formatFn.isFunction()) {
+                QScriptValueList args;
+                args << engine.toScriptValue(metadata);
+                args << engine.toScriptValue(code);
+                args << engine.toScriptValue(locale);
+
+                QScriptValue val = formatFn.call(globalObject, args);
+                if (!engine.hasUncaughtException()) {
+                    formatted = val.toString().trimmed();
                 } else {
-                    qDebug() << "CSLEngine: Could not load style" << styleFile;
+                    qDebug() << "EXCEPTION ---" << val.toString();;
+                    qDebug() << engine.uncaughtException().toString();
+                    foreach (QString line, engine.uncaughtExceptionBacktrace()) {
+                        qDebug() << line;
+                    }
+                    engine.clearExceptions();
                 }
+            } else {
+                qDebug() << "ERROR: format doesn't seem to be a function object";
             }
+            return formatted;
         }
 
-        ~CSLEnginePrivate()
-        {}
+    }; // class CSLEnginePrivate
 
-        QString defaultStyle;
-        QScriptEngine engine;
-        QMutex mutex;
 
-    }; // class CSLEnginePrivate
+
+
+    void CSLEngineThread::run()
+    {
+        CSLScriptEngine engine;
+        d->serve(&engine);
+    }
 
 
 
@@ -258,24 +575,10 @@ namespace Papyro
     {
         QMutexLocker guard(&d->mutex);
         QVariantMap locales;
-        QScriptValue globalObject = d->engine.globalObject();
-        QScriptValue getLocalesFn = globalObject.property("getLocales");
-        if (getLocalesFn.isFunction()) {
-            QVariantMap map(getLocalesFn.call(globalObject).toVariant().toMap());
-            if (!d->engine.hasUncaughtException()) {
-                QMapIterator< QString, QVariant > iter(map);
-                while (iter.hasNext()) {
-                    iter.next();
-                    locales[iter.key()] = iter.value();
-                }
-            } else {
-                qDebug() << "EXCEPTION";
-                qDebug() << d->engine.uncaughtException().toString();
-                foreach (QString line, d->engine.uncaughtExceptionBacktrace()) {
-                    qDebug() << line;
-                }
-                d->engine.clearExceptions();
-            }
+        QMapIterator< QString, QString > iter(d->locales);
+        while (iter.hasNext()) {
+            iter.next();
+            locales[iter.key()] = iter.value();
         }
         return locales;
     }
@@ -284,61 +587,52 @@ namespace Papyro
     {
         QMutexLocker guard(&d->mutex);
         QVariantMap styles;
-        QScriptValue globalObject = d->engine.globalObject();
-        QScriptValue getStylesFn = globalObject.property("getStyles");
-        if (getStylesFn.isFunction()) {
-            QVariantMap map(getStylesFn.call(globalObject).toVariant().toMap());
-            if (!d->engine.hasUncaughtException()) {
-                QMapIterator< QString, QVariant > iter(map);
-                while (iter.hasNext()) {
-                    iter.next();
-                    styles[iter.key()] = iter.value();
-                }
-            } else {
-                qDebug() << "EXCEPTION";
-                qDebug() << d->engine.uncaughtException().toString();
-                foreach (QString line, d->engine.uncaughtExceptionBacktrace()) {
-                    qDebug() << line;
-                }
-                d->engine.clearExceptions();
-            }
+        QMapIterator< QString, QPair< QFileInfo, QString > > iter(d->styles);
+        while (iter.hasNext()) {
+            iter.next();
+            styles[iter.key()] = iter.value().second;
         }
         return styles;
     }
 
-    const QString & CSLEngine::defaultStyle() const
+    QString CSLEngine::defaultLocale() const
     {
         QMutexLocker guard(&d->mutex);
-        return d->defaultStyle;
+        return d->defaultLocale;
     }
 
-    QString CSLEngine::format(const QVariantMap & metadata, const QString & style)
+    QString CSLEngine::defaultStyle() const
     {
         QMutexLocker guard(&d->mutex);
-        QString formatted;
-        QScriptValue globalObject = d->engine.globalObject();
-        QScriptValue formatFn = globalObject.property("format");
-        if (formatFn.isFunction()) {
-            QScriptValueList args;
-            args << d->engine.toScriptValue(metadata);
-            args << d->engine.toScriptValue(style);
-            args << d->engine.toScriptValue(defaultStyle());
-
-            QScriptValue val = formatFn.call(globalObject, args);
-            if (!d->engine.hasUncaughtException()) {
-                formatted = val.toString();
-            } else {
-                qDebug() << "EXCEPTION ---" << val.toString();;
-                qDebug() << d->engine.uncaughtException().toString();
-                foreach (QString line, d->engine.uncaughtExceptionBacktrace()) {
-                    qDebug() << line;
-                }
-                d->engine.clearExceptions();
+        return d->defaultStyle;
+    }
+
+    QString CSLEngine::format(const QVariantMap & metadata, const QString & style, const QString & locale)
+    {
+        CSLFormatJob job;
+        if (d->prepare(&job, metadata, style, locale)) {
+            d->run(QList< CSLFormatJob * >() << &job);
+        }
+        return job.formatted;
+    }
+
+    QStringList CSLEngine::format(const QList< QVariantMap > & metadata, const QString & style, const QString & locale)
+    {
+        // Each citation is formatted by whichever engine in the pool is free
+        std::vector< CSLFormatJob > jobs(metadata.size());
+        QList< CSLFormatJob * > toRun;
+        for (int i = 0; i < metadata.size(); ++i) {
+            if (d->prepare(&jobs[i], metadata.at(i), style, locale)) {
+                toRun << &jobs[i];
             }
-        } else {
-            qDebug() << "ERROR: format doesn't seem to be a function object";
         }
-        return formatted.trimmed();
+        d->run(toRun);
+
+        QStringList formatted;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            formatted << jobs[i].formatted;
+        }
+        return formatted;
     }
 
     boost::shared_ptr< CSLEngine > CSLEngine::instance()
@@ -352,6 +646,12 @@ namespace Papyro
         return shared;
     }
 
+    void CSLEngine::setDefaultLocale(const QString & defaultLocale)
+    {
+        QMutexLocker guard(&d->mutex);
+        d->defaultLocale = defaultLocale;
+    }
+
     void CSLEngine::setDefaultStyle(const QString & defaultStyle)
     {
         QMutexLocker guard(&d->mutex);
@@ -32,8 +32,10 @@
 #ifndef PAPYRO_CSLENGINE_H
 #define PAPYRO_CSLENGINE_H
 
+#include <QList>
 #include <QObject>
 #include <QString>
+#include <QStringList>
 #include <QVariantMap>
 
 #if !defined(Q_MOC_RUN) || QT_VERSION >= 0x050000
@@ -53,6 +55,9 @@ namespace Papyro
     class CSLEngine : public QObject
     {
         Q_OBJECT
+        Q_PROPERTY(QString defaultLocale
+                   READ defaultLocale
+                   WRITE setDefaultLocale)
         Q_PROPERTY(QString defaultStyle
                    READ defaultStyle
                    WRITE setDefaultStyle)
@@ -63,9 +68,13 @@ namespace Papyro
 
         QVariantMap availableLocales() const;
         QVariantMap availableStyles() const;
-        const QString & defaultStyle() const;
-        QString format(const QVariantMap & metadata, const QString & style = QString());
+        QString defaultLocale() const;
+        QString defaultStyle() const;
+        // An empty style or locale means the default one
+        QString format(const QVariantMap & metadata, const QString & style = QString(), const QString & locale = QString());
+        QStringList format(const QList< QVariantMap > & metadata, const QString & style = QString(), const QString & locale = QString());
 
+        void setDefaultLocale(const QString & defaultLocale);
         void setDefaultStyle(const QString & defaultStyle);
 
         static boost::shared_ptr< CSLEngine > instance();
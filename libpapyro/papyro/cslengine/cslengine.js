@@ -57,6 +57,29 @@ var Utopia = {
     styles: {},
     locales: {},
     defaultStyle: undefined,
+    item: undefined,
+    serial: 0,
+};
+
+// Shared by every processor; locales are loaded the first time they are needed
+Utopia.sys = {
+    retrieveLocale: function (name) {
+        if (!Utopia.locales[name]) {
+            var locale = retrieveLocale(name);
+            if (locale) {
+                installLocale(name, name, locale);
+            }
+        }
+        if (Utopia.locales[name]) {
+            return Utopia.locales[name].json;
+        }
+    },
+    retrieveItem: function (id) {
+        return Utopia.item;
+    },
+    getAbbreviations: function (name) {
+        return {};
+    },
 };
 
 function installStyle(code, name, style)
@@ -86,6 +109,7 @@ function installStyle(code, name, style)
         code: code,
         name: find(style, 'info/title/text()'),
         json: style,
+        processors: {},
     };
 }
 
@@ -140,42 +164,28 @@ function get_case_insensitive(map, needle) {
     return false;
 }
 
-function format(metadata, style, defaultStyle)
+function format(metadata, style, locale)
 {
-    // Give the metadata an ID if it doesn't already have one
-    if (!metadata.id) {
-        if (metadata.label) {
-            metadata.id = metadata.label;
-        } else {
-            metadata.id = '';
+    // Give every item a fresh ID, as processors are reused between calls
+    Utopia.serial += 1;
+    metadata.id = 'item-' + Utopia.serial;
+
+    // Resolve style, building (and keeping) a processor for each locale it
+    // is used with on first use
+    locale = locale || 'en-GB';
+    var found = get_case_insensitive(Utopia.styles, style) ||
+                get_case_insensitive(Utopia.styles, 'apa');
+    var citeproc = found ? found.processors[locale] : undefined;
+    if (!citeproc) {
+        citeproc = new CSL.Engine(Utopia.sys, found ? found.json : style, locale);
+        if (found) {
+            found.processors[locale] = citeproc;
         }
     }
 
-    // Resolve style
-    found = get_case_insensitive(Utopia.styles, style) ||
-            get_case_insensitive(Utopia.styles, defaultStyle) ||
-            get_case_insensitive(Utopia.styles, 'apa');
-    if (found) {
-        style = found.json;
-    }
-
-    var sys = {
-        retrieveLocale: function (name) {
-            if (Utopia.locales[name]) {
-                return Utopia.locales[name].json;
-            }
-        },
-        retrieveItem: function (id) {
-            return metadata;
-        },
-        getAbbreviations: function (name) {
-            return {};
-        },
-    };
-
     var label = metadata['citation-label'];
 
-    var citeproc = new CSL.Engine(sys, style, 'en-GB')
+    Utopia.item = metadata;
     citeproc.updateItems([metadata.id], true);
     var bib = citeproc.makeBibliography("CITATION_LABEL");
     var formatted = bib[1][0];
@@ -53,6 +53,12 @@ QDataStream & operator >> (QDataStream & str, QList< Spine::AnnotationHandle > &
     return str;
 }
 
+QDataStream & operator << (QDataStream & str, const QList< Spine::AnnotationHandle > & annotationList)
+{
+    qFatal("QList< Spine::AnnotationHandle > cannot be serialised");
+    return str;
+}
+
 namespace Papyro
 {
 
@@ -38,6 +38,7 @@
 
 #include <QDomDocument>
 #include <QFile>
+#include <QFileInfo>
 #include <QFuture>
 #include <QFutureWatcher>
 #include <QNetworkReply>
@@ -266,8 +267,23 @@ namespace Papyro
 
     Spine::DocumentHandle DocumentManager::open(const QString & filename)
     {
-        QFile file(filename);
-        return open(&file);
+        Spine::DocumentHandle document;
+        // Factories are given the filename rather than the file's contents,
+        // so that they may map the file instead of reading all of it
+        if (QFileInfo(filename).isReadable()) {
+            foreach (DocumentFactory * factory, d->factories) {
+                QEventLoop eventLoop;
+                QFutureWatcher< Spine::DocumentHandle > watcher;
+                connect(&watcher, SIGNAL(finished()), &eventLoop, SLOT(quit()));
+                QFuture< Spine::DocumentHandle > future = QtConcurrent::run(boost::bind(static_cast< Spine::DocumentHandle (DocumentFactory::*)( const QString & ) >(&DocumentFactory::create), factory, filename));
+                watcher.setFuture(future);
+                eventLoop.exec();
+                if ((document = future.result())) {
+                    break;
+                }
+            }
+        }
+        return document;
     }
 
     void DocumentManager::registerDocument(Spine::DocumentHandle document)
@@ -31,7 +31,10 @@
 
 #include <papyro/filters.h>
 #include <papyro/abstractbibliography.h>
+#include <papyro/aggregatingproxymodel.h>
+#include <papyro/searchindex.h>
 
+#include <QAbstractProxyModel>
 #include <QDateTime>
 #include <QRegExp>
 
@@ -126,6 +129,99 @@ namespace Athenaeum
 
 
 
+    class FullTextFilterPrivate
+    {
+    public:
+        FullTextFilterPrivate()
+        {}
+
+        QString query;
+
+        // Results of the query against each index consulted, and the revision
+        // of that index they came from
+        QHash< const SearchIndex *, QPair< quint64, QHash< QString, qreal > > > results;
+
+        // The results relevant to this index's model, or 0 if it has no index.
+        // Proxies (e.g. of the starred or recent items, or of several models
+        // at once) are seen through to the bibliography whose index they show.
+        const QHash< QString, qreal > * resultsFor(QModelIndex index)
+        {
+            const AbstractBibliography * bibliography = 0;
+            while (index.isValid() && !(bibliography = qobject_cast< const AbstractBibliography * >(index.model()))) {
+                if (const QAbstractProxyModel * proxy = qobject_cast< const QAbstractProxyModel * >(index.model())) {
+                    index = proxy->mapToSource(index);
+                } else if (const AggregatingProxyModel * aggregate = qobject_cast< const AggregatingProxyModel * >(index.model())) {
+                    index = aggregate->mapToSource(index);
+                } else {
+                    break;
+                }
+            }
+            if (const SearchIndex * searchIndex = bibliography ? bibliography->searchIndex() : 0) {
+                QPair< quint64, QHash< QString, qreal > > & cached = results[searchIndex];
+                quint64 current = searchIndex->revision();
+                if (current != cached.first) {
+                    cached.second = searchIndex->search(query);
+                    cached.first = current;
+                }
+                return &cached.second;
+            }
+            return 0;
+        }
+    }; // class FullTextFilterPrivate
+
+    FullTextFilter::FullTextFilter(const QString & query, QObject * parent)
+        : AbstractFilter(parent), d(new FullTextFilterPrivate)
+    {
+        setQuery(query);
+    }
+
+    FullTextFilter::~FullTextFilter()
+    {
+        delete d;
+    }
+
+    bool FullTextFilter::accepts(const QModelIndex & index) const
+    {
+        if (d->query.isEmpty()) {
+            return true;
+        }
+
+        CitationHandle item(index.data(Citation::ItemRole).value< CitationHandle >());
+        if (!item) {
+            return false;
+        } else if (const QHash< QString, qreal > * results = d->resultsFor(index)) {
+            return results->contains(item->field(Citation::KeyRole).toString());
+        } else {
+            return SearchIndex::matches(item, d->query);
+        }
+    }
+
+    QString FullTextFilter::query() const
+    {
+        return d->query;
+    }
+
+    qreal FullTextFilter::score(const QModelIndex & index) const
+    {
+        CitationHandle item(index.data(Citation::ItemRole).value< CitationHandle >());
+        if (item && !d->query.isEmpty()) {
+            if (const QHash< QString, qreal > * results = d->resultsFor(index)) {
+                return results->value(item->field(Citation::KeyRole).toString(), 0.0);
+            }
+        }
+        return 0.0;
+    }
+
+    void FullTextFilter::setQuery(const QString & query)
+    {
+        d->query = SearchIndex::tokenize(query).join(" ");
+        d->results.clear();
+        emit filterChanged();
+    }
+
+
+
+
     class DateTimeFilterPrivate
     {
     public:
@@ -65,6 +65,27 @@ namespace Athenaeum
 
 
 
+    class FullTextFilterPrivate;
+    class FullTextFilter : public AbstractFilter
+    {
+        Q_OBJECT
+
+    public:
+        FullTextFilter(const QString & query = QString(), QObject * parent = 0);
+        ~FullTextFilter();
+
+        bool accepts(const QModelIndex & index) const;
+        QString query() const;
+        qreal score(const QModelIndex & index) const;
+        void setQuery(const QString & query);
+
+    protected:
+        FullTextFilterPrivate * d;
+    }; // class FullTextFilter
+
+
+
+
     class DateTimeFilterPrivate;
     class DateTimeFilter : public AbstractFilter
     {
@@ -238,6 +238,14 @@ namespace Athenaeum
         relayDataChanged();
     }
 
+    void LibraryModelPrivate::onMasterLoaded(bool /*success*/)
+    {
+        foreach (Collection * collection, unloadedCollections) {
+            collection->persistenceModel()->load(collection);
+        }
+        unloadedCollections.clear();
+    }
+
     void LibraryModelPrivate::onStateChanged(Athenaeum::AbstractBibliography::State state)
     {
         relayDataChanged();
@@ -260,6 +268,10 @@ namespace Athenaeum
         }
         foreach (QAbstractItemModel * model, models) {
             AbstractBibliography * bibliography = qobject_cast< AbstractBibliography * >(model);
+            // Saving a collection before it has been loaded would empty it
+            if (unloadedCollections.contains(qobject_cast< Collection * >(model))) {
+                continue;
+            }
             if (bibliography && bibliography->persistenceModel() && bibliography->persistenceModel()->isSaveable()) {
                 bibliography->persistenceModel()->save(model);
             }
@@ -313,7 +325,8 @@ namespace Athenaeum
 
                 Athenaeum::LocalPersistenceModel * persistenceModel = new Athenaeum::LocalPersistenceModel(masterDir.absolutePath(), d->master);
                 d->master->setPersistenceModel(persistenceModel);
-                persistenceModel->load(d->master);
+                // The master loads in the background, its items arriving in batches
+                connect(persistenceModel, SIGNAL(loaded(bool)), d, SLOT(onMasterLoaded(bool)));
                 d->starred = new SortFilterProxyModel(this);
                 d->starred->setFilter(new StarredFilter(d->starred));
                 d->starred->setSourceModel(d->master);
@@ -335,12 +348,15 @@ namespace Athenaeum
                         Collection * collection = new Collection(d->master, this);
                         Athenaeum::CollectionPersistenceModel * persistenceModel = new Athenaeum::CollectionPersistenceModel(dir.absoluteFilePath(), collection);
                         collection->setPersistenceModel(persistenceModel);
-                        persistenceModel->load(collection);
+                        d->unloadedCollections.append(collection);
                         appendModel(collection);
                     }
                 } else {
                     qDebug() << "=== Could not open collections directory";
                 }
+
+                // Now the collections are ready to be loaded once it is, load the master
+                d->master->persistenceModel()->load(d->master);
             }
         } else {
             qDebug() << "=== Could not open data directory";
@@ -988,6 +1004,7 @@ namespace Athenaeum
             //int row = d->models.size();
             beginRemoveRows(parent, idx, idx);
             d->models.removeAt(idx);
+            d->unloadedCollections.removeAll(qobject_cast< Collection * >(model));
             d->disconnectModel(model);
             AbstractBibliography * bibliography = dynamic_cast< AbstractBibliography * >(model);
             if (bibliography && bibliography->persistenceModel()) {
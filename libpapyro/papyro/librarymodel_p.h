@@ -63,6 +63,7 @@ namespace Athenaeum
     };
 
     class Bibliography;
+    class Collection;
     class RemoteQueryBibliography;
     class ResolverQueue;
     class SortFilterProxyModel;
@@ -87,6 +88,9 @@ namespace Athenaeum
         QStringList mimeTypes;
         ResolverQueue * resolverQueue;
 
+        // Collections refer to the master's items, so can't be loaded until it is
+        QList< Collection * > unloadedCollections;
+
         bool noCollectionPlaceholder;
         bool noWatchPlaceholder;
 
@@ -112,6 +116,9 @@ namespace Athenaeum
         void onStateChanged(Athenaeum::AbstractBibliography::State state);
         void onTitleChanged(const QString & title);
 
+        // Loading of the master bibliography
+        void onMasterLoaded(bool success);
+
     signals:
         void dataChanged(const QModelIndex &, const QModelIndex &);
     }; // class LibraryModelPrivate
@@ -96,10 +96,7 @@ var utopia = {
                         container.data('initial_citation', initial_citation);
                         citation.label = initial_citation.label;
                         citation.order = initial_citation.order;
-                        console.log(citation.unstructured, citation.label);
-                        if (citation.unstructured && citation.label) {
-                            citation.unstructured = citation.unstructured.replace(new RegExp('^[^a-z0-9]*'+citation.label+'[^a-z0-9]*', 'i'), '');
-                        }
+                        utopia.citation._stripLabel(citation);
                         container.data('citation', citation);
                         // Format and add content
                         utopia.citation.reformat(container);
@@ -147,6 +144,32 @@ var utopia = {
                     }
                 }
             },
+            _stripLabel: function (citation) {
+                if (citation.unstructured && citation.label) {
+                    citation.unstructured = citation.unstructured.replace(new RegExp('^[^a-z0-9]*'+citation.label+'[^a-z0-9]*', 'i'), '');
+                }
+            },
+            _imbueAll: function (containers) {
+                // Citations rendered as they are (not processed and without
+                // links) are formatted together, in parallel, beforehand
+                var ready = containers.filter(function () {
+                    var container = $(this);
+                    return container.data('status') != 'live' && !container.data('process') && !container.data('links');
+                });
+                var citations = ready.map(function () {
+                    // As it will be once rendered (see _imbue)
+                    var citation = $.extend({}, $(this).data('citation'));
+                    utopia.citation._stripLabel(citation);
+                    return citation;
+                }).get();
+                if (citations.length > 1) {
+                    var formatted = utopia.citation.formatAll(citations);
+                    ready.each(function (index) {
+                        $(this).data('formatted', formatted[index]);
+                    });
+                }
+                containers.each(utopia.citation._imbue);
+            },
             _orderLinks: function (citation) {
                 if (citation.links) {
                     citation.links.sort(function (c1, c2) {
@@ -212,12 +235,18 @@ var utopia = {
                 return a;
             },
             _reformatAll: function () {
-                // When the default citation format has changed, update all visible citations
-                $('.-papyro-internal-citation').each(function () {
+                // When the default citation format has changed, update all
+                // visible citations, formatting them together
+                var live = $('.-papyro-internal-citation').filter(function () {
+                    return $(this).data('status') == 'live';
+                });
+                var formatted = utopia.citation.formatAll(live.map(function () {
+                    return $(this).data('citation');
+                }).get());
+                live.each(function (index) {
                     var container = $(this);
-                    if (container.data('status') == 'live') {
-                        this.reformat(container);
-                    }
+                    container.data('formatted', formatted[index]);
+                    utopia.citation.reformat(container);
                 });
             },
             reformat: function (container) {
@@ -225,7 +254,12 @@ var utopia = {
                 var content = container.find('.content');
                 var oldHeight = container.height();
                 console.log(container);
-                var html = this.format(citation);
+                var html = container.data('formatted');
+                if (html === undefined) {
+                    html = this.format(citation);
+                } else {
+                    container.removeData('formatted');
+                }
                 content.html(html);
                 var newHeight = container.height();
                 container.height(oldHeight);
@@ -240,6 +274,7 @@ var utopia = {
             styles: window.control.availableCitationStyles,
             defaultStyle: window.control.defaultCitationStyle,
             format: window.control.formatCitation,
+            formatAll: window.control.formatCitations,
             identify: function (metadata, fn) {
                 utopia.citation._resolveMetadata(metadata, 'identify', fn);
             },
@@ -607,7 +642,7 @@ var utopia = {
             });
 
             // Make sure citations are dealt with properly
-            obj.find('.-papyro-internal-citation[data-citation]').each(utopia.citation._imbue);
+            utopia.citation._imbueAll(obj.find('.-papyro-internal-citation[data-citation]'));
 
             // Hyphenate appropriate elements
             //Hyphenator.config({
@@ -75,6 +75,7 @@
 #include <QResizeEvent>
 #include <QRunnable>
 #include <boost/scoped_ptr.hpp>
+#include <QSet>
 #include <QSettings>
 #include <QSignalMapper>
 #include <QTemporaryFile>
@@ -380,71 +381,11 @@ bool operator < (const QRectF & lhs, const QRectF & rhs)
 namespace Papyro
 {
 
-    /// PageViewRenderThread //////////////////////////////////////////////////////////////////////
+    // Size (in device pixels) of the tiles used to draw zoomed-in pages, and
+    // the largest page image (likewise) that is rendered in one piece
+    static const int TileSize = 256;
+    static const int MaximumPageImageSize = 2560;
 
-    PageViewRenderThread::PageViewRenderThread(PageView * pageView)
-        : QThread(pageView), _pageView(pageView), _dirty(false)
-    {
-        QObject::connect(this, SIGNAL(finished()), pageView, SLOT(renderThreadFinished()));
-    }
-
-    PageViewRenderThread::~PageViewRenderThread() {}
-
-    bool PageViewRenderThread::isDirty()
-    {
-        QMutexLocker lock(&this->_mutex);
-        return this->_dirty;
-    }
-
-    QImage PageViewRenderThread::image()
-    {
-        QMutexLocker lock(&this->_mutex);
-        return this->_image;
-    }
-
-    void PageViewRenderThread::run()
-    {
-        // Get parameters of this rendering
-        QSize size;
-        QColor paper;
-        this->getTarget(&size, &paper);
-        Spine::Image i;
-
-        // Render
-        {
-            QMutexLocker lock(&this->_globalMutex);
-            if (this->_pageView) {
-              i = this->_pageView->page()->render(size_t(size.width()),
-                                                  size_t(size.height()));
-            }
-        }
-
-        // Set image
-        QMutexLocker lock(&this->_mutex);
-        this->_image = qImageFromSpineImage(&i);
-    }
-
-    void PageViewRenderThread::setTarget(QSize size, QColor color)
-    {
-        QMutexLocker lock(&this->_mutex);
-        if (size != this->_size ||
-            color != this->_color)
-        {
-            this->_dirty = true;
-        }
-        this->_size = size;
-        this->_color = color;
-    }
-
-    void PageViewRenderThread::getTarget(QSize * size, QColor * color)
-    {
-        QMutexLocker lock(&this->_mutex);
-        *size = this->_size * Utopia::retinaScaling();
-        *color = this->_color;
-        this->_dirty = false;
-    }
-
-    QMutex PageViewRenderThread::_globalMutex;
 
 
 
@@ -457,16 +398,22 @@ namespace Papyro
           userTransformDegrees(0),
           rotateMapper(0),
           rotateMenu(0),
-          renderThread(new PageViewRenderThread(pageView)),
+          renderScheduler(RenderScheduler::instance()),
           imageCache(QString(":page-cache:%1").arg((qlonglong) pageView->window())),
+          tileCache(QString(":tile-cache:%1").arg((qlonglong) pageView->window())),
           dragging(false),
           multiClick(false),
           tripleClick(false),
           imageFormatManager(Utopia::ImageFormatManager::instance())
     {
-        // Seems reasonable that no more than 20 pages will be visible at once
-        // in a single window
-        imageCache.setMaximumSize(20);
+        // Bounded by what the pixels occupy rather than how many images
+        // there are, as a window full of thumbnail-sized pages costs far
+        // less than one page at full screen on a retina display. Room
+        // enough for a screenful of pages at once...
+        imageCache.setMaximumCost(128 * 1024 * 1024);
+        // ...and for the tiles covering what is visible at high zoom, with
+        // some left over for recently visited parts of the pages
+        tileCache.setMaximumCost(64 * 1024 * 1024);
     }
 
     void PageViewPrivate::browseUrl(const QString & url, const QString & target)
@@ -501,6 +448,113 @@ namespace Papyro
         return pageRect().size();
     }
 
+    // Tiles are rendered at one of a fixed set of scales (quarter octaves of
+    // device pixels per point), so that they can be reused across small
+    // changes of zoom
+    int PageViewPrivate::tileBucket(double scale)
+    {
+        return (int) ceil(log(scale) / log(2.0) * 4.0 - 0.01);
+    }
+
+    QList< PageViewTile > PageViewPrivate::tiles(int bucket, const QRectF & visible, const QSizeF & imageSize) const
+    {
+        QList< PageViewTile > tiles;
+        const double scale = pow(2.0, bucket / 4.0);
+        const QSizeF size(pageSize());
+        const double toTile = scale * size.width() / imageSize.width();
+
+        // The page's extent, and the visible part of it, in tile pixels
+        const int width = (int) ceil(size.width() * scale);
+        const int height = (int) ceil(size.height() * scale);
+        QRect area(QRectF(visible.topLeft() * toTile, visible.size() * toTile).toAlignedRect());
+        area &= QRect(0, 0, width, height);
+
+        for (int y = area.top() / TileSize; y * TileSize <= area.bottom(); ++y) {
+            for (int x = area.left() / TileSize; x * TileSize <= area.right(); ++x) {
+                PageViewTile tile;
+                tile.request.key = QString("%1:%2:%3:%4").arg(cacheName).arg(bucket).arg(x).arg(y);
+                tile.request.document = document;
+                tile.request.page = pageView->pageNumber();
+                int w = qMin(TileSize, width - x * TileSize);
+                int h = qMin(TileSize, height - y * TileSize);
+                // Nudged so the slice lands on whole pixels when rendered
+                double x1 = (x * TileSize + 0.25) / scale;
+                double y1 = (y * TileSize + 0.25) / scale;
+                tile.rect = QRect(x * TileSize, y * TileSize, w, h);
+                tile.request.slice = Spine::BoundingBox(x1, y1, x1 + (w + 0.5) / scale, y1 + (h + 0.5) / scale);
+                tile.request.resolution = 72.0 * scale;
+                tiles.append(tile);
+            }
+        }
+        return tiles;
+    }
+
+    void PageViewPrivate::paintTiles(QPainter & painter, const QRectF & visible, const QSize & imageSize)
+    {
+        const double scale = imageSize.width() / pageSize().width();
+        const int bucket = tileBucket(scale * Utopia::retinaScaling());
+
+        // Remember recent zoom levels, whose tiles can stand in for the
+        // current ones until they have been rendered
+        tileBuckets.removeAll(bucket);
+        tileBuckets.append(bucket);
+        while (tileBuckets.size() > 3) {
+            tileBuckets.removeFirst();
+        }
+        QList< int > buckets(tileBuckets);
+        buckets.removeAll(bucket);
+        qSort(buckets);
+        buckets.append(bucket);
+
+        painter.save();
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        foreach (int b, buckets) {
+            const double toImage = scale / pow(2.0, b / 4.0);
+            foreach (const PageViewTile & tile, tiles(b, visible, imageSize)) {
+                if (tileCache.exists(tile.request.key)) {
+                    QPixmap pixmap(tileCache.get(tile.request.key));
+                    QRectF target(QPointF(tile.rect.topLeft()) * toImage,
+                                  QSizeF(tile.rect.size()) * toImage);
+                    painter.drawPixmap(target, pixmap, QRectF(pixmap.rect()));
+                } else if (b == bucket) {
+                    renderRequests.append(tile.request);
+                }
+            }
+        }
+        painter.restore();
+
+        // Tiles just out of view are rendered ahead of time, but only once
+        // everything visible (in any page view) has been
+        QSet< QString > wanted;
+        foreach (const RenderRequest & request, renderRequests) {
+            wanted.insert(request.key);
+        }
+        const double margin = TileSize / (scale * Utopia::retinaScaling());
+        foreach (const PageViewTile & tile, tiles(bucket, visible.adjusted(-margin, -margin, margin, margin), imageSize)) {
+            if (!tileCache.exists(tile.request.key) && !wanted.contains(tile.request.key)) {
+                prefetchRequests.append(tile.request);
+            }
+        }
+    }
+
+    RenderRequest PageViewPrivate::imageRequest(const QSize & size) const
+    {
+        RenderRequest request;
+        request.size = size * Utopia::retinaScaling();
+        request.key = QString("%1@%2x%3").arg(cacheName).arg(request.size.width()).arg(request.size.height());
+        request.document = document;
+        request.page = pageView->pageNumber();
+        return request;
+    }
+
+    void PageViewPrivate::submitRenderRequests()
+    {
+        renderScheduler->submit(pageView, renderRequests, RenderScheduler::Visible);
+        renderScheduler->submit(pageView, prefetchRequests, RenderScheduler::Prefetch);
+        renderRequests.clear();
+        prefetchRequests.clear();
+    }
+
     // Set interaction state for mouse press
     void PageViewPrivate::setMousePressPos(const QPoint & pos)
     {
@@ -769,8 +823,9 @@ namespace Papyro
         // Disconnect from model
         d->documentProxy.reset();
 
-        // Wait for render thread
-        d->renderThread->wait();
+        // Nothing more to render
+        d->renderScheduler->cancel(this);
+        d->renderedImageKey.clear();
 
         // Clear overlays
         clearSpotlights();
@@ -792,8 +847,9 @@ namespace Papyro
         d->linkedWidgets.clear();
         d->embeddedRects.clear();
 
-        // Clear image cache
+        // Clear image caches
         d->imageCache.clear();
+        d->tileCache.clear();
 
         // Zero state
         d->previousSelectedImageCursor.reset();
@@ -964,6 +1020,22 @@ namespace Papyro
     {
     }
 
+    void PageView::hideEvent(QHideEvent * event)
+    {
+        // Don't keep the render threads busy with pages no-one can see
+        d->renderScheduler->cancel(this, RenderScheduler::Visible);
+        QWidget::hideEvent(event);
+    }
+
+    void PageView::moveEvent(QMoveEvent * event)
+    {
+        // Scrolled out of view, in which case no paint event will follow
+        if (visibleRegion().isEmpty()) {
+            d->renderScheduler->cancel(this, RenderScheduler::Visible);
+        }
+        QWidget::moveEvent(event);
+    }
+
     bool PageView::event(QEvent * event)
     {
         static QTime clickWhen;
@@ -1220,16 +1292,15 @@ namespace Papyro
         return d->cursor->page();
     }
 
-    QPixmap PageView::pageImage(QSize size, QColor paper)
+    QPixmap PageView::pageImage(QSize size, QColor /* paper */)
     {
         QPixmap pageImage = d->imageCache.get(d->cacheName);
 
-        if (size != pageImage.size()) {
-            d->renderThread->setTarget(size, paper);
-            bool running = d->renderThread->isRunning();
-            if (!running) {
-                d->renderThread->start();
-            }
+        // Rendered pages may have since been dropped from the cache
+        RenderRequest request(d->imageRequest(size));
+        d->imageKey = request.key;
+        if (pageImage.isNull() || d->renderedImageKey != d->imageKey) {
+            d->renderRequests.prepend(request);
         }
 
         return pageImage;
@@ -1268,7 +1339,15 @@ namespace Papyro
             // Find the size of the page (before user transform) in screen
             // coordinates
             QSize pImageSize = d->unapplyUserTransform(size()).toSize();
-            QPixmap pImage = pageImage(d->unapplyUserTransform(size()).toSize());
+
+            // Beyond a certain size, the whole page is only rendered at
+            // reduced resolution, and the visible part drawn over it in tiles
+            QSize pBaseSize(pImageSize);
+            bool tiled = qMax(pImageSize.width(), pImageSize.height()) * Utopia::retinaScaling() > MaximumPageImageSize;
+            if (tiled) {
+                pBaseSize.scale(QSize(MaximumPageImageSize, MaximumPageImageSize) / Utopia::retinaScaling(), Qt::KeepAspectRatio);
+            }
+            QPixmap pImage = pageImage(pBaseSize);
 
             if (pImage.isNull())
             {
@@ -1317,6 +1396,11 @@ namespace Papyro
                 painter.drawPixmap(QRect(QPoint(0, 0), pImageSize), pImage);
                 painter.restore();
 
+                if (tiled) {
+                    QRectF visible(transform.inverted().mapRect(QRectF(visibleRegion().boundingRect())));
+                    d->paintTiles(painter, visible, pImageSize);
+                }
+
                 // Scale to current zoom
                 painter.scale(width() / (double) pSize.width(),
                               height() / (double) pSize.height());
@@ -1357,6 +1441,8 @@ namespace Papyro
                 }
             }
         }
+
+        d->submitRenderRequests();
     }
 
     void PageView::populateContextMenuAt(QMenu * menu, const QPoint & pos)
@@ -1444,10 +1530,21 @@ namespace Papyro
         d->temporaryFocus.setFillRule(Qt::WindingFill);
     }
 
-    void PageView::renderThreadFinished()
+    void PageView::renderFinished(const QString & key, const QImage & image)
     {
-        QPixmap pageImage = QPixmap::fromImage(d->renderThread->image());
-        d->imageCache.put(pageImage, d->cacheName);
+        if (image.isNull()) {
+            return;
+        }
+
+        // Only the page image of the current size is kept
+        if (key == d->imageKey) {
+            d->imageCache.put(QPixmap::fromImage(image), d->cacheName);
+            d->renderedImageKey = key;
+        } else if (key.startsWith(d->cacheName + ":")) {
+            d->tileCache.put(QPixmap::fromImage(image), key);
+        } else {
+            return;
+        }
         update();
     }
 
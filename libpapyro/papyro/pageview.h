@@ -167,6 +167,8 @@ namespace Papyro
         void dropEvent (QDropEvent * event);
         void dragEnterEvent(QDragEnterEvent * event);
         void dragMoveEvent(QDragMoveEvent * event);
+        void hideEvent(QHideEvent * event);
+        void moveEvent(QMoveEvent * event);
         bool event(QEvent * event);
         void leaveEvent(QEvent * event);
         void recomputeDarkness();
@@ -180,7 +182,7 @@ namespace Papyro
         void copyEmailAddress();
         void executePhraseLookup(int idx);
         void onMousePressTimeout();
-        void renderThreadFinished();
+        void renderFinished(const QString & key, const QImage & image);
         void saveImageAs();
 
     private:
@@ -38,6 +38,7 @@
 #include <papyro/embeddedframe.h>
 #include <papyro/pageview.h>
 #include <papyro/phraselookup.h>
+#include <papyro/renderscheduler.h>
 
 #if !defined(Q_MOC_RUN) || QT_VERSION >= 0x050000
 #  include <spine/Annotation.h>
@@ -64,6 +65,7 @@
 #include <QMap>
 #include <QMutex>
 #include <QObject>
+#include <QPair>
 #include <QPicture>
 #include <QPixmap>
 #include <QPainterPath>
@@ -75,43 +77,23 @@
 #include <QSize>
 #include <QString>
 #include <QSvgRenderer>
-#include <QThread>
 #include <QTime>
 #include <QTimer>
 #include <QTransform>
 
+class QPainter;
 class QSignalMapper;
 
 namespace Papyro
 {
 
-    class PageViewRenderThread : public QThread
+    // A tile of a page rendered at a particular zoom, and where it sits (in
+    // pixels at that zoom)
+    struct PageViewTile
     {
-        Q_OBJECT
-
-    public:
-        PageViewRenderThread(PageView * pageView);
-        ~PageViewRenderThread();
-
-        bool isDirty();
-        QImage image();
-        void run();
-        void setTarget(QSize size, QColor color);
-
-    protected:
-        void getTarget(QSize * size, QColor * color);
-
-    private:
-        QPointer< PageView > _pageView;
-        QSize _size;
-        QColor _color;
-        QMutex _mutex;
-        QImage _image;
-        bool _dirty;
-
-        static QMutex _globalMutex;
-
-    }; // class PageViewRenderThread
+        RenderRequest request;
+        QRect rect;
+    };
 
 
 
@@ -163,9 +145,25 @@ namespace Papyro
 
         // Image cache
         QString cacheName;
-        boost::scoped_ptr< PageViewRenderThread > renderThread;
         Utopia::Cache< QPixmap > imageCache;
 
+        // Rendering, which is shared with every other page view; what is
+        // wanted is gathered while painting, and then handed over in one go
+        boost::shared_ptr< RenderScheduler > renderScheduler;
+        QString imageKey;
+        QString renderedImageKey;
+        QList< RenderRequest > renderRequests;
+        QList< RenderRequest > prefetchRequests;
+        RenderRequest imageRequest(const QSize & size) const;
+        void submitRenderRequests();
+
+        // Tiles, for when the page is too big to render whole
+        Utopia::Cache< QPixmap > tileCache;
+        QList< int > tileBuckets;
+        static int tileBucket(double scale);
+        QList< PageViewTile > tiles(int bucket, const QRectF & visible, const QSizeF & imageSize) const;
+        void paintTiles(QPainter & painter, const QRectF & visible, const QSize & imageSize);
+
         // Mouse press/release variables
         QPoint mousePressPos;
         QPointF mousePressPagePos;
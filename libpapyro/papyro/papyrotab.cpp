@@ -56,12 +56,17 @@
 #include <utopia2/qt/flowbrowser.h>
 #include <utopia2/qt/spinner.h>
 #include <utopia2/qt/hidpi.h>
+#include <utopia2/global.h>
 
 #include <QAction>
 #include <QApplication>
 #include <QClipboard>
+#include <QCryptographicHash>
 #include <QDesktopServices>
 #include <QDesktopWidget>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QJsonDocument>
 #include <QLabel>
@@ -73,6 +78,7 @@
 #include <QSplitterHandle>
 #include <QStackedLayout>
 #include <QVBoxLayout>
+#include <QtConcurrent>
 
 #include <QDebug>
 
@@ -224,10 +230,89 @@ namespace Papyro
 
     /// PapyroTabPrivate ////////////////////////////////////////////////////////////////
 
+    // Pager thumbnails fit within a square of this size
+    static const int PagerImageSize = 120;
+    // Thumbnails this close to the pager's focus are rendered first
+    static const int PagerImageSpread = 8;
+
+    // The thumbnails of all documents are kept within this many bytes
+    static const qint64 PagerCacheBudget = 64 * 1024 * 1024;
+
+    static QString pagerImagePath(const QString & path, int index)
+    {
+        return QString("%1/%2.png").arg(path).arg(index + 1);
+    }
+
+    // Each document's thumbnails are kept in a directory of their own,
+    // with a marker that's rewritten whenever the document is opened
+    static QString pagerUsedPath(const QString & path)
+    {
+        return path + "/used";
+    }
+
+    // Bring the thumbnail cache back within budget by removing the
+    // thumbnails of the documents least recently opened (other than the
+    // one at keep)
+    static void prunePagerCache(const QString & keep)
+    {
+        QDir root(QFileInfo(keep).path());
+        QMultiMap< QDateTime, QString > byUse;
+        QMap< QString, qint64 > sizes;
+        qint64 total = 0;
+
+        foreach (const QFileInfo & dir, root.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+            qint64 size = 0;
+            foreach (const QFileInfo & file, QDir(dir.filePath()).entryInfoList(QDir::Files)) {
+                size += file.size();
+            }
+            total += size;
+            if (dir.filePath() != keep) {
+                QFileInfo used(pagerUsedPath(dir.filePath()));
+                byUse.insert(used.exists() ? used.lastModified() : dir.lastModified(), dir.filePath());
+                sizes[dir.filePath()] = size;
+            }
+        }
+
+        QMapIterator< QDateTime, QString > iter(byUse);
+        while (total > PagerCacheBudget && iter.hasNext()) {
+            iter.next();
+            if (QDir(iter.value()).removeRecursively()) {
+                total -= sizes.value(iter.value());
+            }
+        }
+    }
+
+    static QMap< int, QImage > loadPagerImages(const QString & path, int count)
+    {
+        QMap< int, QImage > images;
+        if (QFileInfo(path).isDir()) {
+            QFile used(pagerUsedPath(path));
+            if (used.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                used.write(QDateTime::currentDateTimeUtc().toString(Qt::ISODate).toUtf8());
+            }
+
+            for (int index = 0; index < count; ++index) {
+                QImage image(pagerImagePath(path, index));
+                if (!image.isNull()) {
+                    images[index] = image;
+                }
+            }
+        }
+        prunePagerCache(path);
+        return images;
+    }
+
+    static void savePagerImage(const QString & path, int index, const QImage & image)
+    {
+        if (QDir().mkpath(path)) {
+            image.save(pagerImagePath(path, index), "PNG");
+        }
+    }
+
     PapyroTabPrivate::PapyroTabPrivate(PapyroTab * tab)
         : QObject(tab), tab(tab), progress(-1.0), state(PapyroTab::UninitialisedState),
           documentManager(DocumentManager::instance()), activeSelectionProcessorAction(0),
-          ready(false)
+          ready(false), renderScheduler(RenderScheduler::instance())
     {
         // Create a new bus for this tab
         setBus(new Utopia::Bus(this));
@@ -238,11 +323,15 @@ namespace Papyro
         }
 
         libraryModel = Athenaeum::LibraryModel::instance();
+
+        connect(&pagerCacheWatcher, SIGNAL(finished()), this, SLOT(onPagerCacheLoaded()));
     }
 
     PapyroTabPrivate::~PapyroTabPrivate()
     {
         cancelRunnables();
+        renderScheduler->cancel(this);
+        pagerCacheWatcher.waitForFinished();
 
         // Delete decorator extensions
         while (!decorators.isEmpty()) {
@@ -522,26 +611,6 @@ namespace Papyro
         imageBrowserModel->update(i, qImageFromSpineImage(&image));
     }
 
-    void PapyroTabPrivate::loadNextPagerImage()
-    {
-        if (document()) {
-            if (pagerQueue.isEmpty()) {
-                pagerTimer.stop();
-            } else {
-                int i = pagerQueue.dequeue();
-                PageView * pageView = documentView->pageView(i+1);
-                const Spine::Page * page = document()->newCursor(i+1)->page();
-                QSize size = pageView->pageSize().toSize();
-                size.scale(QSize(120, 120), Qt::KeepAspectRatio);
-                Spine::Image spineImage = page->render(size_t(size.width()),
-                                                       size_t(size.height()));
-                pager->replace(i, QPixmap::fromImage(qImageFromSpineImage(&spineImage)).transformed(pageView->userTransform()));
-            }
-        } else {
-            pagerQueue.clear();
-        }
-    }
-
     bool PapyroTabPrivate::on_marshal_event_chain(QObject * obj, const char * receiver)
     {
         bool queued = false;
@@ -1127,6 +1196,12 @@ namespace Papyro
 
     void PapyroTabPrivate::onFilterFinished()
     {
+#ifdef UTOPIA_BUILD_DEBUG
+        foreach (const AnnotatorTiming & timing, annotatorPool.criticalPath()) {
+            qDebug() << "Critical path:" << timing.title << timing.eventName
+                     << "ready" << timing.ready << "started" << timing.started << "finished" << timing.finished;
+        }
+#endif
         //if (!annotatorPool.isActive()) {
             setState(PapyroTab::IdleState);
         //}
@@ -1309,6 +1384,20 @@ namespace Papyro
         }
     }
 
+    void PapyroTabPrivate::onPagerCacheLoaded()
+    {
+        // The document may have been closed in the meantime
+        if (document() && !pagerCachePath.isEmpty()) {
+            QMap< int, QImage > images(pagerCacheWatcher.result());
+            QMapIterator< int, QImage > iter(images);
+            while (iter.hasNext()) {
+                iter.next();
+                setPagerImage(iter.key(), iter.value());
+            }
+            requestImage(pager->current());
+        }
+    }
+
     void PapyroTabPrivate::onPagerPageClicked(int index)
     {
         documentView->showPage(index + 1);
@@ -1400,14 +1489,15 @@ namespace Papyro
             // Go to page/anchor/text according to params
             documentView->showPage(params);
 
-            // Start the pager off generating thumbnails
+            // Start the pager off with whatever thumbnails were kept from
+            // last time, and render the rest once they are loaded
             for (size_t i = 0; i < document->numberOfPages(); ++i) {
                 pager->rename(pager->append(), QString("%1").arg(i+1));
-                pagerQueue.append(i);
             }
-            connect(&pagerTimer, SIGNAL(timeout()), this, SLOT(loadNextPagerImage()));
-            pagerTimer.setInterval(0);
-            pagerTimer.start();
+            QByteArray fileHash(QByteArray::fromStdString(document->filehash()));
+            pagerCachePath = Utopia::profile_path() + "/thumbnails/" +
+                QCryptographicHash::hash(fileHash, QCryptographicHash::Sha1).toHex();
+            pagerCacheWatcher.setFuture(QtConcurrent::run(loadPagerImages, pagerCachePath, pager->count()));
 
             // Start the flowbrowser off generating images
             // Begin by finding all the bitmap bounding boxes
@@ -1556,10 +1646,50 @@ namespace Papyro
         loadAnnotators();
     }
 
+    QSize PapyroTabPrivate::pagerImageSize(int index) const
+    {
+        QSize size(documentView->pageView(index + 1)->pageSize().toSize());
+        size.scale(QSize(PagerImageSize, PagerImageSize), Qt::KeepAspectRatio);
+        return size;
+    }
+
+    void PapyroTabPrivate::renderFinished(const QString & key, const QImage & image)
+    {
+        // Keys are "pager:<document>:<index>"; anything still in flight for
+        // a previously loaded document is dropped
+        QString prefix(QString("pager:%1:").arg((qulonglong) document().get()));
+        if (document() && !image.isNull() && key.startsWith(prefix)) {
+            int index = key.mid(prefix.size()).toInt();
+            setPagerImage(index, image);
+            if (!pagerCachePath.isEmpty()) {
+                QtConcurrent::run(savePagerImage, pagerCachePath, index, image);
+            }
+        }
+    }
+
     void PapyroTabPrivate::requestImage(int index)
     {
-        pagerQueue.removeAll(index);
-        pagerQueue.prepend(index);
+        // Nothing is rendered until it's known what the disk cache holds
+        if (!document() || pagerCacheWatcher.isRunning()) {
+            return;
+        }
+
+        // Thumbnails around the given page go first, the rest after
+        // anything visible in the document view
+        QList< RenderRequest > visible;
+        QList< RenderRequest > prefetch;
+        for (int i = 0; i < pager->count(); ++i) {
+            if (!pagerImagesLoaded.contains(i)) {
+                RenderRequest request;
+                request.key = QString("pager:%1:%2").arg((qulonglong) document().get()).arg(i);
+                request.document = document();
+                request.page = i + 1;
+                request.size = pagerImageSize(i);
+                (qAbs(i - index) <= PagerImageSpread ? visible : prefetch).append(request);
+            }
+        }
+        renderScheduler->submit(this, visible, RenderScheduler::Visible);
+        renderScheduler->submit(this, prefetch, RenderScheduler::Prefetch);
     }
 
     void PapyroTabPrivate::resubscribeToBus()
@@ -1645,6 +1775,12 @@ namespace Papyro
         }
     }
 
+    void PapyroTabPrivate::setPagerImage(int index, const QImage & image)
+    {
+        pager->replace(index, QPixmap::fromImage(image).transformed(documentView->pageView(index + 1)->userTransform()));
+        pagerImagesLoaded.insert(index);
+    }
+
     void PapyroTabPrivate::showPager(bool show)
     {
         pager->setVisible(show);
@@ -1960,6 +2096,8 @@ namespace Papyro
 
             connect(d->pager, SIGNAL(pageClicked(int)),
                     d, SLOT(onPagerPageClicked(int)));
+            connect(d->pager, SIGNAL(focusChanged(int)),
+                    d, SLOT(requestImage(int)));
             connect(d->documentView, SIGNAL(spotlightsHidden()),
                     d->pager, SLOT(hideSpotlights()));
             connect(d->documentView, SIGNAL(spotlightsHidden()),
@@ -2230,6 +2368,10 @@ namespace Papyro
         d->cancelRunnables();
 
         // Clear pager
+        d->renderScheduler->cancel(d);
+        d->pagerCacheWatcher.waitForFinished();
+        d->pagerCachePath.clear();
+        d->pagerImagesLoaded.clear();
         d->pager->clear();
         d->actionTogglePager->setChecked(false);
         d->actionTogglePager->setEnabled(false);
@@ -38,6 +38,7 @@
 #include <papyro/documentmanager.h>
 #include <papyro/librarymodel.h>
 #include <papyro/papyrotab.h>
+#include <papyro/renderscheduler.h>
 #include <papyro/citation.h>
 
 #include <utopia2/bus.h>
@@ -48,8 +49,11 @@
 #  include <boost/shared_ptr.hpp>
 #endif
 
+#include <QFutureWatcher>
+#include <QImage>
+#include <QMap>
 #include <QObject>
-#include <QQueue>
+#include <QSet>
 #include <QSignalMapper>
 #include <QString>
 #include <QSvgRenderer>
@@ -201,9 +205,14 @@ namespace Papyro
         QList< Spine::Area > imageAreas;
         QList< Spine::TextExtentHandle > chemicalExtents;
 
-        // Management of the page
-        QTimer pagerTimer;
-        QQueue< int > pagerQueue;
+        // Management of the pager, whose thumbnails are rendered in the
+        // background and kept on disk (keyed by file hash) between sessions
+        boost::shared_ptr< RenderScheduler > renderScheduler;
+        QString pagerCachePath;
+        QFutureWatcher< QMap< int, QImage > > pagerCacheWatcher;
+        QSet< int > pagerImagesLoaded;
+        QSize pagerImageSize(int index) const;
+        void setPagerImage(int index, const QImage & image);
         QMap< int, int > areaAnnotationCountByPage;
         QMap< int, int > textAnnotationCountByPage;
 
@@ -272,7 +281,6 @@ namespace Papyro
         void focusChanged(PageView * pageView, QPointF pagePos);
         void loadChemicalImage(int i);
         void loadImage(int i);
-        void loadNextPagerImage();
         void onAnnotatorFinished();
         void onAnnotatorSkipped();
         void onAnnotatorStarted();
@@ -295,6 +303,7 @@ namespace Papyro
         void onLookupStopped();
         void onNetworkReplyFinished();
         void onNetworkReplyDownloadProgress(qint64, qint64);
+        void onPagerCacheLoaded();
         void onPagerPageClicked(int index);
         void onProgressLinksLabelLinkActivated(const QString & link);
         void onQuickSearchBarSearchForText(QString text);
@@ -303,6 +312,7 @@ namespace Papyro
         void onSidebarSelectionChanged();
         void onRemoveAnnotation(Spine::AnnotationHandle annotation);
         void publishChanges();
+        void renderFinished(const QString & key, const QImage & image);
         void requestImage(int index);
         void showPager(bool show);
         void showImageBrowser(bool show);
@@ -597,8 +597,7 @@ namespace Papyro
             standardFilters[Athenaeum::BibliographicSearchBox::SearchTitle] = new Athenaeum::TextFilter(QString(), Athenaeum::Citation::TitleRole - Qt::UserRole, Qt::DisplayRole, this);
             standardFilters[Athenaeum::BibliographicSearchBox::SearchAuthors] = new Athenaeum::TextFilter(QString(), Athenaeum::Citation::AuthorsRole - Qt::UserRole, Qt::DisplayRole, this);
             standardFilters[Athenaeum::BibliographicSearchBox::SearchAbstract] = new Athenaeum::TextFilter(QString(), Athenaeum::Citation::AbstractRole - Qt::UserRole, Qt::DisplayRole, this);
-            Athenaeum::ORFilter * orFilter = new Athenaeum::ORFilter(standardFilters.values(), this);
-            standardFilters[Athenaeum::BibliographicSearchBox::SearchAll] = orFilter;
+            standardFilters[Athenaeum::BibliographicSearchBox::SearchAll] = new Athenaeum::FullTextFilter(QString(), this);
 
             libraryModel = Athenaeum::LibraryModel::instance();
 /*
@@ -1606,6 +1605,8 @@ namespace Papyro
             foreach (Athenaeum::AbstractFilter * filter, standardFilters.values()) {
                 if (Athenaeum::TextFilter * textFilter = qobject_cast< Athenaeum::TextFilter * >(filter)) {
                     textFilter->setFixedString(text);
+                } else if (Athenaeum::FullTextFilter * fullTextFilter = qobject_cast< Athenaeum::FullTextFilter * >(filter)) {
+                    fullTextFilter->setQuery(text);
                 }
             }
             filterProxyModel->setFilter(standardFilters.value(searchDomain, 0));
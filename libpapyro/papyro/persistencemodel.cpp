@@ -30,6 +30,7 @@
  *****************************************************************************/
 
 #include <papyro/persistencemodel.h>
+#include <papyro/persistencemodel_p.h>
 
 #include <papyro/abstractbibliography.h>
 #include <papyro/collection.h>
@@ -40,8 +41,11 @@
 #include <QDateTime>
 #include <QDebug>
 #include <QMetaProperty>
+#include <QSaveFile>
 #include <QSet>
 #include <QTextStream>
+#include <QThread>
+#include <QtConcurrent>
 
 namespace Athenaeum
 {
@@ -67,6 +71,202 @@ namespace Athenaeum
         return result;
     }
 
+    // Steps through the top-level elements of a JSON array in turn, so
+    // that each can be parsed on its own rather than as part of one
+    // (potentially huge) document
+    class JsonArrayReader
+    {
+    public:
+        JsonArrayReader(const char * begin, const char * end)
+            : pos(begin), end(end), started(false), ok(true)
+        {}
+
+        // False at the end of the array, or if it is malformed
+        bool next(QByteArray * element)
+        {
+            skipSpace();
+            if (!started) {
+                if (pos == end || *pos != '[') {
+                    ok = false;
+                    return false;
+                }
+                started = true;
+                ++pos;
+                skipSpace();
+                if (pos < end && *pos == ']') {
+                    return false;
+                }
+            } else if (pos < end && *pos == ',') {
+                ++pos;
+                skipSpace();
+            } else {
+                ok = (pos < end && *pos == ']');
+                return false;
+            }
+
+            // Find the end of this element, which is where a comma or
+            // closing bracket appears outside of any string or object
+            const char * begin = pos;
+            int depth = 0;
+            bool inString = false;
+            for (; pos < end; ++pos) {
+                char c = *pos;
+                if (inString) {
+                    if (c == '\\') {
+                        ++pos;
+                    } else if (c == '"') {
+                        inString = false;
+                    }
+                } else if (c == '"') {
+                    inString = true;
+                } else if (c == '{' || c == '[') {
+                    ++depth;
+                } else if (c == '}' || c == ']') {
+                    if (depth == 0) {
+                        break;
+                    }
+                    --depth;
+                } else if (c == ',' && depth == 0) {
+                    break;
+                }
+            }
+            if (pos >= end || pos == begin) {
+                ok = false;
+                return false;
+            }
+
+            *element = QByteArray(begin, pos - begin);
+            return true;
+        }
+
+        bool isOk() const
+        {
+            return ok;
+        }
+
+    private:
+        void skipSpace()
+        {
+            while (pos < end && (unsigned char) *pos <= 32) {
+                ++pos;
+            }
+        }
+
+        const char * pos;
+        const char * end;
+        bool started;
+        bool ok;
+    }; // class JsonArrayReader
+
+    // Parses a data file, one citation at a time, on whichever thread it
+    // is run; the citations are then handed to the given thread
+    class DataFileParser
+    {
+    public:
+        typedef ParsedDataFile result_type;
+
+        DataFileParser(QThread * thread)
+            : thread(thread)
+        {}
+
+        ParsedDataFile operator () (const QFileInfo & fileInfo) const
+        {
+            ParsedDataFile parsed;
+            QFile dataFile(fileInfo.absoluteFilePath());
+            if (dataFile.open(QIODevice::ReadOnly)) {
+                parsed.readable = true;
+
+                // Map the file if possible, rather than reading it in
+                QByteArray buffer;
+                const char * data = 0;
+                qint64 size = dataFile.size();
+                if (uchar * mapped = (size > 0 ? dataFile.map(0, size) : 0)) {
+                    data = reinterpret_cast< const char * >(mapped);
+                } else {
+                    buffer = dataFile.readAll();
+                    data = buffer.constData();
+                    size = buffer.size();
+                }
+
+                JsonArrayReader reader(data, data + size);
+                QByteArray element;
+                bool failed = false;
+                while (!failed && reader.next(&element)) {
+                    if (cJSON * json = cJSON_Parse(element.constData())) {
+                        CitationHandle citation(Citation::fromJson(json));
+                        citation->moveToThread(thread);
+                        parsed.items << citation;
+                        cJSON_Delete(json);
+                    } else {
+                        failed = true;
+                    }
+                }
+                parsed.parsed = !failed && reader.isOk();
+                if (!parsed.parsed) {
+                    parsed.items.clear();
+                }
+                dataFile.close();
+            }
+            return parsed;
+        }
+
+    private:
+        QThread * thread;
+    }; // class DataFileParser
+
+    // Changes made to a library since its data files were last written are
+    // appended to this journal, one JSON record per line: either {"put": item}
+    // or {"remove": key}. Records are applied in order over the data files.
+    static const char * journalFileName = "journal";
+
+    // Once the journal grows beyond this many bytes, it is folded back into
+    // the data files it touches
+    static const qint64 maximumJournalSize = 4 * 1024 * 1024;
+
+    // The data file in which an item with the given key is stored
+    static QString dataFileName(const QString & key)
+    {
+        return key.mid(0, 2);
+    }
+
+    // Replay the journal of changes made since the data files were written,
+    // the last record for any key winning. A record torn by an interrupted
+    // save is cut off, along with anything after it, so that later records
+    // are not appended to it.
+    static Journal readJournal(const QString & journalPath, QThread * thread)
+    {
+        Journal journalled;
+        QFile journalFile(journalPath);
+        if (journalFile.open(QIODevice::ReadOnly)) {
+            qint64 validSize = 0;
+            bool torn = false;
+            while (!torn && !journalFile.atEnd()) {
+                QByteArray line(journalFile.readLine());
+                cJSON * record = line.endsWith('\n') ? cJSON_Parse(line.constData()) : 0;
+                if (!record) {
+                    torn = true;
+                    break;
+                }
+                if (cJSON * item = cJSON_GetObjectItem(record, "put")) {
+                    CitationHandle citation(Citation::fromJson(item));
+                    citation->moveToThread(thread);
+                    journalled[citation->field(Citation::KeyRole).toString()] = citation;
+                } else if (cJSON * key = cJSON_GetObjectItem(record, "remove")) {
+                    if (key->type == cJSON_String) {
+                        journalled[QString::fromUtf8(key->valuestring)] = CitationHandle();
+                    }
+                }
+                cJSON_Delete(record);
+                validSize += line.size();
+            }
+            journalFile.close();
+            if (torn) {
+                journalFile.resize(validSize);
+            }
+        }
+        return journalled;
+    }
+
 
 
 
@@ -110,28 +310,183 @@ namespace Athenaeum
 
 
 
-    class LocalPersistenceModelPrivate
+    LocalPersistenceModelPrivate::LocalPersistenceModelPrivate(LocalPersistenceModel * persistenceModel)
+        : QObject(0), persistenceModel(persistenceModel), purged(false), loading(false), loadSucceeded(false),
+          bibliography(0), parsingFinished(false), journalFinished(false)
     {
-    public:
-        LocalPersistenceModelPrivate()
-            : purged(false)
-        {}
+        connect(&parsing, SIGNAL(resultReadyAt(int)), this, SLOT(onDataFileParsed(int)));
+        connect(&parsing, SIGNAL(finished()), this, SLOT(onParsingFinished()));
+        connect(&journal, SIGNAL(finished()), this, SLOT(onJournalRead()));
+    }
 
-        QDir path;
-        bool purged;
+    LocalPersistenceModelPrivate::~LocalPersistenceModelPrivate()
+    {
+        // The bibliography may already be gone, so abandon any load in progress
+        parsing.disconnect(this);
+        journal.disconnect(this);
+        parsing.cancel();
+        parsing.waitForFinished();
+        journal.waitForFinished();
+    }
 
-        bool imprint() const
-        {
-            return path.mkpath("jsondb/.scratch") && path.mkpath("objects");
+    bool LocalPersistenceModelPrivate::imprint() const
+    {
+        return path.mkpath("jsondb/.scratch") && path.mkpath("objects");
+    }
+
+    // Rewrite the given data files from the bibliography's current items,
+    // each replacing its predecessor with an atomic rename, then discard
+    // the journal (whose records the data files now hold)
+    bool LocalPersistenceModelPrivate::compact(AbstractBibliography * bibliography, const QSet< QString > & fileNames)
+    {
+        QDir jsonDir(path);
+        jsonDir.cd("jsondb");
+
+        QMap< QString, QList< CitationHandle > > toWrite;
+        foreach (const QString & fileName, fileNames) {
+            toWrite[fileName];
+        }
+        foreach (CitationHandle item, bibliography->items()) {
+            QMap< QString, QList< CitationHandle > >::iterator found(toWrite.find(dataFileName(item->field(Citation::KeyRole).toString())));
+            if (found != toWrite.end()) {
+                found.value().append(item);
+            }
+        }
+
+        QMapIterator< QString, QList< CitationHandle > > iter(toWrite);
+        while (iter.hasNext()) {
+            iter.next();
+            if (iter.value().isEmpty()) {
+                // Remove the file, as it is empty and therefore no longer needed
+                if (jsonDir.exists(iter.key()) && !jsonDir.remove(iter.key())) {
+                    return false;
+                }
+            } else {
+                QSaveFile dataFile(jsonDir.filePath(iter.key()));
+                if (!dataFile.open(QIODevice::WriteOnly)) {
+                    return false;
+                }
+                cJSON * json = cJSON_CreateArray();
+                foreach (CitationHandle item, iter.value()) {
+                    cJSON_AddItemToArray(json, item->toJson());
+                }
+                char * str = cJSON_PrintUnformatted(json);
+                dataFile.write(str);
+                free(str);
+                cJSON_Delete(json);
+                if (!dataFile.commit()) {
+                    return false;
+                }
+            }
+        }
+
+        // Any scratch files left behind by older versions are now stale
+        jsonDir.remove(".scratch/.manifest");
+
+        journalledFiles.clear();
+        return !jsonDir.exists(journalFileName) || jsonDir.remove(journalFileName);
+    }
+
+    // Add the items of a parsed data file to the bibliography, bar those
+    // superseded by the journal
+    void LocalPersistenceModelPrivate::addDataFile(int index)
+    {
+        ParsedDataFile parsed(parsing.resultAt(index));
+        if (!parsed.readable || !parsed.parsed) {
+            loadSucceeded = false;
+        } else if (!parsed.items.isEmpty()) {
+            const Journal journalled(journal.result());
+            QVector< CitationHandle > items;
+            foreach (CitationHandle item, parsed.items) {
+                QString key(item->field(Citation::KeyRole).toString());
+                if (!journalled.contains(key)) {
+                    storedKeys.insert(key);
+                    items << item;
+                }
+            }
+            // Add items to model; they are as stored, so not dirty
+            bibliography->prependItems(items);
+            foreach (CitationHandle item, items) {
+                item->setClean();
+            }
+        }
+    }
+
+    void LocalPersistenceModelPrivate::finishLoading()
+    {
+        // Items put by the journal go in last
+        QVector< CitationHandle > items;
+        QMapIterator< QString, CitationHandle > replayed(journal.result());
+        while (replayed.hasNext()) {
+            replayed.next();
+            if (replayed.value()) {
+                storedKeys.insert(replayed.key());
+                items << replayed.value();
+            }
+        }
+        bibliography->prependItems(items);
+        foreach (CitationHandle item, items) {
+            item->setClean();
+        }
+
+        loading = false;
+        bibliography->setState(loadSucceeded ? AbstractBibliography::IdleState : AbstractBibliography::CorruptState);
+        bibliography = 0;
+
+        // Let go of the parsed items
+        parsing.setFuture(QFuture< ParsedDataFile >());
+        journal.setFuture(QFuture< Journal >());
+        emit persistenceModel->loaded(loadSucceeded);
+    }
+
+    void LocalPersistenceModelPrivate::onDataFileParsed(int index)
+    {
+        // Until the journal has been read, it's not known which items it supersedes
+        if (!loading) {
+            return;
+        } else if (journalFinished) {
+            addDataFile(index);
+        } else {
+            unjournalled << index;
+        }
+    }
+
+    void LocalPersistenceModelPrivate::onJournalRead()
+    {
+        if (!loading || journalFinished) {
+            return;
+        }
+
+        journalFinished = true;
+        foreach (const QString & key, journal.result().keys()) {
+            journalledFiles.insert(dataFileName(key));
         }
+        foreach (int index, unjournalled) {
+            addDataFile(index);
+        }
+        unjournalled.clear();
+        if (parsingFinished) {
+            finishLoading();
+        }
+    }
 
-    }; // class LocalPersistenceModelPrivate
+    void LocalPersistenceModelPrivate::onParsingFinished()
+    {
+        if (!loading || parsingFinished) {
+            return;
+        }
+
+        parsingFinished = true;
+        if (journalFinished) {
+            finishLoading();
+        }
+    }
 
 
 
 
     LocalPersistenceModel::LocalPersistenceModel(const QDir & path, QObject * parent)
-        : PersistenceModel(parent), d(new LocalPersistenceModelPrivate)
+        : PersistenceModel(parent), d(new LocalPersistenceModelPrivate(this))
     {
         d->path = path;
     }
@@ -161,6 +516,11 @@ namespace Athenaeum
         bool success = true;
         QString * errorMsg = 0;
 
+        // Only one load at a time
+        if (d->loading) {
+            return false;
+        }
+
         if (AbstractBibliography * bibliography = qobject_cast< AbstractBibliography * >(model)) {
 
             static QRegExp metadataRegExp("(\\w[\\w_\\d]+)\\s*=\\s*(\\S.*)?");
@@ -232,37 +592,22 @@ namespace Athenaeum
                     }
 
                     /////////////////////////////////////////////////////////////////////////
-                    // Load each appropriate file from disk, adding its items to the model.
-
-                    QMapIterator< QString, QFileInfo > iter(manifest);
-                    while (iter.hasNext()) {
-                        iter.next();
-                        QFile dataFile(iter.value().absoluteFilePath());
-                        if (dataFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-                            QByteArray data(dataFile.readAll());
-                            if (cJSON * json = cJSON_Parse(data.constData())) {
-                                QVector< CitationHandle > newItems;
-                                int count = cJSON_GetArraySize(json);
-                                for (int i = 0; i < count; ++i) {
-                                    if (cJSON * item = cJSON_GetArrayItem(json, i)) {
-                                        newItems << Citation::fromJson(item);
-                                    }
-                                }
-                                if (!newItems.isEmpty()) {
-                                    // Add items to model
-                                    bibliography->prependItems(newItems);
-                                }
-                                cJSON_Delete(json);
-                            } else {
-                                if (errorMsg) { *errorMsg = "Failed to parse one or more of the data files."; }
-                                success = false;
-                            }
-                            dataFile.close();
-                        } else {
-                            if (errorMsg) { *errorMsg = "Failed to read one or more of the data files."; }
-                            success = false;
-                        }
-                    }
+                    // Load each appropriate file from disk, in parallel, while the journal
+                    // is read. Their items are added to the model as each becomes available
+                    // (see LocalPersistenceModelPrivate), and loaded() emitted at the end.
+
+                    d->loading = true;
+                    d->loadSucceeded = true;
+                    d->bibliography = bibliography;
+                    d->parsingFinished = false;
+                    d->journalFinished = false;
+                    d->unjournalled.clear();
+                    d->storedKeys.clear();
+                    d->journalledFiles.clear();
+                    bibliography->setState(AbstractBibliography::BusyState);
+
+                    d->journal.setFuture(QtConcurrent::run(readJournal, jsonDir.filePath(journalFileName), model->thread()));
+                    d->parsing.setFuture(QtConcurrent::mapped(manifest.values(), DataFileParser(model->thread())));
 
                 } else {
                     if (errorMsg) { *errorMsg = "Cannot read from metadata file."; }
@@ -281,6 +626,9 @@ namespace Athenaeum
             success = false;
         }
 
+        if (!success) {
+            emit d->persistenceModel->loaded(false);
+        }
         return success;
     }
 
@@ -307,19 +655,25 @@ namespace Athenaeum
 
         if (AbstractBibliography * bibliography = qobject_cast< AbstractBibliography * >(model)) {
 
-            // If this is a purged model, completely remove it from the filesystem
-            if (bibliography->state() == AbstractBibliography::PurgedState) {
+            // A partially loaded model would overwrite what has yet to be loaded
+            if (d->loading) {
+                if (errorMsg) { *errorMsg = "Cannot save while loading."; }
+                success = false;
+            } else if (bibliography->state() == AbstractBibliography::PurgedState) {
+                // If this is a purged model, completely remove it from the filesystem
                 if (d->path.exists()) {
                     if (!removeDir(d->path)) {
                         if (errorMsg) { *errorMsg = "Unable to remove the collection's directory."; }
                         success = false;
                     }
                 }
+                d->storedKeys.clear();
+                d->journalledFiles.clear();
             } else if (d->imprint()) { // Ensure DB exists and is writable
+                static QRegExp dataFileRegExp("[a-f0-9]{2}");
+
                 QDir jsonDir(d->path);
                 jsonDir.cd("jsondb");
-                QDir scratchDir(jsonDir);
-                scratchDir.cd(".scratch");
 
                 /////////////////////////////////////////////////////////////////////////////
                 // Write metadata
@@ -344,99 +698,104 @@ namespace Athenaeum
                     metadataFile.close();
 
                     /////////////////////////////////////////////////////////////////////////
-                    // Compile list of all items that need to be written to the database.
+                    // Compile the changes made since the last save: items that are new or
+                    // modified, and the keys of items that have since been removed.
 
-                    QMap< QString, QList< CitationHandle > > dirty;
-                    QSet< QString > clean;
+                    QList< CitationHandle > dirty;
+                    QSet< QString > keys;
                     QVectorIterator< CitationHandle > iter(bibliography->items());
                     while (iter.hasNext()) {
                         CitationHandle item = iter.next();
-                        if (!incremental || item->isDirty()) {
-                            dirty[item->field(Citation::KeyRole).toString().mid(0, 2)].append(item);
-                        } else {
-                            clean.insert(item->field(Citation::KeyRole).toString().mid(0, 2));
+                        keys.insert(item->field(Citation::KeyRole).toString());
+                        if (item->isDirty()) {
+                            dirty.append(item);
                         }
                     }
-                    clean.subtract(dirty.keys().toSet());
-
-                    /////////////////////////////////////////////////////////////////////////
-                    // Mark for removal any file that is no longer needed
-
-                    foreach (QFileInfo fileInfo, jsonDir.entryInfoList(QDir::Files)) {
-                        QString baseName = fileInfo.baseName();
-                        if (!clean.contains(baseName) && !dirty.contains(baseName)) {
-                            dirty[baseName]; // Ensure an empty dirty list, to be deleted later
-                        }
-                    }
-
-                    /////////////////////////////////////////////////////////////////////////
-                    // Write into the scratch directory a manifest of all the files that need
-                    // to be written. If this fails, the database cannot be saved
-
-                    QFile scratchManifestFile(scratchDir.filePath(".manifest"));
-                    if (scratchManifestFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
-                        scratchManifestFile.write(QStringList(dirty.keys()).join("\n").toUtf8());
-                        scratchManifestFile.close();
+                    QSet< QString > removed(d->storedKeys);
+                    removed.subtract(keys);
 
+                    if (incremental) {
                         /////////////////////////////////////////////////////////////////////
-                        // Now write all the items that need saving into the scratch directory
-
-                        QMapIterator< QString, QList< CitationHandle > > toWrite(dirty);
-                        while (toWrite.hasNext()) {
-                            toWrite.next();
-                            QFile scratchFile(scratchDir.filePath(toWrite.key()));
-                            QFile destinationFile(jsonDir.filePath(toWrite.key()));
-                            if (!scratchFile.exists() || scratchFile.remove()) {
-                                QList< cJSON * > itemsToWrite;
-                                foreach (CitationHandle item, toWrite.value()) {
-                                    itemsToWrite << item->toJson();
-                                }
-                                if (itemsToWrite.isEmpty()) {
-                                    // Remove the file, as it is empty and therefore no longer needed
-                                    destinationFile.remove();
-                                } else if (scratchFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
-                                    cJSON * json = cJSON_CreateArray();
-                                    foreach (cJSON * item, itemsToWrite) {
-                                        cJSON_AddItemToArray(json, item);
-                                    }
-                                    char * str = cJSON_PrintUnformatted(json);
-                                    scratchFile.write(str);
-                                    free(str);
-                                    cJSON_Delete(json);
-                                    scratchFile.close();
-
-                                    if (true) { // FIXME check for item->write() above returning NULL
-                                        // Relatively atomic move, ish
-                                        if (!(destinationFile.exists() && !destinationFile.remove()) &&
-                                            QFile::copy(scratchFile.fileName(), destinationFile.fileName())) {
-                                            // Success!
-                                            foreach (CitationHandle item, toWrite.value()) {
-                                                item->setClean();
-                                            }
-                                        } else {
-                                            if (errorMsg) { *errorMsg = "Unable to copy the scratch file into place."; }
-                                            success = false;
-                                            break;
-                                        }
-                                    } else {
-                                        if (errorMsg) { *errorMsg = "Unable to generate scratch data for " + toWrite.key() + "."; }
-                                        success = false;
-                                        break;
-                                    }
+                        // Append the changes to the journal, so that the cost of saving
+                        // depends only on what has changed
+
+                        if (!dirty.isEmpty() || !removed.isEmpty()) {
+                            QByteArray records;
+                            QSet< QString > journalled;
+                            foreach (CitationHandle item, dirty) {
+                                cJSON * record = cJSON_CreateObject();
+                                cJSON_AddItemToObject(record, "put", item->toJson());
+                                char * str = cJSON_PrintUnformatted(record);
+                                records += str;
+                                records += '\n';
+                                free(str);
+                                cJSON_Delete(record);
+                                journalled.insert(dataFileName(item->field(Citation::KeyRole).toString()));
+                            }
+                            foreach (const QString & key, removed) {
+                                cJSON * record = cJSON_CreateObject();
+                                cJSON_AddItemToObject(record, "remove", cJSON_CreateString(key.toUtf8().constData()));
+                                char * str = cJSON_PrintUnformatted(record);
+                                records += str;
+                                records += '\n';
+                                free(str);
+                                cJSON_Delete(record);
+                                journalled.insert(dataFileName(key));
+                            }
+
+                            QFile journalFile(jsonDir.filePath(journalFileName));
+                            if (journalFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+                                qint64 journalSize = journalFile.size();
+                                if (journalFile.write(records) == records.size() && journalFile.flush()) {
+                                    d->journalledFiles.unite(journalled);
                                 } else {
-                                    if (errorMsg) { *errorMsg = "Unable to open the scratch file."; }
+                                    // Don't leave a torn record for later ones to follow
+                                    journalFile.resize(journalSize);
+                                    if (errorMsg) { *errorMsg = "Unable to append to the journal."; }
                                     success = false;
-                                    break;
                                 }
+                                journalFile.close();
                             } else {
-                                if (errorMsg) { *errorMsg = "Unable to remove old scratch file."; }
+                                if (errorMsg) { *errorMsg = "Unable to open the journal."; }
+                                success = false;
+                            }
+                        }
+
+                        /////////////////////////////////////////////////////////////////////
+                        // Once the journal has grown large enough, fold it back into the
+                        // data files it touches
+
+                        if (success && QFileInfo(jsonDir.filePath(journalFileName)).size() > maximumJournalSize) {
+                            if (!d->compact(bibliography, d->journalledFiles)) {
+                                if (errorMsg) { *errorMsg = "Unable to compact the journal into the data files."; }
                                 success = false;
-                                break;
                             }
                         }
                     } else {
-                        if (errorMsg) { *errorMsg = "Unable to write the scratch manifest file."; }
-                        success = false;
+                        /////////////////////////////////////////////////////////////////////
+                        // Rewrite every data file, including any no longer needed
+
+                        QSet< QString > fileNames;
+                        foreach (const QString & key, keys) {
+                            fileNames.insert(dataFileName(key));
+                        }
+                        foreach (QFileInfo fileInfo, jsonDir.entryInfoList(QDir::Files)) {
+                            if (dataFileRegExp.exactMatch(fileInfo.baseName())) {
+                                fileNames.insert(fileInfo.baseName());
+                            }
+                        }
+                        if (!d->compact(bibliography, fileNames)) {
+                            if (errorMsg) { *errorMsg = "Unable to write the data files."; }
+                            success = false;
+                        }
+                    }
+
+                    // The journal (or data files) now hold these changes
+                    if (success) {
+                        foreach (CitationHandle item, dirty) {
+                            item->setClean();
+                        }
+                        d->storedKeys = keys;
                     }
                 } else {
                     if (errorMsg) { *errorMsg = "Cannot write to metadata file."; }
@@ -460,10 +819,11 @@ namespace Athenaeum
     class CollectionPersistenceModelPrivate
     {
     public:
-        CollectionPersistenceModelPrivate()
-            : purged(false)
+        CollectionPersistenceModelPrivate(CollectionPersistenceModel * persistenceModel)
+            : persistenceModel(persistenceModel), purged(false)
         {}
 
+        CollectionPersistenceModel * persistenceModel;
         QDir path;
         bool purged;
 
@@ -473,7 +833,7 @@ namespace Athenaeum
 
 
     CollectionPersistenceModel::CollectionPersistenceModel(const QDir & path, QObject * parent)
-        : PersistenceModel(parent), d(new CollectionPersistenceModelPrivate)
+        : PersistenceModel(parent), d(new CollectionPersistenceModelPrivate(this))
     {
         d->path = path;
     }
@@ -567,6 +927,7 @@ namespace Athenaeum
             success = false;
         }
 
+        emit d->persistenceModel->loaded(success);
         return success;
     }
 
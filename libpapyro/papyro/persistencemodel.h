@@ -55,10 +55,15 @@ namespace Athenaeum
         virtual bool isPurgeable() const;
         virtual bool isSaveable() const;
 
+        // Loading may carry on after load() returns, in which case the model
+        // is populated as it goes, and loaded() is emitted once it is done
         virtual bool load(QAbstractItemModel * model) const;
         virtual bool purge() const;
         virtual bool save(QAbstractItemModel * model) const;
 
+    signals:
+        void loaded(bool success);
+
     }; // class PersistenceModel
 
 
@@ -0,0 +1,113 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef ATHENAEUM_PERSISTENCEMODEL_P_H
+#define ATHENAEUM_PERSISTENCEMODEL_P_H
+
+#include <papyro/citation.h>
+
+#include <QDir>
+#include <QFutureWatcher>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+class QAbstractItemModel;
+
+namespace Athenaeum
+{
+
+    class AbstractBibliography;
+    class LocalPersistenceModel;
+
+    // The citations of one jsondb data file
+    struct ParsedDataFile
+    {
+        ParsedDataFile()
+            : readable(false), parsed(false)
+        {}
+
+        QVector< CitationHandle > items;
+        bool readable;
+        bool parsed;
+    };
+
+    // The last journal record for each key (a null item marking a removal)
+    typedef QMap< QString, CitationHandle > Journal;
+
+    class LocalPersistenceModelPrivate : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        LocalPersistenceModelPrivate(LocalPersistenceModel * persistenceModel);
+        ~LocalPersistenceModelPrivate();
+
+        LocalPersistenceModel * persistenceModel;
+
+        QDir path;
+        bool purged;
+
+        // Keys of the items currently stored on disk, and the data files for
+        // which the journal holds records
+        QSet< QString > storedKeys;
+        QSet< QString > journalledFiles;
+
+        // A load in progress: the data files are parsed, and the journal read,
+        // on the global thread pool, and each data file's items are added to
+        // the bibliography (on its own thread) as they become available
+        bool loading;
+        bool loadSucceeded;
+        AbstractBibliography * bibliography;
+        QFutureWatcher< ParsedDataFile > parsing;
+        QFutureWatcher< Journal > journal;
+        bool parsingFinished;
+        bool journalFinished;
+        QList< int > unjournalled; // Data files parsed before the journal was read
+
+        bool imprint() const;
+        bool compact(AbstractBibliography * bibliography, const QSet< QString > & fileNames);
+
+        void addDataFile(int index);
+        void finishLoading();
+
+    public slots:
+        void onDataFileParsed(int index);
+        void onJournalRead();
+        void onParsingFinished();
+    }; // class LocalPersistenceModelPrivate
+
+} // namespace Athenaeum
+
+#endif // ATHENAEUM_PERSISTENCEMODEL_P_H
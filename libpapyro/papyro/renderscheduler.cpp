@@ -0,0 +1,300 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#include <papyro/renderscheduler.h>
+#include <papyro/renderscheduler_p.h>
+
+#include <spine/Page.h>
+
+#include <QImage>
+#include <QMap>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <boost/weak_ptr.hpp>
+
+namespace Papyro
+{
+
+    /// RenderRequest ///////////////////////////////////////////////////////////////////
+
+    RenderRequest::RenderRequest()
+        : page(0), resolution(0)
+    {}
+
+
+
+
+    /// RenderSchedulerWorker ///////////////////////////////////////////////////////////
+
+    RenderSchedulerWorker::RenderSchedulerWorker(RenderScheduler * scheduler)
+        : _scheduler(scheduler)
+    {}
+
+    void RenderSchedulerWorker::run()
+    {
+        RenderSchedulerPrivate * d = _scheduler->d;
+        RenderSchedulerPrivate::Job job;
+        while (d->take(&job)) {
+            const RenderRequest & request(job.request);
+            QImage image;
+            QElapsedTimer timer;
+            timer.start();
+            if (request.document) {
+                Spine::CursorHandle cursor(request.document->newCursor(request.page));
+                if (const Spine::Page * page = cursor->page()) {
+                    // Pages are drawn straight into the image's own pixels,
+                    // in a format that needs no conversion for display
+                    QSize size(request.size);
+                    if (size.isEmpty()) {
+                        size = QSize(int(request.slice.width() * request.resolution / 72.0),
+                                     int(request.slice.height() * request.resolution / 72.0));
+                    }
+                    image = QImage(size, QImage::Format_RGB32);
+                    if (!image.isNull()) {
+                        bool drawn;
+                        if (request.size.isEmpty()) {
+                            drawn = page->renderAreaInto(request.slice, request.resolution,
+                                                         image.bits(), image.width(), image.height(),
+                                                         image.bytesPerLine(), Spine::Image::XRGB32);
+                        } else {
+                            drawn = page->renderInto(image.bits(), image.width(), image.height(),
+                                                     image.bytesPerLine(), Spine::Image::XRGB32);
+                        }
+                        if (!drawn) {
+                            image = QImage();
+                        }
+                    }
+                }
+            }
+            d->finished(job, image, timer.elapsed());
+            Q_EMIT _scheduler->rendered();
+        }
+    }
+
+
+
+
+    /// RenderSchedulerPrivate //////////////////////////////////////////////////////////
+
+    RenderSchedulerPrivate::RenderSchedulerPrivate()
+        : mutex(QMutex::Recursive), workers(0)
+    {
+        statistics.queued = 0;
+        statistics.running = 0;
+        statistics.completed = 0;
+        statistics.cancelled = 0;
+        statistics.pixels = 0;
+        statistics.renderTime = 0;
+        statistics.averageLatency = 0;
+
+        threadPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+        clock.start();
+    }
+
+    bool RenderSchedulerPrivate::take(Job * job)
+    {
+        QMutexLocker lock(&mutex);
+        for (int priority = RenderScheduler::Visible; priority >= RenderScheduler::Prefetch; --priority) {
+            while (!queues[priority].isEmpty()) {
+                *job = queues[priority].takeFirst();
+                // Nobody left to give the result to
+                if (job->owner.isNull()) {
+                    ++statistics.cancelled;
+                    continue;
+                }
+                active.append(qMakePair(job->ownerId, job->request.key));
+                return true;
+            }
+        }
+
+        // Deciding to stop while holding the lock means no request can be
+        // submitted in between without a worker to pick it up
+        --workers;
+        return false;
+    }
+
+    void RenderSchedulerPrivate::finished(const Job & job, const QImage & image, qint64 renderTime)
+    {
+        QMutexLocker lock(&mutex);
+        active.removeOne(qMakePair(job.ownerId, job.request.key));
+        results.append(qMakePair(job, image));
+
+        ++statistics.completed;
+        statistics.pixels += quint64(image.width()) * quint64(image.height());
+        statistics.renderTime += renderTime;
+        double latency = clock.elapsed() - job.submitted;
+        if (statistics.completed == 1) {
+            statistics.averageLatency = latency;
+        } else {
+            statistics.averageLatency = 0.9 * statistics.averageLatency + 0.1 * latency;
+        }
+    }
+
+
+
+
+    /// RenderScheduler /////////////////////////////////////////////////////////////////
+
+    RenderScheduler::RenderScheduler()
+        : QObject(0), d(new RenderSchedulerPrivate)
+    {
+        connect(this, SIGNAL(rendered()), this, SLOT(deliver()), Qt::QueuedConnection);
+    }
+
+    RenderScheduler::~RenderScheduler()
+    {
+        {
+            QMutexLocker lock(&d->mutex);
+            for (int priority = Prefetch; priority <= Visible; ++priority) {
+                d->statistics.cancelled += d->queues[priority].size();
+                d->queues[priority].clear();
+            }
+        }
+        d->threadPool.waitForDone();
+        delete d;
+    }
+
+    boost::shared_ptr< RenderScheduler > RenderScheduler::instance()
+    {
+        static boost::weak_ptr< RenderScheduler > singleton;
+        boost::shared_ptr< RenderScheduler > shared(singleton.lock());
+        if (singleton.expired())
+        {
+            shared = boost::shared_ptr< RenderScheduler >(new RenderScheduler());
+            singleton = shared;
+        }
+        return shared;
+    }
+
+    void RenderScheduler::cancel(QObject * owner, Priority priority)
+    {
+        QMutexLocker lock(&d->mutex);
+        QMutableListIterator< RenderSchedulerPrivate::Job > jobs(d->queues[priority]);
+        while (jobs.hasNext()) {
+            if (jobs.next().ownerId == owner) {
+                jobs.remove();
+                ++d->statistics.cancelled;
+            }
+        }
+    }
+
+    void RenderScheduler::cancel(QObject * owner)
+    {
+        QMutexLocker lock(&d->mutex);
+        for (int priority = Prefetch; priority <= Visible; ++priority) {
+            cancel(owner, (Priority) priority);
+        }
+    }
+
+    void RenderScheduler::deliver()
+    {
+        QList< QPair< RenderSchedulerPrivate::Job, QImage > > results;
+        {
+            QMutexLocker lock(&d->mutex);
+            results.swap(d->results);
+        }
+
+        // Owners are only ever destroyed in this (the GUI) thread, so
+        // checking them here is safe
+        typedef QPair< RenderSchedulerPrivate::Job, QImage > Result;
+        foreach (const Result & result, results) {
+            if (QObject * owner = result.first.owner.data()) {
+                QMetaObject::invokeMethod(owner, "renderFinished", Qt::DirectConnection,
+                                          Q_ARG(QString, result.first.request.key),
+                                          Q_ARG(QImage, result.second));
+            }
+        }
+    }
+
+    RenderScheduler::Statistics RenderScheduler::statistics() const
+    {
+        QMutexLocker lock(&d->mutex);
+        Statistics statistics(d->statistics);
+        statistics.queued = d->queues[Prefetch].size() + d->queues[Visible].size();
+        statistics.running = d->active.size();
+        return statistics;
+    }
+
+    void RenderScheduler::submit(QObject * owner, const QList< RenderRequest > & requests, Priority priority)
+    {
+        QMutexLocker lock(&d->mutex);
+
+        // Anything the owner no longer asks for is stale; anything it still
+        // does keeps its place in the latency figures
+        QMap< QString, qint64 > submitted;
+        for (int p = Prefetch; p <= Visible; ++p) {
+            QMutableListIterator< RenderSchedulerPrivate::Job > jobs(d->queues[p]);
+            while (jobs.hasNext()) {
+                RenderSchedulerPrivate::Job & job(jobs.next());
+                if (job.ownerId == owner) {
+                    if (p == priority) {
+                        submitted[job.request.key] = job.submitted;
+                        jobs.remove();
+                    } else {
+                        // Requests can move between priorities
+                        foreach (const RenderRequest & request, requests) {
+                            if (request.key == job.request.key) {
+                                submitted[job.request.key] = job.submitted;
+                                jobs.remove();
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        foreach (const RenderRequest & request, requests) {
+            // Already being rendered
+            if (d->active.contains(qMakePair(owner, request.key))) {
+                submitted.remove(request.key);
+                continue;
+            }
+            RenderSchedulerPrivate::Job job;
+            job.owner = owner;
+            job.ownerId = owner;
+            job.request = request;
+            job.submitted = submitted.contains(request.key) ? submitted.take(request.key) : d->clock.elapsed();
+            d->queues[priority].append(job);
+        }
+        d->statistics.cancelled += submitted.size();
+
+        // Start as many workers as there is work for
+        int queued = d->queues[Prefetch].size() + d->queues[Visible].size();
+        while (d->workers < d->threadPool.maxThreadCount() && d->workers < queued) {
+            ++d->workers;
+            d->threadPool.start(new RenderSchedulerWorker(this));
+        }
+    }
+
+} // namespace Papyro
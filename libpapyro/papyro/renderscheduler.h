@@ -0,0 +1,128 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef PAPYRO_RENDERSCHEDULER_H
+#define PAPYRO_RENDERSCHEDULER_H
+
+#include <papyro/config.h>
+
+#if !defined(Q_MOC_RUN) || QT_VERSION >= 0x050000
+#  include <spine/BoundingBox.h>
+#  include <spine/Document.h>
+#endif
+
+#include <boost/shared_ptr.hpp>
+
+#include <QList>
+#include <QObject>
+#include <QSize>
+#include <QString>
+
+namespace Papyro
+{
+
+    /// RenderRequest ///////////////////////////////////////////////////////////////////
+
+    // A page (or a slice of one) to be rendered on behalf of some object,
+    // which is handed the resulting image through its renderFinished(QString,
+    // QImage) slot
+    struct LIBPAPYRO_API RenderRequest
+    {
+        RenderRequest();
+
+        QString key;
+        Spine::DocumentHandle document;
+        int page;
+
+        // Either the whole page scaled to this size (in pixels)...
+        QSize size;
+        // ...or, if that is empty, this slice of it (in points)
+        Spine::BoundingBox slice;
+        double resolution;
+    };
+
+
+
+
+    /// RenderScheduler /////////////////////////////////////////////////////////////////
+
+    class RenderSchedulerPrivate;
+    class LIBPAPYRO_API RenderScheduler : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        typedef enum
+        {
+            Prefetch = 0,
+            Visible
+        } Priority;
+
+        struct Statistics
+        {
+            int queued;
+            int running;
+            quint64 completed;
+            quint64 cancelled;
+            quint64 pixels;
+            double renderTime;      // total milliseconds spent rendering
+            double averageLatency;  // recent milliseconds from request to result
+        };
+
+        static boost::shared_ptr< RenderScheduler > instance();
+        virtual ~RenderScheduler();
+
+        // Replace whatever the owner has waiting with these requests, which
+        // are rendered in order after any of a higher priority
+        void submit(QObject * owner, const QList< RenderRequest > & requests, Priority priority = Visible);
+        void cancel(QObject * owner, Priority priority);
+        void cancel(QObject * owner);
+
+        Statistics statistics() const;
+
+    Q_SIGNALS:
+        void rendered();
+
+    protected Q_SLOTS:
+        void deliver();
+
+    protected:
+        RenderScheduler();
+
+    private:
+        RenderSchedulerPrivate * d;
+
+        friend class RenderSchedulerWorker;
+    };
+
+} // namespace Papyro
+
+#endif // PAPYRO_RENDERSCHEDULER_H
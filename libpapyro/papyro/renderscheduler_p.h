@@ -0,0 +1,99 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef PAPYRO_RENDERSCHEDULER_P_H
+#define PAPYRO_RENDERSCHEDULER_P_H
+
+#include <papyro/renderscheduler.h>
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QPointer>
+#include <QRunnable>
+#include <QThreadPool>
+
+namespace Papyro
+{
+
+    /// RenderSchedulerWorker ///////////////////////////////////////////////////////////
+
+    class RenderSchedulerWorker : public QRunnable
+    {
+    public:
+        RenderSchedulerWorker(RenderScheduler * scheduler);
+
+        void run();
+
+    private:
+        RenderScheduler * _scheduler;
+
+    }; // class RenderSchedulerWorker
+
+
+
+
+    /// RenderSchedulerPrivate //////////////////////////////////////////////////////////
+
+    class RenderSchedulerPrivate
+    {
+    public:
+        struct Job
+        {
+            QPointer< QObject > owner;
+            QObject * ownerId; // still identifies the owner once it has gone
+            RenderRequest request;
+            qint64 submitted;
+        };
+
+        RenderSchedulerPrivate();
+
+        bool take(Job * job);
+        void finished(const Job & job, const QImage & image, qint64 renderTime);
+
+        mutable QMutex mutex;
+        QList< Job > queues[RenderScheduler::Visible + 1];
+        QList< QPair< QObject *, QString > > active;
+        QList< QPair< Job, QImage > > results;
+        int workers;
+        QThreadPool threadPool;
+        QElapsedTimer clock;
+
+        RenderScheduler::Statistics statistics;
+
+    }; // class RenderSchedulerPrivate
+
+} // namespace Papyro
+
+#endif // PAPYRO_RENDERSCHEDULER_P_H
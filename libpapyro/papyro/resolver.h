@@ -40,6 +40,7 @@
 #endif
 
 #include <QStringList>
+#include <QThreadStorage>
 #include <QVariantList>
 
 class QIODevice;
@@ -73,11 +74,13 @@ namespace Athenaeum
 
         virtual void cancel() {};
 
-        std::string errorString() const { return _errorString; }
-        void setErrorString(const std::string & errorString) { _errorString = errorString; }
+        // A resolver may be run by several threads at once, so each of them
+        // sees only the errors of its own resolutions
+        std::string errorString() const { return _errorString.hasLocalData() ? _errorString.localData() : std::string(); }
+        void setErrorString(const std::string & errorString) { _errorString.setLocalData(errorString); }
 
     private:
-        std::string _errorString;
+        QThreadStorage< std::string > _errorString;
     };
 
 }
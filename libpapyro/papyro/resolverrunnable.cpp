@@ -35,10 +35,16 @@
 #include <papyro/resolver.h>
 #include <papyro/citations.h>
 
+#include <utopia2/global.h>
+
 #include <boost/weak_ptr.hpp>
 
 #include <QDateTime>
+#include <QFuture>
+#include <QRegExp>
+#include <QStringList>
 #include <QThreadPool>
+#include <QtConcurrent>
 
 #include <QDebug>
 
@@ -67,10 +73,169 @@ namespace Athenaeum
 
 
 
+    // Identifiers in a canonical form, so that equivalent spellings share results
+    static QString normalizeIdentifier(const QString & type, const QString & value)
+    {
+        QString normalized(value.trimmed().toLower());
+        if (type == "doi") {
+            normalized.remove(QRegExp("^(doi:|https?://(dx\\.)?doi\\.org/)"));
+        } else if (type == "arxiv") {
+            normalized.remove(QRegExp("^arxiv:")).remove(QRegExp("v\\d+$"));
+        } else if (type == "pubmed" || type == "pmc") {
+            normalized.remove(QRegExp("^(pmid:|pmc)"));
+        }
+        return normalized;
+    }
+
+
+
+
+    // Resolvers spend most of their time waiting on remote services, so many
+    // more of them can usefully run at once than there are cores
+    static const int maximumConcurrentResolvers = 40;
+
+    // The pool in which resolutions, and the resolvers each runs side by side,
+    // are run. A resolution waiting on its resolvers' futures takes back any
+    // that have yet to start, so a full pool cannot deadlock.
+    class ResolverThreadPool : public QThreadPool
+    {
+    public:
+        ResolverThreadPool()
+        {
+            setMaxThreadCount(maximumConcurrentResolvers);
+        }
+    }; // class ResolverThreadPool
+
+    static QThreadPool * resolverThreadPool()
+    {
+        static ResolverThreadPool pool;
+        return &pool;
+    }
+
+
+
+
+    // What is worth caching of a resolved citation: not the fields belonging
+    // to the particular copy that was resolved (its key, its flags, where its
+    // files are kept, and so on), which would otherwise be stamped on the next
+    // citation to share its identifiers
+    static QVariantMap cacheable(QVariantMap resolved)
+    {
+        static const char * local_fields[] = {
+            "key", "object-path", "originating-uri", "state", "flags", "date-imported",
+            "date-resolved", "date-modified", "known", "userdef", 0
+        };
+        for (const char ** field = local_fields; *field; ++field) {
+            resolved.remove(*field);
+        }
+        return resolved;
+    }
+
+
+
+
     ResolverRunnablePrivate::ResolverRunnablePrivate()
         : cancelled(false), mutex(QMutex::Recursive)
     {}
 
+    Utopia::Cache< QVariantMap > & ResolverRunnablePrivate::cache()
+    {
+        static Utopia::Cache< QVariantMap > cache(Utopia::profile_path() + "/resolvers");
+        return cache;
+    }
+
+    QString ResolverRunnablePrivate::cacheKey(Resolver::Purposes purposes, const QVariantMap & identifiers, Spine::DocumentHandle document)
+    {
+        QStringList normalized;
+        QMapIterator< QString, QVariant > iter(identifiers);
+        while (iter.hasNext()) {
+            iter.next();
+            QString type(iter.key().toLower());
+            QString value(normalizeIdentifier(type, iter.value().toString()));
+            if (!type.isEmpty() && !value.isEmpty()) {
+                normalized << type + ":" + value;
+            }
+        }
+        if (normalized.isEmpty()) {
+            return QString();
+        }
+        normalized.sort();
+        QString key(QString::number((int) purposes, 16) + "|" + normalized.join(" "));
+        // Resolvers may draw on the document itself, whose contents then
+        // matter as much as the identifiers do
+        if (document) {
+            key += "|" + QString::fromStdString(document->filehash());
+        }
+        return key;
+    }
+
+    int ResolverRunnablePrivate::cacheLifetime(Resolver::Purposes purposes)
+    {
+        // Links (to PDFs and the like) go stale far sooner than bibliographic
+        // metadata does
+        static const int day = 24 * 60 * 60;
+        return (purposes & Resolver::Dereference) ? day : 30 * day;
+    }
+
+    ResolverOutcome ResolverRunnablePrivate::resolve(boost::shared_ptr< Resolver > resolver, const QVariantList & citations,
+                                                     Spine::DocumentHandle document)
+    {
+        // Resolvers report failure by way of their error string (handing back
+        // what they were given)
+        ResolverOutcome outcome;
+        resolver->setErrorString(std::string());
+        try {
+            outcome.citations = resolver->resolve(citations, document);
+            outcome.failed = !resolver->errorString().empty();
+        } catch (...) {
+            outcome.citations = citations;
+            outcome.failed = true;
+        }
+        return outcome;
+    }
+
+    QVariantList ResolverRunnablePrivate::merge(const QVariantList & input, const QList< QVariantList > & results)
+    {
+        // Each resolver hands back the citations it was given (possibly amended)
+        // followed by any it has added. Amendments are merged field by field, and
+        // additions appended, in resolver order, so that the outcome does not
+        // depend on which resolver finished first; where two resolvers amend the
+        // same field, the later one wins.
+        QVariantList merged(input);
+        QVariantList added;
+        foreach (const QVariantList & result, results) {
+            for (int i = 0; i < result.size(); ++i) {
+                if (i >= input.size()) {
+                    added << result.at(i);
+                } else if (result.at(i) != input.at(i)) {
+                    if (input.at(i).type() == QVariant::Map && result.at(i).type() == QVariant::Map) {
+                        const QVariantMap before(input.at(i).toMap());
+                        const QVariantMap after(result.at(i).toMap());
+                        QVariantMap fields(merged.at(i).toMap());
+                        QMapIterator< QString, QVariant > changed(after);
+                        while (changed.hasNext()) {
+                            changed.next();
+                            if (!before.contains(changed.key()) || before.value(changed.key()) != changed.value()) {
+                                fields[changed.key()] = changed.value();
+                            }
+                        }
+                        QMapIterator< QString, QVariant > original(before);
+                        while (original.hasNext()) {
+                            original.next();
+                            if (!after.contains(original.key())) {
+                                fields.remove(original.key());
+                            }
+                        }
+                        merged[i] = fields;
+                    } else {
+                        merged[i] = result.at(i);
+                    }
+                }
+            }
+        }
+        return merged + added;
+    }
+
 
 
 
@@ -92,12 +257,10 @@ namespace Athenaeum
     {
         QMutexLocker guard(&d->mutex);
         d->cancelled = true;
-        d->queue.clear();
-        // Signal the resolver to cancel, if possible
-        if (d->running) {
-            d->running->cancel();
+        // Signal the running resolvers to cancel, if possible
+        foreach (boost::shared_ptr< Resolver > resolver, d->running) {
+            resolver->cancel();
         }
-        d->running.reset();
     }
 
     ResolverRunnable * ResolverRunnable::resolve(Athenaeum::CitationHandle citation,
@@ -106,17 +269,10 @@ namespace Athenaeum
                                                  Resolver::Purposes purposes,
                                                  Spine::DocumentHandle document)
     {
-        static QThreadPool threadPool;
-        static bool set = false;
-        if (!set) {
-            threadPool.setMaxThreadCount(40);
-            set = true;
-        }
-
         ResolverRunnable * resolverRunnable = new ResolverRunnable(citation, purposes, document);
         connect(resolverRunnable, SIGNAL(completed(Athenaeum::CitationHandle)), obj, method);
         //QThreadPool::globalInstance()->start(resolverRunnable);
-        threadPool.start(resolverRunnable);
+        resolverThreadPool()->start(resolverRunnable);
         return resolverRunnable;
     }
 
@@ -138,44 +294,78 @@ namespace Athenaeum
             qCitations = sources;
         }
 
-        {
-            // Reset management information
-            QMutexLocker guard(&d->mutex);
-            d->running.reset();
-            d->queue.clear();
-
-            // Collect all the resolvers in order
-            _ResolverMap::const_iterator iter(d->resolvers->begin());
-            _ResolverMap::const_iterator end(d->resolvers->end());
-            for (; iter != end; ++iter) {
-                foreach (boost::shared_ptr< Resolver > resolver, iter->second) {
-                    d->queue.push_back(resolver);
-                }
+        // Resolving the same identifiers again need not repeat the work, unless
+        // the results have since expired
+        Utopia::Cache< QVariantMap > & cache(d->cache());
+        QString cacheKey(d->cacheKey(d->purposes, citation->field(Citation::IdentifiersRole).toMap(), d->document));
+        if (!cacheKey.isEmpty() && cache.isValid() && cache.exists(cacheKey)) {
+            Utopia::CachedItem< QVariantMap > cached(cache.getMeta(cacheKey));
+            if (cached.isValid() && cached.modified().secsTo(QDateTime::currentDateTime()) < d->cacheLifetime(d->purposes)) {
+                citation->updateFromMap(cached.item());
+                citation->setField(Citation::StateRole, QVariant::fromValue(AbstractBibliography::IdleState));
+                citation->setField(Citation::DateResolvedRole, QDateTime::currentDateTime());
+                emit completed();
+                qRegisterMetaType< Athenaeum::CitationHandle >("Athenaeum::CitationHandle");
+                emit completed(citation);
+                return;
             }
+            cache.remove(cacheKey);
         }
 
-        // Run resolvers over metadata in order, while there are new resolvers to run
-        d->mutex.lock();
+        // Resolvers of equal weight are independent of one another, so each such
+        // tier is run side by side (over the output of the tier before), this
+        // thread taking the first resolver and the shared pool the rest. Only
+        // if every one of them succeeds, and between them they find something,
+        // is the outcome worth caching.
+        QVariantList original(qCitations);
+        bool failed = false;
 
-        while (!d->queue.isEmpty() && !d->cancelled) {
-            d->running = d->queue.takeFirst();
+        d->mutex.lock();
+        d->running.clear();
+
+        _ResolverMap::const_iterator tier(d->resolvers->begin());
+        _ResolverMap::const_iterator end(d->resolvers->end());
+        for (; tier != end && !d->cancelled; ++tier) {
+            QList< boost::shared_ptr< Resolver > > resolvers;
+            foreach (boost::shared_ptr< Resolver > resolver, tier->second) {
+                if (resolver->purposes() & d->purposes) {
+                    resolvers << resolver;
+                }
+            }
+            if (resolvers.isEmpty()) {
+                continue;
+            }
+            d->running = resolvers;
             d->mutex.unlock();
 
+            QList< QFuture< ResolverOutcome > > futures;
+            for (int i = 1; i < resolvers.size(); ++i) {
+                futures << QtConcurrent::run(resolverThreadPool(), &ResolverRunnablePrivate::resolve, resolvers.at(i), qCitations, d->document);
+            }
+            QList< ResolverOutcome > outcomes;
+            outcomes << d->resolve(resolvers.first(), qCitations, d->document);
+            foreach (QFuture< ResolverOutcome > future, futures) {
+                outcomes << future.result();
+            }
+            QList< QVariantList > results;
+            foreach (const ResolverOutcome & outcome, outcomes) {
+                results << outcome.citations;
+                failed = failed || outcome.failed;
+            }
+            qCitations = d->merge(qCitations, results);
+
             bool shouldStop = false;
-            if (d->running->purposes() & d->purposes) {
-                qCitations = d->running->resolve(qCitations, d->document);
-                foreach (QVariant variant, qCitations) {
-                    if (variant.toMap().value("_action").toString() == "stop") {
-                        shouldStop = true;
-                        break;
-                    }
+            foreach (QVariant variant, qCitations) {
+                if (variant.toMap().value("_action").toString() == "stop") {
+                    shouldStop = true;
+                    break;
                 }
             }
 
             d->mutex.lock();
-            d->running.reset();
+            d->running.clear();
 
-            // Cancel this pipeline if asked to by this resolver
+            // Cancel this pipeline if asked to by one of this tier's resolvers
             if (shouldStop) {
                 d->cancelled = true;
             }
@@ -186,6 +376,9 @@ namespace Athenaeum
         qCitation = Papyro::flatten(qCitations);
 
         citation->updateFromMap(qCitation);
+        if (!isCancelled && !failed && qCitations != original && !cacheKey.isEmpty() && cache.isValid()) {
+            cache.put(cacheable(qCitation), cacheKey);
+        }
         citation->setField(Citation::StateRole, QVariant::fromValue(AbstractBibliography::IdleState));
         citation->setField(Citation::DateResolvedRole, QDateTime::currentDateTime());
         emit completed();
@@ -34,6 +34,7 @@
 
 #include <papyro/citation.h>
 #include <papyro/resolver.h>
+#include <utopia2/qt/cache.h>
 #include <boost/shared_ptr.hpp>
 #include <map>
 #include <vector>
@@ -49,6 +50,17 @@ namespace Athenaeum
 
     boost::shared_ptr< _ResolverMap > get_resolvers();
 
+    // What became of running a single resolver
+    struct ResolverOutcome
+    {
+        ResolverOutcome()
+            : failed(false)
+        {}
+
+        QVariantList citations;
+        bool failed;
+    };
+
     class ResolverRunnablePrivate
     {
     public:
@@ -58,10 +70,23 @@ namespace Athenaeum
         Athenaeum::CitationHandle citation;
         Spine::DocumentHandle document;
         boost::shared_ptr< _ResolverMap > resolvers;
-        QList< boost::shared_ptr< Resolver > > queue;
-        boost::shared_ptr< Resolver > running;
+        QList< boost::shared_ptr< Resolver > > running;
         bool cancelled;
         QMutex mutex;
+
+        // Results of earlier resolutions (shared by all runnables), keyed by
+        // purpose, identifiers and document
+        static Utopia::Cache< QVariantMap > & cache();
+        static QString cacheKey(Resolver::Purposes purposes, const QVariantMap & identifiers,
+                                Spine::DocumentHandle document = Spine::DocumentHandle());
+        static int cacheLifetime(Resolver::Purposes purposes);
+
+        // Run a resolver, noting whether it failed
+        static ResolverOutcome resolve(boost::shared_ptr< Resolver > resolver, const QVariantList & citations,
+                                       Spine::DocumentHandle document);
+
+        // Combine the results of resolvers run side by side over the same input
+        static QVariantList merge(const QVariantList & input, const QList< QVariantList > & results);
     }; // class ResolverRunnablePrivate
 
 } // namespace Athenaeum
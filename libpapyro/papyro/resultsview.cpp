@@ -343,6 +343,15 @@ namespace Papyro
         return d->cslengine->format(convert_to_cslengine(metadata), style);
     }
 
+    QStringList ResultsViewControl::formatCitations(const QVariantList & metadata, const QString & style)
+    {
+        QList< QVariantMap > converted;
+        foreach (const QVariant & citation, metadata) {
+            converted << convert_to_cslengine(citation.toMap());
+        }
+        return d->cslengine->format(converted, style);
+    }
+
     void ResultsViewControl::onLoadComplete()
     {
         //qDebug() << "ResultsViewControl::onLoadComplete()";
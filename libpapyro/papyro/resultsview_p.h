@@ -42,6 +42,7 @@
 #include <QMutex>
 #include <QObject>
 #include <QQueue>
+#include <QStringList>
 #include <QTimer>
 #include <QWebElement>
 
@@ -164,6 +165,8 @@ namespace Papyro
         Q_SCRIPTABLE QVariantMap availableCitationStyles();
         Q_SCRIPTABLE QString defaultCitationStyle();
         Q_SCRIPTABLE QString formatCitation(const QVariantMap & metadata, const QString & style = QString());
+        // Formats many citations at once, in parallel
+        Q_SCRIPTABLE QStringList formatCitations(const QVariantList & metadata, const QString & style = QString());
         Q_SCRIPTABLE QObject * resolveMetadata(const QVariantMap & metadata, const QString & purpose);
 
     public slots:
@@ -0,0 +1,306 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#include <papyro/searchindex.h>
+
+#include <QAtomicInt>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVariant>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Athenaeum
+{
+
+    // The indexed fields, and how much a word found in each counts for
+    static const struct { int role; qreal weight; } indexedFields[] = {
+        { Citation::TitleRole, 4.0 },
+        { Citation::AuthorsRole, 3.0 },
+        { Citation::KeywordsRole, 2.0 },
+        { Citation::IdentifiersRole, 2.0 },
+        { Citation::AbstractRole, 1.0 },
+    };
+    static const size_t indexedFieldCount = sizeof(indexedFields) / sizeof(indexedFields[0]);
+
+    // Revisions are drawn from one sequence, so no two indexes share one
+    static QAtomicInt revisions;
+
+    // All the text of a field, whatever its type
+    static QStringList fieldText(const QVariant & value)
+    {
+        QStringList text;
+        switch (value.type()) {
+        case QVariant::Map:
+            foreach (const QVariant & item, value.toMap()) {
+                text += fieldText(item);
+            }
+            break;
+        case QVariant::List:
+            foreach (const QVariant & item, value.toList()) {
+                text += fieldText(item);
+            }
+            break;
+        case QVariant::StringList:
+            text = value.toStringList();
+            break;
+        default:
+            text << value.toString();
+            break;
+        }
+        return text;
+    }
+
+    // The words of an item, each with the summed weight of the fields it is found in
+    static QHash< QString, qreal > itemWords(const CitationHandle & item)
+    {
+        QHash< QString, qreal > words;
+        for (size_t i = 0; i < indexedFieldCount; ++i) {
+            foreach (const QString & text, fieldText(item->field(indexedFields[i].role))) {
+                foreach (const QString & word, SearchIndex::tokenize(text)) {
+                    words[word] += indexedFields[i].weight;
+                }
+            }
+        }
+        return words;
+    }
+
+    // Orders the matches of terms, smallest first
+    static bool hasFewerMatches(const QHash< QString, qreal > & lhs, const QHash< QString, qreal > & rhs)
+    {
+        return lhs.size() < rhs.size();
+    }
+
+
+
+
+    class SearchIndexPrivate
+    {
+    public:
+        SearchIndexPrivate()
+            : revision(0)
+        {}
+
+        mutable QMutex mutex;
+        quint64 revision;
+
+        // For each word, the keys of the items it is found in (with its weight
+        // there), sorted so that all the words with a given prefix are adjacent
+        QMap< QString, QHash< QString, qreal > > postings;
+        // For each item, the words it was indexed under
+        QHash< QString, QStringList > itemWords;
+
+        void add(const QString & key, const QHash< QString, qreal > & words)
+        {
+            QHashIterator< QString, qreal > iter(words);
+            while (iter.hasNext()) {
+                iter.next();
+                postings[iter.key()][key] = iter.value();
+            }
+            itemWords[key] = words.keys();
+        }
+
+        void remove(const QString & key)
+        {
+            foreach (const QString & word, itemWords.take(key)) {
+                QMap< QString, QHash< QString, qreal > >::iterator found(postings.find(word));
+                if (found != postings.end()) {
+                    found.value().remove(key);
+                    if (found.value().isEmpty()) {
+                        postings.erase(found);
+                    }
+                }
+            }
+        }
+
+        // Items with a word starting with the given term, scored by the best such
+        // word, weighted by how rare it is
+        QHash< QString, qreal > match(const QString & term) const
+        {
+            QHash< QString, qreal > scores;
+            const qreal itemCount = itemWords.size();
+            QMap< QString, QHash< QString, qreal > >::const_iterator iter(postings.lowerBound(term));
+            for (; iter != postings.constEnd() && iter.key().startsWith(term); ++iter) {
+                const qreal idf = std::log(1.0 + itemCount / iter.value().size());
+                // Exact matches count for more than prefixes of longer words
+                const qreal exactness = (iter.key().size() == term.size()) ? 1.0 : 0.5;
+                QHashIterator< QString, qreal > posting(iter.value());
+                while (posting.hasNext()) {
+                    posting.next();
+                    qreal & score = scores[posting.key()];
+                    score = qMax(score, posting.value() * idf * exactness);
+                }
+            }
+            return scores;
+        }
+    }; // class SearchIndexPrivate
+
+
+
+
+    SearchIndex::SearchIndex()
+        : d(new SearchIndexPrivate)
+    {}
+
+    SearchIndex::~SearchIndex()
+    {
+        delete d;
+    }
+
+    void SearchIndex::addItem(const CitationHandle & item)
+    {
+        QString key(item->field(Citation::KeyRole).toString());
+        QHash< QString, qreal > words(itemWords(item));
+
+        QMutexLocker guard(&d->mutex);
+        d->remove(key);
+        d->add(key, words);
+        d->revision = revisions.fetchAndAddOrdered(1) + 1;
+    }
+
+    void SearchIndex::clear()
+    {
+        QMutexLocker guard(&d->mutex);
+        d->postings.clear();
+        d->itemWords.clear();
+        d->revision = revisions.fetchAndAddOrdered(1) + 1;
+    }
+
+    bool SearchIndex::isIndexed(int role)
+    {
+        for (size_t i = 0; i < indexedFieldCount; ++i) {
+            if (indexedFields[i].role == role) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool SearchIndex::matches(const CitationHandle & item, const QString & query)
+    {
+        QList< QString > words(itemWords(item).keys());
+        foreach (const QString & term, tokenize(query)) {
+            bool found = false;
+            foreach (const QString & word, words) {
+                if ((found = word.startsWith(term))) {
+                    break;
+                }
+            }
+            if (!found) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void SearchIndex::removeItem(const CitationHandle & item)
+    {
+        QString key(item->field(Citation::KeyRole).toString());
+
+        QMutexLocker guard(&d->mutex);
+        d->remove(key);
+        d->revision = revisions.fetchAndAddOrdered(1) + 1;
+    }
+
+    quint64 SearchIndex::revision() const
+    {
+        QMutexLocker guard(&d->mutex);
+        return d->revision;
+    }
+
+    QHash< QString, qreal > SearchIndex::search(const QString & query) const
+    {
+        QStringList terms(tokenize(query));
+        terms.removeDuplicates();
+
+        QMutexLocker guard(&d->mutex);
+
+        // Match every term, giving up as soon as one matches nothing
+        QList< QHash< QString, qreal > > matches;
+        foreach (const QString & term, terms) {
+            matches << d->match(term);
+            if (matches.last().isEmpty()) {
+                return QHash< QString, qreal >();
+            }
+        }
+        if (matches.isEmpty()) {
+            return QHash< QString, qreal >();
+        }
+
+        // Keep only those items matched by all of them, starting from the smallest
+        // set of matches so each intersection walks as few items as it can
+        std::sort(matches.begin(), matches.end(), hasFewerMatches);
+        QHash< QString, qreal > results(matches.first());
+        for (int i = 1; i < matches.size(); ++i) {
+            const QHash< QString, qreal > & matched(matches.at(i));
+            QHash< QString, qreal >::iterator iter(results.begin());
+            while (iter != results.end()) {
+                QHash< QString, qreal >::const_iterator found(matched.constFind(iter.key()));
+                if (found == matched.constEnd()) {
+                    iter = results.erase(iter);
+                } else {
+                    iter.value() += found.value();
+                    ++iter;
+                }
+            }
+            if (results.isEmpty()) {
+                break;
+            }
+        }
+        return results;
+    }
+
+    QStringList SearchIndex::tokenize(const QString & text)
+    {
+        QStringList words;
+        QString folded(text.toCaseFolded());
+        int start = -1;
+        for (int i = 0; i <= folded.size(); ++i) {
+            if (i < folded.size() && folded.at(i).isLetterOrNumber()) {
+                if (start < 0) {
+                    start = i;
+                }
+            } else if (start >= 0) {
+                words << folded.mid(start, i - start);
+                start = -1;
+            }
+        }
+        return words;
+    }
+
+    void SearchIndex::updateItem(const CitationHandle & item)
+    {
+        addItem(item);
+    }
+
+} // namespace Athenaeum
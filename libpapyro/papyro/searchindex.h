@@ -0,0 +1,88 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef ATHENAEUM_SEARCHINDEX_H
+#define ATHENAEUM_SEARCHINDEX_H
+
+#include <papyro/citation.h>
+
+#include <QHash>
+#include <QStringList>
+
+namespace Athenaeum
+{
+
+    /////////////////////////////////////////////////////////////////////////////////////
+    // SearchIndex is an inverted index over the title, authors, abstract, keywords and
+    // identifiers of a set of citations, keyed by citation key. Queries are split into
+    // terms, each of which matches any indexed word it prefixes; a citation matches
+    // only if every term does, and is scored by how many (and in which fields, and how
+    // rare) the words it matched were.
+
+    class SearchIndexPrivate;
+    class SearchIndex
+    {
+    public:
+        SearchIndex();
+        ~SearchIndex();
+
+        // Keep the index up to date with the items it covers
+        void addItem(const CitationHandle & item);
+        void clear();
+        void removeItem(const CitationHandle & item);
+        void updateItem(const CitationHandle & item);
+
+        // Does a change to this role affect the index?
+        static bool isIndexed(int role);
+
+        // Changes every time the index does (and is unique to this index)
+        quint64 revision() const;
+
+        // Citation keys matching the query, with their scores
+        QHash< QString, qreal > search(const QString & query) const;
+
+        // Match a single item without an index (all terms present, no scoring)
+        static bool matches(const CitationHandle & item, const QString & query);
+
+        // Split text into normalised words
+        static QStringList tokenize(const QString & text);
+
+    protected:
+        SearchIndexPrivate * d;
+
+    private:
+        SearchIndex(const SearchIndex &);
+        SearchIndex & operator = (const SearchIndex &);
+    }; // class SearchIndex
+
+} // namespace Athenaeum
+
+#endif // ATHENAEUM_SEARCHINDEX_H
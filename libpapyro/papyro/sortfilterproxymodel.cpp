@@ -31,6 +31,7 @@
 
 #include <papyro/sortfilterproxymodel.h>
 #include <papyro/abstractfilter.h>
+#include <papyro/filters.h>
 
 #include <QPointer>
 
@@ -45,6 +46,13 @@ namespace Athenaeum
         {}
 
         QPointer< AbstractFilter > filter;
+
+        // A full text filter with a query to rank by, if there is one
+        FullTextFilter * ranking() const
+        {
+            FullTextFilter * fullTextFilter = qobject_cast< FullTextFilter * >(filter.data());
+            return (fullTextFilter && !fullTextFilter->query().isEmpty()) ? fullTextFilter : 0;
+        }
     }; // class SortFilterProxyModelPrivate
 
 
@@ -74,16 +82,37 @@ namespace Athenaeum
         return !(d->filter && sourceModel()) || d->filter->accepts(sourceModel()->index(source_row, 0, source_parent));
     }
 
+    bool SortFilterProxyModel::lessThan(const QModelIndex & source_left, const QModelIndex & source_right) const
+    {
+        if (FullTextFilter * fullTextFilter = d->ranking()) {
+            // Sorting is stable, so equal scores keep the source's order
+            return fullTextFilter->score(source_left) > fullTextFilter->score(source_right);
+        }
+        return QSortFilterProxyModel::lessThan(source_left, source_right);
+    }
+
+    void SortFilterProxyModel::onFilterChanged()
+    {
+        // Rank by the filter's scores if it has any, otherwise keep the source's order
+        int column = d->ranking() ? 0 : -1;
+        if (sortColumn() != column) {
+            invalidateFilter();
+            sort(column);
+        } else {
+            invalidate();
+        }
+    }
+
     void SortFilterProxyModel::setFilter(AbstractFilter * filter)
     {
         if (d->filter) {
-            disconnect(d->filter.data(), SIGNAL(filterChanged()), this, SLOT(invalidate()));
+            disconnect(d->filter.data(), SIGNAL(filterChanged()), this, SLOT(onFilterChanged()));
         }
         d->filter = filter;
         if (d->filter) {
-            connect(d->filter.data(), SIGNAL(filterChanged()), this, SLOT(invalidate()));
+            connect(d->filter.data(), SIGNAL(filterChanged()), this, SLOT(onFilterChanged()));
         }
-        invalidateFilter();
+        onFilterChanged();
     }
 
 } // namespace Athenaeum
@@ -58,6 +58,8 @@ namespace Athenaeum
 
         bool filterAcceptsColumn(int source_column, const QModelIndex & source_parent) const;
         bool filterAcceptsRow(int source_row, const QModelIndex & source_parent) const;
+        // Full text matches are ranked, best first
+        bool lessThan(const QModelIndex & source_left, const QModelIndex & source_right) const;
 
         // Hide the standard filtering methods
         using QSortFilterProxyModel::filterCaseSensitivity;
@@ -69,6 +71,9 @@ namespace Athenaeum
         using QSortFilterProxyModel::setFilterRegExp;
         using QSortFilterProxyModel::setFilterRole;
 
+    protected slots:
+        void onFilterChanged();
+
     }; // class SortFilterProxyModel
 
 } // namespace Athenaeum
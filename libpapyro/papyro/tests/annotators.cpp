@@ -0,0 +1,256 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * annotators.cpp
+ *
+ * Runs stub annotators through an AnnotatorRunnablePool, checking that an
+ * annotator declaring what it consumes starts as soon as that is produced
+ * (without waiting on unrelated annotators), that undeclared annotators keep
+ * to the order set by sync points, that sync receivers are called only once
+ * everything before them has finished, and that the pool forgets its tasks
+ * once idle.
+ *
+ ****************************************************************************/
+
+#include <papyro/annotator.h>
+#include <papyro/annotatorrunnable.h>
+#include <papyro/annotatorrunnablepool.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QSemaphore>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+
+#include <cstdio>
+
+using namespace Papyro;
+
+namespace
+{
+
+    int failures = 0;
+
+    void check(bool passed, const char * what)
+    {
+        if (!passed) {
+            fprintf(stderr, "FAILED: %s\n", what);
+            ++failures;
+        }
+    }
+
+    // How long to wait on anything that should happen, before giving up
+    const int patience = 5000; // milliseconds
+
+    // What the stub annotators have done, in the order they did it
+    boost::mutex logMutex;
+    QStringList log;
+
+    void record(const QString & entry)
+    {
+        boost::mutex::scoped_lock guard(logMutex);
+        log << entry;
+    }
+
+    bool logged(const QString & entry)
+    {
+        boost::mutex::scoped_lock guard(logMutex);
+        return log.contains(entry);
+    }
+
+    int loggedAt(const QString & entry)
+    {
+        boost::mutex::scoped_lock guard(logMutex);
+        return log.indexOf(entry);
+    }
+
+    // Logs its start and end, in between waiting (if given a gate) for the
+    // gate to open, and opening another gate (if given one)
+    class StubAnnotator : public Annotator
+    {
+    public:
+        StubAnnotator(const QString & name,
+                      const QStringList & consumes = QStringList(),
+                      const QStringList & produces = QStringList(),
+                      QSemaphore * waitFor = 0,
+                      QSemaphore * open = 0)
+            : _name(name), _consumes(consumes), _produces(produces), _waitFor(waitFor), _open(open)
+        {}
+
+        bool handleEvent(const QString & event, Spine::DocumentHandle document, const QVariantMap & kwargs)
+        {
+            record(_name + ":started");
+            if (_open) {
+                _open->release();
+            }
+            if (_waitFor && !_waitFor->tryAcquire(1, patience)) {
+                record(_name + ":gave up");
+            }
+            record(_name + ":finished");
+            return true;
+        }
+
+        QStringList consumes(const QString & event) { return _consumes; }
+        QStringList produces(const QString & event) { return _produces; }
+        std::string title() { return _name.toStdString(); }
+        QUuid configurationId() const { return QUuid(); }
+
+    private:
+        QString _name;
+        QStringList _consumes;
+        QStringList _produces;
+        QSemaphore * _waitFor;
+        QSemaphore * _open;
+    }; // class StubAnnotator
+
+    AnnotatorRunnable * runnable(StubAnnotator * annotator)
+    {
+        return new AnnotatorRunnable(boost::shared_ptr< Annotator >(annotator), "on:load", Spine::DocumentHandle());
+    }
+
+    // Records, when called, what had finished by then
+    class SyncReceiver : public QObject
+    {
+        Q_OBJECT
+
+    public:
+        SyncReceiver(const QString & before, const QString & after, QSemaphore * open)
+            : called(false), beforeFinished(false), afterFinished(true), _before(before), _after(after), _open(open)
+        {}
+
+        bool called;
+        bool beforeFinished;
+        bool afterFinished;
+
+    public slots:
+        void onSynced()
+        {
+            called = true;
+            beforeFinished = logged(_before + ":finished");
+            afterFinished = logged(_after + ":finished");
+            _open->release();
+        }
+
+    private:
+        QString _before;
+        QString _after;
+        QSemaphore * _open;
+    }; // class SyncReceiver
+
+    // Runs the event loop until the pool has finished everything
+    void waitForPool(AnnotatorRunnablePool & pool)
+    {
+        QEventLoop loop;
+        QObject::connect(&pool, SIGNAL(finished()), &loop, SLOT(quit()));
+        QTimer::singleShot(2 * patience, &loop, SLOT(quit()));
+        if (pool.isActive()) {
+            loop.exec();
+        }
+        check(!pool.isActive(), "pool finishes");
+    }
+
+}
+
+int main(int argc, char ** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    AnnotatorRunnablePool pool;
+
+    // A declared consumer starts once its producer has finished, while an
+    // unrelated slow annotator given before it is still running (which it
+    // can only do if there is a thread to spare)
+    if (QThread::idealThreadCount() > 1) {
+        QSemaphore consumerStarted;
+        pool.start(runnable(new StubAnnotator("slow", QStringList(), QStringList(), &consumerStarted)));
+        pool.start(runnable(new StubAnnotator("producer", QStringList(), QStringList() << "figures")));
+        pool.sync();
+        pool.start(runnable(new StubAnnotator("consumer", QStringList() << "figures", QStringList(), 0, &consumerStarted)));
+        waitForPool(pool);
+        check(!logged("slow:gave up"), "consumer starts before unrelated slow annotator finishes");
+        check(loggedAt("producer:finished") < loggedAt("consumer:started"), "consumer starts after its producer finishes");
+        check(pool.timings().size() == 3, "timings cover every runnable given");
+    } else {
+        printf("Only one thread available: not checking that consumers overtake\n");
+    }
+
+    // Undeclared annotators wait on everything given before the last sync
+    // point, and only that
+    {
+        pool.start(runnable(new StubAnnotator("first")));
+        pool.start(runnable(new StubAnnotator("alongside")));
+        pool.sync();
+        pool.start(runnable(new StubAnnotator("second")));
+        check(pool.timings().size() == 3, "graph is reset once the pool is idle");
+        waitForPool(pool);
+        check(loggedAt("first:finished") < loggedAt("second:started"), "undeclared annotator waits on the one before its sync point");
+        check(loggedAt("alongside:finished") < loggedAt("second:started"), "undeclared annotator waits on all before its sync point");
+        check(pool.criticalPath().size() == 2, "critical path runs through the sync point");
+    }
+
+    // A sync receiver is called once everything before it has finished, and
+    // before anything after it has
+    {
+        QSemaphore synced;
+        SyncReceiver receiver("before", "after", &synced);
+        pool.start(runnable(new StubAnnotator("before")));
+        pool.sync(&receiver, SLOT(onSynced()));
+        pool.start(runnable(new StubAnnotator("after", QStringList(), QStringList(), &synced)));
+        waitForPool(pool);
+        check(receiver.called, "sync receiver is called");
+        check(receiver.beforeFinished, "sync receiver is called after its prefix finishes");
+        check(!receiver.afterFinished, "sync receiver is called before what follows finishes");
+        check(!logged("after:gave up"), "what follows a sync point is not held up by it");
+    }
+
+    // Skipping an idle pool leaves nothing behind, and what is given after
+    // still runs
+    {
+        pool.skip();
+        check(pool.timings().isEmpty(), "skipping an idle pool forgets its graph");
+        pool.start(runnable(new StubAnnotator("afterskip")));
+        waitForPool(pool);
+        check(logged("afterskip:finished"), "runnables given after a skip still run");
+    }
+
+    if (failures == 0) {
+        printf("All annotator pool tests passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+#include "annotators.moc"
@@ -0,0 +1,322 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * resolvers.cpp
+ *
+ * Runs ResolverRunnable over resolvers that fetch from a local stub HTTP
+ * server, checking that resolvers of equal weight run side by side and have
+ * their results merged, that successful resolutions are cached (by
+ * normalised identifier) and that failed ones are not.
+ *
+ ****************************************************************************/
+
+#include <papyro/citation.h>
+#include <papyro/resolver.h>
+#include <papyro/resolverrunnable.h>
+#include <utopia2/extension.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <QCoreApplication>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include <cstdio>
+
+using namespace Athenaeum;
+
+namespace
+{
+
+    int failures = 0;
+
+    void check(bool passed, const char * what)
+    {
+        if (!passed) {
+            fprintf(stderr, "FAILED: %s\n", what);
+            ++failures;
+        }
+    }
+
+    // How long the stub server takes to answer each request, so that
+    // requests made side by side are seen to overlap
+    const int responseDelay = 200; // milliseconds
+
+    // Answers each request on a thread of its own, counting how many it has
+    // answered, and how many it has had in hand at once
+    class StubServer : public QTcpServer
+    {
+    public:
+        StubServer()
+            : requests(0), active(0), maximumActive(0)
+        {}
+
+        int requestCount()
+        {
+            boost::mutex::scoped_lock guard(mutex);
+            return requests;
+        }
+
+        int maximumConcurrency()
+        {
+            boost::mutex::scoped_lock guard(mutex);
+            return maximumActive;
+        }
+
+    protected:
+        void incomingConnection(qintptr socketDescriptor)
+        {
+            boost::thread(boost::bind(&StubServer::respond, this, socketDescriptor)).detach();
+        }
+
+    private:
+        void respond(qintptr socketDescriptor)
+        {
+            QTcpSocket socket;
+            socket.setSocketDescriptor(socketDescriptor);
+            while (!socket.canReadLine() && socket.waitForReadyRead(5000)) {}
+            QByteArray path(socket.readLine().split(' ').value(1));
+
+            {
+                boost::mutex::scoped_lock guard(mutex);
+                ++requests;
+                maximumActive = qMax(maximumActive, ++active);
+            }
+            QThread::msleep(responseDelay);
+            {
+                boost::mutex::scoped_lock guard(mutex);
+                --active;
+            }
+
+            QByteArray body;
+            QByteArray status("200 OK");
+            if (path == "/title") {
+                body = "A Stubbed Title";
+            } else if (path == "/year") {
+                body = "2017";
+            } else {
+                status = "500 Internal Server Error";
+            }
+            socket.write("HTTP/1.0 " + status + "\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body);
+            socket.waitForBytesWritten(5000);
+            socket.disconnectFromHost();
+            if (socket.state() != QAbstractSocket::UnconnectedState) {
+                socket.waitForDisconnected(5000);
+            }
+        }
+
+        boost::mutex mutex;
+        int requests;
+        int active;
+        int maximumActive;
+    }; // class StubServer
+
+    // The server listens on a thread of its own
+    class StubServerThread : public QThread
+    {
+    public:
+        StubServerThread()
+            : server(0), port(0)
+        {}
+
+        StubServer * server;
+        quint16 port;
+        boost::mutex mutex;
+        boost::condition_variable listening;
+
+    protected:
+        void run()
+        {
+            StubServer stub;
+            stub.listen(QHostAddress::LocalHost);
+            {
+                boost::mutex::scoped_lock guard(mutex);
+                server = &stub;
+                port = stub.serverPort();
+                listening.notify_all();
+            }
+            exec();
+        }
+    }; // class StubServerThread
+
+    quint16 stubPort = 0;
+    bool stubFailing = false;
+
+    // Resolvers that fetch from the stub server
+    class StubResolver : public Resolver
+    {
+    public:
+        int weight() { return 10; }
+        Purposes purposes() { return Identify; }
+
+    protected:
+        // The body of the response to a GET of the given path, if successful
+        bool fetch(const char * path, QByteArray * body)
+        {
+            QTcpSocket socket;
+            socket.connectToHost(QHostAddress::LocalHost, stubPort);
+            if (!socket.waitForConnected(5000)) {
+                return false;
+            }
+            socket.write(QByteArray("GET ") + path + " HTTP/1.0\r\n\r\n");
+            socket.waitForBytesWritten(5000);
+            QByteArray response;
+            while (socket.waitForReadyRead(5000) || socket.bytesAvailable() > 0) {
+                response += socket.readAll();
+            }
+            *body = response.mid(response.indexOf("\r\n\r\n") + 4);
+            return response.startsWith("HTTP/1.0 200");
+        }
+
+        QVariantList resolveField(const QVariantList & citations, const char * field, const char * path)
+        {
+            QVariantList resolved(citations);
+            QByteArray body;
+            if (fetch(path, &body)) {
+                QVariantMap citation(resolved.value(0).toMap());
+                citation[field] = QString::fromUtf8(body);
+                resolved[0] = citation;
+            } else {
+                setErrorString("stub request failed");
+            }
+            return resolved;
+        }
+    }; // class StubResolver
+
+    class TitleResolver : public StubResolver
+    {
+    public:
+        QVariantList resolve(const QVariantList & citations, Spine::DocumentHandle)
+        { return resolveField(citations, "title", "/title"); }
+        std::string title() { return "Stub title resolver"; }
+    }; // class TitleResolver
+
+    class YearResolver : public StubResolver
+    {
+    public:
+        QVariantList resolve(const QVariantList & citations, Spine::DocumentHandle)
+        { return resolveField(citations, "year", "/year"); }
+        std::string title() { return "Stub year resolver"; }
+    }; // class YearResolver
+
+    // Runs after the others, failing (as an exception in a Python resolver
+    // would, handing back what it was given) when asked to
+    class FailingResolver : public StubResolver
+    {
+    public:
+        int weight() { return 20; }
+        QVariantList resolve(const QVariantList & citations, Spine::DocumentHandle)
+        { return stubFailing ? resolveField(citations, "abstract", "/fail") : citations; }
+        std::string title() { return "Stub failing resolver"; }
+    }; // class FailingResolver
+
+    CitationHandle identify(const QString & doi)
+    {
+        CitationHandle citation(new Citation);
+        QVariantMap identifiers;
+        identifiers["doi"] = doi;
+        citation->setField(Citation::IdentifiersRole, identifiers);
+        ResolverRunnable runnable(citation, Resolver::Identify);
+        runnable.run();
+        return citation;
+    }
+
+}
+
+int main(int argc, char ** argv)
+{
+    // Keep the resolver cache away from the user's own
+    QTemporaryDir home;
+    qputenv("HOME", home.path().toUtf8());
+
+    QCoreApplication app(argc, argv);
+
+    StubServerThread serverThread;
+    {
+        boost::mutex::scoped_lock guard(serverThread.mutex);
+        serverThread.start();
+        while (!serverThread.server) {
+            serverThread.listening.wait(guard);
+        }
+    }
+    StubServer * server = serverThread.server;
+    stubPort = serverThread.port;
+    check(stubPort != 0, "stub server listens");
+
+    Utopia::registerExtension< TitleResolver >("TitleResolver");
+    Utopia::registerExtension< YearResolver >("YearResolver");
+    Utopia::registerExtension< FailingResolver >("FailingResolver");
+
+    // Resolvers of equal weight run side by side, each amending a different
+    // field of the citation, and both amendments are kept
+    {
+        CitationHandle citation(identify("10.1234/A"));
+        check(citation->field(Citation::TitleRole).toString() == "A Stubbed Title", "title resolved");
+        check(citation->field(Citation::YearRole).toString() == "2017", "year resolved alongside title");
+        check(server->requestCount() == 2, "one request per resolver");
+        check(server->maximumConcurrency() == 2, "resolvers of equal weight run concurrently");
+    }
+
+    // The same identifier, spelt differently, is answered from the cache,
+    // without taking on the key of the citation first resolved
+    {
+        CitationHandle first(identify("10.1234/C"));
+        CitationHandle citation(identify("https://doi.org/10.1234/c"));
+        check(server->requestCount() == 4, "cached resolution makes no requests");
+        check(citation->field(Citation::TitleRole).toString() == "A Stubbed Title", "cached title");
+        check(citation->field(Citation::YearRole).toString() == "2017", "cached year");
+        check(citation->field(Citation::KeyRole) != first->field(Citation::KeyRole), "cached result keeps the citation's own key");
+    }
+
+    // A failed resolution is not cached, so is tried again next time
+    {
+        stubFailing = true;
+        identify("10.1234/B");
+        check(server->requestCount() == 7, "failing resolution makes its requests");
+        CitationHandle citation(identify("10.1234/B"));
+        check(server->requestCount() == 10, "failed resolution was not cached");
+        check(citation->field(Citation::TitleRole).toString() == "A Stubbed Title", "successful resolvers still apply");
+        stubFailing = false;
+    }
+
+    serverThread.quit();
+    serverThread.wait();
+
+    if (failures == 0) {
+        printf("All resolver tests passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -34,20 +34,36 @@
 namespace Papyro
 {
 
+    static void releaseSpineImageData(void * data)
+    {
+        delete static_cast< boost::shared_ptr< char > * >(data);
+    }
+
     QImage qImageFromSpineImage(const Spine::Image * spineImage)
     {
         QImage image;
         switch (spineImage->type())
         {
         case Spine::Image::RGB:
-            image = QImage(reinterpret_cast<unsigned char*>(spineImage->data().get()), spineImage->width(), spineImage->height(), spineImage->width()*3, QImage::Format_RGB888).copy();
+            {
+                // Shares the Spine image's (read-only) pixels rather than
+                // copying them, keeping them alive for as long as it needs
+                boost::shared_ptr< char > data(spineImage->data());
+                if (data) {
+                    image = QImage(reinterpret_cast<const unsigned char*>(data.get()), spineImage->width(), spineImage->height(), spineImage->width()*3, QImage::Format_RGB888,
+                                   releaseSpineImageData, new boost::shared_ptr< char >(data));
+                }
+            }
             break;
         case Spine::Image::Bitmap:
             image = QImage(reinterpret_cast<unsigned char*>(spineImage->data().get()), spineImage->width(), spineImage->height(), (spineImage->width()+7)/8, QImage::Format_Mono).copy();
             image.invertPixels();
             break;
         case Spine::Image::JPEG:
-            image = QImage::fromData(reinterpret_cast<unsigned char*>(spineImage->data().get()), spineImage->size());
+            {
+                boost::shared_ptr< char > data(spineImage->data());
+                image = QImage::fromData(reinterpret_cast<unsigned char*>(data.get()), spineImage->size());
+            }
             break;
         default:
             break;
@@ -36,10 +36,16 @@
 #include <QDebug>
 #include <QFile>
 #include <QIODevice>
+#include <stdlib.h>
 #include <string.h>
 
 CrackleDocumentFactory::CrackleDocumentFactory()
 {
+    // Documents are extracted page-parallel unless the environment says
+    // otherwise, so that prefetching a long document uses every core
+    if (!getenv("CRACKLE_CONCURRENCY")) {
+        Crackle::PDFDocument::setConcurrency(Crackle::PDFDocument::PageConcurrency);
+    }
 }
 
 CrackleDocumentFactory::~CrackleDocumentFactory()
@@ -62,6 +68,20 @@ Spine::DocumentHandle CrackleDocumentFactory::create(const QByteArray & bytes)
     return Spine::DocumentHandle(document);
 }
 
+Spine::DocumentHandle CrackleDocumentFactory::create(const QString & filename)
+{
+    // Crackle maps the file itself, so there is no need to read it here
+    Crackle::PDFDocument * document = new Crackle::PDFDocument();
+    document->readFile(filename.toUtf8().constData());
+    if(!document->isOK()) {
+        qDebug() << "Could not read pdf:" << filename;
+        delete document;
+        document = 0;
+    }
+
+    return Spine::DocumentHandle(document);
+}
+
 bool CrackleDocumentFactory::isCapable(const QString & filename)
 {
     return true;
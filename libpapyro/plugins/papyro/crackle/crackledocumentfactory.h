@@ -45,6 +45,7 @@ public:
 protected:
     // Produce a document
     Spine::DocumentHandle create(const QByteArray & bytes);
+    Spine::DocumentHandle create(const QString & filename);
     // Check to see if this factory is capable of producing a document
     bool isCapable(const QString & filename);
 
@@ -85,6 +85,21 @@ namespace Spine
 
         std::list< CapabilityHandle > capabilities;
 
+        std::list< std::pair< AnnotationAreasChangedSignal, void * > > areaSubscribers;
+
+        void emitAreasChanged(Annotation * annotation)
+        {
+            std::list< std::pair< AnnotationAreasChangedSignal, void * > > subscribers;
+            {
+                boost::lock_guard< boost::recursive_mutex > guard(mutex);
+                subscribers = areaSubscribers;
+            }
+            std::list< std::pair< AnnotationAreasChangedSignal, void * > >::const_iterator i(subscribers.begin());
+            for (; i != subscribers.end(); ++i) {
+                (i->first)(i->second, annotation);
+            }
+        }
+
         bool equalRegions(const AnnotationPrivate &rhs_) const
         {
             return area.areas == rhs_.area.areas &&
@@ -135,13 +150,20 @@ namespace Spine
 
     bool Annotation::addArea(const Area & area)
     {
-        boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
-        bool exists = d->area.areas.count(area);
+        bool exists;
+        {
+            boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
+            exists = d->area.areas.count(area);
+            if (!exists)
+            {
+                d->area.areas.insert(area);
+            }
+            d->recache();
+        }
         if (!exists)
         {
-            d->area.areas.insert(area);
+            d->emitAreasChanged(this);
         }
-        d->recache();
         return !exists;
     }
 
@@ -151,6 +173,12 @@ namespace Spine
         return d->area.areas;
     }
 
+    AreaSet Annotation::allAreas() const
+    {
+        boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
+        return d->uniqueAreas;
+    }
+
     void Annotation::addCapability(CapabilityHandle capability)
     {
         if (capability) {
@@ -172,15 +200,22 @@ namespace Spine
     {
         if (extent)
         {
-            boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
-            bool exists = d->text.extents.find(extent) != d->text.extents.end();
+            bool exists;
+            {
+                boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
+                exists = d->text.extents.find(extent) != d->text.extents.end();
+                if (!exists)
+                {
+                    d->text.extents.insert(extent);
+                    std::list< Area > boxes(extent->areas());
+                    d->text.areas.insert(boxes.begin(), boxes.end());
+                }
+                d->recache();
+            }
             if (!exists)
             {
-                d->text.extents.insert(extent);
-                std::list< Area > boxes(extent->areas());
-                d->text.areas.insert(boxes.begin(), boxes.end());
+                d->emitAreasChanged(this);
             }
-            d->recache();
             return !exists;
         }
         else
@@ -330,9 +365,16 @@ namespace Spine
 
     bool Annotation::removeArea(const Area & area)
     {
-        boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
-        bool ret = d->area.areas.erase(area) > 0;
-        d->recache();
+        bool ret;
+        {
+            boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
+            ret = d->area.areas.erase(area) > 0;
+            d->recache();
+        }
+        if (ret)
+        {
+            d->emitAreasChanged(this);
+        }
         return ret;
     }
 
@@ -348,21 +390,28 @@ namespace Spine
     {
         if (extent)
         {
-            boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
-            bool exists = d->text.extents.find(extent) != d->text.extents.end();
-            if (exists)
+            bool exists;
             {
-                d->text.extents.erase(extent);
-                BOOST_FOREACH(const Area & area, extent->areas())
+                boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
+                exists = d->text.extents.find(extent) != d->text.extents.end();
+                if (exists)
                 {
-                    std::multiset< Area >::const_iterator found = d->text.areas.find(area);
-                    if (found != d->text.areas.end())
+                    d->text.extents.erase(extent);
+                    BOOST_FOREACH(const Area & area, extent->areas())
                     {
-                        d->text.areas.erase(found);
+                        std::multiset< Area >::const_iterator found = d->text.areas.find(area);
+                        if (found != d->text.areas.end())
+                        {
+                            d->text.areas.erase(found);
+                        }
                     }
                 }
+                d->recache();
+            }
+            if (exists)
+            {
+                d->emitAreasChanged(this);
             }
-            d->recache();
             return exists;
         }
         else
@@ -410,6 +459,18 @@ namespace Spine
         return result;
     }
 
+    void Annotation::connectAreasChanged(AnnotationAreasChangedSignal subscriber, void * userdef)
+    {
+        boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
+        d->areaSubscribers.push_back(std::make_pair(subscriber, userdef));
+    }
+
+    void Annotation::disconnectAreasChanged(AnnotationAreasChangedSignal subscriber, void * userdef)
+    {
+        boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
+        d->areaSubscribers.remove(std::make_pair(subscriber, userdef));
+    }
+
     void Annotation::setPublic(bool isPublic)
     {
         boost::lock_guard< boost::recursive_mutex > guard(d->mutex);
@@ -46,6 +46,9 @@
 
 namespace Spine {
 
+    class Annotation;
+    typedef void (*AnnotationAreasChangedSignal)(void*, Annotation *);
+
     class AnnotationPrivate;
     class Annotation
     {
@@ -61,6 +64,7 @@ namespace Spine {
         void addCapability(CapabilityHandle capability);
         bool addExtent(TextExtentHandle extent);
         AreaSet areas() const;
+        AreaSet allAreas() const;
         iterator begin();
         const_iterator begin() const;
         iterator begin(int page);
@@ -88,6 +92,11 @@ namespace Spine {
         void setPublic(bool isPublic);
         std::string text(const std::string & joiner = " ") const;
 
+        // Notified (outside the annotation's lock) whenever its areas or
+        // extents change, so that spatial indexes can be kept up to date
+        void connectAreasChanged(AnnotationAreasChangedSignal subscriber, void * userdef);
+        void disconnectAreasChanged(AnnotationAreasChangedSignal subscriber, void * userdef);
+
         bool operator==(const Annotation &rhs_) const;
 
         // Are there any capabilities registered for the given annotation
@@ -0,0 +1,250 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libspine library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libspine library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libspine library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libspine library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * AnnotationIndex.cpp
+ *
+ ****************************************************************************/
+
+#include <spine/AnnotationIndex.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+
+    // Size (in points) of the cells each page is divided into
+    const double CellSize = 32.0;
+
+    // Areas covering more cells than this are checked on every query
+    const long MaxCells = 64;
+
+    // Cells further out than this (in either direction) are not indexed
+    const double CellLimit = 1 << 20;
+
+    template< typename Entries >
+    void eraseEntry(Entries & entries_, Spine::Annotation * annotation_, const Spine::BoundingBox & box_)
+    {
+        typename Entries::iterator i(entries_.begin());
+        for (; i != entries_.end(); ++i) {
+            if (i->annotation == annotation_ && i->box == box_) {
+                *i = entries_.back();
+                entries_.pop_back();
+                break;
+            }
+        }
+    }
+
+}
+
+namespace Spine
+{
+
+    /****************************************************************************/
+
+    bool AnnotationIndex::cellRange(const BoundingBox & box_, Cell & from_, Cell & to_)
+    {
+        BoundingBox box(box_.normalized());
+        double x1 = floor(box.x1 / CellSize);
+        double y1 = floor(box.y1 / CellSize);
+        double x2 = floor(box.x2 / CellSize);
+        double y2 = floor(box.y2 / CellSize);
+
+        // Rejects NaNs and infinities as well as very large areas
+        if (!(x1 >= -CellLimit && y1 >= -CellLimit && x2 <= CellLimit && y2 <= CellLimit &&
+              (x2 - x1 + 1) * (y2 - y1 + 1) <= MaxCells)) {
+            return false;
+        }
+
+        from_ = Cell((int) x1, (int) y1);
+        to_ = Cell((int) x2, (int) y2);
+        return true;
+    }
+
+    void AnnotationIndex::_add(Annotation * annotation_, const Area & area_)
+    {
+        Page & page = _pages[area_.page];
+        ++page.annotations[annotation_];
+
+        Cell from, to;
+        if (cellRange(area_.boundingBox, from, to)) {
+            for (int x = from.first; x <= to.first; ++x) {
+                for (int y = from.second; y <= to.second; ++y) {
+                    page.cells[Cell(x, y)].push_back(Entry(annotation_, area_.boundingBox));
+                }
+            }
+        } else {
+            page.large.push_back(Entry(annotation_, area_.boundingBox));
+        }
+    }
+
+    void AnnotationIndex::_remove(Annotation * annotation_, const Area & area_)
+    {
+        map< int, Page >::iterator found_page(_pages.find(area_.page));
+        if (found_page == _pages.end()) {
+            return;
+        }
+        Page & page = found_page->second;
+
+        Cell from, to;
+        if (cellRange(area_.boundingBox, from, to)) {
+            for (int x = from.first; x <= to.first; ++x) {
+                for (int y = from.second; y <= to.second; ++y) {
+                    map< Cell, vector< Entry > >::iterator cell(page.cells.find(Cell(x, y)));
+                    if (cell != page.cells.end()) {
+                        eraseEntry(cell->second, annotation_, area_.boundingBox);
+                        if (cell->second.empty()) {
+                            page.cells.erase(cell);
+                        }
+                    }
+                }
+            }
+        } else {
+            eraseEntry(page.large, annotation_, area_.boundingBox);
+        }
+
+        map< Annotation *, size_t >::iterator count(page.annotations.find(annotation_));
+        if (count != page.annotations.end() && --count->second == 0) {
+            page.annotations.erase(count);
+        }
+        if (page.annotations.empty()) {
+            _pages.erase(found_page);
+        }
+    }
+
+    AnnotationSet AnnotationIndex::_handles(const set< Annotation * > & found_) const
+    {
+        AnnotationSet handles;
+        set< Annotation * >::const_iterator i(found_.begin());
+        for (; i != found_.end(); ++i) {
+            map< Annotation *, pair< AnnotationHandle, AreaSet > >::const_iterator indexed(_indexed.find(*i));
+            if (indexed != _indexed.end()) {
+                handles.insert(indexed->second.first);
+            }
+        }
+        return handles;
+    }
+
+    void AnnotationIndex::insert(AnnotationHandle annotation_)
+    {
+        if (annotation_) {
+            remove(annotation_);
+
+            pair< AnnotationHandle, AreaSet > & indexed = _indexed[annotation_.get()];
+            indexed.first = annotation_;
+            indexed.second = annotation_->allAreas();
+            BOOST_FOREACH(const Area & area, indexed.second) {
+                _add(annotation_.get(), area);
+            }
+        }
+    }
+
+    void AnnotationIndex::remove(const AnnotationHandle & annotation_)
+    {
+        map< Annotation *, pair< AnnotationHandle, AreaSet > >::iterator indexed(_indexed.find(annotation_.get()));
+        if (indexed != _indexed.end()) {
+            BOOST_FOREACH(const Area & area, indexed->second.second) {
+                _remove(indexed->first, area);
+            }
+            _indexed.erase(indexed);
+        }
+    }
+
+    bool AnnotationIndex::update(Annotation * annotation_)
+    {
+        map< Annotation *, pair< AnnotationHandle, AreaSet > >::iterator indexed(_indexed.find(annotation_));
+        if (indexed != _indexed.end()) {
+            // Hold a reference, as insert() removes the old entry first
+            AnnotationHandle annotation(indexed->second.first);
+            insert(annotation);
+            return true;
+        }
+        return false;
+    }
+
+    void AnnotationIndex::clear()
+    {
+        _pages.clear();
+        _indexed.clear();
+    }
+
+    AnnotationSet AnnotationIndex::annotationsAt(int page_) const
+    {
+        set< Annotation * > found;
+        map< int, Page >::const_iterator page(_pages.find(page_));
+        if (page != _pages.end()) {
+            map< Annotation *, size_t >::const_iterator i(page->second.annotations.begin());
+            for (; i != page->second.annotations.end(); ++i) {
+                found.insert(i->first);
+            }
+        }
+        return _handles(found);
+    }
+
+    AnnotationSet AnnotationIndex::annotationsAt(int page_, double x_, double y_) const
+    {
+        return annotationsWithin(page_, BoundingBox(x_, y_, x_, y_));
+    }
+
+    AnnotationSet AnnotationIndex::annotationsWithin(int page_, const BoundingBox & box_) const
+    {
+        set< Annotation * > found;
+        map< int, Page >::const_iterator found_page(_pages.find(page_));
+        if (found_page != _pages.end()) {
+            const Page & page = found_page->second;
+            BoundingBox box(box_.normalized());
+
+            // Closed intervals, to agree with BoundingBox::contains()
+            vector< const vector< Entry > * > candidates;
+            candidates.push_back(&page.large);
+
+            Cell from, to;
+            if (cellRange(box, from, to)) {
+                for (int x = from.first; x <= to.first; ++x) {
+                    map< Cell, vector< Entry > >::const_iterator cell(page.cells.lower_bound(Cell(x, from.second)));
+                    for (; cell != page.cells.end() && cell->first.first == x && cell->first.second <= to.second; ++cell) {
+                        candidates.push_back(&cell->second);
+                    }
+                }
+            } else {
+                map< Cell, vector< Entry > >::const_iterator cell(page.cells.begin());
+                for (; cell != page.cells.end(); ++cell) {
+                    candidates.push_back(&cell->second);
+                }
+            }
+
+            BOOST_FOREACH(const vector< Entry > * entries, candidates) {
+                BOOST_FOREACH(const Entry & entry, *entries) {
+                    BoundingBox area(entry.box.normalized());
+                    if (area.x1 <= box.x2 && area.x2 >= box.x1 && area.y1 <= box.y2 && area.y2 >= box.y1) {
+                        found.insert(entry.annotation);
+                    }
+                }
+            }
+        }
+        return _handles(found);
+    }
+
+}
@@ -0,0 +1,103 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libspine library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libspine library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libspine library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libspine library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef LIBSPINE_ANNOTATIONINDEX_INCL_
+#define LIBSPINE_ANNOTATIONINDEX_INCL_
+
+/*****************************************************************************
+ *
+ * AnnotationIndex.h
+ *
+ ****************************************************************************/
+
+#include <spine/Annotation.h>
+#include <spine/Area.h>
+#include <spine/BoundingBox.h>
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace Spine
+{
+
+    /***************************************************************************
+     *
+     * AnnotationIndex
+     *
+     * A spatial index of the areas of a set of annotations. Each page is
+     * divided into a grid of fixed-size cells, and every area is filed under
+     * the cells it overlaps, so that hit-testing a point or a rectangle only
+     * has to look at the handful of areas near it. Areas too big to file
+     * cheaply (whole-page annotations, say) are kept in a short list per
+     * page that is always checked.
+     *
+     * The index holds no lock of its own; its owner must serialise access.
+     *
+     **************************************************************************/
+
+    class AnnotationIndex
+    {
+    public:
+        // (Re)index an annotation using its current areas
+        void insert(AnnotationHandle annotation_);
+        void remove(const AnnotationHandle & annotation_);
+        bool update(Annotation * annotation_);
+        void clear();
+
+        AnnotationSet annotationsAt(int page_) const;
+        AnnotationSet annotationsAt(int page_, double x_, double y_) const;
+        AnnotationSet annotationsWithin(int page_, const BoundingBox & box_) const;
+
+    private:
+        typedef std::pair< int, int > Cell;
+
+        struct Entry
+        {
+            Entry(Annotation * annotation_, const BoundingBox & box_)
+                : annotation(annotation_), box(box_)
+            {}
+
+            Annotation * annotation;
+            BoundingBox box;
+        };
+
+        struct Page
+        {
+            std::map< Cell, std::vector< Entry > > cells;
+            std::vector< Entry > large;
+            std::map< Annotation *, size_t > annotations; // number of areas
+        };
+
+        static bool cellRange(const BoundingBox & box_, Cell & from_, Cell & to_);
+
+        void _add(Annotation * annotation_, const Area & area_);
+        void _remove(Annotation * annotation_, const Area & area_);
+        AnnotationSet _handles(const std::set< Annotation * > & found_) const;
+
+        std::map< int, Page > _pages;
+        std::map< Annotation *, std::pair< AnnotationHandle, AreaSet > > _indexed;
+    };
+
+}
+
+#endif /* LIBSPINE_ANNOTATIONINDEX_INCL_ */
@@ -35,15 +35,20 @@
 #include <spine/Region.h>
 #include <spine/Image.h>
 #include <spine/Annotation.h>
+#include <spine/AnnotationIndex.h>
 #include <spine/utility.h>
 #include <spine/fingerprint.h>
 
 #include <algorithm>
+#include <deque>
 #include <locale>
 #include <cstdlib>
 #include <cwctype>
 
 #include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 #include <utf8/unicode.h>
 #include <pcrecpp.h>
 
@@ -85,6 +90,206 @@ namespace {
 
         return result;
     }
+
+    // What a single page contributes to the character and image
+    // fingerprints, in the order it would have been hashed
+    struct PageFingerprintData
+    {
+        // big endian code points
+        string characters;
+        // decoded image data and its size
+        vector< std::pair< boost::shared_ptr< char >, size_t > > images;
+    };
+
+    void collectPageFingerprintData(Document * doc_, int page_, PageFingerprintData & data_)
+    {
+        unsigned char data[4];
+
+        CursorHandle c(doc_->newCursor(page_));
+        if (!c->page()) {
+            return;
+        }
+
+        const Character *txtchr;
+        const Word *wrd;
+
+        // iterate over words but not advancing page
+        while ( (wrd=c->word()) ) {
+
+            // only hash horizontal text as often watermarks are rotated
+            if(wrd->rotation()==0) {
+                while( (txtchr=c->character()) ) {
+
+                    // ignore 1 inch margin
+                    if(txtchr->boundingBox().x1 >= 72.0 &&
+                       txtchr->boundingBox().x2 <= c->page()->boundingBox().x2-72.0 &&
+                       txtchr->boundingBox().y1 >= 72.0 &&
+                       txtchr->boundingBox().y2 <= c->page()->boundingBox().y2-72.0)
+                    {
+                        utf8::uint32_t ch(txtchr->charcode());
+                        data[0]=(ch & 0xff000000) >> 24;
+                        data[1]=(ch & 0x00ff0000) >> 16;
+                        data[2]=(ch & 0x0000ff00) >> 8;
+                        data[3]=(ch & 0x000000ff);
+                        data_.characters.append(reinterpret_cast< char * >(data), 4);
+                    }
+                    c->nextCharacter();
+                }
+            }
+            c->nextWord(WithinPage);
+        }
+
+        CursorHandle ic(doc_->newCursor(page_));
+        const Image *img;
+
+        // iterate over images on same page
+        while( (img=ic->image()) ) {
+            if((img->boundingBox().width() * img->boundingBox().height()) > 5000.0) {
+
+                if(img->boundingBox().x2 > 72.0 &&
+                   img->boundingBox().x1 < ic->page()->boundingBox().x2-72.0 &&
+                   img->boundingBox().y2 > 72.0  &&
+                   img->boundingBox().y1 < ic->page()->boundingBox().y2-72.0)
+                {
+                    // decoding is the costly part, so it happens here
+                    // rather than when the data is hashed
+                    data_.images.push_back(std::make_pair(img->data(), img->size()));
+                }
+            }
+            ic->nextImage();
+        }
+    }
+
+    // Helper threads shared by every document being fingerprinted, so that
+    // fingerprinting many documents at once doesn't oversubscribe the CPU
+    class FingerprintPool
+    {
+    public:
+        static FingerprintPool & instance()
+        {
+            static boost::once_flag once=BOOST_ONCE_INIT;
+            boost::call_once(&FingerprintPool::create, once);
+            return *_instance;
+        }
+
+        size_t size() const
+        {
+            return _size;
+        }
+
+        void post(const boost::function< void () > & task_)
+        {
+            {
+                boost::lock_guard<boost::mutex> g(_mutex);
+                _tasks.push_back(task_);
+            }
+            _available.notify_one();
+        }
+
+        ~FingerprintPool()
+        {
+            {
+                boost::lock_guard<boost::mutex> g(_mutex);
+                _stopping=true;
+            }
+            _available.notify_all();
+            _threads.join_all();
+        }
+
+    private:
+        FingerprintPool()
+            : _size(std::max(boost::thread::hardware_concurrency(), 2u) - 1), _stopping(false)
+        {
+            for (size_t i=0; i<_size; ++i) {
+                _threads.create_thread(boost::bind(&FingerprintPool::run, this));
+            }
+        }
+
+        static void create()
+        {
+            static FingerprintPool pool;
+            _instance=&pool;
+        }
+
+        void run()
+        {
+            for (;;) {
+                boost::function< void () > task;
+                {
+                    boost::unique_lock<boost::mutex> g(_mutex);
+                    while (_tasks.empty() && !_stopping) {
+                        _available.wait(g);
+                    }
+                    if (_stopping) {
+                        break;
+                    }
+                    task=_tasks.front();
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+        static FingerprintPool * _instance;
+
+        size_t _size;
+        bool _stopping;
+        std::deque< boost::function< void () > > _tasks;
+        boost::mutex _mutex;
+        boost::condition_variable _available;
+        boost::thread_group _threads;
+    };
+
+    FingerprintPool * FingerprintPool::_instance=0;
+
+    // Pages are collected (and their images decoded) by any thread, but
+    // hashed in order by the calling thread as they become ready. Pages
+    // are only handed out a little way ahead of the one being hashed, to
+    // bound how much decoded image data is held at once. Helpers hold on
+    // to the job, so one that starts late finds nothing left to do.
+    struct FingerprintJob
+    {
+        FingerprintJob(Document * doc_, int pages_, int window_)
+            : doc(doc_), next(1), hashed(1), last(pages_), window(window_),
+              pages(pages_), ready(pages_, false)
+        {}
+
+        // Collect the next page, if there is one within the window; returns
+        // false if there isn't
+        bool collectNext(boost::unique_lock<boost::mutex> & g_)
+        {
+            if (next > last || next-hashed >= window) {
+                return false;
+            }
+            int page=next++;
+            g_.unlock();
+            collectPageFingerprintData(doc, page, pages[page-1]);
+            g_.lock();
+            ready[page-1]=true;
+            changed.notify_all();
+            return true;
+        }
+
+        Document * doc;
+        int next;
+        int hashed;
+        int last;
+        int window;
+        vector< PageFingerprintData > pages;
+        vector< bool > ready;
+        boost::mutex mutex;
+        boost::condition_variable changed;
+    };
+
+    void fingerprintHelper(boost::shared_ptr< FingerprintJob > job_)
+    {
+        boost::unique_lock<boost::mutex> g(job_->mutex);
+        while (job_->next <= job_->last) {
+            if (!job_->collectNext(g)) {
+                job_->changed.wait(g);
+            }
+        }
+    }
 }
 
 /****************************************************************************/
@@ -132,6 +337,8 @@ namespace Spine
         mutable string charhash2;
         mutable string imagehash1;
         mutable string imagehash2;
+        mutable bool fingerprinted;
+        bool wordIndexEnabled;
         mutable string pmid;
         mutable string doi;
         mutable string pii;
@@ -145,8 +352,20 @@ namespace Spine
         map< string, AnnotationSet, compare_uri > annotationsByParentId;
         map< Annotation *, size_t > annotationsByParentIdRefCount;
         map< string, list< pair< AnnotationsChangedSignal, void * > > > annotationSubscribers;
+        map< string, AnnotationIndex > annotationIndexes;
         mutable boost::recursive_mutex annotationsMutex;
 
+        // Keep the spatial indexes in step with annotations that change shape
+        static void annotationAreasChanged(void * userdef, Annotation * annotation)
+        {
+            DocumentPrivate * d = static_cast< DocumentPrivate * >(userdef);
+            boost::lock_guard<boost::recursive_mutex> g(d->annotationsMutex);
+            map< string, AnnotationIndex >::iterator index(d->annotationIndexes.begin());
+            for (; index != d->annotationIndexes.end(); ++index) {
+                index->second.update(annotation);
+            }
+        }
+
         void emitAnnotationsChanged(const string & name, const AnnotationSet & annotations, bool added)
         {
             string any;
@@ -247,10 +466,19 @@ namespace Spine
         d->userdef = userdef_;
         d->deathRowScratchId = newScratchId();
         d->imageBased = DocumentPrivate::Unknown;
+        d->fingerprinted = false;
+        d->wordIndexEnabled = true;
     }
 
     Document::~Document()
     {
+        {
+            boost::lock_guard<boost::recursive_mutex> g(d->annotationsMutex);
+            map< Annotation *, size_t >::const_iterator i(d->annotationsByIdRefCount.begin());
+            for (; i != d->annotationsByIdRefCount.end(); ++i) {
+                i->first->disconnectAreasChanged(&DocumentPrivate::annotationAreasChanged, d);
+            }
+        }
         delete d;
     }
 
@@ -355,7 +583,7 @@ namespace Spine
 
     string Document::characterFingerprint1()
     {
-        if(d->charhash1.empty()) {
+        if(d->charhash1.empty() && !d->fingerprinted) {
             this->calculateCharacterFingerprints();
         }
         return d->charhash1;
@@ -363,7 +591,7 @@ namespace Spine
 
     string Document::characterFingerprint2()
     {
-        if(d->charhash2.empty()) {
+        if(d->charhash2.empty() && !d->fingerprinted) {
             this->calculateCharacterFingerprints();
         }
         return d->charhash2;
@@ -372,65 +600,12 @@ namespace Spine
     // generate SHA-256 hash of characters
     void Document::calculateCharacterFingerprints()
     {
-        Sha256 hash1;
-        Sha256 hash2;
-        unsigned char data[4];
-
-        CursorHandle c(this->newCursor());
-
-        const Character *txtchr;
-        const Word *wrd;
-
-        for( ; c->page(); c->nextPage()) {
-
-            int pg(c->page()->pageNumber());
-
-            // iterate over words but not advancing page
-            while ( (wrd=c->word()) ) {
-
-                // only hash horizontal text as often watermarks are rotated
-                if(wrd->rotation()==0) {
-                    while( (txtchr=c->character()) ) {
-
-                        // ignore 1 inch margin
-                        if(txtchr->boundingBox().x1 >= 72.0 &&
-                           txtchr->boundingBox().x2 <= c->page()->boundingBox().x2-72.0 &&
-                           txtchr->boundingBox().y1 >= 72.0 &&
-                           txtchr->boundingBox().y2 <= c->page()->boundingBox().y2-72.0)
-                        {
-                            utf8::uint32_t ch(txtchr->charcode());
-                            data[0]=(ch & 0xff000000) >> 24;
-                            data[1]=(ch & 0x00ff0000) >> 16;
-                            data[2]=(ch & 0x0000ff00) >> 8;
-                            data[3]=(ch & 0x000000ff);
-                            hash1.update(data, 4);
-                            if (pg>1) {
-                                hash2.update(data, 4);
-                            }
-                        }
-                        c->nextCharacter();
-                    }
-                }
-                c->nextWord(WithinPage);
-            }
-        }
-
-        if(hash1.isValid()) {
-            d->charhash1=Fingerprint::character1FingerprintIri(hash1.calculateHash());
-        } else {
-            d->charhash1.clear();
-        }
-
-        if(hash2.isValid()) {
-            d->charhash2=Fingerprint::character2FingerprintIri(hash2.calculateHash());
-        } else {
-            d->charhash2.clear();
-        }
+        this->calculateFingerprints();
     }
 
     string Document::imageFingerprint1()
     {
-        if(d->imagehash1.empty()) {
+        if(d->imagehash1.empty() && !d->fingerprinted) {
             this->calculateImageFingerprints();
         }
         return d->imagehash1;
@@ -438,7 +613,7 @@ namespace Spine
 
     string Document::imageFingerprint2()
     {
-        if(d->imagehash2.empty()) {
+        if(d->imagehash2.empty() && !d->fingerprinted) {
             this->calculateImageFingerprints();
         }
         return d->imagehash2;
@@ -446,47 +621,93 @@ namespace Spine
 
     void Document::calculateImageFingerprints()
     {
-        Sha256 hash1;
-        Sha256 hash2;
+        this->calculateFingerprints();
+    }
 
-        CursorHandle c(this->newCursor());
-        const Image *img;
+    // Character and image fingerprints are gathered in the same walk over
+    // the document. Pages are walked concurrently, but what each
+    // contributes is hashed in page order as it becomes ready, so the
+    // results are the same as hashing the document serially.
+    void Document::calculateFingerprints()
+    {
+        Sha256 charhash1;
+        Sha256 charhash2;
+        Sha256 imagehash1;
+        Sha256 imagehash2;
 
-        for( ; c->page(); c->nextPage()) {
+        this->prefetch();
 
-            int pg(c->page()->pageNumber());
+        int pages(static_cast< int >(this->numberOfPages()));
+        FingerprintPool & pool(FingerprintPool::instance());
+        boost::shared_ptr< FingerprintJob > job(new FingerprintJob(this, pages, 2*(pool.size()+1)));
 
-            // iterate over images on same page
-            while( (img=c->image()) ) {
-                if((img->boundingBox().width() * img->boundingBox().height()) > 5000.0) {
+        // the calling thread takes a share of the work too
+        int helpers(std::min(static_cast< int >(pool.size()), pages-1));
+        for (int i=0; i<helpers; ++i) {
+            pool.post(boost::bind(fingerprintHelper, job));
+        }
 
-                    if(img->boundingBox().x2 > 72.0 &&
-                       img->boundingBox().x1 < c->page()->boundingBox().x2-72.0 &&
-                       img->boundingBox().y2 > 72.0  &&
-                       img->boundingBox().y1 < c->page()->boundingBox().y2-72.0)
-                    {
-                        unsigned char *data(reinterpret_cast<unsigned char *>(img->data().get()));
-                        size_t size(img->size());
-                        hash1.update(data, size);
-                        if (pg>1) {
-                            hash2.update(data, size);
-                        }
-                    }
+        boost::unique_lock<boost::mutex> g(job->mutex);
+        while (job->hashed <= pages) {
+            int pg(job->hashed);
+            if (!job->ready[pg-1]) {
+                if (!job->collectNext(g)) {
+                    job->changed.wait(g);
+                }
+                continue;
+            }
+
+            PageFingerprintData page;
+            std::swap(page, job->pages[pg-1]);
+            g.unlock();
+
+            if(!page.characters.empty()) {
+                unsigned char *chars(reinterpret_cast< unsigned char * >(&page.characters[0]));
+                charhash1.update(chars, page.characters.size());
+                if (pg>1) {
+                    charhash2.update(chars, page.characters.size());
+                }
+            }
+
+            for(size_t i=0; i<page.images.size(); ++i) {
+                unsigned char *image(reinterpret_cast<unsigned char *>(page.images[i].first.get()));
+                size_t size(page.images[i].second);
+                imagehash1.update(image, size);
+                if (pg>1) {
+                    imagehash2.update(image, size);
                 }
-                c->nextImage();
             }
+
+            g.lock();
+            ++job->hashed;
+            job->changed.notify_all();
+        }
+        g.unlock();
+
+        if(charhash1.isValid()) {
+            d->charhash1=Fingerprint::character1FingerprintIri(charhash1.calculateHash());
+        } else {
+            d->charhash1.clear();
+        }
+
+        if(charhash2.isValid()) {
+            d->charhash2=Fingerprint::character2FingerprintIri(charhash2.calculateHash());
+        } else {
+            d->charhash2.clear();
         }
 
-        if(hash1.isValid()) {
-            d->imagehash1=Fingerprint::image1FingerprintIri(string(hash1.calculateHash()));
+        if(imagehash1.isValid()) {
+            d->imagehash1=Fingerprint::image1FingerprintIri(string(imagehash1.calculateHash()));
         } else {
             d->imagehash1.clear();
         }
-        if(hash2.isValid()) {
-            d->imagehash2=Fingerprint::image2FingerprintIri(string(hash2.calculateHash()));
+        if(imagehash2.isValid()) {
+            d->imagehash2=Fingerprint::image2FingerprintIri(string(imagehash2.calculateHash()));
         } else {
             d->imagehash2.clear();
         }
+
+        d->fingerprinted=true;
     }
 
     /****************************************************************************/
@@ -587,6 +808,7 @@ namespace Spine
     {
         size_t count(0);
 
+        this->prefetch();
         CursorHandle c(this->newCursor());
         const Word *w;
         while ( (w=c->word()) ) {
@@ -598,6 +820,18 @@ namespace Spine
 
     /****************************************************************************/
 
+    void Document::prefetch()
+    {}
+
+    void Document::prefetchFrom(int pageNumber)
+    {
+        if (pageNumber <= 1) {
+            this->prefetch();
+        }
+    }
+
+    /****************************************************************************/
+
     Image Document::render(int pageNumber, double resolution)
     {
         CursorHandle c(this->newCursor(pageNumber));
@@ -641,10 +875,30 @@ namespace Spine
 
     TextExtentSet Document::searchFrom(const TextIterator & start, const string & regexp, int options)
     {
+        const Page * page = start.cursor()->page();
+        this->prefetchFrom(page ? page->pageNumber() : 1);
         TextExtentHandle h(_cachedExtent(start, end()));
+        h->setWordIndexed(d->wordIndexEnabled);
         return (*h).search(regexp, options);
     }
 
+    std::vector< TextExtentSet > Document::searchMany(const std::vector< std::string > & terms, int options)
+    {
+        this->prefetch();
+        TextExtentHandle h(_cachedExtent(begin(), end()));
+        return (*h).searchMany(terms, options);
+    }
+
+    void Document::setWordIndexEnabled(bool enabled)
+    {
+        d->wordIndexEnabled = enabled;
+    }
+
+    bool Document::wordIndexEnabled() const
+    {
+        return d->wordIndexEnabled;
+    }
+
     TextExtentHandle Document::substr(int start, int len)
     {
         TextExtentHandle h(_cachedExtent(begin(), end()));
@@ -740,6 +994,7 @@ namespace Spine
 
     string Document::text()
     {
+        this->prefetch();
         TextExtentHandle h(_cachedExtent(begin(), end()));
         return (*h).text();
     }
@@ -845,6 +1100,7 @@ namespace Spine
                     if (d->annotationsByIdRefCount.find(ann_.get()) == d->annotationsByIdRefCount.end()) {
                         d->annotationsByIdRefCount[ann_.get()] = 0;
                         ann_->setProperty("concrete", "1");
+                        ann_->connectAreasChanged(&DocumentPrivate::annotationAreasChanged, d);
                     }
                     if (d->annotationsByParentIdRefCount.find(ann_.get()) == d->annotationsByParentIdRefCount.end()) {
                         d->annotationsByParentIdRefCount[ann_.get()] = 0;
@@ -852,6 +1108,7 @@ namespace Spine
 
                     d->annotationsById[id].insert(ann_);
                     d->annotationsByIdRefCount[ann_.get()] += 1;
+                    d->annotationIndexes[list].insert(ann_);
 
                     //cerr << "+++++ addAnnotation " << list << " - " << parent << endl;
                     if (!parent.empty()) {
@@ -883,6 +1140,8 @@ namespace Spine
 
                 // Remove the annotation
                 if (d->annotations[list].erase(ann_) > 0) {
+                    d->annotationIndexes[list].remove(ann_);
+
                     // Remove reference count if no longer needed, and make no longer
                     // concrete
                     d->annotationsByIdRefCount[ann_.get()] -= 1;
@@ -890,6 +1149,7 @@ namespace Spine
                         d->annotationsByIdRefCount.erase(ann_.get());
                         d->annotationsById[id].erase(ann_);
                         ann_->setProperty("concrete", "0");
+                        ann_->disconnectAreasChanged(&DocumentPrivate::annotationAreasChanged, d);
                     }
 
                     //cerr << "+++++ removeAnnotation " << list << " - " << parent << endl;
@@ -909,37 +1169,34 @@ namespace Spine
     AnnotationSet Document::annotationsAt(int page, const string & list) const
     {
         boost::lock_guard<boost::recursive_mutex> g(d->annotationsMutex);
-        AnnotationSet found;
-        map< string, AnnotationSet >::const_iterator found_list(d->annotations.find(list));
-        if (found_list != d->annotations.end())
+        map< string, AnnotationIndex >::const_iterator index(d->annotationIndexes.find(list));
+        if (index != d->annotationIndexes.end())
         {
-            BOOST_FOREACH(AnnotationHandle annotation, found_list->second)
-            {
-                if (annotation->contains(page))
-                {
-                    found.insert(annotation);
-                }
-            }
+            return index->second.annotationsAt(page);
         }
-        return found;
+        return AnnotationSet();
     }
 
     AnnotationSet Document::annotationsAt(int page, double x, double y, const string & list) const
     {
         boost::lock_guard<boost::recursive_mutex> g(d->annotationsMutex);
-        AnnotationSet found;
-        map< string, AnnotationSet >::const_iterator found_list(d->annotations.find(list));
-        if (found_list != d->annotations.end())
+        map< string, AnnotationIndex >::const_iterator index(d->annotationIndexes.find(list));
+        if (index != d->annotationIndexes.end())
         {
-            BOOST_FOREACH(AnnotationHandle annotation, found_list->second)
-            {
-                if (annotation->contains(page, x, y))
-                {
-                    found.insert(annotation);
-                }
-            }
+            return index->second.annotationsAt(page, x, y);
         }
-        return found;
+        return AnnotationSet();
+    }
+
+    AnnotationSet Document::annotationsWithin(int page, const BoundingBox & box, const string & list) const
+    {
+        boost::lock_guard<boost::recursive_mutex> g(d->annotationsMutex);
+        map< string, AnnotationIndex >::const_iterator index(d->annotationIndexes.find(list));
+        if (index != d->annotationIndexes.end())
+        {
+            return index->second.annotationsWithin(page, box);
+        }
+        return AnnotationSet();
     }
 
     AnnotationSet Document::annotationsSelected(const TextSelection & selection, const string & list) const
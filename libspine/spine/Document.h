@@ -119,6 +119,7 @@ namespace Spine
         virtual std::string pii();
         virtual std::string uniqueID(); // specific to derived class
         virtual std::string filehash() = 0;
+        virtual void calculateFingerprints();
         virtual void calculateCharacterFingerprints();
         virtual void calculateImageFingerprints();
         virtual std::string characterFingerprint1();
@@ -131,6 +132,12 @@ namespace Spine
         virtual size_t numberOfPages()=0;
         virtual size_t wordCount();
 
+        // Hint that the whole document is about to be walked, so that
+        // implementations may extract its pages ahead of time
+        virtual void prefetch();
+        // Likewise, from the given (1-based) page to the end
+        virtual void prefetchFrom(int pageNumber);
+
         virtual std::string title();
         virtual std::string subject();
         virtual std::string keywords();
@@ -160,6 +167,10 @@ namespace Spine
         TextIterator end();
         TextExtentSet search(const std::string & term, int options = DefaultSearchOptions);
         TextExtentSet searchFrom(const TextIterator & start, const std::string & term, int options = DefaultSearchOptions);
+        std::vector< TextExtentSet > searchMany(const std::vector< std::string > & terms, int options = DefaultSearchOptions);
+        // Case-insensitive word searches use a word index (on by default)
+        void setWordIndexEnabled(bool enabled);
+        bool wordIndexEnabled() const;
         TextExtentHandle resolveExtent(int page1, double x1, double y1, int page2, double x2, double y2);
         virtual std::string text();
         TextExtentHandle substr(int start, int len);
@@ -175,6 +186,7 @@ namespace Spine
         void removeAnnotations(const std::set< AnnotationHandle > & anns_, const std::string & list = std::string());
         std::set< AnnotationHandle > annotationsAt(int page, const std::string & list = std::string()) const;
         std::set< AnnotationHandle > annotationsAt(int page, double x, double y, const std::string & list = std::string()) const;
+        std::set< AnnotationHandle > annotationsWithin(int page, const BoundingBox & box, const std::string & list = std::string()) const;
         std::set< AnnotationHandle > annotationsSelected(const TextSelection & selection, const std::string & list = std::string()) const;
 
         // Selection
@@ -35,8 +35,11 @@
 
 #include <vector>
 #include <algorithm>
+#include <stdint.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
 
 #if 0
 struct DELETER {
@@ -60,6 +63,20 @@ namespace Spine {
 
         enum ImageType {Null, JPEG, RGB, Bitmap};
 
+        // Pixel layouts of a caller-supplied buffer that images and pages
+        // can be drawn into: packed 24-bit RGB, or 32-bit 0xffRRGGBB words
+        // in native byte order (as used by QImage::Format_RGB32)
+        enum PixelFormat {RGB888, XRGB32};
+
+        // Supplies the data of an image whose decoding has been deferred
+        // until its data is first asked for
+        class Source
+        {
+        public:
+            virtual ~Source() {}
+            virtual boost::shared_ptr<char> load(size_t & size_) = 0;
+        };
+
         Image()
             : _type(Null), _width(0), _height(0), _size(0)
         {
@@ -79,9 +96,26 @@ namespace Spine {
             std::copy(data_, data_+size_, _data.get());
         }
 
+        // Adopts data_ rather than copying it
+        Image(ImageType type_, int width_, int height_,
+              BoundingBox minmax_,
+              boost::shared_ptr<char> data_, size_t size_)
+            : _type(type_), _width(width_), _height(height_),
+              _box(minmax_), _data(data_), _size(size_)
+        {}
+
+        // Asks source_ for the data when it is first needed
+        Image(ImageType type_, int width_, int height_,
+              BoundingBox minmax_,
+              boost::shared_ptr<Source> source_)
+            : _type(type_), _width(width_), _height(height_),
+              _box(minmax_), _size(0), _deferred(new Deferred(source_))
+        {}
+
         Image(const Image &rhs_)
             : _type(rhs_._type), _width(rhs_._width), _height(rhs_._height),
-              _box(rhs_._box), _data(rhs_._data),_size(rhs_._size)
+              _box(rhs_._box), _data(rhs_._data),_size(rhs_._size),
+              _deferred(rhs_._deferred)
         {
             //printf("+++ IM %p\n", this);
         }
@@ -100,6 +134,7 @@ namespace Spine {
                 _box=rhs_._box;
                 _data=rhs_._data;
                 _size=rhs_._size;
+                _deferred=rhs_._deferred;
             }
 
             return *this;
@@ -130,24 +165,152 @@ namespace Spine {
             return _height;
         }
 
+        // The data of a deferred image is decoded on demand and kept only
+        // for as long as somebody holds on to what this returns
         boost::shared_ptr<char> data() const
         {
+            if (_deferred) {
+                return _deferred->load();
+            }
             return _data;
         }
 
         size_t size() const
         {
+            if (_deferred) {
+                return _deferred->loadSize();
+            }
             return _size;
         }
 
+        // Copies this (RGB) image into a buffer of height_ rows of stride_
+        // bytes; see copyPixels()
+        bool copyInto(unsigned char *buffer_, int width_, int height_,
+                      size_t stride_, PixelFormat format_) const
+        {
+            boost::shared_ptr<char> pixels(type() == RGB ? data() : boost::shared_ptr<char>());
+            if (!pixels) {
+                return false;
+            }
+            copyPixels(reinterpret_cast<const unsigned char *>(pixels.get()),
+                       _width, _height, _width*3,
+                       buffer_, width_, height_, stride_, format_);
+            return true;
+        }
+
+        // Scales this (RGB) image to exactly width_ x height_ pixels, by
+        // nearest neighbour, into a buffer of height_ rows of stride_ bytes
+        bool scaleInto(unsigned char *buffer_, int width_, int height_,
+                       size_t stride_, PixelFormat format_) const
+        {
+            boost::shared_ptr<char> pixels(type() == RGB ? data() : boost::shared_ptr<char>());
+            if (!pixels || _width <= 0 || _height <= 0) {
+                return false;
+            }
+            const unsigned char *src(reinterpret_cast<const unsigned char *>(pixels.get()));
+            if (_width == width_ && _height == height_) {
+                copyPixels(src, _width, _height, _width*3,
+                           buffer_, width_, height_, stride_, format_);
+                return true;
+            }
+            for (int y=0; y<height_; ++y) {
+                const unsigned char *row=src+(long long) y*_height/height_*_width*3;
+                unsigned char *dst=buffer_+y*stride_;
+                for (int x=0; x<width_; ++x) {
+                    const unsigned char *pixel=row+(long long) x*_width/width_*3;
+                    if (format_==RGB888) {
+                        std::copy(pixel, pixel+3, dst+x*3);
+                    } else {
+                        reinterpret_cast<uint32_t *>(dst)[x]=0xff000000u | (uint32_t(pixel[0])<<16) |
+                            (uint32_t(pixel[1])<<8) | uint32_t(pixel[2]);
+                    }
+                }
+            }
+            return true;
+        }
+
+        // Copies rows of packed 24-bit RGB pixels (which may run backwards
+        // if srcStride_ is negative) into a buffer of the given format,
+        // cropping them to width_ x height_, or padding them with white
+        static void copyPixels(const unsigned char *src_, int srcWidth_,
+                               int srcHeight_, long srcStride_,
+                               unsigned char *buffer_, int width_, int height_,
+                               size_t stride_, PixelFormat format_)
+        {
+            int w=std::min(srcWidth_, width_);
+            for (int y=0; y<height_; ++y) {
+                unsigned char *dst=buffer_+y*stride_;
+                int copied=0;
+                if (y<srcHeight_) {
+                    const unsigned char *src=src_+y*srcStride_;
+                    if (format_==RGB888) {
+                        std::copy(src, src+w*3, dst);
+                    } else {
+                        uint32_t *pixel=reinterpret_cast<uint32_t *>(dst);
+                        for (int x=0; x<w; ++x, src+=3) {
+                            pixel[x]=0xff000000u | (uint32_t(src[0])<<16) |
+                                     (uint32_t(src[1])<<8) | uint32_t(src[2]);
+                        }
+                    }
+                    copied=w;
+                }
+                if (copied<width_) {
+                    size_t bytes=(format_==RGB888 ? 3 : 4);
+                    std::fill(dst+copied*bytes, dst+width_*bytes, 0xff);
+                }
+            }
+        }
+
     private:
 
+        // Shared between copies, so that data in use by one copy is not
+        // decoded again for another. Decoded data is not pinned, so that
+        // images that are only passed over (e.g. when fingerprinting) don't
+        // all stay in memory; it is decoded again if asked for once freed.
+        struct Deferred
+        {
+            Deferred(boost::shared_ptr<Source> source_)
+                : source(source_), size(0), sized(false)
+            {}
+
+            boost::shared_ptr<char> load()
+            {
+                boost::lock_guard<boost::mutex> g(mutex);
+                boost::shared_ptr<char> loaded(data.lock());
+                if (!loaded) {
+                    loaded=source->load(size);
+                    sized=true;
+                    data=loaded;
+                }
+                return loaded;
+            }
+
+            size_t loadSize()
+            {
+                {
+                    boost::lock_guard<boost::mutex> g(mutex);
+                    if (sized) {
+                        return size;
+                    }
+                }
+                load();
+                return size;
+            }
+
+            boost::mutex mutex;
+            boost::shared_ptr<Source> source;
+            boost::weak_ptr<char> data;
+            size_t size;
+            bool sized;
+        };
+
         ImageType _type;
         int _width;
         int _height;
         BoundingBox _box;
         boost::shared_ptr<char> _data;
         size_t _size;
+        boost::shared_ptr<Deferred> _deferred;
     };
 
     typedef boost::shared_ptr< Image > ImageHandle;
@@ -66,6 +66,29 @@ namespace Spine
         virtual Image renderArea(const BoundingBox & slice,
                                  double resolution_,
                                  bool antialias_=true) const=0;
+
+        // As render() and renderArea(), but drawing straight into a
+        // caller-supplied buffer of height_ rows of stride_ bytes. The page
+        // is scaled to fill exactly width_ x height_ pixels, whatever its
+        // aspect ratio; a slice is drawn at the given resolution, and
+        // cropped or padded with white to fit. Back ends that can't do
+        // better render an Image and scale or copy it.
+        virtual bool renderInto(unsigned char *buffer_, int width_, int height_,
+                                size_t stride_, Image::PixelFormat format_,
+                                bool antialias_=true) const
+        {
+            return render(size_t(width_), size_t(height_), antialias_)
+                .scaleInto(buffer_, width_, height_, stride_, format_);
+        }
+        virtual bool renderAreaInto(const BoundingBox & slice,
+                                    double resolution_,
+                                    unsigned char *buffer_, int width_, int height_,
+                                    size_t stride_, Image::PixelFormat format_,
+                                    bool antialias_=true) const
+        {
+            return renderArea(slice, resolution_, antialias_)
+                .copyInto(buffer_, width_, height_, stride_, format_);
+        }
         virtual std::string text() const=0;
     };
 }
@@ -25,20 +25,466 @@
 #include <spine/Line.h>
 #include <spine/Page.h>
 #include <spine/Word.h>
+#include <spine/WordIndex.h>
 #include <spine/Character.h>
 #include <pcre.h>
 #include <pcrecpp.h>
 #include <string>
 #include <utf8/unicode.h>
 #include <algorithm>
+#include <cctype>
+#include <list>
+#include <map>
+#include <vector>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 
 using namespace std;
 using namespace utf8;
 using namespace pcrecpp;
 
+
+namespace
+{
+
+    /***************************************************************************
+     *
+     * Compiled patterns
+     *
+     **************************************************************************/
+
+    // Turns a search term into the regular expression that finds it
+    string patternFor(const string &term_, int options)
+    {
+        // initialise regex string
+        string regex;
+        if (!term_.empty()) {
+            if(options & Spine::RegExp) {
+                regex=term_;
+            } else {
+                regex=RE::QuoteMeta(term_);
+            }
+
+            if(options & Spine::WholeWordsOnly) {
+                // this was converted from previous boost using code but
+                // doesn't really make sense for regexs since the regex
+                // may match a non word pattern such as a particular type
+                // of punctuation
+                regex = "\\b" + regex + "\\b";
+            } else if(options & Spine::WordPrefix) {
+                regex = "\\b" + regex;
+            }
+        }
+        return regex;
+    }
+
+    class CompiledPattern
+    {
+    public:
+        CompiledPattern(pcre * re_, pcre_extra * extra_)
+            : re(re_), extra(extra_), substring_count(0)
+        {
+            pcre_fullinfo(re, extra, PCRE_INFO_CAPTURECOUNT, &substring_count);
+        }
+
+        ~CompiledPattern()
+        {
+            if (extra) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+                pcre_free_study(extra);
+#else
+                pcre_free(extra);
+#endif
+            }
+            pcre_free(re);
+        }
+
+        pcre * re;
+        pcre_extra * extra;
+        int substring_count;
+
+    private:
+        CompiledPattern(const CompiledPattern &);
+        CompiledPattern & operator = (const CompiledPattern &);
+    };
+
+    typedef boost::shared_ptr< CompiledPattern > CompiledPatternHandle;
+
+    // Least-recently-used cache of compiled and studied patterns, shared
+    // by all documents, as the same terms tend to be searched for again
+    // and again (by annotators, for example)
+    class PatternCache
+    {
+    public:
+        static PatternCache & instance()
+        {
+            static PatternCache cache;
+            return cache;
+        }
+
+        CompiledPatternHandle get(const string & regex_, int options)
+        {
+            // set options for regex
+            int opt = PCRE_UTF8;
+            if(options & Spine::IgnoreCase) {
+                opt |= PCRE_CASELESS;
+            }
+
+            Key key(regex_, opt);
+            {
+                boost::lock_guard< boost::mutex > g(_mutex);
+                Index::iterator found(_index.find(key));
+                if (found != _index.end()) {
+                    _entries.splice(_entries.begin(), _entries, found->second);
+                    return found->second->second;
+                }
+            }
+
+            // Compile the regular expression
+            const char * errptr = 0;
+            int erroffset = 0;
+            pcre * re = pcre_compile(regex_.c_str(), opt, &errptr, &erroffset, NULL);
+
+            // check regex was created OK
+            if(!re) {
+                throw Spine::TextExtent::regex_exception(regex_, string(errptr));
+            }
+
+            // Study it, which may well be worthwhile given it is kept
+#ifdef PCRE_STUDY_JIT_COMPILE
+            pcre_extra * extra = pcre_study(re, PCRE_STUDY_JIT_COMPILE, &errptr);
+#else
+            pcre_extra * extra = pcre_study(re, 0, &errptr);
+#endif
+            CompiledPatternHandle compiled(new CompiledPattern(re, extra));
+
+            boost::lock_guard< boost::mutex > g(_mutex);
+            if (_index.find(key) == _index.end()) {
+                _entries.push_front(std::make_pair(key, compiled));
+                _index[key] = _entries.begin();
+                if (_entries.size() > capacity) {
+                    _index.erase(_entries.back().first);
+                    _entries.pop_back();
+                }
+            }
+            return compiled;
+        }
+
+    private:
+        static const size_t capacity = 256;
+
+        typedef std::pair< string, int > Key;
+        typedef std::list< std::pair< Key, CompiledPatternHandle > > Entries;
+        typedef std::map< Key, Entries::iterator > Index;
+
+        boost::mutex _mutex;
+        Entries _entries;
+        Index _index;
+    };
+
+    void searchCompiled(const Spine::TextExtent & extent_, const string & text_,
+                        const CompiledPattern & pattern_, Spine::TextExtentSet & matches_)
+    {
+        // Set up output variables and dynamic offset
+        int substring_count = pattern_.substring_count;
+        int ovector_length = (substring_count + 1) * 3;
+        std::vector< int > ovector(ovector_length);
+        int offset = 0;
+
+        // Continue searching until complete
+        while (true) {
+            int rc = pcre_exec(pattern_.re,             /* the compiled pattern */
+                               pattern_.extra,          /* the result of studying it */
+                               text_.c_str(),           /* the subject string */
+                               text_.length(),          /* the length of the subject in bytes */
+                               offset,                  /* offset in the subject */
+                               0,                       /* default options */
+                               &ovector[0],             /* output vector for substring information */
+                               ovector_length);         /* number of elements in the output vector */
+
+            if (rc < 0) { // Error
+                break;
+            }
+
+            for (int i = 0; i < substring_count + 1; ++i) {
+                int match_offset = ovector[i * 2];
+                int match_length = ovector[i * 2 + 1] - match_offset;
+                if (i == 0) {
+                    offset = match_offset + match_length;
+                }
+                if (match_length > 0) {
+                    matches_.insert(Spine::TextExtentHandle(extent_.subExtentUtf8(match_offset, match_length)));
+                } else if (i == 0) {
+                    break;
+                }
+            }
+        }
+    }
+
+    /***************************************************************************
+     *
+     * PhraseMatcher
+     *
+     * An Aho-Corasick automaton over the UTF-8 bytes of a set of literal
+     * terms, finding every one of them in a single pass over the text. Its
+     * results are those the equivalent quoted regular expressions would
+     * give: leftmost, non-overlapping matches of each term.
+     *
+     **************************************************************************/
+
+    class PhraseMatcher
+    {
+    public:
+        PhraseMatcher()
+            : _nodes(1), _compiled(false)
+        {}
+
+        // Case-insensitive matching is only done here for ASCII terms, as
+        // PCRE's notion of caseless UTF-8 goes well beyond byte folding
+        static bool accepts(const string & term_, int options)
+        {
+            if (options & (Spine::RegExp | Spine::WordPrefix)) {
+                return false;
+            }
+            if (options & Spine::IgnoreCase) {
+                for (string::const_iterator c = term_.begin(); c != term_.end(); ++c) {
+                    if ((unsigned char) *c >= 0x80) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        void add(const string & term_, size_t id_)
+        {
+            size_t node = 0;
+            for (string::const_iterator c = term_.begin(); c != term_.end(); ++c) {
+                unsigned char ch = (unsigned char) *c;
+                std::map< unsigned char, size_t >::const_iterator next(_nodes[node].next.find(ch));
+                if (next == _nodes[node].next.end()) {
+                    _nodes.push_back(Node());
+                    _nodes[node].next[ch] = _nodes.size() - 1;
+                    node = _nodes.size() - 1;
+                } else {
+                    node = next->second;
+                }
+            }
+            _nodes[node].terms.push_back(id_);
+            _lengths.resize(std::max(_lengths.size(), id_ + 1));
+            _lengths[id_] = term_.length();
+            _compiled = false;
+        }
+
+        // Appends (term, offset) pairs to found_, offsets being in bytes
+        void scan(const string & text_, int options, std::vector< std::pair< size_t, size_t > > & found_)
+        {
+            bool fold = (options & Spine::IgnoreCase) != 0;
+            bool wholeWords = (options & Spine::WholeWordsOnly) != 0;
+            if (fold) {
+                _fold();
+            }
+            _compile();
+
+            // offset before which each term may not match again
+            std::vector< size_t > resume(_lengths.size(), 0);
+
+            size_t node = 0;
+            for (size_t pos = 0; pos < text_.length(); ++pos) {
+                unsigned char ch = (unsigned char) text_[pos];
+                if (fold) {
+                    ch = lower(ch);
+                }
+
+                std::map< unsigned char, size_t >::const_iterator next;
+                while ((next = _nodes[node].next.find(ch)) == _nodes[node].next.end() && node != 0) {
+                    node = _nodes[node].fail;
+                }
+                node = (next == _nodes[node].next.end()) ? 0 : next->second;
+
+                for (size_t out = _nodes[node].terms.empty() ? _nodes[node].output : node; out != 0; out = _nodes[out].output) {
+                    std::vector< size_t >::const_iterator term(_nodes[out].terms.begin());
+                    std::vector< size_t >::const_iterator term_end(_nodes[out].terms.end());
+                    for (; term != term_end; ++term) {
+                        size_t length = _lengths[*term];
+                        size_t start = pos + 1 - length;
+                        if (start < resume[*term]) {
+                            continue;
+                        }
+                        if (wholeWords && !(isWordBoundary(text_, start) && isWordBoundary(text_, pos + 1))) {
+                            continue;
+                        }
+                        found_.push_back(std::make_pair(*term, start));
+                        resume[*term] = pos + 1;
+                    }
+                }
+            }
+        }
+
+    private:
+        struct Node
+        {
+            Node() : fail(0), output(0) {}
+
+            std::map< unsigned char, size_t > next;
+            size_t fail;
+            // nearest node along the fail chain that completes a term
+            size_t output;
+            std::vector< size_t > terms;
+        };
+
+        static unsigned char lower(unsigned char ch_)
+        {
+            return (ch_ >= 'A' && ch_ <= 'Z') ? ch_ - 'A' + 'a' : ch_;
+        }
+
+        // As PCRE's \b in UTF-8 mode, where only ASCII counts as a word
+        static bool isWordCharacter(unsigned char ch_)
+        {
+            return ch_ < 0x80 && (isalnum(ch_) || ch_ == '_');
+        }
+
+        static bool isWordBoundary(const string & text_, size_t pos_)
+        {
+            bool before = pos_ > 0 && isWordCharacter((unsigned char) text_[pos_ - 1]);
+            bool after = pos_ < text_.length() && isWordCharacter((unsigned char) text_[pos_]);
+            return before != after;
+        }
+
+        // Rebuild the trie with lowercased terms
+        void _fold()
+        {
+            std::vector< Node > nodes(_nodes);
+            std::vector< std::pair< string, size_t > > terms;
+            _collect(nodes, 0, string(), terms);
+
+            _nodes.assign(1, Node());
+            std::vector< std::pair< string, size_t > >::const_iterator i(terms.begin());
+            for (; i != terms.end(); ++i) {
+                string term(i->first);
+                std::transform(term.begin(), term.end(), term.begin(), &PhraseMatcher::lower);
+                add(term, i->second);
+            }
+        }
+
+        static void _collect(const std::vector< Node > & nodes_, size_t node_, const string & prefix_,
+                             std::vector< std::pair< string, size_t > > & terms_)
+        {
+            for (size_t i = 0; i < nodes_[node_].terms.size(); ++i) {
+                terms_.push_back(std::make_pair(prefix_, nodes_[node_].terms[i]));
+            }
+            std::map< unsigned char, size_t >::const_iterator child(nodes_[node_].next.begin());
+            for (; child != nodes_[node_].next.end(); ++child) {
+                _collect(nodes_, child->second, prefix_ + (char) child->first, terms_);
+            }
+        }
+
+        // Breadth-first construction of the failure and output links
+        void _compile()
+        {
+            if (_compiled) {
+                return;
+            }
+
+            std::list< size_t > queue;
+            std::map< unsigned char, size_t >::const_iterator child(_nodes[0].next.begin());
+            for (; child != _nodes[0].next.end(); ++child) {
+                _nodes[child->second].fail = 0;
+                _nodes[child->second].output = 0;
+                queue.push_back(child->second);
+            }
+
+            while (!queue.empty()) {
+                size_t node = queue.front();
+                queue.pop_front();
+
+                for (child = _nodes[node].next.begin(); child != _nodes[node].next.end(); ++child) {
+                    size_t fail = _nodes[node].fail;
+                    std::map< unsigned char, size_t >::const_iterator next;
+                    while ((next = _nodes[fail].next.find(child->first)) == _nodes[fail].next.end() && fail != 0) {
+                        fail = _nodes[fail].fail;
+                    }
+                    fail = (next == _nodes[fail].next.end()) ? 0 : next->second;
+
+                    _nodes[child->second].fail = fail;
+                    _nodes[child->second].output = _nodes[fail].terms.empty() ? _nodes[fail].output : fail;
+                    queue.push_back(child->second);
+                }
+            }
+
+            _compiled = true;
+        }
+
+        std::vector< Node > _nodes;
+        std::vector< size_t > _lengths;
+        bool _compiled;
+    };
+
+}
+
 namespace Spine
 {
 
+    TextExtent::TextExtent(const TextExtent & other)
+        : _Base(other), _textCached(false), _wordIndexed(other._wordIndexed)
+    {
+        boost::lock_guard< boost::mutex > g(other._mutexCache);
+        _cached_text = other._cached_text;
+        _skiplist_utf8 = other._skiplist_utf8;
+        _skiplist_utf32 = other._skiplist_utf32;
+        _textCached = other._textCached;
+        _wordIndex = other._wordIndex;
+    }
+
+    TextExtent & TextExtent::operator = (const TextExtent & other)
+    {
+        if (&other != this) {
+            _Base::operator = (other);
+            std::string text;
+            std::map<size_t, TextIterator> skiplist_utf8;
+            std::map<size_t, TextIterator> skiplist_utf32;
+            bool textCached;
+            boost::shared_ptr< WordIndex > wordIndex;
+            {
+                boost::lock_guard< boost::mutex > g(other._mutexCache);
+                text = other._cached_text;
+                skiplist_utf8 = other._skiplist_utf8;
+                skiplist_utf32 = other._skiplist_utf32;
+                textCached = other._textCached;
+                wordIndex = other._wordIndex;
+            }
+            boost::lock_guard< boost::mutex > g(_mutexCache);
+            _cached_text.swap(text);
+            _skiplist_utf8.swap(skiplist_utf8);
+            _skiplist_utf32.swap(skiplist_utf32);
+            _textCached = textCached;
+            _wordIndex = wordIndex;
+            _wordIndexed = other._wordIndexed;
+        }
+        return *this;
+    }
+
+    void TextExtent::_ensureTextCached() const
+    {
+        boost::lock_guard< boost::mutex > g(_mutexCache);
+        if (!_textCached) {
+            _cacheText();
+            _textCached = true;
+        }
+    }
+
+    boost::shared_ptr< WordIndex > TextExtent::_ensureWordIndex() const
+    {
+        _ensureTextCached();
+
+        boost::lock_guard< boost::mutex > g(_mutexCache);
+        if (!_wordIndex) {
+            _wordIndex.reset(new WordIndex(_cached_text));
+        }
+        return _wordIndex;
+    }
+
     void TextExtent::_cacheText() const
     {
         // append utf8 representation of each character in turn onto
@@ -207,98 +653,74 @@ namespace Spine
     {
         Spine::TextExtentSet matches;
 
-        //std::cerr << "=== SEARCHING ===" << std::endl;
-        if (!regexp_.empty()) {
-            //std::cerr << "   orig regex: " << regexp_ << std::endl;
+        // Plain case-insensitive single words are looked up in the word
+        // index rather than scanning the whole text with a regex
+        if (isWordIndexed() && (options & IgnoreCase) && !(options & RegExp) && WordIndex::isWord(regexp_)) {
+            boost::shared_ptr< WordIndex > index(_ensureWordIndex());
 
-            // initialise regex string
-            string regex;
-            if(options & RegExp) {
-                regex=regexp_;
-            } else {
-                regex=RE::QuoteMeta(regexp_);
+            WordIndex::MatchType type = WordIndex::Substring;
+            if (options & WholeWordsOnly) {
+                type = WordIndex::WholeWord;
+            } else if (options & WordPrefix) {
+                type = WordIndex::Prefix;
             }
 
-            //std::cerr << "escaped regex: " << regex << std::endl;
-
-            if(options & WholeWordsOnly) {
-                // this was converted from previous boost using code but
-                // doesn't really make sense for regexs since the regex
-                // may match a non word pattern such as a particular type
-                // of punctuation
-                regex = "\\b" + regex + "\\b";
+            std::vector< WordIndex::Range > ranges(index->find(regexp_, type));
+            std::vector< WordIndex::Range >::const_iterator range(ranges.begin());
+            for (; range != ranges.end(); ++range) {
+                matches.insert(subExtentUtf8(range->first, range->second));
             }
+            return matches;
+        }
 
-            //std::cerr << "  final regex: " << regex << std::endl;
+        string regex(patternFor(regexp_, options));
+        if (!regex.empty()) {
+            CompiledPatternHandle re(PatternCache::instance().get(regex, options));
 
-            // set options for regex
-            int opt = PCRE_UTF8;
-            if(options & IgnoreCase) {
-                opt |= PCRE_CASELESS;
-            }
+            // cache text if not already
+            _ensureTextCached();
 
-            if (!regex.empty()) {
-                //std::cerr << "REGEX SEARCH " << regex << std::endl;
-
-                // Compile the regular expression
-                const char * errptr = 0;
-                int erroffset = 0;
-                pcre * re = pcre_compile(regex.c_str(), opt, &errptr, &erroffset, NULL);
+            searchCompiled(*this, _cached_text, *re, matches);
+        }
 
-                // check regex was created OK
-                if(!re) {
-                    throw TextExtent::regex_exception(regex, string(errptr));
-                }
+        return matches;
+    }
 
-                // cache text if not already
-                if(_cached_text.empty()) {
-                    _cacheText();
+    std::vector< Spine::TextExtentSet > TextExtent::searchMany(const std::vector< std::string > &terms_, int options) const
+    {
+        std::vector< Spine::TextExtentSet > matches(terms_.size());
+
+        // cache text if not already
+        _ensureTextCached();
+
+        // Literal terms are all found together in a single scan of the
+        // text; anything else falls back to a (cached) regex per term
+        PhraseMatcher matcher;
+        std::vector< size_t > literals;
+        for (size_t i = 0; i < terms_.size(); ++i) {
+            if (terms_[i].empty()) {
+                continue;
+            } else if (PhraseMatcher::accepts(terms_[i], options)) {
+                matcher.add(terms_[i], literals.size());
+                literals.push_back(i);
+            } else {
+                string regex(patternFor(terms_[i], options));
+                if (!regex.empty()) {
+                    CompiledPatternHandle re(PatternCache::instance().get(regex, options));
+                    searchCompiled(*this, _cached_text, *re, matches[i]);
                 }
+            }
+        }
 
-                // Find number of sub-string matches
-                int substring_count = 0;
-                pcre_fullinfo(re, NULL, PCRE_INFO_CAPTURECOUNT, &substring_count);
-
-                //std::cerr << "    regex info: " << substring_count << std::endl;
-
-                // Set up output variables and dynamic offset
-                int ovector_length = (substring_count + 1) * 3;
-                int ovector[ovector_length];
-                int offset = 0;
-
-                // Continue searching until complete
-                while (true) {
-                    int rc = pcre_exec(re,                      /* the compiled pattern */
-                                   NULL,                    /* no extra data - we didn't study the pattern */
-                                   _cached_text.c_str(),    /* the subject string */
-                                   _cached_text.length(),   /* the length of the subject in bytes */
-                                   offset,                  /* offset in the subject */
-                                   0,                       /* default options */
-                                   ovector,                 /* output vector for substring information */
-                                   ovector_length);          /* number of elements in the output vector */
-
-                    //std::cerr << " -> " << rc << std::endl;
-                    if (rc < 0) { // Error
-                        break;
-                    }
-
-                    for (int i = 0; i < substring_count + 1; ++i) {
-                        int match_offset = ovector[i * 2];
-                        int match_length = ovector[i * 2 + 1] - match_offset;
-                        if (i == 0) {
-                            offset = match_offset + match_length;
-                        }
-                        if (match_length > 0) {
-                            //std::cerr << "match " << i << " from " << match_offset << " length " << match_length << "       " << TextExtentHandle(subExtentUtf8(match_offset, match_length))->text() << std::endl;
-                            matches.insert(TextExtentHandle(subExtentUtf8(match_offset, match_length)));
-                        } else if (i == 0) {
-                            break;
-                        }
-                    }
-                }
+        if (!literals.empty()) {
+            std::vector< std::pair< size_t, size_t > > found;
+            matcher.scan(_cached_text, options, found);
 
-                // Delete regular expression
-                pcre_free(re);
+            std::vector< std::pair< size_t, size_t > >::const_iterator i(found.begin());
+            std::vector< std::pair< size_t, size_t > >::const_iterator i_end(found.end());
+            for (; i != i_end; ++i) {
+                size_t term = literals[i->first];
+                matches[term].insert(TextExtentHandle(subExtentUtf8(i->second, terms_[term].length())));
             }
         }
 
@@ -317,9 +739,7 @@ namespace Spine
                                                        const std::map<size_t,
                                                        TextIterator> &skiplist_) const {
 
-        if(_cached_text.empty()) {
-            _cacheText();
-        }
+        _ensureTextCached();
 
         // This returns an iterator pointing to the first element in
         // the container whose key compares greater than x
@@ -372,6 +792,21 @@ namespace Spine
         return Spine::TextExtentHandle(new TextExtent(*this));
     }
 
+    void TextExtent::setWordIndexed(bool indexed_)
+    {
+        boost::lock_guard< boost::mutex > g(_mutexCache);
+        _wordIndexed = indexed_;
+        if (!indexed_) {
+            _wordIndex.reset();
+        }
+    }
+
+    bool TextExtent::isWordIndexed() const
+    {
+        boost::lock_guard< boost::mutex > g(_mutexCache);
+        return _wordIndexed;
+    }
+
 }
 
 bool operator < (const Spine::TextExtentHandle & lhs, const Spine::TextExtentHandle & rhs)
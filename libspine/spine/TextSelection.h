@@ -25,6 +25,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
 #include <boost/shared_array.hpp>
+#include <boost/thread/mutex.hpp>
 #include <spine/spineapi.h>
 #include <spine/Area.h>
 #include <spine/BoundingBox.h>
@@ -50,6 +51,7 @@ namespace Spine
 {
 
     class Document;
+    class WordIndex;
 
     typedef enum
     {
@@ -57,6 +59,7 @@ namespace Spine
         IgnoreCase                      = 0x1,
         WholeWordsOnly                  = 0x2,
         RegExp                          = 0x4,
+        WordPrefix                      = 0x8,
 
         RegularExpression               = RegExp
     } SearchOptions;
@@ -107,8 +110,12 @@ namespace Spine
         {}
 #endif
         TextExtent(const TextIterator & first, const TextIterator & second)
-            : _Base(first, second)
+            : _Base(first, second), _textCached(false), _wordIndexed(false)
         {}
+
+        // Copies share whatever text and word index have been built so far
+        TextExtent(const TextExtent & other);
+        TextExtent & operator = (const TextExtent & other);
 #if 0
         TextExtent(const _Base & other)
             : _Base(other)
@@ -142,9 +149,7 @@ namespace Spine
 
         std::string text() const
         {
-            if(_cached_text.empty()) {
-                _cacheText();
-            }
+            _ensureTextCached();
             return _cached_text;
         }
 
@@ -157,11 +162,24 @@ namespace Spine
         AreaList areas() const;
         std::set< boost::shared_ptr< TextExtent >, ExtentCompare< TextExtent > >
             search(const std::string &regexp_, int options = DefaultSearchOptions) const;
+        // Search for many terms in one pass over the text, returning one
+        // set of matches per term, in the order the terms were given
+        std::vector< std::set< boost::shared_ptr< TextExtent >, ExtentCompare< TextExtent > > >
+            searchMany(const std::vector< std::string > &terms_, int options = DefaultSearchOptions) const;
         boost::shared_ptr< TextExtent > clone();
 
+        // Answer simple case-insensitive word searches from a word index,
+        // built over this extent's text the first time it is needed
+        void setWordIndexed(bool indexed_);
+        bool isWordIndexed() const;
+
     private:
 
         void _cacheText() const;
+        // Extents are shared between threads (e.g. by concurrent
+        // annotators), so the text and word index are built under a lock
+        void _ensureTextCached() const;
+        boost::shared_ptr< WordIndex > _ensureWordIndex() const;
         boost::shared_ptr< TextExtent > _cachedSubExtent(size_t start_, size_t length_,
                                                          const std::map<size_t,
                                                          TextIterator> &skiplist_) const;
@@ -172,6 +190,10 @@ namespace Spine
         mutable std::string _cached_text;
         mutable std::map<size_t, TextIterator> _skiplist_utf8;
         mutable std::map<size_t, TextIterator> _skiplist_utf32;
+        mutable bool _textCached;
+        mutable boost::shared_ptr< WordIndex > _wordIndex;
+        bool _wordIndexed;
+        mutable boost::mutex _mutexCache;
     };
 
     typedef boost::shared_ptr< TextExtent > TextExtentHandle;
@@ -0,0 +1,225 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libspine library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libspine library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libspine library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libspine library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * WordIndex.cpp
+ *
+ ****************************************************************************/
+
+#include <spine/WordIndex.h>
+
+#include <utf8/unicode.h>
+
+using namespace std;
+
+namespace
+{
+
+    // Letters, marks, numbers and connectors (such as '_') make up words
+    bool isWordCharacter(utf8proc_int32_t codepoint_)
+    {
+        switch (utf8proc_get_property(codepoint_)->category) {
+        case UTF8PROC_CATEGORY_LU:
+        case UTF8PROC_CATEGORY_LL:
+        case UTF8PROC_CATEGORY_LT:
+        case UTF8PROC_CATEGORY_LM:
+        case UTF8PROC_CATEGORY_LO:
+        case UTF8PROC_CATEGORY_MN:
+        case UTF8PROC_CATEGORY_MC:
+        case UTF8PROC_CATEGORY_ME:
+        case UTF8PROC_CATEGORY_ND:
+        case UTF8PROC_CATEGORY_NL:
+        case UTF8PROC_CATEGORY_NO:
+        case UTF8PROC_CATEGORY_PC:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Decode the codepoint at offset_, returning its length in octets
+    // (invalid octets are decoded as a single non-word codepoint)
+    size_t decode(const string & text_, size_t offset_, utf8proc_int32_t & codepoint_)
+    {
+        utf8proc_ssize_t length = utf8proc_iterate(reinterpret_cast< const utf8proc_uint8_t * >(text_.data() + offset_),
+                                                   text_.size() - offset_, &codepoint_);
+        if (length <= 0) {
+            codepoint_ = -1;
+            length = 1;
+        }
+        return length;
+    }
+
+    // Lowercase one codepoint at a time, noting whether the result has
+    // the same length as the original, codepoint for codepoint
+    string lowercase(const string & word_, bool & aligned_)
+    {
+        string result;
+        aligned_ = true;
+        for (size_t offset = 0; offset < word_.size();) {
+            utf8proc_int32_t codepoint;
+            size_t length = decode(word_, offset, codepoint);
+            if (codepoint < 0) {
+                result += word_[offset];
+            } else {
+                utf8proc_uint8_t encoded[4];
+                utf8proc_ssize_t encodedLength = utf8proc_encode_char(utf8proc_tolower(codepoint), encoded);
+                result.append(reinterpret_cast< const char * >(encoded), encodedLength);
+                aligned_ = aligned_ && (size_t) encodedLength == length;
+            }
+            offset += length;
+        }
+        return result;
+    }
+
+}
+
+namespace Spine
+{
+
+    WordIndex::WordIndex(const string & text_)
+    {
+        size_t offset = 0;
+        while (offset < text_.size()) {
+            // skip to the start of the next word
+            utf8proc_int32_t codepoint;
+            size_t length = decode(text_, offset, codepoint);
+            if (codepoint < 0 || !isWordCharacter(codepoint)) {
+                offset += length;
+                continue;
+            }
+
+            // and find its end
+            size_t end = offset + length;
+            while (end < text_.size()) {
+                length = decode(text_, end, codepoint);
+                if (codepoint < 0 || !isWordCharacter(codepoint)) {
+                    break;
+                }
+                end += length;
+            }
+
+            string word(text_, offset, end - offset);
+            bool aligned;
+            string lowered(lowercase(word, aligned));
+            string normalized(normalize(word));
+
+            Occurrence occurrence;
+            occurrence.offset = offset;
+            occurrence.length = end - offset;
+            occurrence.aligned = aligned && lowered == normalized;
+            _words[normalized].push_back(occurrence);
+
+            offset = end;
+        }
+    }
+
+    bool WordIndex::isWord(const string & term_)
+    {
+        if (term_.empty()) {
+            return false;
+        }
+        for (size_t offset = 0; offset < term_.size();) {
+            utf8proc_int32_t codepoint;
+            offset += decode(term_, offset, codepoint);
+            if (codepoint < 0 || !isWordCharacter(codepoint)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    string WordIndex::normalize(const string & word_)
+    {
+        string normalized;
+        try {
+            utf8::normalize_utf8(word_.begin(), word_.end(), back_inserter(normalized), utf8::NFKC);
+        } catch (utf8::exception &) {
+            normalized = word_;
+        }
+
+        bool aligned;
+        return lowercase(normalized, aligned);
+    }
+
+    vector< WordIndex::Range > WordIndex::find(const string & term_, MatchType type_) const
+    {
+        vector< Range > ranges;
+        string key(normalize(term_));
+        if (key.empty()) {
+            return ranges;
+        }
+
+        Words::const_iterator word;
+        Words::const_iterator word_end;
+        switch (type_) {
+        case WholeWord:
+            word = _words.find(key);
+            word_end = (word == _words.end()) ? word : ++Words::const_iterator(word);
+            break;
+        case Prefix:
+            word = _words.lower_bound(key);
+            for (word_end = word; word_end != _words.end() && word_end->first.compare(0, key.size(), key) == 0; ++word_end) {}
+            break;
+        default:
+            word = _words.begin();
+            word_end = _words.end();
+            break;
+        }
+
+        for (; word != word_end; ++word) {
+            // where, within the word, the term is found
+            vector< size_t > positions;
+            if (type_ == Substring) {
+                for (size_t position = word->first.find(key); position != string::npos; position = word->first.find(key, position + key.size())) {
+                    positions.push_back(position);
+                }
+                if (positions.empty()) {
+                    continue;
+                }
+            } else {
+                positions.push_back(0);
+            }
+
+            vector< Occurrence >::const_iterator occurrence(word->second.begin());
+            vector< Occurrence >::const_iterator occurrence_end(word->second.end());
+            for (; occurrence != occurrence_end; ++occurrence) {
+                if (occurrence->aligned) {
+                    vector< size_t >::const_iterator position(positions.begin());
+                    for (; position != positions.end(); ++position) {
+                        ranges.push_back(Range(occurrence->offset + *position, key.size()));
+                    }
+                } else {
+                    ranges.push_back(Range(occurrence->offset, occurrence->length));
+                }
+            }
+        }
+
+        return ranges;
+    }
+
+    size_t WordIndex::size() const
+    {
+        return _words.size();
+    }
+
+}
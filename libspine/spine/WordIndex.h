@@ -0,0 +1,91 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libspine library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libspine library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libspine library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libspine library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#ifndef LIBSPINE_WORDINDEX_INCL_
+#define LIBSPINE_WORDINDEX_INCL_
+
+/*****************************************************************************
+ *
+ * WordIndex.h
+ *
+ ****************************************************************************/
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Spine
+{
+
+    /***************************************************************************
+     *
+     * WordIndex
+     *
+     * An inverted index from the words of a UTF-8 text, normalised (NFKC)
+     * and lowercased, to where they occur in that text. It answers
+     * case-insensitive searches for a single word (as a whole word, a word
+     * prefix, or anywhere within a word) without scanning the text.
+     *
+     **************************************************************************/
+
+    class WordIndex
+    {
+    public:
+        typedef enum
+        {
+            WholeWord,
+            Prefix,
+            Substring
+        } MatchType;
+
+        typedef std::pair< size_t, size_t > Range; // offset and length in octets
+
+        explicit WordIndex(const std::string & text_);
+
+        // Can term_ be looked up (is it a single word)?
+        static bool isWord(const std::string & term_);
+
+        // The form in which words are indexed
+        static std::string normalize(const std::string & word_);
+
+        std::vector< Range > find(const std::string & term_, MatchType type_) const;
+
+        size_t size() const;
+
+    private:
+        struct Occurrence
+        {
+            size_t offset;
+            size_t length;
+            // Does each octet of the indexed form correspond to the same
+            // octet of the word as it appears in the text? If not, parts
+            // of this word can't be located, and matches cover all of it
+            bool aligned;
+        };
+
+        typedef std::map< std::string, std::vector< Occurrence > > Words;
+        Words _words;
+    };
+
+}
+
+#endif /* LIBSPINE_WORDINDEX_INCL_ */
@@ -37,6 +37,7 @@
 #include <spine/TextIterator.h>
 #include <spine/TextSelection.h>
 #include <spine/Word.h>
+#include <spine/WordIndex.h>
 #include <spine/utility.h>
 #include <spine/fingerprint.h>
 
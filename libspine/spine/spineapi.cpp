@@ -361,7 +361,10 @@ Spine_ImageType SpineImage_type(SpineImage img, SpineError *error)
 
 char *SpineImage_data(SpineImage img, SpineError *error)
 {
-    return img->_handle.data().get();
+    if (!img->_data) {
+        img->_data=img->_handle.data();
+    }
+    return img->_data.get();
 }
 
 /*****************************************************************************
@@ -419,6 +422,35 @@ void delete_SpineTextExtentList(SpineTextExtentList *list, SpineError *error)
     *list = 0;
 }
 
+/*****************************************************************************
+ *
+ * SpineTextExtentListArray
+ *
+ ****************************************************************************/
+
+SpineTextExtentListArray new_SpineTextExtentListArray(size_t entries, SpineError *error)
+{
+    SpineTextExtentListArray result = new SpineTextExtentListArrayImpl;
+
+    result->count=entries;
+    result->lists=new SpineTextExtentList[entries];
+    ::memset(result->lists, '\0', entries*sizeof(SpineTextExtentList));
+
+    return result;
+}
+
+void delete_SpineTextExtentListArray(SpineTextExtentListArray *array, SpineError *error)
+{
+    for (size_t i = 0; i < (*array)->count; ++i) {
+        if ((*array)->lists[i]) {
+            delete_SpineTextExtentList(&(*array)->lists[i], error);
+        }
+    }
+    delete [] (*array)->lists;
+    delete *array;
+    *array = 0;
+}
+
 /*****************************************************************************
  *
  * SpineAreaList
@@ -467,6 +499,53 @@ void delete_SpineAnnotationList(SpineAnnotationList *list, SpineError *error)
     *list = 0;
 }
 
+/*****************************************************************************
+ *
+ * SpineTextLayout
+ *
+ ****************************************************************************/
+
+SpineTextLayout new_SpineTextLayout(size_t characters, size_t words, size_t lines, size_t blocks, size_t fonts, SpineError *error)
+{
+    SpineTextLayout result = new SpineTextLayoutImpl;
+
+    result->count=characters;
+    result->wordCount=words;
+    result->lineCount=lines;
+    result->blockCount=blocks;
+
+    // Doubles first, so that every column is suitably aligned
+    size_t doubles=characters*6;
+    size_t integers=characters*2 + (words+1) + (lines+1) + (blocks+1);
+    result->size=doubles*sizeof(double) + integers*sizeof(uint32_t);
+    result->data=new char[result->size];
+    ::memset(result->data, '\0', result->size);
+
+    double *d=reinterpret_cast< double * >(result->data);
+    result->boxes=d;
+    result->fontSizes=(d+=characters*4);
+    result->baselines=(d+=characters);
+    uint32_t *u=reinterpret_cast< uint32_t * >(d+characters);
+    result->codepoints=u;
+    result->fonts=(u+=characters);
+    result->wordStarts=(u+=characters);
+    result->lineStarts=(u+=words+1);
+    result->blockStarts=(u+=lines+1);
+
+    result->fontNames=new_SpineSet(fonts, error);
+    ::memset(result->fontNames->values, '\0', fonts*sizeof(SpineString));
+
+    return result;
+}
+
+void delete_SpineTextLayout(SpineTextLayout *layout, SpineError *error)
+{
+    delete_SpineSet(&(*layout)->fontNames, error);
+    delete [] (*layout)->data;
+    delete *layout;
+    *layout = 0;
+}
+
 /*****************************************************************************
  *
  * TextExtent
@@ -1293,6 +1372,54 @@ SpineTextExtentList SpineDocument_searchFrom(SpineDocument doc, SpineCursor from
     return list;
 }
 
+SpineTextExtentListArray SpineDocument_searchMany(SpineDocument doc, SpineSet terms_, int options, SpineError *error)
+{
+    SpineTextExtentListArray array(0);
+
+    if (doc && terms_) {
+
+        std::vector< string > terms;
+        for (size_t i = 0; i < terms_->length && SpineError_ok(*error); ++i) {
+            terms.push_back(SpineString_asUTF8string(terms_->values[i], error));
+        }
+        if(SpineError_ok(*error)) {
+
+            try {
+                std::vector< Spine::TextExtentSet > results(doc->_handle->searchMany(
+                                                                terms, options));
+
+                array = new_SpineTextExtentListArray(results.size(), error);
+
+                for (size_t k = 0; k < results.size() && SpineError_ok(*error); ++k) {
+                    const Spine::TextExtentSet & extents(results[k]);
+                    SpineTextExtentList list = new_SpineTextExtentList(extents.size(), error);
+                    array->lists[k] = list;
+
+                    if (SpineError_ok(*error)) {
+                        Spine::TextExtentSet::const_iterator i(extents.begin());
+                        Spine::TextExtentSet::const_iterator i_end(extents.end());
+
+                        size_t j = 0;
+                        while(i != i_end && SpineError_ok(*error)) {
+                            list->extents[j] = copy_SpineTextExtent(*i, error);
+                            ++i; ++j;
+                        }
+                    }
+                }
+            }
+            catch (Spine::TextExtent::regex_exception)
+            {
+                setError(error, SpineError_InvalidRegex);
+            }
+        }
+
+    } else {
+        setError(error, SpineError_InvalidType);
+    }
+
+    return array;
+}
+
 SpineString SpineDocument_text(SpineDocument doc, SpineError *error)
 {
     if (doc) {
@@ -1398,6 +1525,79 @@ SpineTextExtent SpineDocument_resolveExtent(SpineDocument doc, int page1, double
     return result;
 }
 
+SpineTextLayout SpineDocument_pageTextLayout(SpineDocument doc, int page, SpineError *error)
+{
+    SpineTextLayout result(0);
+
+    if(!doc) {
+        setError(error, SpineError_InvalidType);
+        return result;
+    }
+
+    CursorHandle cursor(doc->_handle->newCursor(page));
+    if(!cursor->page()) {
+        setError(error, SpineError_InvalidArgument);
+        return result;
+    }
+
+    // Walk the page once, gathering characters in reading order and
+    // noting where each word, line and block begins
+    std::vector< const Character * > characters;
+    std::vector< uint32_t > wordStarts, lineStarts, blockStarts;
+    while (cursor->region()) {
+        while (cursor->block()) {
+            blockStarts.push_back(characters.size());
+            while (cursor->line()) {
+                lineStarts.push_back(characters.size());
+                while (cursor->word()) {
+                    wordStarts.push_back(characters.size());
+                    while (const Character * character = cursor->character()) {
+                        characters.push_back(character);
+                        cursor->nextCharacter();
+                    }
+                    cursor->nextWord();
+                }
+                cursor->nextLine();
+            }
+            cursor->nextBlock();
+        }
+        cursor->nextRegion();
+    }
+
+    std::map< string, uint32_t > fontIds;
+    std::vector< uint32_t > fonts;
+    fonts.reserve(characters.size());
+    BOOST_FOREACH(const Character * character, characters) {
+        std::map< string, uint32_t >::iterator found(fontIds.insert(std::make_pair(character->fontName(), (uint32_t) fontIds.size())).first);
+        fonts.push_back(found->second);
+    }
+
+    result=new_SpineTextLayout(characters.size(), wordStarts.size(), lineStarts.size(), blockStarts.size(), fontIds.size(), error);
+    for (size_t i = 0; i < characters.size(); ++i) {
+        const Character * character = characters[i];
+        BoundingBox bb(character->boundingBox());
+        result->boxes[i*4]=bb.x1;
+        result->boxes[i*4+1]=bb.y1;
+        result->boxes[i*4+2]=bb.x2;
+        result->boxes[i*4+3]=bb.y2;
+        result->fontSizes[i]=character->fontSize();
+        result->baselines[i]=character->baseline();
+        result->codepoints[i]=character->charcode();
+        result->fonts[i]=fonts[i];
+    }
+    std::copy(wordStarts.begin(), wordStarts.end(), result->wordStarts);
+    result->wordStarts[wordStarts.size()]=characters.size();
+    std::copy(lineStarts.begin(), lineStarts.end(), result->lineStarts);
+    result->lineStarts[lineStarts.size()]=characters.size();
+    std::copy(blockStarts.begin(), blockStarts.end(), result->blockStarts);
+    result->blockStarts[blockStarts.size()]=characters.size();
+    for (std::map< string, uint32_t >::const_iterator i = fontIds.begin(); i != fontIds.end(); ++i) {
+        result->fontNames->values[i->second]=new_SpineStringFromUTF8string(i->first, error);
+    }
+
+    return result;
+}
+
 /*****************************************************************************
  *
  * Cursor
@@ -35,6 +35,7 @@ extern "C" {
         Spine_IgnoreCase                      = 0x1,
         Spine_WholeWordsOnly                  = 0x2,
         Spine_RegExp                          = 0x4,
+        Spine_WordPrefix                      = 0x8,
     } Spine_RegexOption;
 
     typedef enum {
@@ -88,6 +89,11 @@ extern "C" {
         size_t count;
     } *SpineTextExtentList;
 
+    typedef struct SpineTextExtentListArrayImpl {
+        SpineTextExtentList * lists;
+        size_t count;
+    } *SpineTextExtentListArray;
+
     typedef struct {
         int page;
         int rotation;
@@ -107,6 +113,30 @@ extern "C" {
         size_t count;
     } *SpineAnnotationList;
 
+    /* Columnar text layout of a page: one entry per character in each of
+       the per-character arrays, all of which live in the single block
+       [data, data+size) so they can be handed on without further copying */
+    typedef struct SpineTextLayoutImpl {
+        char * data;
+        size_t size;
+
+        size_t count;           /* number of characters */
+        double * boxes;         /* x1, y1, x2, y2 for each character */
+        double * fontSizes;
+        double * baselines;
+        uint32_t * codepoints;
+        uint32_t * fonts;       /* indices into fontNames */
+
+        size_t wordCount;       /* words, lines and blocks are given as the */
+        uint32_t * wordStarts;  /* offsets of their first characters, with */
+        size_t lineCount;       /* one extra entry for the end of the page */
+        uint32_t * lineStarts;
+        size_t blockCount;
+        uint32_t * blockStarts;
+
+        SpineSet fontNames;
+    } *SpineTextLayout;
+
     typedef struct
     {
         double r;
@@ -146,6 +176,10 @@ extern "C" {
     SpineTextExtentList new_SpineTextExtentList(size_t entries, SpineError *error);
     void delete_SpineTextExtentList(SpineTextExtentList *list, SpineError *error);
 
+    /* SpineTextExtentListArray */
+    SpineTextExtentListArray new_SpineTextExtentListArray(size_t entries, SpineError *error);
+    void delete_SpineTextExtentListArray(SpineTextExtentListArray *array, SpineError *error);
+
     /* SpineAreaList */
     SpineAreaList new_SpineAreaList(size_t entries, SpineError *error);
     void delete_SpineAreaList(SpineAreaList *list, SpineError *error);
@@ -154,6 +188,10 @@ extern "C" {
     SpineAnnotationList new_SpineAnnotationList(size_t entries, SpineError *error);
     void delete_SpineAnnotationList(SpineAnnotationList *list, SpineError *error);
 
+    /* SpineTextLayout */
+    SpineTextLayout new_SpineTextLayout(size_t characters, size_t words, size_t lines, size_t blocks, size_t fonts, SpineError *error);
+    void delete_SpineTextLayout(SpineTextLayout *layout, SpineError *error);
+
     /* Document */
     typedef enum {
         SpineDocument_ViewDefault,
@@ -223,6 +261,7 @@ extern "C" {
 
     SpineTextExtentList SpineDocument_search(SpineDocument doc, SpineString regex, int options, SpineError *error);
     SpineTextExtentList SpineDocument_searchFrom(SpineDocument doc, SpineCursor start, SpineString regex, int options, SpineError *error);
+    SpineTextExtentListArray SpineDocument_searchMany(SpineDocument doc, SpineSet terms, int options, SpineError *error);
     SpineString SpineDocument_text(SpineDocument doc, SpineError *error);
     SpineTextExtent SpineDocument_substr(SpineDocument doc, int start, int len, SpineError *error);
 
@@ -235,6 +274,7 @@ extern "C" {
     void SpineDocument_removeAnnotation(SpineDocument doc, SpineAnnotation sa, SpineError *error);
     void SpineDocument_removeScratchAnnotation(SpineDocument doc, SpineAnnotation sa, SpineString list, SpineError *error);
     SpineTextExtent SpineDocument_resolveExtent(SpineDocument doc, int page1, double x1, double y1, int page2, double x2, double y2, SpineError *error);
+    SpineTextLayout SpineDocument_pageTextLayout(SpineDocument doc, int page, SpineError *error);
 
     /* Cursor */
     typedef enum { SpineCursor_DoNotIterate=0,
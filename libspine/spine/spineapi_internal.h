@@ -48,6 +48,8 @@ struct SpineTextExtentImpl {
 
 struct SpineImageImpl {
     Spine::Image _handle;
+    // keeps the data handed out by SpineImage_data() alive
+    boost::shared_ptr<char> _data;
 };
 
 #endif /* SPINEAPI_INTERNAL_INCL_ */
@@ -0,0 +1,121 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the libspine library.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   The libspine library is free software: you can redistribute it and/or
+ *   modify it under the terms of the GNU AFFERO GENERAL PUBLIC LICENSE
+ *   VERSION 3 as published by the Free Software Foundation.
+ *   
+ *   The libspine library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Affero
+ *   General Public License for more details.
+ *   
+ *   You should have received a copy of the GNU Affero General Public License
+ *   along with the libspine library. If not, see
+ *   <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * wordindex.cpp
+ *
+ * Pins down how word indexed searches differ from the regular expression
+ * searches they replace: words are NFKC normalised and split at Unicode
+ * (not ASCII) word boundaries, and words whose normalised form doesn't
+ * line up with the text match as a whole.
+ *
+ ****************************************************************************/
+
+#include <spine/WordIndex.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace Spine;
+
+namespace
+{
+
+    int failures = 0;
+
+    void check(bool passed_, const char * what_)
+    {
+        if (!passed_) {
+            fprintf(stderr, "FAILED: %s\n", what_);
+            ++failures;
+        }
+    }
+
+    typedef std::vector< WordIndex::Range > Ranges;
+
+    Ranges ranges(const WordIndex::Range * first_, size_t count_)
+    {
+        return Ranges(first_, first_ + count_);
+    }
+
+}
+
+int main()
+{
+    // Matching is case-insensitive
+    {
+        WordIndex index("Hello HELLO hello");
+        WordIndex::Range expected[] = { WordIndex::Range(0, 5), WordIndex::Range(6, 5), WordIndex::Range(12, 5) };
+        check(index.find("hello", WordIndex::WholeWord) == ranges(expected, 3), "case-insensitive whole words");
+        check(index.size() == 1, "case variants index as one word");
+    }
+
+    // Prefixes and substrings match within words, and cover only the term
+    {
+        WordIndex index("index indexes reindex");
+        Ranges prefixes(index.find("index", WordIndex::Prefix));
+        check(prefixes.size() == 2, "prefix matches");
+        Ranges whole(index.find("index", WordIndex::WholeWord));
+        check(whole.size() == 1 && whole[0] == WordIndex::Range(0, 5), "whole word excludes longer words");
+        Ranges within(index.find("index", WordIndex::Substring));
+        check(within.size() == 3, "substring matches");
+        check(!within.empty() && within.back() == WordIndex::Range(16, 5), "substring match covers only the term");
+    }
+
+    // Word boundaries are Unicode aware: an accented letter is part of its
+    // word, where PCRE's ASCII \b would split "café" after "caf"
+    {
+        WordIndex index("caf\xc3\xa9 au lait");
+        check(index.find("caf", WordIndex::WholeWord).empty(), "no whole word match inside an accented word");
+        Ranges cafe(index.find("caf\xc3\xa9", WordIndex::WholeWord));
+        check(cafe.size() == 1 && cafe[0] == WordIndex::Range(0, 5), "accented whole word");
+        check(index.find("CAF\xc3\x89", WordIndex::WholeWord).size() == 1, "accented letters fold case");
+    }
+
+    // Ligatures are normalised (NFKC), so "file" finds "\xef\xac\x81le"; as the
+    // normalised word doesn't line up with the text, the match covers the
+    // whole word rather than just the term
+    {
+        std::string text("the \xef\xac\x81le and pro\xef\xac\x81le");
+        WordIndex index(text);
+        Ranges whole(index.find("file", WordIndex::WholeWord));
+        check(whole.size() == 1 && whole[0] == WordIndex::Range(4, 5), "ligature matches as a whole word");
+        Ranges within(index.find("fi", WordIndex::Substring));
+        WordIndex::Range expected[] = { WordIndex::Range(4, 5), WordIndex::Range(14, 8) };
+        check(within == ranges(expected, 2), "substring match in a ligature word widens to the whole word");
+    }
+
+    // Only single words can be looked up
+    {
+        check(WordIndex::isWord("na\xc3\xafve"), "accented word is a word");
+        check(WordIndex::isWord("snake_case"), "connectors are part of words");
+        check(!WordIndex::isWord("two words"), "phrase is not a word");
+        check(!WordIndex::isWord("a.b"), "punctuation is not part of a word");
+        check(!WordIndex::isWord(""), "empty term is not a word");
+    }
+
+    if (failures == 0) {
+        printf("All word index tests passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
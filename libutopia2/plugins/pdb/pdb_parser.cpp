@@ -32,6 +32,8 @@
 #include "pdb_parser.h"
 #include <gtl/matrix.h>
 
+#include <QHash>
+
 namespace Utopia {
 
     // Constructor
@@ -638,6 +640,11 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
     //Node * c_Alignment = UtopiaDomain.term("Alignment");
     //Node * c_Sequence = UtopiaDomain.term("Sequence");
 
+    // Chains and residues are selected by these (see Utopia::select)
+    Node::attribution::createIndex("chainId");
+    Node::attribution::createIndex("seqId");
+    Node::attribution::createIndex("hetID");
+
     Node * authority = createAuthority();
     Node * model = authority->create("complex");
     authority->relations(Utopia::UtopiaSystem.hasPart).append(model);
@@ -666,6 +673,7 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
         QVector< QMap< QString, QString > > compndInfo;
         QString lastKey = "MOLECULE";
         QList< Heterogen > hetInfo;
+        QHash< QString, QString > hetNames;
         QString utopia_name = "Unknown Model";
         QString utopia_description = "No Header Information Found";
         QString classification = "";
@@ -738,6 +746,7 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
                 for (; het != end; ++het)
                     if ((*het).hetID == hetID)
                         (*het).name = name;
+                hetNames[hetID] = name;
             } else if (recordtype == "TURN  ") {
                 QChar chainId = line[19];
                 QString initSeqId = line.mid(20, 4).trimmed();
@@ -977,15 +986,7 @@ Node * PDBParser::parse(Parser::Context& ctx, QIODevice& stream_) const
 
                 molecule = model->create("heterogen");
                 model->relations(Utopia::UtopiaSystem.hasPart).append(molecule);
-                QString molname = "unknown";
-                QList< Heterogen >::iterator het = hetInfo.begin();
-                QList< Heterogen >::iterator end = hetInfo.end();
-                for (; het != end; ++het) {
-                    if ((*het).hetID == resSymbol) {
-                        molname = (*het).name;
-                        break;
-                    }
-                }
+                QString molname = hetNames.value(resSymbol, "unknown");
                 molecule->attributes.set("name", molname);
                 molecule->attributes.set("hetID", resSymbol);
                 chain_het = molecule;
@@ -41,12 +41,15 @@
 #include <boost/mpl/vector.hpp>
 
 #include "conversion.h"
+#include "pyworkerpool.h"
 #include "spine/pyspineapi.h"
 
 #include <string>
 #include <iostream>
 
+#include <QAtomicInt>
 #include <QDebug>
+#include <QSet>
 #include <QVariant>
 
 namespace python = boost::python;
@@ -133,15 +136,30 @@ public:
                             QRegExp parse("(before|on|after)_(\\w+)_event");
                             if (PyCallable_Check(py_attr) && parse.exactMatch(attr)) {
                                 int weight = 0;
+                                QString event(QString("%1:%2").arg(parse.cap(1)).arg(parse.cap(2)));
                                 if (PyObject * doc = PyObject_GetAttrString(py_attr, (char *) "__doc__")) {
+                                    QString docString(convert(doc).toString());
                                     QRegExp parseWeight(".*\\[(?:.+;)?\\s*weight=(-?\\d+)\\s*(?:;.+)?\\].*");
-                                    if (parseWeight.exactMatch(convert(doc).toString())) {
+                                    if (parseWeight.exactMatch(docString)) {
                                         weight = parseWeight.cap(1).toInt();
                                     }
+                                    // Dependencies, e.g. [consumes=on:load,citations; produces=links]
+                                    QRegExp parseConsumes("\\[(?:[^\\]]*;)?\\s*consumes=([^;\\]]*)");
+                                    if (parseConsumes.indexIn(docString) >= 0) {
+                                        _consumes[event] = parseConsumes.cap(1).split(',', QString::SkipEmptyParts).replaceInStrings(QRegExp("^\\s+|\\s+$"), QString());
+                                    }
+                                    QRegExp parseProduces("\\[(?:[^\\]]*;)?\\s*produces=([^;\\]]*)");
+                                    if (parseProduces.indexIn(docString) >= 0) {
+                                        _produces[event] = parseProduces.cap(1).split(',', QString::SkipEmptyParts).replaceInStrings(QRegExp("^\\s+|\\s+$"), QString());
+                                    }
+                                    // Out-of-process execution, e.g. [weight=10; isolated]
+                                    QRegExp parseIsolated("\\[(?:[^\\]]*;)?\\s*isolated\\s*(?:;[^\\]]*)?\\]");
+                                    if (parseIsolated.indexIn(docString) >= 0) {
+                                        _isolatedEvents << event;
+                                    }
                                     Py_DECREF(doc);
                                 }
 
-                                QString event(QString("%1:%2").arg(parse.cap(1)).arg(parse.cap(2)));
                                 _handleableEventNames << event;
                                 event += QString("/%1").arg(weight);
                                 _handleableEvents << event;
@@ -155,6 +173,19 @@ public:
                 PyErr_PrintEx(0);
             }
 
+            // Workers load the extension from the same plugin file
+            if (!_isolatedEvents.isEmpty()) {
+                std::string typeName(extensionTypeName());
+                if (PyObject * module = PyImport_AddModule(typeName.substr(0, typeName.rfind('.')).c_str())) {
+                    if (PyObject * file = PyObject_GetAttrString(module, (char *) "__file__")) {
+                        _extensionFile = convert(file).toString();
+                        Py_DECREF(file);
+                    } else {
+                        PyErr_Clear();
+                    }
+                }
+            }
+
             // Register legacy method names to event names
             QMapIterator< QString, QString > liter(event_name_to_legacy_method_name);
             while (liter.hasNext()) {
@@ -248,9 +279,35 @@ public:
         return success;
     }
 
+    // Run an isolated event handler in a worker process
+    PyWorkerPool::Outcome _annotateInWorker(const QString & name, Spine::DocumentHandle document, const QVariantMap & kwargs)
+    {
+        QVariantMap config;
+        if (Utopia::Configuration * conf = configuration()) {
+            foreach (const QString & key, conf->keys()) {
+                config[key] = conf->get(key);
+            }
+        }
+
+        QString error;
+        PyWorkerPool::Outcome outcome = PyWorkerPool::annotate(_extensionFile,
+                                                               QString::fromStdString(extensionTypeName()),
+                                                               name,
+                                                               document,
+                                                               kwargs,
+                                                               config,
+                                                               _workerCancelled,
+                                                               &error);
+        if (outcome == PyWorkerPool::Failed) {
+            setErrorString(Papyro::unicodeFromQString(error));
+        }
+        return outcome;
+    }
+
     // Ensure the extension is cancelled
     void cancel()
     {
+        _workerCancelled.store(1);
         PyExtension::cancel();
     }
 
@@ -265,6 +322,16 @@ public:
         return false;
     }
 
+    QStringList consumes(const QString & event)
+    {
+        return _consumes.value(event);
+    }
+
+    QStringList produces(const QString & event)
+    {
+        return _produces.value(event);
+    }
+
     QStringList handleableEvents()
     {
         QStringList unique(_handleableEvents + _handleableLegacyEvents);
@@ -275,10 +342,17 @@ public:
     bool handleEvent(const QString & event, Spine::DocumentHandle document, const QVariantMap & kwargs)
     {
         makeCancellable();
+        _workerCancelled.store(0);
 
         // Only attempt events we've registered
         if (_handleableEventNames.contains(event)) {
             QString name(event_name_to_method_name(event));
+            if (_isolatedEvents.contains(event) && PyWorkerPool::isEnabled()) {
+                PyWorkerPool::Outcome outcome = _annotateInWorker(name, document, kwargs);
+                if (outcome != PyWorkerPool::Unavailable) {
+                    return outcome == PyWorkerPool::Succeeded;
+                }
+            }
             return _annotate(Papyro::unicodeFromQString(name), document, kwargs);
         }
         if (_handleableLegacyEvents.contains(event)) {
@@ -436,6 +510,11 @@ protected:
     QStringList _handleableEvents;
     QStringList _handleableLegacyEvents;
     QStringList _handleableEventNames;
+    QMap< QString, QStringList > _consumes;
+    QMap< QString, QStringList > _produces;
+    QSet< QString > _isolatedEvents;
+    QString _extensionFile;
+    QAtomicInt _workerCancelled;
 };
 
 
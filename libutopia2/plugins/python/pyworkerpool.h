@@ -0,0 +1,345 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#include <Python.h>
+
+#include <papyro/utils.h>
+#include <spine/Annotation.h>
+#include <spine/Document.h>
+#include <utopia2/global.h>
+
+#include <boost/python.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <QAtomicInt>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QTemporaryFile>
+#include <QThreadStorage>
+#include <QVariant>
+
+#include <set>
+#include <string>
+
+#include <QDebug>
+
+namespace python = boost::python;
+
+
+
+
+/// PyWorker /////////////////////////////////////////////////////////////////
+
+// A single out-of-process Python interpreter running utopia.worker. Workers
+// are owned by (and only ever used from) the thread that started them.
+//
+// Workers isolate annotators from the application's process (and its GIL);
+// they are NOT a security sandbox. A worker starts in the temporary
+// directory with a clean environment, holding only the variables needed to
+// run Python, load its libraries and reach the network, but otherwise has the same filesystem
+// and network access as the application.
+
+class PyWorker
+{
+public:
+    PyWorker(const QString & interpreter, const QString & pythonPath)
+    {
+        static const char * inherited[] = {
+            "PATH", "LD_LIBRARY_PATH", "DYLD_LIBRARY_PATH", "PYTHONHOME",
+            "LANG", "LC_ALL", "LC_CTYPE", "TMPDIR", "TEMP", "TMP", "SYSTEMROOT",
+            "http_proxy", "https_proxy", "no_proxy", "HTTP_PROXY", "HTTPS_PROXY", "NO_PROXY"
+        };
+        QProcessEnvironment system(QProcessEnvironment::systemEnvironment());
+        QProcessEnvironment environment;
+        for (size_t i = 0; i < sizeof(inherited) / sizeof(inherited[0]); ++i) {
+            if (system.contains(inherited[i])) {
+                environment.insert(inherited[i], system.value(inherited[i]));
+            }
+        }
+        environment.insert("PYTHONPATH", pythonPath);
+        environment.insert("PYTHONDONTWRITEBYTECODE", "1");
+        environment.insert("PYTHONUNBUFFERED", "1");
+        _process.setProcessEnvironment(environment);
+        _process.setWorkingDirectory(QDir::tempPath());
+        _process.setStandardErrorFile(Utopia::profile_path(Utopia::ProfileLogs) + "/python-worker.log", QIODevice::Append);
+        _process.start(interpreter, QStringList() << "-m" << "utopia.worker");
+    }
+
+    ~PyWorker()
+    {
+        _process.closeWriteChannel();
+        if (!_process.waitForFinished(1000)) {
+            _process.kill();
+            _process.waitForFinished();
+        }
+    }
+
+    bool isRunning()
+    {
+        return _process.state() != QProcess::NotRunning;
+    }
+
+    bool waitForStarted()
+    {
+        return _process.waitForStarted();
+    }
+
+    // Send a request and block until its response arrives, the worker dies,
+    // or the caller cancels (in which case the worker is killed).
+    bool call(const QByteArray & request, QByteArray * response, const QAtomicInt & cancelled)
+    {
+        _process.write(request);
+        _process.write("\n");
+        while (!_process.canReadLine()) {
+            if (cancelled.load() || _process.state() == QProcess::NotRunning) {
+                _process.kill();
+                _process.waitForFinished();
+                return false;
+            }
+            _process.waitForReadyRead(100);
+        }
+
+        *response = _process.readLine();
+        return true;
+    }
+
+protected:
+    QProcess _process;
+};
+
+
+
+
+/// PyWorkerPool /////////////////////////////////////////////////////////////
+
+// Runs annotator methods in worker processes so that they are not serialised
+// on the embedded interpreter's global lock. Each thread of the annotator
+// thread pool gets its own worker, so the pool grows with (and shrinks
+// with) the number of annotators actually running at once.
+//
+// Workers are only used if the UTOPIA_PYTHON_WORKER environment variable
+// names a Python interpreter compatible with the embedded one.
+
+class PyWorkerPool
+{
+public:
+    typedef enum {
+        Unavailable, // The worker could not be used; run in-process instead
+        Succeeded,
+        Failed
+    } Outcome;
+
+    static QString interpreter()
+    {
+        static QString interpreter(QString::fromLocal8Bit(::getenv("UTOPIA_PYTHON_WORKER")));
+        return interpreter;
+    }
+
+    static bool isEnabled()
+    {
+        return !interpreter().isEmpty() && !broken().load();
+    }
+
+    static Outcome annotate(const QString & plugin,
+                            const QString & extension,
+                            const QString & method,
+                            Spine::DocumentHandle document,
+                            const QVariantMap & kwargs,
+                            const QVariantMap & config,
+                            const QAtomicInt & cancelled,
+                            QString * errorString)
+    {
+        // Only plain data can be sent to a worker
+        QMapIterator< QString, QVariant > iter(kwargs);
+        while (iter.hasNext()) {
+            iter.next();
+            if (!iter.value().isNull() && QJsonValue::fromVariant(iter.value()).isNull()) {
+                return Unavailable;
+            }
+        }
+
+        QJsonObject request;
+        request["plugin"] = plugin.isEmpty() ? QJsonValue() : QJsonValue(plugin);
+        request["extension"] = extension;
+        request["method"] = method;
+        request["kwargs"] = QJsonObject::fromVariantMap(kwargs);
+        request["config"] = QJsonObject::fromVariantMap(config);
+        if (document) {
+            QString path(documentPath(document));
+            if (path.isEmpty()) {
+                return Unavailable;
+            }
+            request["document"] = path;
+        }
+
+        PyWorker * worker = threadWorker();
+        QByteArray line;
+        if (!worker || !worker->call(QJsonDocument(request).toJson(QJsonDocument::Compact), &line, cancelled)) {
+            if (cancelled.load()) {
+                *errorString = "The user has cancelled this task.";
+                return Failed;
+            }
+            qDebug() << "Python worker unavailable for" << extension;
+            return Unavailable;
+        }
+
+        QJsonObject response(QJsonDocument::fromJson(line).object());
+        if (response.contains("error")) {
+            *errorString = response.value("error").toString();
+            return Failed;
+        }
+
+        // Rebuild the new annotations against the application's own document
+        if (document) {
+            QMap< QString, std::set< Spine::AnnotationHandle > > added;
+            foreach (const QJsonValue & value, response.value("annotations").toArray()) {
+                QJsonObject object(value.toObject());
+                Spine::AnnotationHandle annotation(new Spine::Annotation);
+                QJsonObject properties(object.value("properties").toObject());
+                QJsonObject::const_iterator property(properties.constBegin());
+                for (; property != properties.constEnd(); ++property) {
+                    std::string key(Papyro::unicodeFromQString(property.key()));
+                    foreach (const QJsonValue & propertyValue, property.value().toArray()) {
+                        annotation->setProperty(key, Papyro::unicodeFromQString(propertyValue.toString()));
+                    }
+                }
+                foreach (const QJsonValue & area, object.value("areas").toArray()) {
+                    QJsonArray a(area.toArray());
+                    if (a.size() == 6) {
+                        annotation->addArea(Spine::Area(a[0].toInt(), a[1].toInt(), Spine::BoundingBox(a[2].toDouble(), a[3].toDouble(), a[4].toDouble(), a[5].toDouble())));
+                    }
+                }
+                foreach (const QJsonValue & extent, object.value("extents").toArray()) {
+                    QJsonArray e(extent.toArray());
+                    if (e.size() == 6) {
+                        Spine::TextExtentHandle resolved(document->resolveExtent(e[0].toInt(), e[1].toDouble(), e[2].toDouble(), e[3].toInt(), e[4].toDouble(), e[5].toDouble()));
+                        if (resolved) {
+                            annotation->addExtent(resolved);
+                        }
+                    }
+                }
+                added[object.value("scratch").toString()].insert(annotation);
+            }
+            QMapIterator< QString, std::set< Spine::AnnotationHandle > > list(added);
+            while (list.hasNext()) {
+                list.next();
+                document->addAnnotations(list.value(), Papyro::unicodeFromQString(list.key()));
+            }
+        }
+
+        return Succeeded;
+    }
+
+protected:
+    // Set if the interpreter could not be started at all
+    static QAtomicInt & broken()
+    {
+        static QAtomicInt broken(0);
+        return broken;
+    }
+
+    // The embedded interpreter's module search path, handed on to workers
+    static QString pythonPath()
+    {
+        static QMutex mutex;
+        static QString path;
+        QMutexLocker guard(&mutex);
+        if (path.isNull()) {
+            PyGILState_STATE gstate;
+            gstate = PyGILState_Ensure();
+            try {
+                python::object sys(python::import("sys"));
+                python::object os(python::import("os"));
+                std::string joined = python::extract< std::string >(os.attr("pathsep").attr("join")(sys.attr("path")));
+                path = QString::fromUtf8(joined.c_str());
+            } catch (python::error_already_set e) {
+                PyErr_PrintEx(0);
+                path = "";
+            }
+            PyGILState_Release(gstate);
+        }
+        return path;
+    }
+
+    static PyWorker * threadWorker()
+    {
+        static QThreadStorage< PyWorker * > workers;
+        if (!workers.hasLocalData() || !workers.localData()->isRunning()) {
+            // Replaces (and deletes) any worker that has since died
+            workers.setLocalData(new PyWorker(interpreter(), pythonPath()));
+            if (!workers.localData()->waitForStarted()) {
+                qDebug() << "Unable to start Python worker" << interpreter();
+                broken().store(1);
+                return 0;
+            }
+        }
+        return workers.localData();
+    }
+
+    // Workers load documents from a file written once per document; the
+    // file lives for as long as the document does
+    static QString documentPath(Spine::DocumentHandle document)
+    {
+        typedef QPair< boost::weak_ptr< Spine::Document >, boost::shared_ptr< QTemporaryFile > > Entry;
+        static QMutex mutex;
+        static QMap< Spine::Document *, Entry > files;
+        QMutexLocker guard(&mutex);
+
+        QMutableMapIterator< Spine::Document *, Entry > iter(files);
+        while (iter.hasNext()) {
+            iter.next();
+            if (iter.value().first.expired()) {
+                iter.remove();
+            }
+        }
+
+        if (!files.contains(document.get())) {
+            boost::shared_ptr< QTemporaryFile > file(new QTemporaryFile(QDir::temp().filePath("utopia-worker-XXXXXX.pdf")));
+            if (!file->open()) {
+                return QString();
+            }
+            std::string data(document->data());
+            if (file->write(data.c_str(), data.size()) != (qint64) data.size()) {
+                return QString();
+            }
+            file->close();
+            files[document.get()] = Entry(document, file);
+        }
+        return files[document.get()].second->fileName();
+    }
+};
@@ -101,6 +101,7 @@
 %constant int RegExp=Spine_RegExp;
 %constant int IgnoreCase=Spine_IgnoreCase;
 %constant int WholeWordsOnly=Spine_WholeWordsOnly;
+%constant int WordPrefix=Spine_WordPrefix;
 
 %constant int DefaultView=SpineDocument_ViewDefault;
 %constant int OutlineView=SpineDocument_ViewOutlines;
@@ -352,6 +353,40 @@
     delete_SpineSet(&$1, 0);
 }
 
+%typemap(in) SpineSet
+{
+    if(PySequence_Check($input)) {
+        Py_ssize_t i, length=PySequence_Size($input);
+        $1=new_SpineSet(length, 0);
+        for(i=0; i < length; ++i) {
+            $1->values[i]=0;
+        }
+        for(i=0; i < length; ++i) {
+            PyObject *item=PySequence_GetItem($input, i);
+            if(PyUnicode_Check(item)) {
+                PyObject *tempstring=PyUnicode_AsUTF8String(item);
+                $1->values[i]=new_SpineStringFromUTF8(PyString_AsString(tempstring), PyString_Size(tempstring), 0);
+                Py_DECREF(tempstring);
+            } else if(PyString_Check(item)) {
+                $1->values[i]=new_SpineStringFromUTF8(PyString_AsString(item), PyString_Size(item), 0);
+            }
+            Py_XDECREF(item);
+            if(!$1->values[i]) {
+                PyErr_SetString(PyExc_ValueError,"Need a sequence of string or unicode arguments");
+                SWIG_fail;
+            }
+        }
+    } else {
+        PyErr_SetString(PyExc_ValueError,"Need a sequence of string or unicode arguments");
+        SWIG_fail;
+    }
+}
+
+%typemap(freearg) SpineSet
+{
+    delete_SpineSet(&$1, 0);
+}
+
 
 
 
@@ -392,6 +427,49 @@
 
 
 
+%typemap(out) SpineTextExtentListArray
+{
+    size_t i, j;
+    if($1) {
+        PyObject *lists=PyList_New($1->count);
+        for (i = 0; i < $1->count; ++i)
+        {
+            SpineTextExtentList extents = $1->lists[i];
+            PyObject *list=PyList_New(extents ? extents->count : 0);
+            for (j = 0; extents && j < extents->count; ++j)
+            {
+                struct TextExtent *ext = (struct TextExtent *)(malloc(sizeof(struct TextExtent)));
+                ext->_extent = extents->extents[j];
+                ext->_err = SpineError_NoError;
+                PyList_SetItem(list,
+                               j,
+                               SWIG_NewPointerObj((void *)(ext),
+                                                  SWIG_TypeQuery("_p_TextExtent"),
+                                                  SWIG_POINTER_OWN));
+            }
+            PyList_SetItem(lists, i, list);
+        }
+        $result = lists;
+    } else {
+        Py_INCREF(Py_None);
+        $result=Py_None;
+    }
+}
+
+
+%typemap(arginit) SpineTextExtentListArray
+{
+    $1 = 0;
+}
+
+%typemap(newfree) SpineTextExtentListArray
+{
+    delete_SpineTextExtentListArray(&$1, 0);
+}
+
+
+
+
 %typemap(out) SpineAnnotationList
 {
     size_t i;
@@ -498,10 +576,74 @@
 
 
 
+%typemap(out) SpineTextLayout
+{
+    /* One copy of the layout's block into a bytearray; the columns are
+       memoryview slices of that, so they share its storage */
+    if($1) {
+        PyObject *data=PyByteArray_FromStringAndSize($1->data, $1->size);
+        PyObject *view=PyMemoryView_FromObject(data);
+        PyObject *dict=PyDict_New();
+        PyObject *item;
+        size_t i;
+
+#define SPINE_LAYOUT_COLUMN(NAME, COUNT)                                \
+        {                                                               \
+            Py_ssize_t from=(char *) $1->NAME - $1->data;               \
+            Py_ssize_t to=from + (COUNT) * sizeof(*$1->NAME);           \
+            item=PySequence_GetSlice(view, from, to);                   \
+            PyDict_SetItemString(dict, #NAME, item);                    \
+            Py_DECREF(item);                                            \
+        }
+        SPINE_LAYOUT_COLUMN(boxes, $1->count * 4)
+        SPINE_LAYOUT_COLUMN(fontSizes, $1->count)
+        SPINE_LAYOUT_COLUMN(baselines, $1->count)
+        SPINE_LAYOUT_COLUMN(codepoints, $1->count)
+        SPINE_LAYOUT_COLUMN(fonts, $1->count)
+        SPINE_LAYOUT_COLUMN(wordStarts, $1->wordCount + 1)
+        SPINE_LAYOUT_COLUMN(lineStarts, $1->lineCount + 1)
+        SPINE_LAYOUT_COLUMN(blockStarts, $1->blockCount + 1)
+#undef SPINE_LAYOUT_COLUMN
+
+        item=PyInt_FromSize_t($1->count);
+        PyDict_SetItemString(dict, "count", item);
+        Py_DECREF(item);
+
+        item=PyList_New($1->fontNames->length);
+        for (i = 0; i < $1->fontNames->length; ++i)
+        {
+            PyList_SetItem(item, i, PyUnicode_DecodeUTF8($1->fontNames->values[i]->utf8, $1->fontNames->values[i]->length, 0));
+        }
+        PyDict_SetItemString(dict, "fontNames", item);
+        Py_DECREF(item);
+
+        Py_DECREF(view);
+        Py_DECREF(data);
+        $result = dict;
+    } else {
+        Py_INCREF(Py_None);
+        $result = Py_None;
+    }
+}
+
+%typemap(arginit) SpineTextLayout
+{
+    $1 = 0;
+}
+
+%typemap(newfree) SpineTextLayout
+{
+    delete_SpineTextLayout(&$1, 0);
+}
+
+
+
+
 %constant int DefaultSearchOptions=Spine_DefaultSearchOptions;
 %constant int RegExp=Spine_RegExp;
 %constant int IgnoreCase=Spine_IgnoreCase;
 %constant int WholeWordsOnly=Spine_WholeWordsOnly;
+%constant int WordPrefix=Spine_WordPrefix;
 
 %constant int DefaultView=SpineDocument_ViewDefault;
 %constant int OutlineView=SpineDocument_ViewOutlines;
@@ -824,6 +966,20 @@
         return result;
     }
 
+    %newobject _searchMany;
+    SpineTextExtentListArray _searchMany(const SpineSet terms, int options)
+    {
+        SpineTextExtentListArray result=SpineDocument_searchMany($self->_doc, terms, options, &$self->_err);
+        return result;
+    }
+
+    %newobject _pageTextLayout;
+    SpineTextLayout _pageTextLayout(int page)
+    {
+        SpineTextLayout result=SpineDocument_pageTextLayout($self->_doc, page, &$self->_err);
+        return result;
+    }
+
     %newobject text;
     SpineString text() {
         SpineString result=SpineDocument_text($self->_doc, &$self->_err);
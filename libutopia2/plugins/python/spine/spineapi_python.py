@@ -110,6 +110,15 @@
         else:
             return self._search(regex, options)
 
+    def searchMany(self, terms, options=DefaultSearchOptions):
+        return self._searchMany(list(terms), options)
+
+    def pageTextLayout(self, page):
+        '''Return the text layout of a page as a dictionary of columns, each
+        a memoryview of packed native values (see TextLayoutFormats), e.g.
+        numpy.frombuffer(layout['codepoints'], numpy.uint32).'''
+        return self._pageTextLayout(page)
+
     def findInContext(self, before, label, after, fuzzy = True):
         import re
         import spineapi
@@ -368,3 +377,17 @@
 
   %}
 }
+
+%pythoncode %{
+# array / struct typecodes of the columns returned by Document.pageTextLayout()
+TextLayoutFormats = {
+    'boxes': 'd',       # x1, y1, x2, y2 per character
+    'fontSizes': 'd',
+    'baselines': 'd',
+    'codepoints': 'I',
+    'fonts': 'I',       # indices into fontNames
+    'wordStarts': 'I',  # offsets of each word's first character, plus the end
+    'lineStarts': 'I',
+    'blockStarts': 'I',
+}
+%}
@@ -0,0 +1,172 @@
+###############################################################################
+#   
+#    This file is part of the Utopia Documents application.
+#        Copyright (c) 2008-2017 Lost Island Labs
+#            <info@utopiadocs.com>
+#    
+#    Utopia Documents is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+#    published by the Free Software Foundation.
+#    
+#    Utopia Documents is distributed in the hope that it will be useful, but
+#    WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+#    Public License for more details.
+#    
+#    In addition, as a special exception, the copyright holders give
+#    permission to link the code of portions of this program with the OpenSSL
+#    library under certain conditions as described in each individual source
+#    file, and distribute linked combinations including the two.
+#    
+#    You must obey the GNU General Public License in all respects for all of
+#    the code used other than OpenSSL. If you modify file(s) with this
+#    exception, you may extend this exception to your version of the file(s),
+#    but you are not obligated to do so. If you do not wish to do so, delete
+#    this exception statement from your version.
+#    
+#    You should have received a copy of the GNU General Public License
+#    along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+#   
+###############################################################################
+
+# Round trips through utopia.worker's line protocol, with a stub extension
+# and document standing in for the real (embedded) ones.
+
+import imp
+import json
+import os
+import StringIO
+import sys
+
+worker = imp.load_source('utopia_worker', os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'utopia', 'worker.py'))
+
+
+class StubExtent(object):
+    def __init__(self, areas):
+        self._areas = areas
+    def areas(self):
+        return self._areas
+
+class StubAnnotation(object):
+    def __init__(self, properties, areas = [], extents = []):
+        self._properties = properties
+        self._areas = areas
+        self._extents = extents
+    def properties(self):
+        return self._properties
+    def areas(self):
+        return self._areas
+    def extents(self):
+        return self._extents
+
+class StubDocument(object):
+    def __init__(self):
+        self.added = []
+    def addAnnotation(self, annotation, scratch = None):
+        self.added.append(annotation)
+    def addAnnotations(self, annotations, scratch = None):
+        self.added.extend(annotations)
+    def numberOfPages(self):
+        return 3
+
+class StubAnnotator(object):
+    def on_ready_event(self, document, **kwargs):
+        document.addAnnotation(StubAnnotation({'concept': ['Hyperlink'], 'property:webpageUrl': [self.get_config('url')]},
+                                              areas = [(1, 0, (10.0, 20.0), (30.0, 40.0))]))
+        document.addAnnotations([StubAnnotation({'concept': ['Definition'], 'property:term': [kwargs['term']]},
+                                                extents = [StubExtent([(1, 0, (100.0, 200.0), (150.0, 210.0)),
+                                                                       (2, 0, (50.0, 60.0), (90.0, 70.0))]),
+                                                           StubExtent([])])],
+                                'definitions')
+    def on_filter_event(self, **kwargs):
+        pass
+    def on_explode_event(self, document, **kwargs):
+        raise ValueError('exploded on page {0}'.format(document.numberOfPages()))
+    def on_silent_event(self, document, **kwargs):
+        raise RuntimeError()
+
+
+def roundtrip(requests):
+    stub = worker.Worker()
+    stub._extensions['stub.StubAnnotator'] = StubAnnotator()
+    stub._documents['/tmp/stub.pdf'] = StubDocument()
+    input = StringIO.StringIO(''.join((json.dumps(request) + '\n' for request in requests)))
+    output = StringIO.StringIO()
+    stderr, sys.stderr = sys.stderr, StringIO.StringIO()
+    try:
+        stub.run(input, output)
+    finally:
+        sys.stderr = stderr
+    lines = output.getvalue().splitlines()
+    assert len(lines) == len(requests)
+    return [json.loads(line) for line in lines]
+
+def request(method, document = '/tmp/stub.pdf', **kwargs):
+    return {'plugin': None, 'extension': 'stub.StubAnnotator', 'method': method,
+            'document': document, 'kwargs': kwargs, 'config': {'url': 'http://example.com/'}}
+
+
+## Tests
+
+def test_annotations():
+    (response,) = roundtrip([request('on_ready_event', term = 'utopia')])
+    annotations = response['annotations']
+    assert len(annotations) == 2
+    assert annotations[0]['scratch'] is None
+    assert annotations[0]['properties'] == {'concept': ['Hyperlink'], 'property:webpageUrl': ['http://example.com/']}
+    assert annotations[1]['scratch'] == 'definitions'
+    assert annotations[1]['properties'] == {'concept': ['Definition'], 'property:term': ['utopia']}
+
+def test_areas():
+    (response,) = roundtrip([request('on_ready_event', term = 'utopia')])
+    assert response['annotations'][0]['areas'] == [[1, 0, 10.0, 20.0, 30.0, 40.0]]
+    assert response['annotations'][1]['areas'] == []
+
+def test_extents():
+    # First and last characters' positions, just inside the extent; extents
+    # without areas are left out
+    (response,) = roundtrip([request('on_ready_event', term = 'utopia')])
+    assert response['annotations'][0]['extents'] == []
+    ((page1, x1, y1, page2, x2, y2),) = response['annotations'][1]['extents']
+    assert (page1, page2) == (1, 2)
+    assert abs(x1 - 100.01) < 1e-9 and abs(y1 - 205.0) < 1e-9
+    assert abs(x2 - 89.99) < 1e-9 and abs(y2 - 65.0) < 1e-9
+
+def test_no_document():
+    (response,) = roundtrip([request('on_filter_event', document = None)])
+    assert response == {'annotations': []}
+
+def test_errors():
+    # Errors are reported in place of the response, and the worker carries on
+    responses = roundtrip([request('on_explode_event'),
+                           request('on_silent_event'),
+                           request('on_missing_event'),
+                           request('on_ready_event', term = 'after')])
+    assert responses[0] == {'error': 'exploded on page 3'}
+    assert responses[1] == {'error': 'RuntimeError'}
+    assert 'error' in responses[2]
+    assert len(responses[3]['annotations']) == 2
+
+def test_malformed():
+    stub = worker.Worker()
+    output = StringIO.StringIO()
+    stderr, sys.stderr = sys.stderr, StringIO.StringIO()
+    try:
+        stub.run(StringIO.StringIO('not json\n'), output)
+    finally:
+        sys.stderr = stderr
+    assert 'error' in json.loads(output.getvalue())
+
+
+if __name__ == '__main__':
+    failures = 0
+    for name, test in sorted(globals().items()):
+        if name.startswith('test_') and callable(test):
+            try:
+                test()
+            except Exception:
+                import traceback
+                traceback.print_exc()
+                print('FAIL: ' + name)
+                failures += 1
+    sys.exit(1 if failures else 0)
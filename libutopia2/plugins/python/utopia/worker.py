@@ -0,0 +1,175 @@
+###############################################################################
+#   
+#    This file is part of the Utopia Documents application.
+#        Copyright (c) 2008-2017 Lost Island Labs
+#            <info@utopiadocs.com>
+#    
+#    Utopia Documents is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+#    published by the Free Software Foundation.
+#    
+#    Utopia Documents is distributed in the hope that it will be useful, but
+#    WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+#    Public License for more details.
+#    
+#    In addition, as a special exception, the copyright holders give
+#    permission to link the code of portions of this program with the OpenSSL
+#    library under certain conditions as described in each individual source
+#    file, and distribute linked combinations including the two.
+#    
+#    You must obey the GNU General Public License in all respects for all of
+#    the code used other than OpenSSL. If you modify file(s) with this
+#    exception, you may extend this exception to your version of the file(s),
+#    but you are not obligated to do so. If you do not wish to do so, delete
+#    this exception statement from your version.
+#    
+#    You should have received a copy of the GNU General Public License
+#    along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+#   
+###############################################################################
+
+
+# Out-of-process annotator worker.
+#
+# Annotators that declare themselves `isolated` can be run in a pool of these
+# worker processes rather than the embedded interpreter, so that their pure
+# Python work is not serialised on the application's GIL. The application
+# speaks to each worker over its standard input / output, one compact JSON
+# object per line:
+#
+#   request:  {"plugin": path, "extension": name, "method": name,
+#              "document": path, "kwargs": {...}, "config": {...}}
+#   response: {"annotations": [{"scratch": name, "properties": {key: [values]},
+#                               "areas": [[page, rotation, x1, y1, x2, y2]],
+#                               "extents": [[page1, x1, y1, page2, x2, y2]]}]}
+#         or: {"error": message}
+#
+# The document is loaded from a file that the application writes once per
+# document; its text layout comes from the on-disk layout cache that the
+# application has already populated, so nothing but the annotations that
+# the extension adds is ever serialised. Text extents are sent back as the
+# coordinates of their first and last characters, from which the
+# application resolves them against its own copy of the document.
+
+import json
+import os
+import sys
+import traceback
+
+
+
+
+class _RecordingDocumentWrapper:
+    def __init__(self, document):
+        self.__dict__['_document'] = document
+        self.__dict__['_added'] = []
+    def addAnnotation(self, annotation, scratch = None):
+        self._added.append((scratch, annotation))
+        return self._document.addAnnotation(annotation, scratch)
+    def addAnnotations(self, annotations, scratch = None):
+        annotations = list(annotations)
+        self._added.extend([(scratch, annotation) for annotation in annotations])
+        return self._document.addAnnotations(annotations, scratch)
+    def __getattr__(self, key):
+        return getattr(self._document, key)
+    def __setattr__(self, key, value):
+        setattr(self._document, key, value)
+
+
+def _serialiseExtent(extent):
+    areas = extent.areas()
+    if len(areas) > 0:
+        (page1, _, (left, top), (_, bottom)) = areas[0]
+        y1 = (top + bottom) / 2.0
+        (page2, _, (_, top), (right, bottom)) = areas[-1]
+        y2 = (top + bottom) / 2.0
+        return [page1, left + 0.01, y1, page2, right - 0.01, y2]
+
+def _serialiseAnnotation(scratch, annotation):
+    areas = [[page, rotation, x1, y1, x2, y2] for (page, rotation, (x1, y1), (x2, y2)) in annotation.areas()]
+    extents = [e for e in (_serialiseExtent(extent) for extent in annotation.extents()) if e is not None]
+    return {
+        'scratch': scratch,
+        'properties': annotation.properties(),
+        'areas': areas,
+        'extents': extents,
+    }
+
+
+class Worker(object):
+    def __init__(self):
+        self._extensions = {}
+        self._documents = {}
+
+    def extension(self, plugin, name):
+        extension = self._extensions.get(name)
+        if extension is None:
+            import utopia.document
+            module = name[:name.rfind('.')]
+            if module not in sys.modules and plugin is not None:
+                utopia.extension.loadPlugin(plugin)
+            extension = utopia.document.Annotator.typeOf(name)()
+            self._extensions[name] = extension
+        return extension
+
+    def document(self, path):
+        # Keep only the most recently used document
+        document = self._documents.get(path)
+        if document is None:
+            import crackleapi
+            document = crackleapi.loadPDF(path)
+            self._documents = {path: document}
+        return document
+
+    def handle(self, request):
+        extension = self.extension(request.get('plugin'), request['extension'])
+        config = request.get('config', {})
+        extension.get_config = lambda key, default = None: config.get(key, default)
+        extension.set_config = lambda key, value: config.__setitem__(key, value)
+        extension.del_config = lambda key: config.pop(key, None)
+        extension.postToBus = lambda *args: None
+
+        kwargs = dict(((str(k), v) for (k, v) in request.get('kwargs', {}).iteritems()))
+        document = None
+        if request.get('document') is not None:
+            document = _RecordingDocumentWrapper(self.document(request['document']))
+            kwargs['document'] = document
+
+        getattr(extension, request['method'])(**kwargs)
+
+        annotations = []
+        if document is not None:
+            annotations = [_serialiseAnnotation(scratch, annotation) for (scratch, annotation) in document._added]
+        return {'annotations': annotations}
+
+    def run(self, input, output):
+        while True:
+            line = input.readline()
+            if not line:
+                break
+            try:
+                response = self.handle(json.loads(line))
+            except Exception as e:
+                traceback.print_exc()
+                response = {'error': unicode(e) or e.__class__.__name__}
+            output.write(json.dumps(response, separators=(',', ':')))
+            output.write('\n')
+            output.flush()
+
+
+def main():
+    # Keep the protocol channel to ourselves; anything the extensions print
+    # goes to standard error, which the application sends to a log file
+    channel = os.fdopen(os.dup(sys.stdout.fileno()), 'w')
+    os.dup2(sys.stderr.fileno(), sys.stdout.fileno())
+    sys.stdout = sys.stderr
+
+    import logging
+    logging.basicConfig(format='%(asctime)s.%(msecs)03d %(levelname)s | worker {0} | %(message)s'.format(os.getpid()), level=logging.DEBUG, datefmt='%H:%M:%S')
+
+    import utopia.extension
+    Worker().run(sys.stdin, channel)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,210 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+/*****************************************************************************
+ *
+ * selectbench.cpp
+ *
+ * Measures how long typical structure selections take over a large PDB
+ * model, testing every Node of the model against testing only the
+ * candidates Utopia::select() gets from an index. Without a file, a
+ * synthetic model of some 90,000 atoms is used.
+ *
+ ****************************************************************************/
+
+#include <utopia2/utopia2.h>
+
+#include <QApplication>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+
+    // 26 chains of 400 lysines, and 5000 waters
+    QByteArray synthesise()
+    {
+        static const char * names[] = { " N  ", " CA ", " C  ", " O  ", " CB ", " CG ", " CD ", " CE " };
+        static const char * elements[] = { "N", "C", "C", "O", "C", "C", "C", "C" };
+
+        QByteArray pdb;
+        char line[128];
+        sprintf(line, "HEADER    %-40s%-9s   %-4s\n", "SYNTHETIC", "01-JAN-00", "1SYN");
+        pdb += line;
+        sprintf(line, "TITLE     %-60s\n", "SYNTHETIC SELECTION BENCHMARK");
+        pdb += line;
+
+        int serial = 0;
+        for (char chainId = 'A'; chainId <= 'Z'; ++chainId)
+        {
+            for (int seqId = 1; seqId <= 400; ++seqId)
+            {
+                for (int i = 0; i < 8; ++i)
+                {
+                    ++serial;
+                    sprintf(line, "ATOM  %5d %-4s LYS %c%4d    %8.3f%8.3f%8.3f  1.00  0.00          %2s  \n",
+                            serial % 100000, names[i], chainId, seqId,
+                            (chainId - 'A') * 10.0 + i, seqId * 3.8, i * 1.5, elements[i]);
+                    pdb += line;
+                }
+            }
+            sprintf(line, "TER   %5d      LYS %c%4d%54s\n", ++serial % 100000, chainId, 400, "");
+            pdb += line;
+        }
+        for (int seqId = 1; seqId <= 5000; ++seqId)
+        {
+            ++serial;
+            sprintf(line, "HETATM%5d  O   HOH W%4d    %8.3f%8.3f%8.3f  1.00  0.00           O  \n",
+                    serial % 100000, seqId, -10.0, seqId * 0.3, 0.0);
+            pdb += line;
+        }
+        pdb += "END\n";
+
+        return pdb;
+    }
+
+    struct Query
+    {
+        const char * name;
+        Utopia::criterion * criterion;
+    };
+
+    // Test every Node in the scope
+    QList< Utopia::Node * > scan(Utopia::List * scope_, Utopia::criterion * criterion_)
+    {
+        QList< Utopia::Node * > selected;
+        Utopia::List::iterator iter = scope_->begin();
+        Utopia::List::iterator end = scope_->end();
+        for (; iter != end; ++iter)
+        {
+            if ((*criterion_)(*iter))
+            {
+                selected.append(*iter);
+            }
+        }
+        return selected;
+    }
+
+}
+
+int main(int argc, char ** argv)
+{
+    QApplication app(argc, argv);
+    Utopia::init();
+
+    Utopia::FileFormat * format = Utopia::FileFormat::get("PDB");
+    if (format == 0 || Utopia::Parser::get(format) == 0)
+    {
+        fprintf(stderr, "no PDB parser is installed\n");
+        return 1;
+    }
+
+    int repeats = argc > 2 ? atoi(argv[2]) : 100;
+    if (repeats < 1)
+    {
+        repeats = 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    Utopia::Parser::Context ctx(0);
+    if (argc > 1)
+    {
+        ctx = Utopia::load(argv[1], format);
+    }
+    else
+    {
+        QBuffer buffer;
+        buffer.setData(synthesise());
+        buffer.open(QIODevice::ReadOnly);
+        ctx = Utopia::parse(buffer, format);
+    }
+    Utopia::Node * authority = ctx.model();
+    if (authority == 0)
+    {
+        fprintf(stderr, "cannot parse %s: %s\n", argc > 1 ? argv[1] : "synthetic model",
+                qPrintable(ctx.message()));
+        return 1;
+    }
+    Utopia::List * minions = authority->minions();
+    printf("parsed %lu nodes in %.3f seconds\n\n", (unsigned long) minions->size(), timer.elapsed() / 1000.0);
+
+    Utopia::HasType chains(Utopia::Node::getNode("chain"));
+    Utopia::HasAttributeValue< QString > chainA("chainId", "A");
+    Utopia::HasAttributeValue< QString > residue1("seqId", "1");
+    Utopia::HasAttributeValue< QString > water("hetID", "HOH");
+    Utopia::HasAttribute heterogens("hetID");
+    Utopia::AND chainAResidue1(&chainA, &residue1);
+    Query queries[] = {
+        { "chains", &chains },
+        { "chain A", &chainA },
+        { "residue 1", &residue1 },
+        { "chain A residue 1", &chainAResidue1 },
+        { "heterogens", &heterogens },
+        { "water", &water }
+    };
+
+    printf("%-20s %8s %12s %12s %8s\n", "query", "nodes", "scan (ms)", "select (ms)", "speedup");
+    for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i)
+    {
+        size_t scanned = 0;
+        timer.restart();
+        for (int repeat = 0; repeat < repeats; ++repeat)
+        {
+            scanned = scan(minions, queries[i].criterion).size();
+        }
+        double scanTime = timer.nsecsElapsed() / 1000000.0 / repeats;
+
+        size_t selected = 0;
+        timer.restart();
+        for (int repeat = 0; repeat < repeats; ++repeat)
+        {
+            selected = Utopia::select(minions, queries[i].criterion).size();
+        }
+        double selectTime = timer.nsecsElapsed() / 1000000.0 / repeats;
+
+        if (scanned != selected)
+        {
+            fprintf(stderr, "%s: select() found %lu nodes, but a scan found %lu\n",
+                    queries[i].name, (unsigned long) selected, (unsigned long) scanned);
+            return 1;
+        }
+        printf("%-20s %8lu %12.3f %12.3f %7.1fx\n", queries[i].name, (unsigned long) selected,
+               scanTime, selectTime, selectTime > 0 ? scanTime / selectTime : 0.0);
+    }
+
+    delete authority;
+    return 0;
+}
@@ -30,9 +30,44 @@
  *****************************************************************************/
 
 #include <utopia2/functional.h>
+#include <utopia2/propertylist.h>
 
 namespace Utopia
 {
+    QList< Node* > select(List* scope_, criterion* criterion_)
+    {
+        QList< Node* > selected;
+        int estimate = criterion_->ordered() ? -1 : criterion_->estimate();
+
+        if (estimate >= 0 && (size_t) estimate < scope_->size())
+        {
+            // Test only the candidates supplied by an index
+            QSet< Node* > candidates;
+            criterion_->candidates(candidates);
+            foreach (Node* node, candidates)
+            {
+                if (scope_->exists(node) && (*criterion_)(node))
+                {
+                    selected.append(node);
+                }
+            }
+        }
+        else
+        {
+            List::iterator iter = scope_->begin();
+            List::iterator end = scope_->end();
+            for (; iter != end; ++iter)
+            {
+                if ((*criterion_)(*iter))
+                {
+                    selected.append(*iter);
+                }
+            }
+        }
+
+        return selected;
+    }
+
     AND::AND(criterion* lhs_, criterion* rhs_)
         : _lhs(lhs_), _rhs(rhs_)
     {}
@@ -45,6 +80,33 @@ namespace Utopia
         return ((*_lhs)(node_) && (*_rhs)(node_));
     }
 
+    int AND::estimate()
+    {
+        // Either side's candidates will do, so use the fewer
+        int lhs = _lhs->estimate();
+        int rhs = _rhs->estimate();
+        return (lhs < 0 || (rhs >= 0 && rhs < lhs)) ? rhs : lhs;
+    }
+
+    void AND::candidates(QSet< Node* >& candidates_)
+    {
+        int lhs = _lhs->estimate();
+        int rhs = _rhs->estimate();
+        if (lhs < 0 || (rhs >= 0 && rhs < lhs))
+        {
+            _rhs->candidates(candidates_);
+        }
+        else
+        {
+            _lhs->candidates(candidates_);
+        }
+    }
+
+    bool AND::ordered() const
+    {
+        return _lhs->ordered() || _rhs->ordered();
+    }
+
     OR::OR(criterion* lhs_, criterion* rhs_)
         : _lhs(lhs_), _rhs(rhs_)
     {}
@@ -57,6 +119,25 @@ namespace Utopia
         return ((*_lhs)(node_) || (*_rhs)(node_));
     }
 
+    int OR::estimate()
+    {
+        // Both sides must be answerable from an index
+        int lhs = _lhs->estimate();
+        int rhs = _rhs->estimate();
+        return (lhs < 0 || rhs < 0) ? -1 : lhs + rhs;
+    }
+
+    void OR::candidates(QSet< Node* >& candidates_)
+    {
+        _lhs->candidates(candidates_);
+        _rhs->candidates(candidates_);
+    }
+
+    bool OR::ordered() const
+    {
+        return _lhs->ordered() || _rhs->ordered();
+    }
+
     HasAttribute::HasAttribute(QString key_)
         : _key(key_)
     {}
@@ -69,6 +150,85 @@ namespace Utopia
         return node_->attributes.exists(_key);
     }
 
+    int HasAttribute::estimate()
+    {
+        Node* key = Node::getNode(_key);
+        return (key && Node::attribution::isIndexed(key)) ? (int) Node::attribution::lookupCount(key) : -1;
+    }
+
+    void HasAttribute::candidates(QSet< Node* >& candidates_)
+    {
+        Node* key = Node::getNode(_key);
+        if (key && Node::attribution::isIndexed(key))
+        {
+            candidates_ += Node::attribution::lookup(key);
+        }
+    }
+
+    HasType::HasType(Node* type_)
+        : _type(type_)
+    {}
+
+    HasType::~HasType()
+    {}
+
+    bool HasType::operator () (Node* node_)
+    {
+        return node_->type() == _type;
+    }
+
+    int HasType::estimate()
+    {
+        // Types always know their instances
+        List* instances = _type ? _type->instances() : 0;
+        return instances ? (int) instances->size() : 0;
+    }
+
+    void HasType::candidates(QSet< Node* >& candidates_)
+    {
+        if (List* instances = _type ? _type->instances() : 0)
+        {
+            List::iterator iter = instances->begin();
+            List::iterator end = instances->end();
+            for (; iter != end; ++iter)
+            {
+                candidates_.insert(*iter);
+            }
+        }
+    }
+
+    RelatedTo::RelatedTo(const Property& property_, Node* target_)
+        : _property(property_), _target(target_)
+    {}
+
+    RelatedTo::~RelatedTo()
+    {}
+
+    bool RelatedTo::operator () (Node* node_)
+    {
+        return node_->relations(_property).exists(_target);
+    }
+
+    int RelatedTo::estimate()
+    {
+        // Relations are always stored in both directions
+        List* inverse = _target ? _target->relations._getDirectAccessList(~_property) : 0;
+        return inverse ? (int) inverse->size() : 0;
+    }
+
+    void RelatedTo::candidates(QSet< Node* >& candidates_)
+    {
+        if (List* inverse = _target ? _target->relations._getDirectAccessList(~_property) : 0)
+        {
+            List::iterator iter = inverse->begin();
+            List::iterator end = inverse->end();
+            for (; iter != end; ++iter)
+            {
+                candidates_.insert(*iter);
+            }
+        }
+    }
+
     AtPosition::AtPosition(int index_)
         : _index(index_), _found(false)
     {}
@@ -97,4 +257,9 @@ namespace Utopia
         return false;
     }
 
+    bool AtPosition::ordered() const
+    {
+        return true;
+    }
+
 } /* namespace Utopia */
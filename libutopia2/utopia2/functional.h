@@ -33,8 +33,11 @@
 #define Utopia_FUNCTIONAL_H
 
 #include <utopia2/config.h>
+#include <utopia2/list.h>
 #include <utopia2/node.h>
 
+#include <QList>
+#include <QSet>
 #include <QString>
 
 namespace Utopia
@@ -45,14 +48,31 @@ namespace Utopia
         virtual ~criterion() {};
         virtual bool operator () (Node* node_) = 0;
 
+        // Query planning: the number of candidates an index can supply for
+        // this criterion, or -1 if no index can answer it
+        virtual int estimate() { return -1; }
+        // Add to candidates_ a superset of the Nodes this criterion accepts
+        virtual void candidates(QSet< Node* >& candidates_) {}
+        // Does this criterion depend on the order Nodes are presented in?
+        virtual bool ordered() const { return false; }
+
     }; /* class criterion */
 
+    // Select those Nodes of scope_ that satisfy criterion_. Where the
+    // criterion can be answered from an index (types, relations, and indexed
+    // attributes) that is cheaper than scanning scope_, only the candidates
+    // it supplies are tested, and the result is in no particular order.
+    LIBUTOPIA_EXPORT QList< Node* > select(List* scope_, criterion* criterion_);
+
     class LIBUTOPIA_API AND : public criterion
     {
     public:
         AND(criterion* lhs_, criterion* rhs_);
         ~AND();
         bool operator () (Node* node_);
+        int estimate();
+        void candidates(QSet< Node* >& candidates_);
+        bool ordered() const;
 
     private:
         criterion* _lhs;
@@ -65,6 +85,9 @@ namespace Utopia
         OR(criterion* lhs_, criterion* rhs_);
         ~OR();
         bool operator () (Node* node_);
+        int estimate();
+        void candidates(QSet< Node* >& candidates_);
+        bool ordered() const;
 
     private:
         criterion* _lhs;
@@ -77,6 +100,8 @@ namespace Utopia
         HasAttribute(QString key_);
         ~HasAttribute();
         bool operator () (Node* node_);
+        int estimate();
+        void candidates(QSet< Node* >& candidates_);
 
     private:
         QString _key;
@@ -98,11 +123,70 @@ namespace Utopia
             return node_->attributes.exists(_key) && node_->attributes.get(_key).template value< value_type >() == _value;
         }
 
+        int estimate()
+        {
+            QString indexValue;
+            Node* key = indexKey(&indexValue);
+            return key ? (int) Node::attribution::lookupCount(key, indexValue) : -1;
+        }
+
+        void candidates(QSet< Node* >& candidates_)
+        {
+            QString indexValue;
+            if (Node* key = indexKey(&indexValue))
+            {
+                candidates_ += Node::attribution::lookup(key, indexValue);
+            }
+        }
+
     private:
         QString _key;
         value_type _value;
+
+        // Indexes compare values as strings, which only matches value<>()
+        // exactly for string values
+        Node* indexKey(QString* indexValue_)
+        {
+            Node* key = Node::getNode(_key);
+            if (key && Node::attribution::isIndexed(key) && indexValue(_value, indexValue_))
+            {
+                return key;
+            }
+            return 0;
+        }
+
+        template< typename other_type >
+        static bool indexValue(const other_type&, QString*) { return false; }
+        static bool indexValue(const QString& value_, QString* indexValue_) { *indexValue_ = value_; return true; }
     }; /* class HasAttributeValue */
 
+    class LIBUTOPIA_API HasType : public criterion
+    {
+    public:
+        HasType(Node* type_);
+        ~HasType();
+        bool operator () (Node* node_);
+        int estimate();
+        void candidates(QSet< Node* >& candidates_);
+
+    private:
+        Node* _type;
+    }; /* class HasType */
+
+    class LIBUTOPIA_API RelatedTo : public criterion
+    {
+    public:
+        RelatedTo(const Property& property_, Node* target_);
+        ~RelatedTo();
+        bool operator () (Node* node_);
+        int estimate();
+        void candidates(QSet< Node* >& candidates_);
+
+    private:
+        Property _property;
+        Node* _target;
+    }; /* class RelatedTo */
+
     class LIBUTOPIA_API AtPosition : public criterion
     {
     public:
@@ -111,6 +195,7 @@ namespace Utopia
         ~AtPosition();
 
         bool operator () (Node* node_);
+        bool ordered() const;
 
     private:
         int _index;
@@ -112,6 +112,12 @@ namespace Utopia
         return get()._uris;
     }
 
+    // Get attribute indexes
+    QHash< Node*, QMultiHash< QString, Node* > >& Node::Registry::indexes()
+    {
+        return get()._indexes;
+    }
+
     // Remove Node from URI map
     void Node::Registry::removeUri(Node* node_)
     {
@@ -224,6 +230,12 @@ namespace Utopia
         // Remove from authority
         setType(0);
 
+        // Drop any index keyed by this Node
+        if (!Registry::indexes().isEmpty())
+        {
+            attribution::dropIndex(this);
+        }
+
         // Has minions?
         if (_minions)
         {
@@ -434,6 +446,7 @@ namespace Utopia
                 Node::Registry::removeUri(&_node);
             }
 
+            unindex(&_node, key_, _attributes[key_]);
             delete _attributes[key_];
             _attributes.erase(key_);
         }
@@ -453,6 +466,7 @@ namespace Utopia
         AttributeMap::iterator end = _attributes.end();
         for (; iter != end; ++iter)
         {
+            unindex(&_node, iter->first, iter->second);
             delete iter->second;
         }
         _attributes.clear();
@@ -514,6 +528,131 @@ namespace Utopia
         Registry::addUri(node_);
     }
 
+    /** Index the values of an attribute key across all Nodes. */
+    void Node::attribution::createIndex(const QString& key_)
+    {
+        createIndex(fromURI(key_));
+    }
+
+    /**
+     *  \brief Index the values of an attribute key across all Nodes.
+     *
+     *  Only Nodes reachable from an authority are indexed. Once created, the
+     *  index is kept up to date as attributes are set and removed.
+     */
+    void Node::attribution::createIndex(Node* key_)
+    {
+        if (isIndexed(key_))
+        {
+            return;
+        }
+
+        QMultiHash< QString, Node* >& index = Registry::indexes()[key_];
+        foreach (Node* authority, Registry::authorities())
+        {
+            if (authority->attributes.exists(key_))
+            {
+                index.insert(authority->attributes.get(key_).toString(), authority);
+            }
+
+            List::iterator minion_iter = authority->_minions->begin();
+            List::iterator minion_end = authority->_minions->end();
+            for (; minion_iter != minion_end; ++minion_iter)
+            {
+                // Authorities are visited in their own right
+                if (!(*minion_iter)->_minions && (*minion_iter)->attributes.exists(key_))
+                {
+                    index.insert((*minion_iter)->attributes.get(key_).toString(), *minion_iter);
+                }
+            }
+        }
+    }
+
+    /** Stop indexing an attribute key. */
+    void Node::attribution::dropIndex(Node* key_)
+    {
+        Registry::indexes().remove(key_);
+    }
+
+    /** Is this attribute key indexed? */
+    bool Node::attribution::isIndexed(Node* key_)
+    {
+        return Registry::indexes().contains(key_);
+    }
+
+    /** All Nodes with an indexed attribute. */
+    QSet< Node* > Node::attribution::lookup(Node* key_)
+    {
+        QSet< Node* > found;
+        QHash< Node*, QMultiHash< QString, Node* > >::const_iterator index = Registry::indexes().constFind(key_);
+        if (index != Registry::indexes().constEnd())
+        {
+            QMultiHash< QString, Node* >::const_iterator iter = index->constBegin();
+            QMultiHash< QString, Node* >::const_iterator end = index->constEnd();
+            for (; iter != end; ++iter)
+            {
+                found.insert(iter.value());
+            }
+        }
+        return found;
+    }
+
+    /** All Nodes whose indexed attribute has the given (string) value. */
+    QSet< Node* > Node::attribution::lookup(Node* key_, const QString& value_)
+    {
+        QSet< Node* > found;
+        QHash< Node*, QMultiHash< QString, Node* > >::const_iterator index = Registry::indexes().constFind(key_);
+        if (index != Registry::indexes().constEnd())
+        {
+            QMultiHash< QString, Node* >::const_iterator iter = index->constFind(value_);
+            QMultiHash< QString, Node* >::const_iterator end = index->constEnd();
+            for (; iter != end && iter.key() == value_; ++iter)
+            {
+                found.insert(iter.value());
+            }
+        }
+        return found;
+    }
+
+    /** Number of Nodes with an indexed attribute. */
+    size_t Node::attribution::lookupCount(Node* key_)
+    {
+        return Registry::indexes().value(key_).size();
+    }
+
+    /** Number of Nodes whose indexed attribute has the given (string) value. */
+    size_t Node::attribution::lookupCount(Node* key_, const QString& value_)
+    {
+        QHash< Node*, QMultiHash< QString, Node* > >::const_iterator index = Registry::indexes().constFind(key_);
+        return index != Registry::indexes().constEnd() ? index->count(value_) : 0;
+    }
+
+    void Node::attribution::index(Node* node_, Node* key_, const QVariant* value_)
+    {
+        QHash< Node*, QMultiHash< QString, Node* > >& indexes = Registry::indexes();
+        if (!indexes.isEmpty())
+        {
+            QHash< Node*, QMultiHash< QString, Node* > >::iterator index = indexes.find(key_);
+            if (index != indexes.end())
+            {
+                index->insert(value_->toString(), node_);
+            }
+        }
+    }
+
+    void Node::attribution::unindex(Node* node_, Node* key_, const QVariant* value_)
+    {
+        QHash< Node*, QMultiHash< QString, Node* > >& indexes = Registry::indexes();
+        if (!indexes.isEmpty())
+        {
+            QHash< Node*, QMultiHash< QString, Node* > >::iterator index = indexes.find(key_);
+            if (index != indexes.end())
+            {
+                index->remove(value_->toString(), node_);
+            }
+        }
+    }
+
 
 
     //
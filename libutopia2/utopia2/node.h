@@ -40,8 +40,10 @@
 #include <utopia2/hashmap.h>
 
 #include <QString>
+#include <QHash>
 #include <QList>
 #include <QMap>
+#include <QSet>
 #include <QVariant>
 
 namespace Utopia
@@ -202,6 +204,7 @@ namespace Utopia
                         removeUri(&_node);
                     }
 
+                    unindex(&_node, key_, _attributes[key_]);
                     delete _attributes[key_];
                 }
 
@@ -209,6 +212,7 @@ namespace Utopia
                 QVariant * v = new QVariant(value_);
                 //qDebug() << "***** set" << v;
                 _attributes[key_] = v;
+                index(&_node, key_, v);
 
                 // Register URI if so
                 if (key_ == UtopiaSystem.uri)
@@ -217,6 +221,20 @@ namespace Utopia
                 }
             }
 
+            // Index the values of an attribute key across all Nodes
+            static void createIndex(const QString& key_);
+            static void createIndex(Node* key_);
+            // Stop indexing an attribute key
+            static void dropIndex(Node* key_);
+            // Is this attribute key indexed?
+            static bool isIndexed(Node* key_);
+            // Nodes with an indexed attribute, compared by its string value
+            static QSet< Node* > lookup(Node* key_);
+            static QSet< Node* > lookup(Node* key_, const QString& value_);
+            // Number of Nodes the above lookups would return
+            static size_t lookupCount(Node* key_);
+            static size_t lookupCount(Node* key_, const QString& value_);
+
         private:
             // Actual Node
             Node& _node;
@@ -232,6 +250,9 @@ namespace Utopia
             static Node* fromURI(QString uri_);
             static void removeUri(Node* node_);
             static void addUri(Node* node_);
+            // Maintain secondary indexes
+            static void index(Node* node_, Node* key_, const QVariant* value_);
+            static void unindex(Node* node_, Node* key_, const QVariant* value_);
 
         } attributes;
 
@@ -367,12 +388,16 @@ namespace Utopia
             static void removeUri(Node* node_);
             // Add Node to URI map
             static void addUri(Node* node_);
+            // Get attribute indexes (key -> value -> Nodes)
+            static QHash< Node*, QMultiHash< QString, Node* > >& indexes();
 
         private:
             // Authorities
             QSet< Node* > _authorities;
             // All URIs
             QMap< QString, Node* > _uris;
+            // Secondary attribute indexes, dropped along with their key
+            QHash< Node*, QMultiHash< QString, Node* > > _indexes;
             // Initialised?
             bool _initialised;
 
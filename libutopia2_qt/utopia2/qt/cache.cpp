@@ -0,0 +1,145 @@
+/*****************************************************************************
+ *  
+ *   This file is part of the Utopia Documents application.
+ *       Copyright (c) 2008-2017 Lost Island Labs
+ *           <info@utopiadocs.com>
+ *   
+ *   Utopia Documents is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU GENERAL PUBLIC LICENSE VERSION 3 as
+ *   published by the Free Software Foundation.
+ *   
+ *   Utopia Documents is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ *   Public License for more details.
+ *   
+ *   In addition, as a special exception, the copyright holders give
+ *   permission to link the code of portions of this program with the OpenSSL
+ *   library under certain conditions as described in each individual source
+ *   file, and distribute linked combinations including the two.
+ *   
+ *   You must obey the GNU General Public License in all respects for all of
+ *   the code used other than OpenSSL. If you modify file(s) with this
+ *   exception, you may extend this exception to your version of the file(s),
+ *   but you are not obligated to do so. If you do not wish to do so, delete
+ *   this exception statement from your version.
+ *   
+ *   You should have received a copy of the GNU General Public License
+ *   along with Utopia Documents. If not, see <http://www.gnu.org/licenses/>
+ *  
+ *****************************************************************************/
+
+#include <utopia2/qt/cache.h>
+
+#include <QAtomicInteger>
+#include <QList>
+
+namespace Utopia
+{
+
+    namespace
+    {
+
+        struct CacheBudgetData
+        {
+            CacheBudgetData()
+                : maximumCost(512 * 1024 * 1024)
+            {}
+
+            QMutex mutex;
+            QList< CacheBackend * > backends;
+            qint64 maximumCost;
+        };
+
+        CacheBudgetData & budget()
+        {
+            static CacheBudgetData data;
+            return data;
+        }
+
+    }
+
+
+
+
+    /// CacheBackend ////////////////////////////////////////////////////////////////////
+
+    qint64 CacheBackend::tick()
+    {
+        static QAtomicInteger< qint64 > clock;
+        return ++clock;
+    }
+
+
+
+
+    /// CacheBudget /////////////////////////////////////////////////////////////////////
+
+    void CacheBudget::attach(CacheBackend * backend)
+    {
+        QMutexLocker lock(&budget().mutex);
+        budget().backends.append(backend);
+    }
+
+    qint64 CacheBudget::cost()
+    {
+        QMutexLocker lock(&budget().mutex);
+        qint64 cost = 0;
+        foreach (CacheBackend * backend, budget().backends) {
+            cost += backend->cost();
+        }
+        return cost;
+    }
+
+    void CacheBudget::detach(CacheBackend * backend)
+    {
+        QMutexLocker lock(&budget().mutex);
+        budget().backends.removeAll(backend);
+    }
+
+    void CacheBudget::enforce()
+    {
+        QMutexLocker lock(&budget().mutex);
+        if (budget().maximumCost <= 0) {
+            return;
+        }
+
+        qint64 cost = 0;
+        foreach (CacheBackend * backend, budget().backends) {
+            cost += backend->cost();
+        }
+
+        // Evict whichever item, in whichever cache, was used least recently
+        while (cost > budget().maximumCost) {
+            CacheBackend * victim = 0;
+            qint64 victimOldest = -1;
+            foreach (CacheBackend * backend, budget().backends) {
+                qint64 oldest = backend->oldest();
+                if (oldest >= 0 && (victim == 0 || oldest < victimOldest)) {
+                    victim = backend;
+                    victimOldest = oldest;
+                }
+            }
+            if (victim == 0) {
+                break;
+            }
+            cost -= victim->evictOldest();
+        }
+    }
+
+    qint64 CacheBudget::maximumCost()
+    {
+        QMutexLocker lock(&budget().mutex);
+        return budget().maximumCost;
+    }
+
+    void CacheBudget::setMaximumCost(qint64 maximumCost)
+    {
+        {
+            QMutexLocker lock(&budget().mutex);
+            budget().maximumCost = maximumCost;
+        }
+        enforce();
+    }
+
+} // namespace Utopia
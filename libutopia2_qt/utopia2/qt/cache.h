@@ -32,61 +32,533 @@
 #ifndef Utopia_CACHE_H
 #define Utopia_CACHE_H
 
+#include <utopia2/qt/config.h>
 #include <utopia2/qt/cacheditem.h>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <QCryptographicHash>
 #include <QDataStream>
 #include <QDateTime>
 #include <QDir>
+#include <QHash>
+#include <QImage>
 #include <QMap>
+#include <QMultiMap>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QPair>
+#include <QPixmap>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSet>
 #include <QString>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 #include <QtDebug>
 
+#include <list>
+
 namespace Utopia
 {
 
+    // The cost of keeping an item in a cache, in (approximate) bytes; images
+    // cost what their pixels occupy, and anything else its own size
     template< class Item >
-    class CachePrivate
+    inline qint64 cacheCost(const Item & /* item */)
+    {
+        return sizeof(Item);
+    }
+
+    inline qint64 cacheCost(const QImage & image)
+    {
+        return image.byteCount();
+    }
+
+    inline qint64 cacheCost(const QPixmap & pixmap)
+    {
+        return qint64(pixmap.width()) * pixmap.height() * qMax(pixmap.depth(), 8) / 8;
+    }
+
+    struct CacheStatistics
+    {
+        CacheStatistics()
+            : count(0), cost(0), hits(0), misses(0), evictions(0),
+              diskCount(0), diskSize(0), diskReads(0), diskWrites(0), diskEvictions(0)
+        {}
+
+        int count;
+        qint64 cost;
+        quint64 hits;
+        quint64 misses;
+        quint64 evictions;
+
+        // Persistent caches only
+        int diskCount;
+        qint64 diskSize;
+        quint64 diskReads;
+        quint64 diskWrites;
+        quint64 diskEvictions;
+    };
+
+    // Every cache backend, whatever the type of its items, is also one of
+    // these, so that they can all be held to the same memory budget
+    class LIBUTOPIA_QT_API CacheBackend
+    {
+    public:
+        virtual ~CacheBackend() {}
+
+        // Total cost of the items held
+        virtual qint64 cost() const = 0;
+        // When the least recently used item was last used (as a value of
+        // tick()), or -1 if there are no items
+        virtual qint64 oldest() const = 0;
+        // Remove the least recently used item, returning its cost
+        virtual qint64 evictOldest() = 0;
+
+        // A clock shared by all caches, so that their items' recency can be
+        // compared with one another
+        static qint64 tick();
+    };
+
+    // The memory budget shared by all (named) caches; when exceeded, the
+    // least recently used items across all of them are evicted
+    class LIBUTOPIA_QT_API CacheBudget
+    {
+    public:
+        // A zero maximum cost means the budget is unrestricted
+        static qint64 maximumCost();
+        static void setMaximumCost(qint64 maximumCost);
+
+        static qint64 cost();
+        static void enforce();
+
+        static void attach(CacheBackend * backend);
+        static void detach(CacheBackend * backend);
+    };
+
+    template< class Item > class CachePrivate;
+
+    // Writes a persistent cache's pending changes to disk in the background
+    template< class Item >
+    class CacheWriter : public QRunnable
+    {
+    public:
+        CacheWriter(CachePrivate< Item > * cache)
+            : cache(cache)
+        {}
+
+        void run()
+        {
+            cache->write();
+        }
+
+    private:
+        CachePrivate< Item > * cache;
+    };
+
+    template< class Item >
+    class CachePrivate : public CacheBackend
     {
     public:
         typedef CachePrivate< Item > CachePrivateClass;
         typedef CachedItem< Item > CachedItemClass;
 
+        // Least recently used at the front
+        typedef std::list< QString > RecencyList;
+
+        struct Entry
+        {
+            CachedItemClass item;
+            bool used;
+            qint64 cost;
+            qint64 touched;
+            typename RecencyList::iterator recency;
+        };
+
+        // What a persistent cache holds on disk, one file per item
+        struct DiskEntry
+        {
+            qint64 size;
+            QDateTime modified;
+        };
+
         // Create a new cache backend with the specified path name
         CachePrivate(const QString & path = QString())
-            : path(path), maximumSize(0), mutex(QMutex::Recursive)
-        {}
+            : path(path), maximumSize(0), maximumCost(0), totalCost(0), mutex(QMutex::Recursive),
+              persistent(!path.isEmpty() && !path.startsWith(":")), directory(path),
+              diskSize(0), maximumDiskSize(256 * 1024 * 1024), writerRunning(false)
+        {
+            if (!path.isEmpty()) {
+                CacheBudget::attach(this);
+            }
+        }
         ~CachePrivate()
-        {}
+        {
+            // Must happen before anything is destroyed, as the budget may be
+            // evicting from this cache as we speak
+            if (!path.isEmpty()) {
+                CacheBudget::detach(this);
+            }
+
+            // Anything not yet on disk is written now
+            if (persistent) {
+                flush();
+            }
+        }
 
         // Path name of cache
         QString path;
         // Items stored in cache
-        QMap< QString, QPair< CachedItemClass, bool > > items;
-        // Maximum size
+        QHash< QString, Entry > items;
+        // Maximum number of items
         int maximumSize;
+        // Maximum total cost of items
+        qint64 maximumCost;
+        // Total cost of items
+        qint64 totalCost;
         // Recently used items
-        QList< QString > recentlyUsed;
+        RecencyList recentlyUsed;
+        // Counters
+        CacheStatistics statistics;
 
         // Mutex for concurrent access to this cache backend
-        QMutex mutex;
+        mutable QMutex mutex;
+
+        // Persistence, for caches whose path is a directory; only an index
+        // of the items on disk is read up front, each item being loaded
+        // when it is first asked for
+        bool persistent;
+        QDir directory;
+        QHash< QString, DiskEntry > disk;
+        qint64 diskSize;
+        qint64 maximumDiskSize;
+
+        // Changes not yet on disk, which are written in batches by a
+        // CacheWriter in the background
+        QHash< QString, CachedItemClass > pendingWrites;
+        QHash< QString, CachedItemClass > inFlightWrites;
+        QSet< QString > pendingRemovals;
+        QMutex writerMutex;
+        QWaitCondition writerDone;
+        bool writerRunning;
+
+        void insert(const CachedItemClass & item, bool used, qint64 cost)
+        {
+            erase(item.id());
+            Entry & entry(items[item.id()]);
+            entry.item = item;
+            entry.used = used;
+            entry.cost = cost;
+            entry.touched = tick();
+            entry.recency = recentlyUsed.insert(recentlyUsed.end(), item.id());
+            totalCost += cost;
+        }
+
+        bool erase(const QString & id)
+        {
+            typename QHash< QString, Entry >::iterator found(items.find(id));
+            if (found == items.end()) {
+                return false;
+            }
+            totalCost -= found->cost;
+            recentlyUsed.erase(found->recency);
+            items.erase(found);
+            return true;
+        }
+
+        void touch(Entry & entry)
+        {
+            recentlyUsed.splice(recentlyUsed.end(), recentlyUsed, entry.recency);
+            entry.touched = tick();
+            entry.item.touch();
+            entry.used = true;
+        }
+
+        // Find an item, loading it from disk if need be; the result is
+        // invalid if there is no such item
+        CachedItemClass fetch(const QString & id)
+        {
+            typename QHash< QString, Entry >::iterator found(items.find(id));
+            if (found != items.end()) {
+                ++statistics.hits;
+                touch(*found);
+                return found->item;
+            }
+
+            CachedItemClass item;
+            if (persistent) {
+                if (pendingWrites.contains(id)) {
+                    item = pendingWrites.value(id);
+                } else if (inFlightWrites.contains(id) && !pendingRemovals.contains(id)) {
+                    item = inFlightWrites.value(id);
+                } else if (disk.contains(id)) {
+                    QFile file(filePathOf(id));
+                    if (file.open(QIODevice::ReadOnly)) {
+                        QDataStream str(&file);
+                        str >> item;
+                        ++statistics.diskReads;
+                    }
+                    // Missing or damaged files are forgotten
+                    if (!item.isValid() || item.id() != id) {
+                        diskSize -= disk.take(id).size;
+                        item = CachedItemClass();
+                    }
+                }
+            }
+
+            if (item.isValid()) {
+                ++statistics.hits;
+                insert(item, true, cacheCost(item.item()));
+                resize();
+            } else {
+                ++statistics.misses;
+            }
+            return item;
+        }
+
+        bool contains(const QString & id) const
+        {
+            return items.contains(id) || pendingWrites.contains(id) ||
+                   (disk.contains(id) && !pendingRemovals.contains(id)) ||
+                   (inFlightWrites.contains(id) && !pendingRemovals.contains(id));
+        }
+
+        void persist(const CachedItemClass & item)
+        {
+            if (persistent) {
+                pendingWrites[item.id()] = item;
+                scheduleWrite();
+            }
+        }
+
+        void unpersist(const QString & id)
+        {
+            if (persistent) {
+                pendingWrites.remove(id);
+                if (disk.contains(id)) {
+                    diskSize -= disk.take(id).size;
+                }
+                pendingRemovals.insert(id);
+                scheduleWrite();
+            }
+        }
+
+        void unpersistAll()
+        {
+            if (persistent) {
+                pendingWrites.clear();
+                foreach (const QString & id, disk.keys() + inFlightWrites.keys()) {
+                    pendingRemovals.insert(id);
+                }
+                disk.clear();
+                diskSize = 0;
+                scheduleWrite();
+            }
+        }
+
+        QString filePathOf(const QString & id) const
+        {
+            return directory.filePath(QCryptographicHash::hash(id.toUtf8(), QCryptographicHash::Sha1).toHex() + ".cache");
+        }
+
+        QString indexPath() const
+        {
+            return directory.filePath("index");
+        }
+
+        // Must be called with the mutex held
+        void scheduleWrite()
+        {
+            QMutexLocker writer(&writerMutex);
+            if (!writerRunning) {
+                writerRunning = true;
+                QThreadPool::globalInstance()->start(new CacheWriter< Item >(this));
+            }
+        }
+
+        // Must be called without the mutex held; waits for any background
+        // write, then writes whatever remains
+        void flush()
+        {
+            {
+                QMutexLocker writer(&writerMutex);
+                while (writerRunning) {
+                    writerDone.wait(&writerMutex);
+                }
+                writerRunning = true;
+            }
+            write();
+        }
+
+        // Write pending changes to disk, batch by batch, until there are none
+        void write()
+        {
+            forever {
+                QHash< QString, CachedItemClass > writes;
+                QSet< QString > removals;
+                {
+                    QMutexLocker lock(&mutex);
+                    if (pendingWrites.isEmpty() && pendingRemovals.isEmpty()) {
+                        QMutexLocker writer(&writerMutex);
+                        writerRunning = false;
+                        writerDone.wakeAll();
+                        return;
+                    }
+                    writes.swap(pendingWrites);
+                    removals.swap(pendingRemovals);
+                    inFlightWrites = writes;
+                }
+
+                // The disk is only touched without the lock held
+                foreach (const QString & id, removals) {
+                    QFile::remove(filePathOf(id));
+                }
+                QHash< QString, DiskEntry > written;
+                QHashIterator< QString, CachedItemClass > iter(writes);
+                while (iter.hasNext()) {
+                    iter.next();
+                    if (!directory.exists() && !QDir().mkpath(directory.path())) {
+                        break;
+                    }
+                    QSaveFile file(filePathOf(iter.key()));
+                    if (file.open(QIODevice::WriteOnly)) {
+                        QDataStream str(&file);
+                        str << iter.value();
+                        DiskEntry entry;
+                        entry.size = file.size();
+                        entry.modified = iter.value().modified();
+                        if (file.commit()) {
+                            written[iter.key()] = entry;
+                        }
+                    }
+                }
+
+                QStringList evicted;
+                QHash< QString, DiskEntry > index;
+                {
+                    QMutexLocker lock(&mutex);
+                    inFlightWrites.clear();
+                    QHashIterator< QString, DiskEntry > iter(written);
+                    while (iter.hasNext()) {
+                        iter.next();
+                        // Removed again while being written
+                        if (!pendingRemovals.contains(iter.key())) {
+                            diskSize += iter.value().size - disk.value(iter.key(), DiskEntry()).size;
+                            disk[iter.key()] = iter.value();
+                            ++statistics.diskWrites;
+                        }
+                    }
+
+                    // Keep within the maximum size on disk, losing the
+                    // least recently written items first
+                    if (maximumDiskSize > 0 && diskSize > maximumDiskSize) {
+                        QMultiMap< QDateTime, QString > byAge;
+                        QHashIterator< QString, DiskEntry > iter(disk);
+                        while (iter.hasNext()) {
+                            iter.next();
+                            byAge.insert(iter.value().modified, iter.key());
+                        }
+                        QMapIterator< QDateTime, QString > oldest(byAge);
+                        while (diskSize > maximumDiskSize && oldest.hasNext()) {
+                            oldest.next();
+                            diskSize -= disk.take(oldest.value()).size;
+                            evicted << oldest.value();
+                            ++statistics.diskEvictions;
+                        }
+                    }
+
+                    index = disk;
+                }
+
+                foreach (const QString & id, evicted) {
+                    QFile::remove(filePathOf(id));
+                }
+                writeIndex(index);
+            }
+        }
+
+        bool readIndex()
+        {
+            QFile file(indexPath());
+            if (!file.open(QIODevice::ReadOnly)) {
+                return false;
+            }
+
+            QDataStream str(&file);
+            quint32 magic = 0;
+            qint32 version = 0;
+            qint32 count = 0;
+            str >> magic >> version >> count;
+            if (magic != IndexMagic || version != IndexVersion) {
+                return false;
+            }
+            for (qint32 i = 0; i < count && str.status() == QDataStream::Ok; ++i) {
+                QString id;
+                DiskEntry entry;
+                str >> id >> entry.size >> entry.modified;
+                if (str.status() == QDataStream::Ok) {
+                    disk[id] = entry;
+                    diskSize += entry.size;
+                }
+            }
+            return true;
+        }
+
+        void writeIndex(const QHash< QString, DiskEntry > & index)
+        {
+            QSaveFile file(indexPath());
+            if (file.open(QIODevice::WriteOnly)) {
+                QDataStream str(&file);
+                str << IndexMagic << IndexVersion << (qint32) index.size();
+                QHashIterator< QString, DiskEntry > iter(index);
+                while (iter.hasNext()) {
+                    iter.next();
+                    str << iter.key() << iter.value().size << iter.value().modified;
+                }
+                file.commit();
+            }
+        }
+
+        static const quint32 IndexMagic = 0x55434958; // "UCIX"
+        static const qint32 IndexVersion = 1;
 
         // Check the size of this cache, removing elements if they cause it
-        // to exceed its maximum size
+        // to exceed its maximum size or cost
         void resize()
         {
-            // A zero maximum size means this cache is unrestricted
-            if (maximumSize > 0 && recentlyUsed.size() > maximumSize) {
-                // Remove excess items from the front of the list, removing
-                // them from the cache
-                while (recentlyUsed.size() > maximumSize) {
-                    QString doomed = recentlyUsed.takeFirst();
-                    items.remove(doomed);
-                }
+            // Zero maxima mean this cache is unrestricted
+            while (!recentlyUsed.empty() &&
+                   ((maximumSize > 0 && items.size() > maximumSize) ||
+                    (maximumCost > 0 && totalCost > maximumCost))) {
+                evictOldest();
+            }
+        }
+
+        qint64 cost() const
+        {
+            QMutexLocker lock(&mutex);
+            return totalCost;
+        }
+
+        qint64 oldest() const
+        {
+            QMutexLocker lock(&mutex);
+            return recentlyUsed.empty() ? -1 : items.value(recentlyUsed.front()).touched;
+        }
+
+        qint64 evictOldest()
+        {
+            QMutexLocker lock(&mutex);
+            if (recentlyUsed.empty()) {
+                return 0;
             }
+            qint64 before = totalCost;
+            erase(recentlyUsed.front());
+            ++statistics.evictions;
+            return before - totalCost;
         }
 
         // Get an existing cache by path name or create a new one
@@ -123,7 +595,7 @@ namespace Utopia
 
                     // Ensure existence of cache path
                     if (!info.exists()) {
-                        if (!QDir().mkpath(info.path())) {
+                        if (!QDir().mkpath(info.filePath())) {
                             // Couldn't create path
                             return boost::shared_ptr< CachePrivateClass >();
                         }
@@ -132,32 +604,11 @@ namespace Utopia
                         return boost::shared_ptr< CachePrivateClass >();
                     }
 
-                    boost::shared_ptr< CachePrivateClass > cache(new CachePrivateClass(path));
+                    boost::shared_ptr< CachePrivateClass > cache(new CachePrivateClass(info.filePath()));
                     caches[path] = cache;
 
-                    // Load all persisted items
-                    QDir dir(info.dir());
-                    dir.setFilter(QDir::Files |
-                                  QDir::NoSymLinks |
-                                  QDir::NoDotAndDotDot |
-                                  QDir::Readable |
-                                  QDir::Writable |
-                                  QDir::CaseSensitive);
-                    QStringList filters;
-                    filters << "*.cache";
-                    dir.setNameFilters(filters);
-
-                    QFileInfoList list(dir.entryInfoList());
-                    for (int i = 0; i < list.size(); ++i) {
-                        QFileInfo info(list.at(i));
-                        QFile file(info.path());
-                        file.open(QIODevice::ReadOnly);
-                        QDataStream str(&file);
-                        CachedItemClass item;
-                        str >> item;
-                        file.close();
-                        cache->items[item.id()] = qMakePair(item, false);
-                    }
+                    // Only the index is read now; items are loaded lazily
+                    cache->readIndex();
 
                     return cache;
                 }
@@ -192,78 +643,100 @@ namespace Utopia
             if (isValid()) {
                 d->items.clear();
                 d->recentlyUsed.clear();
+                d->totalCost = 0;
+                d->unpersistAll();
             }
         }
 
-        bool exists(const QString & id) const
+        qint64 cost() const
         {
             // Lock access
             QMutexLocker lock(&m);
             QMutexLocker lockShared(&d->mutex);
 
-            return isValid() && d->items.contains(id);
+            return isValid() ? d->totalCost : 0;
         }
 
-        void flush()
+        bool exists(const QString & id) const
         {
             // Lock access
             QMutexLocker lock(&m);
             QMutexLocker lockShared(&d->mutex);
 
+            return isValid() && d->contains(id);
+        }
+
+        void flush()
+        {
+            // Lock access (but not to the shared backend, whose lock the
+            // background writer needs)
+            QMutexLocker lock(&m);
+
             // Flush only works on persistent caches
             if (isValid() && isPersistent()) {
-                // FIXME
+                d->flush();
             }
         }
 
         Item get(const QString & id) const
+        {
+            CachedItemClass item(getMeta(id));
+            return item.isValid() ? item.item() : Item();
+        }
+
+        CachedItemClass getMeta(const QString & id) const
+        {
+            CachedItemClass item;
+            {
+                // Lock access
+                QMutexLocker lock(&m);
+                QMutexLocker lockShared(&d->mutex);
+
+                Q_ASSERT_X(isValid(), "d->items", "Cannot get item from Null cache");
+
+                // Touch (loading from disk if need be) and return
+                item = d->fetch(id);
+            }
+
+            // Items loaded from disk count towards the budget
+            CacheBudget::enforce();
+            return item;
+        }
+
+        bool isPersistent() const
         {
             // Lock access
             QMutexLocker lock(&m);
             QMutexLocker lockShared(&d->mutex);
 
-            Q_ASSERT_X(isValid(), "d->items", "Cannot get item from Null cache");
-
-            // Touch and return
-            QPair< CachedItemClass, bool > & item = d->items[id];
-            d->recentlyUsed.removeAll(id);
-            d->recentlyUsed.append(id);
-            item.first.touch();
-            item.second = true;
-            return item.first.isValid() ? item.first : Item();
+            return isValid() && !d->path.isEmpty() && !d->path.startsWith(":");
         }
 
-        CachedItemClass getMeta(const QString & id) const
+        bool isValid() const
         {
             // Lock access
             QMutexLocker lock(&m);
             QMutexLocker lockShared(&d->mutex);
 
-            Q_ASSERT_X(isValid(), "d->items", "Cannot get item from Null cache");
-
-            // Touch and return
-            QPair< CachedItemClass, bool > & item = d->items[id];
-            item.first.touch();
-            item.second = true;
-            return item.first;
+            return (bool) d;
         }
 
-        bool isPersistent() const
+        qint64 maximumCost() const
         {
             // Lock access
             QMutexLocker lock(&m);
             QMutexLocker lockShared(&d->mutex);
 
-            return isValid() && !d->path.isEmpty() && !d->path.startsWith(":");
+            return isValid() ? d->maximumCost : 0;
         }
 
-        bool isValid() const
+        qint64 maximumDiskSize() const
         {
             // Lock access
             QMutexLocker lock(&m);
             QMutexLocker lockShared(&d->mutex);
 
-            return (bool) d;
+            return isValid() ? d->maximumDiskSize : 0;
         }
 
         int maximumSize() const
@@ -285,35 +758,63 @@ namespace Utopia
         }
 
         void put(const Item & item, const QString & id)
+        {
+            put(item, id, cacheCost(item));
+        }
+
+        void put(const Item & item, const QString & id, qint64 cost)
+        {
+            {
+                // Lock access
+                QMutexLocker lock(&m);
+                QMutexLocker lockShared(&d->mutex);
+
+                Q_ASSERT_X(isValid(), "d->items", "Cannot put item into Null cache");
+
+                // Replace if present, then check whether this now means we
+                // should remove old items from the cache
+                CachedItemClass cachedItem(item, id, QDateTime::currentDateTime(), QDateTime::currentDateTime());
+                d->insert(cachedItem, true, cost);
+                d->resize();
+                d->persist(cachedItem);
+            }
+
+            // Never done while holding this cache's lock, as it may evict
+            // from any cache (this one included)
+            CacheBudget::enforce();
+        }
+
+        void remove(const QString & id)
         {
             // Lock access
             QMutexLocker lock(&m);
             QMutexLocker lockShared(&d->mutex);
 
-            Q_ASSERT_X(isValid(), "d->items", "Cannot put item into Null cache");
+            if (isValid()) {
+                d->erase(id);
+                d->unpersist(id);
+            }
+        }
 
-            // Remove if present
-            remove(id);
+        void setMaximumCost(qint64 maximumCost)
+        {
+            // Lock access
+            QMutexLocker lock(&m);
+            QMutexLocker lockShared(&d->mutex);
 
-            // Check whether this now means we should remove an old item from
-            // the cache
+            d->maximumCost = maximumCost;
             d->resize();
-
-            // Create new item
-            d->items[id] = qMakePair(CachedItemClass(item, id, QDateTime::currentDateTime(), QDateTime::currentDateTime()), true);
-            d->recentlyUsed.push_back(id);
         }
 
-        void remove(const QString & id)
+        // A zero maximum disk size means this cache's directory may grow
+        // without limit
+        void setMaximumDiskSize(qint64 maximumDiskSize)
         {
             // Lock access
             QMutexLocker lock(&m);
             QMutexLocker lockShared(&d->mutex);
 
-            if (isValid() && exists(id)) {
-                d->items.remove(id);
-                d->recentlyUsed.removeAll(id);
-            }
+            d->maximumDiskSize = maximumDiskSize;
         }
 
         void setMaximumSize(int maximumSize)
@@ -342,16 +843,31 @@ namespace Utopia
             return true;
         }
 
+        CacheStatistics statistics() const
+        {
+            // Lock access
+            QMutexLocker lock(&m);
+            QMutexLocker lockShared(&d->mutex);
+
+            CacheStatistics statistics;
+            if (isValid()) {
+                statistics = d->statistics;
+                statistics.count = d->items.size();
+                statistics.cost = d->totalCost;
+                statistics.diskCount = d->disk.size();
+                statistics.diskSize = d->diskSize;
+            }
+            return statistics;
+        }
+
     protected:
         QString filePathOf(const QString & id) const
         {
-            QString result;
-            QString filePath = path();
-            if (true) {
-                QString tmp(id);
-                result=filePath + "/" + tmp.replace("/", "\\/") + ".cache";
-            }
-	    return result;
+            // Lock access
+            QMutexLocker lock(&m);
+            QMutexLocker lockShared(&d->mutex);
+
+            return isPersistent() ? d->filePathOf(id) : QString();
         }
 
     private: